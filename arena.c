@@ -0,0 +1,147 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "arena.h"
+#include "lease_metrics.h"
+
+struct arena_chunk_t
+{
+  struct arena_chunk_t *next;
+  size_t size;
+  size_t used;
+  char data[] __attribute__((aligned(ARENA_ALIGN)));
+};
+
+void
+arena_init(struct arena_t *arena, size_t chunk_size)
+{
+  memset(arena, 0, sizeof(*arena));
+  arena->chunk_size = chunk_size ? chunk_size : ARENA_CHUNK_SIZE;
+}
+
+static struct arena_chunk_t *
+arena_chunk_new(size_t size)
+{
+  struct arena_chunk_t *chunk;
+
+  chunk = malloc(sizeof(*chunk) + size);
+  if (!chunk)
+    return NULL;
+  lease_metrics_add(LEASE_METRIC_ALLOCATIONS, 1);
+
+  chunk->next = NULL;
+  chunk->size = size;
+  chunk->used = 0;
+
+  return chunk;
+}
+
+void *
+arena_alloc(struct arena_t *arena, size_t size)
+{
+  struct arena_chunk_t *chunk = arena->chunks;
+  void *ptr;
+
+  size = (size + ARENA_ALIGN - 1) & ~(size_t) (ARENA_ALIGN - 1);
+
+  if (!chunk || chunk->size - chunk->used < size)
+    {
+      // big objects get a chunk of their own behind the current one
+      if (size > arena->chunk_size / 4 && chunk)
+        {
+          struct arena_chunk_t *big = arena_chunk_new(size);
+
+          if (!big)
+            return NULL;
+
+          big->used = size;
+          big->next = chunk->next;
+          chunk->next = big;
+          arena->chunks_allocated++;
+          arena->bytes_used += size;
+          return big->data;
+        }
+
+      chunk = arena_chunk_new(size > arena->chunk_size ? size : arena->chunk_size);
+      if (!chunk)
+        return NULL;
+
+      chunk->next = arena->chunks;
+      arena->chunks = chunk;
+      arena->chunks_allocated++;
+    }
+
+  ptr = chunk->data + chunk->used;
+  chunk->used += size;
+  arena->bytes_used += size;
+
+  return ptr;
+}
+
+void *
+arena_calloc(struct arena_t *arena, size_t size)
+{
+  void *ptr = arena_alloc(arena, size);
+
+  if (ptr)
+    memset(ptr, 0, size);
+
+  return ptr;
+}
+
+char *
+arena_strndup(struct arena_t *arena, const char *str, size_t len)
+{
+  char *dup = arena_alloc(arena, len + 1);
+
+  if (!dup)
+    return NULL;
+
+  memcpy(dup, str, len);
+  dup[len] = '\0';
+
+  return dup;
+}
+
+void
+arena_release(struct arena_t *arena)
+{
+  struct arena_chunk_t *chunk, *next;
+
+  for (chunk = arena->chunks; chunk; chunk = next)
+    {
+      next = chunk->next;
+      free(chunk);
+    }
+
+  arena->chunks = NULL;
+  arena->chunks_allocated = 0;
+  arena->bytes_used = 0;
+}
+
+void
+arena_adopt(struct arena_t *dst, struct arena_t *src)
+{
+  struct arena_chunk_t *tail;
+
+  if (!src->chunks)
+    return;
+
+  // keep allocating from the current chunk of dst
+  if (!dst->chunks)
+    dst->chunks = src->chunks;
+  else
+    {
+      for (tail = src->chunks; tail->next; tail = tail->next)
+        ;
+      tail->next = dst->chunks->next;
+      dst->chunks->next = src->chunks;
+    }
+
+  dst->chunks_allocated += src->chunks_allocated;
+  dst->bytes_used += src->bytes_used;
+
+  src->chunks = NULL;
+  src->chunks_allocated = 0;
+  src->bytes_used = 0;
+}
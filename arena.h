@@ -0,0 +1,49 @@
+/*
+ * arena.h
+ *
+ */
+
+#ifndef _ARENA_H_
+#define _ARENA_H_
+
+#include <stddef.h>
+
+/**
+ *
+ * \brief bump allocator
+ *
+ * Memory is handed out from large chunks and only released as a whole
+ * by arena_release(), so objects that live and die together (all
+ * records and strings of one parse) cost no per-object malloc/free.
+ * Allocations are aligned to ARENA_ALIGN.
+ *
+ * struct arena_t arena;
+ *
+ * arena_init(&arena, 0);                       // default chunk size
+ * item = arena_alloc(&arena, sizeof(*item));
+ * name = arena_strndup(&arena, str, len);
+ * arena_release(&arena);                       // frees item and name
+ */
+
+#define ARENA_ALIGN             8
+#define ARENA_CHUNK_SIZE        (64 * 1024)
+
+struct arena_chunk_t;
+
+struct arena_t
+{
+  struct arena_chunk_t *chunks;
+  size_t chunk_size;
+  size_t chunks_allocated;
+  size_t bytes_used;
+};
+
+void arena_init(struct arena_t *arena, size_t chunk_size);
+void *arena_alloc(struct arena_t *arena, size_t size);
+void *arena_calloc(struct arena_t *arena, size_t size);
+char *arena_strndup(struct arena_t *arena, const char *str, size_t len);
+void arena_release(struct arena_t *arena);
+// move all memory of src into dst, src is empty afterwards
+void arena_adopt(struct arena_t *dst, struct arena_t *src);
+
+#endif /* _ARENA_H_ */
@@ -0,0 +1,443 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#include "lease.h"
+
+#define ARRAYSIZE(n) (sizeof(n)/sizeof(n[0]))
+
+struct lease_binding_state_2_str_t
+{
+  enum lease_binding_state_t state;
+  const char *str;
+};
+
+static const struct lease_binding_state_2_str_t lease_binding_state_2_str_map[] =
+    {
+        {.state = LEASE_BINDING_STATE_FREE,      .str = "free",      },
+        {.state = LEASE_BINDING_STATE_ACTIVE,    .str = "active",    },
+        {.state = LEASE_BINDING_STATE_EXPIRED,   .str = "expired",   },
+        {.state = LEASE_BINDING_STATE_RELEASED,  .str = "released",  },
+        {.state = LEASE_BINDING_STATE_ABANDONED, .str = "abandoned", },
+        {.state = LEASE_BINDING_STATE_RESET,     .str = "reset",     },
+        {.state = LEASE_BINDING_STATE_BACKUP,    .str = "backup",    },
+        {.state = LEASE_BINDING_STATE_RESERVED,  .str = "reserved",  },
+        {.state = LEASE_BINDING_STATE_BOOTP,     .str = "bootp",     },
+    };
+
+struct lease_ia_type_2_str_t
+{
+  enum lease_ia_type_t type;
+  const char *str;
+};
+
+static const struct lease_ia_type_2_str_t lease_ia_type_2_str_map[] =
+    {
+        {.type = LEASE_IA_TYPE_NA, .str = "ia-na", },
+        {.type = LEASE_IA_TYPE_TA, .str = "ia-ta", },
+        {.type = LEASE_IA_TYPE_PD, .str = "ia-pd", },
+    };
+
+struct lease_hwaddr_type_2_str_t
+{
+  enum lease_hwaddr_type_t type;
+  const char *str;
+};
+
+static const struct lease_hwaddr_type_2_str_t lease_hwaddr_type_2_str_map[] =
+    {
+        {.type = LEASE_HWADDR_TYPE_ETHERNET,   .str = "ethernet",   },
+        {.type = LEASE_HWADDR_TYPE_TOKEN_RING, .str = "token-ring", },
+        {.type = LEASE_HWADDR_TYPE_FDDI,       .str = "fddi",       },
+    };
+
+static const char *lease_change_2_str_map[LEASE_CHANGE_MAX] =
+    {
+        [LEASE_CHANGE_ADDED]    = "added",
+        [LEASE_CHANGE_REMOVED]  = "removed",
+        [LEASE_CHANGE_MODIFIED] = "modified",
+    };
+
+struct lease_field_2_str_t
+{
+  uint32_t field;
+  const char *str;
+};
+
+static const struct lease_field_2_str_t lease_field_2_str_map[] =
+    {
+        {.field = LEASE_FIELD_HARDWARE,                .str = "hardware",                },
+        {.field = LEASE_FIELD_BINDING_STATE,           .str = "binding_state",           },
+        {.field = LEASE_FIELD_NEXT_BINDING_STATE,      .str = "next_binding_state",      },
+        {.field = LEASE_FIELD_REWIND_BINDING_STATE,    .str = "rewind_binding_state",    },
+        {.field = LEASE_FIELD_FLAGS,                   .str = "flags",                   },
+        {.field = LEASE_FIELD_STARTS,                  .str = "starts",                  },
+        {.field = LEASE_FIELD_ENDS,                    .str = "ends",                    },
+        {.field = LEASE_FIELD_TSTP,                    .str = "tstp",                    },
+        {.field = LEASE_FIELD_CLTT,                    .str = "cltt",                    },
+        {.field = LEASE_FIELD_TSFP,                    .str = "tsfp",                    },
+        {.field = LEASE_FIELD_ATSFP,                   .str = "atsfp",                   },
+        {.field = LEASE_FIELD_CLIENT_HOSTNAME,         .str = "client_hostname",         },
+        {.field = LEASE_FIELD_UID,                     .str = "uid",                     },
+        {.field = LEASE_FIELD_VENDOR_CLASS_IDENTIFIER, .str = "vendor_class_identifier", },
+        {.field = LEASE_FIELD_EXT,                     .str = "ext",                     },
+    };
+
+static int
+lease_addr_parse_v4(const char *str, size_t len, uint32_t *out)
+{
+  uint32_t addr = 0;
+  unsigned octet = 0;
+  int digits = 0, dots = 0;
+  size_t i;
+
+  for (i = 0; i < len; i++)
+    {
+      unsigned c = (unsigned char) str[i];
+
+      if (c == '.')
+        {
+          if (!digits || ++dots > 3)
+            return -1;
+          addr = (addr << 8) | octet;
+          octet = 0;
+          digits = 0;
+          continue;
+        }
+
+      c -= '0';
+      if (c > 9 || ++digits > 3)
+        return -1;
+      octet = octet * 10 + c;
+      if (octet > 255)
+        return -1;
+    }
+
+  if (dots != 3 || !digits)
+    return -1;
+
+  *out = (addr << 8) | octet;
+  return 0;
+}
+
+int
+lease_addr_parse(const char *str, size_t len, struct lease_addr_t *addr)
+{
+  char tmp[INET6_ADDRSTRLEN];
+
+  memset(addr, 0, sizeof(*addr));
+
+  if (!memchr(str, ':', len))
+    {
+      if (lease_addr_parse_v4(str, len, &addr->v4) < 0)
+        return -1;
+      addr->family = AF_INET;
+      return 0;
+    }
+
+  if (len >= sizeof(tmp))
+    return -1;
+
+  memcpy(tmp, str, len);
+  tmp[len] = '\0';
+
+  if (inet_pton(AF_INET6, tmp, addr->v6) != 1)
+    return -1;
+
+  addr->family = AF_INET6;
+  return 0;
+}
+
+int
+lease_addr_parse_prefix(const char *str, size_t len, struct lease_addr_t *addr,
+    unsigned int *prefix_len)
+{
+  const char *slash = memchr(str, '/', len);
+  unsigned int max_len;
+  char *end;
+  unsigned long bits;
+
+  if (lease_addr_parse(str, slash ? slash - str : len, addr) < 0)
+    return -1;
+
+  max_len = addr->family == AF_INET6 ? 128 : 32;
+  *prefix_len = max_len;
+
+  if (!slash)
+    return 0;
+
+  bits = strtoul(slash + 1, &end, 10);
+  if (end == slash + 1 || end != str + len || bits > max_len)
+    return -1;
+
+  *prefix_len = bits;
+  return 0;
+}
+
+char *
+lease_addr_to_str(const struct lease_addr_t *addr, char *buf, size_t size)
+{
+  uint32_t v4;
+  size_t len;
+
+  switch (addr->family)
+    {
+  case AF_INET:
+    v4 = htonl(addr->v4);
+    return (char *) inet_ntop(AF_INET, &v4, buf, size);
+  case AF_INET6:
+    if (!inet_ntop(AF_INET6, addr->v6, buf, size))
+      return NULL;
+    if (!addr->prefix_len)
+      return buf;
+
+    len = strlen(buf);
+    if (snprintf(buf + len, size - len, "/%u", addr->prefix_len) >= size - len)
+      return NULL;
+    return buf;
+  default:
+    return NULL;
+    }
+}
+
+static int
+lease_hex_digit(char c)
+{
+  if (c >= '0' && c <= '9')
+    return c - '0';
+  if (c >= 'a' && c <= 'f')
+    return c - 'a' + 10;
+  if (c >= 'A' && c <= 'F')
+    return c - 'A' + 10;
+  return -1;
+}
+
+int
+lease_hwaddr_parse(const char *type, size_t type_len, const char *str,
+    size_t len, struct lease_hwaddr_t *hwaddr)
+{
+  const char *end = str + len;
+  size_t i;
+  int n;
+
+  memset(hwaddr, 0, sizeof(*hwaddr));
+
+  for (i = 0; i < ARRAYSIZE(lease_hwaddr_type_2_str_map); i++)
+    {
+      if (strlen(lease_hwaddr_type_2_str_map[i].str) == type_len
+          && !memcmp(lease_hwaddr_type_2_str_map[i].str, type, type_len))
+        break;
+    }
+
+  if (i >= ARRAYSIZE(lease_hwaddr_type_2_str_map))
+    return -1;
+
+  // "0:16:3e:a:b:c", dhcpd drops leading zeros
+  for (n = 0; n < LEASE_HWADDR_LEN; n++)
+    {
+      int hi, lo;
+
+      if (n && (str >= end || *str++ != ':'))
+        return -1;
+
+      if (str >= end || (hi = lease_hex_digit(*str++)) < 0)
+        return -1;
+
+      if (str < end && (lo = lease_hex_digit(*str)) >= 0)
+        {
+          hi = (hi << 4) | lo;
+          str++;
+        }
+
+      hwaddr->addr[n] = hi;
+    }
+
+  if (str != end)
+    return -1;
+
+  hwaddr->type = lease_hwaddr_type_2_str_map[i].type;
+  return 0;
+}
+
+char *
+lease_hwaddr_to_str(const struct lease_hwaddr_t *hwaddr, char *buf,
+    size_t size)
+{
+  static const char hex[] = "0123456789abcdef";
+  int i;
+
+  if (hwaddr->type == LEASE_HWADDR_TYPE_NONE || size < LEASE_HWADDR_STR_SIZE)
+    return NULL;
+
+  for (i = 0; i < LEASE_HWADDR_LEN; i++)
+    {
+      buf[i * 3] = hex[hwaddr->addr[i] >> 4];
+      buf[i * 3 + 1] = hex[hwaddr->addr[i] & 0xf];
+      buf[i * 3 + 2] = i == LEASE_HWADDR_LEN - 1 ? '\0' : ':';
+    }
+
+  return buf;
+}
+
+const char *
+lease_ia_type_2_str(enum lease_ia_type_t type)
+{
+  int i;
+
+  for (i = 0; i < ARRAYSIZE(lease_ia_type_2_str_map); i++)
+    {
+      if (type == lease_ia_type_2_str_map[i].type)
+        return lease_ia_type_2_str_map[i].str;
+    }
+
+  return NULL;
+}
+
+enum lease_binding_state_t
+lease_binding_state_parse(const char *str, size_t len)
+{
+  int i;
+
+  for (i = 0; i < ARRAYSIZE(lease_binding_state_2_str_map); i++)
+    {
+      if (strlen(lease_binding_state_2_str_map[i].str) == len
+          && !memcmp(lease_binding_state_2_str_map[i].str, str, len))
+        return lease_binding_state_2_str_map[i].state;
+    }
+
+  return LEASE_BINDING_STATE_NONE;
+}
+
+const char *
+lease_binding_state_2_str(enum lease_binding_state_t state)
+{
+  int i;
+
+  for (i = 0; i < ARRAYSIZE(lease_binding_state_2_str_map); i++)
+    {
+      if (state == lease_binding_state_2_str_map[i].state)
+        return lease_binding_state_2_str_map[i].str;
+    }
+
+  return NULL;
+}
+
+static int
+lease_str_differ(const char *a, const char *b)
+{
+  if (a == b)
+    return 0;
+
+  return !a || !b || strcmp(a, b);
+}
+
+static int
+lease_ext_differ(const struct lease_element_ext_t *a,
+    const struct lease_element_ext_t *b)
+{
+  static const struct lease_element_ext_t none;
+
+  if (a == b)
+    return 0;
+
+  a = a ? a : &none;
+  b = b ? b : &none;
+
+  return lease_str_differ(a->billing_class, b->billing_class)
+      || lease_str_differ(a->ddns_fwd_name, b->ddns_fwd_name)
+      || lease_str_differ(a->ddns_rev_name, b->ddns_rev_name)
+      || lease_str_differ(a->ddns_txt, b->ddns_txt)
+      || lease_str_differ(a->ddns_client_fqdn, b->ddns_client_fqdn)
+      || lease_str_differ(a->agent_circuit_id, b->agent_circuit_id)
+      || lease_str_differ(a->agent_remote_id, b->agent_remote_id)
+      || lease_str_differ(a->agent_subscriber_id, b->agent_subscriber_id);
+}
+
+const char *
+lease_field_2_str(uint32_t field)
+{
+  int i;
+
+  for (i = 0; i < ARRAYSIZE(lease_field_2_str_map); i++)
+    {
+      if (field == lease_field_2_str_map[i].field)
+        return lease_field_2_str_map[i].str;
+    }
+
+  return NULL;
+}
+
+const char *
+lease_change_2_str(enum lease_change_t change)
+{
+  return change < LEASE_CHANGE_MAX ? lease_change_2_str_map[change] : NULL;
+}
+
+char *
+lease_fields_to_str(uint32_t fields, char *buf, size_t size)
+{
+  size_t len = 0, n;
+  int i;
+
+  if (!size)
+    return NULL;
+
+  buf[0] = 0;
+  for (i = 0; i < ARRAYSIZE(lease_field_2_str_map); i++)
+    {
+      if (!(fields & lease_field_2_str_map[i].field))
+        continue;
+
+      n = snprintf(buf + len, size - len, "%s%s", len ? "," : "",
+          lease_field_2_str_map[i].str);
+      if (n >= size - len)
+        return NULL;
+      len += n;
+    }
+
+  return buf;
+}
+
+uint32_t
+lease_element_diff(const struct lease_element_t *a,
+    const struct lease_element_t *b)
+{
+  uint32_t mask = 0;
+
+  if (a->hardware.type != b->hardware.type
+      || memcmp(a->hardware.addr, b->hardware.addr, sizeof(a->hardware.addr)))
+    mask |= LEASE_FIELD_HARDWARE;
+  if (a->binding_state != b->binding_state)
+    mask |= LEASE_FIELD_BINDING_STATE;
+  if (a->next_binding_state != b->next_binding_state)
+    mask |= LEASE_FIELD_NEXT_BINDING_STATE;
+  if (a->rewind_binding_state != b->rewind_binding_state)
+    mask |= LEASE_FIELD_REWIND_BINDING_STATE;
+  if (a->flags != b->flags)
+    mask |= LEASE_FIELD_FLAGS;
+  if (a->starts != b->starts)
+    mask |= LEASE_FIELD_STARTS;
+  if (a->ends != b->ends)
+    mask |= LEASE_FIELD_ENDS;
+  if (a->tstp != b->tstp)
+    mask |= LEASE_FIELD_TSTP;
+  if (a->cltt != b->cltt)
+    mask |= LEASE_FIELD_CLTT;
+  if (a->tsfp != b->tsfp)
+    mask |= LEASE_FIELD_TSFP;
+  if (a->atsfp != b->atsfp)
+    mask |= LEASE_FIELD_ATSFP;
+  if (lease_str_differ(a->client_hostname, b->client_hostname))
+    mask |= LEASE_FIELD_CLIENT_HOSTNAME;
+  if (lease_str_differ(a->uid, b->uid))
+    mask |= LEASE_FIELD_UID;
+  if (lease_str_differ(a->vendor_class_identifier, b->vendor_class_identifier))
+    mask |= LEASE_FIELD_VENDOR_CLASS_IDENTIFIER;
+  if (lease_ext_differ(a->ext, b->ext))
+    mask |= LEASE_FIELD_EXT;
+
+  return mask;
+}
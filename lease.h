@@ -0,0 +1,178 @@
+/*
+ * lease.h
+ *
+ */
+
+#ifndef _LEASE_H_
+#define _LEASE_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include <time.h>
+
+#define LEASE_HWADDR_LEN        6
+
+// text buffer sizes for lease_addr_to_str() / lease_hwaddr_to_str()
+#define LEASE_ADDR_STR_SIZE     (46 + 4)
+#define LEASE_HWADDR_STR_SIZE   (LEASE_HWADDR_LEN * 3)
+
+enum lease_binding_state_t
+{
+  LEASE_BINDING_STATE_NONE,
+  LEASE_BINDING_STATE_FREE,
+  LEASE_BINDING_STATE_ACTIVE,
+  LEASE_BINDING_STATE_EXPIRED,
+  LEASE_BINDING_STATE_RELEASED,
+  LEASE_BINDING_STATE_ABANDONED,
+  LEASE_BINDING_STATE_RESET,
+  LEASE_BINDING_STATE_BACKUP,
+  LEASE_BINDING_STATE_RESERVED,
+  LEASE_BINDING_STATE_BOOTP,
+  LEASE_BINDING_STATE_MAX,
+};
+
+// hardware types as written by dhcpd (ARP hardware type numbers)
+enum lease_hwaddr_type_t
+{
+  LEASE_HWADDR_TYPE_NONE = 0,
+  LEASE_HWADDR_TYPE_ETHERNET = 1,
+  LEASE_HWADDR_TYPE_TOKEN_RING = 6,
+  LEASE_HWADDR_TYPE_FDDI = 8,
+};
+
+// how the lease of an address differs between two tables
+enum lease_change_t
+{
+  LEASE_CHANGE_ADDED,
+  LEASE_CHANGE_REMOVED,
+  LEASE_CHANGE_MODIFIED,
+  LEASE_CHANGE_MAX,
+};
+
+// identity association a DHCPv6 lease belongs to, NONE for DHCPv4
+enum lease_ia_type_t
+{
+  LEASE_IA_TYPE_NONE,
+  LEASE_IA_TYPE_NA,
+  LEASE_IA_TYPE_TA,
+  LEASE_IA_TYPE_PD,
+};
+
+#define LEASE_FLAG_ABANDONED    (1 << 0)
+#define LEASE_FLAG_BOOTP        (1 << 1)
+#define LEASE_FLAG_RESERVED     (1 << 2)
+
+/*
+ * IPv4 addresses are kept in host byte order. prefix_len is only set
+ * for a delegated IPv6 prefix (iaprefix), 0 means a single address.
+ */
+struct lease_addr_t
+{
+  uint8_t family;
+  uint8_t prefix_len;
+  union
+  {
+    uint32_t v4;
+    uint8_t v6[16];
+  };
+};
+
+struct lease_hwaddr_t
+{
+  uint8_t type;
+  uint8_t addr[LEASE_HWADDR_LEN];
+};
+
+// rarely present fields, only allocated if one of them is seen
+struct lease_element_ext_t
+{
+  const char *billing_class;
+  const char *ddns_fwd_name;
+  const char *ddns_rev_name;
+  const char *ddns_txt;
+  const char *ddns_client_fqdn;
+  const char *agent_circuit_id;
+  const char *agent_remote_id;
+  const char *agent_subscriber_id;
+};
+
+/*
+ * one lease block, or one iaaddr / iaprefix of a DHCPv6 ia-na, ia-ta or
+ * ia-pd block. A DHCPv6 lease carries the quoted IAID + DUID of its IA
+ * as uid and the cltt of the IA. Records and the strings they point to
+ * are owned by the arena of the table they were parsed into;
+ * client_hostname, uid and vendor_class_identifier are interned.
+ */
+struct lease_element_t
+{
+  struct lease_addr_t ip;
+  struct lease_hwaddr_t hardware;
+  uint8_t binding_state;
+  uint8_t next_binding_state;
+  uint8_t rewind_binding_state;
+  uint8_t flags;
+  uint8_t ia_type;
+  time_t starts;
+  time_t ends;
+  time_t tstp;
+  time_t cltt;
+  time_t tsfp;
+  time_t atsfp;
+  const char *client_hostname;
+  const char *uid;
+  const char *vendor_class_identifier;
+  struct lease_element_ext_t *ext;
+};
+
+// field bits of lease_element_diff()
+#define LEASE_FIELD_HARDWARE                    (1 << 0)
+#define LEASE_FIELD_BINDING_STATE               (1 << 1)
+#define LEASE_FIELD_NEXT_BINDING_STATE          (1 << 2)
+#define LEASE_FIELD_REWIND_BINDING_STATE        (1 << 3)
+#define LEASE_FIELD_FLAGS                       (1 << 4)
+#define LEASE_FIELD_STARTS                      (1 << 5)
+#define LEASE_FIELD_ENDS                        (1 << 6)
+#define LEASE_FIELD_TSTP                        (1 << 7)
+#define LEASE_FIELD_CLTT                        (1 << 8)
+#define LEASE_FIELD_TSFP                        (1 << 9)
+#define LEASE_FIELD_ATSFP                       (1 << 10)
+#define LEASE_FIELD_CLIENT_HOSTNAME             (1 << 11)
+#define LEASE_FIELD_UID                         (1 << 12)
+#define LEASE_FIELD_VENDOR_CLASS_IDENTIFIER     (1 << 13)
+#define LEASE_FIELD_EXT                         (1 << 14)
+
+// buffer size for lease_fields_to_str() of any mask
+#define LEASE_FIELDS_STR_SIZE                   192
+
+/*
+ * mask of the fields that differ between two records of the same
+ * address. Strings are compared by value, so records of different
+ * tables can be compared.
+ */
+uint32_t lease_element_diff(const struct lease_element_t *a,
+    const struct lease_element_t *b);
+// name of a single field bit, NULL if unknown
+const char *lease_field_2_str(uint32_t field);
+// names of the field bits, comma separated; NULL if buf is too small
+char *lease_fields_to_str(uint32_t fields, char *buf, size_t size);
+const char *lease_change_2_str(enum lease_change_t change);
+
+int lease_addr_parse(const char *str, size_t len, struct lease_addr_t *addr);
+// address or address/prefix, a plain address gets the full length
+int lease_addr_parse_prefix(const char *str, size_t len,
+    struct lease_addr_t *addr, unsigned int *prefix_len);
+char *lease_addr_to_str(const struct lease_addr_t *addr, char *buf,
+    size_t size);
+
+int lease_hwaddr_parse(const char *type, size_t type_len, const char *str,
+    size_t len, struct lease_hwaddr_t *hwaddr);
+char *lease_hwaddr_to_str(const struct lease_hwaddr_t *hwaddr, char *buf,
+    size_t size);
+
+const char *lease_ia_type_2_str(enum lease_ia_type_t type);
+
+enum lease_binding_state_t lease_binding_state_parse(const char *str,
+    size_t len);
+const char *lease_binding_state_2_str(enum lease_binding_state_t state);
+
+#endif /* _LEASE_H_ */
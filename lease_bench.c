@@ -0,0 +1,781 @@
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include "dllist.h"
+#include "lease_gen.h"
+#include "lease_lexer.h"
+#include "lease_metrics.h"
+#include "lease_parser.h"
+#include "lease_snapshot.h"
+#include "lease_table.h"
+#include "lease_time.h"
+#include "log.h"
+
+#define ARRAYSIZE(n) (sizeof(n)/sizeof(n[0]))
+
+#define BENCH_STAGES_MAX        32
+#define BENCH_TIME_STR_SIZE     32
+
+/**
+ *
+ * \brief benchmarks of every parsing stage on a generated lease file
+ *
+ * Each stage runs reps times and reports its fastest run, the bytes and
+ * items (tokens, keys, times, records) it processed and the resulting
+ * rates. The report is one JSON object on stdout, so runs of different
+ * releases can be compared by a script.
+ *
+ * lease_bench -n 1000000 -d 20 -6 10 > before.json
+ */
+
+struct bench_stage_t
+{
+  char name[32];
+  double seconds;
+  size_t bytes;
+  size_t items;
+};
+
+struct bench_span_t
+{
+  const char *str;
+  size_t len;
+};
+
+static struct bench_stage_t stages[BENCH_STAGES_MAX];
+static int stage_count;
+static unsigned int reps = 3;
+
+static double
+bench_now(void)
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static struct bench_stage_t *
+bench_stage(const char *name, size_t bytes, size_t items)
+{
+  struct bench_stage_t *stage;
+
+  if (stage_count == BENCH_STAGES_MAX)
+    return NULL;
+
+  stage = &stages[stage_count++];
+  snprintf(stage->name, sizeof(stage->name), "%s", name);
+  stage->seconds = -1;
+  stage->bytes = bytes;
+  stage->items = items;
+
+  return stage;
+}
+
+static void
+bench_record(struct bench_stage_t *stage, double start)
+{
+  double seconds = bench_now() - start;
+
+  if (stage && (stage->seconds < 0 || seconds < stage->seconds))
+    stage->seconds = seconds;
+}
+
+static char *
+bench_read_file(const char *path, size_t *len)
+{
+  struct stat st;
+  char *buf;
+  ssize_t n;
+  size_t off = 0;
+  int fd;
+
+  fd = open(path, O_RDONLY);
+  if (fd < 0 || fstat(fd, &st) < 0)
+    {
+      logg_err("can't open %s (%s)", path, strerror(errno));
+      if (fd >= 0)
+        close(fd);
+      return NULL;
+    }
+
+  buf = malloc(st.st_size + 1);
+  if (!buf)
+    {
+      logg_err("Cannot allocate memory.");
+      close(fd);
+      return NULL;
+    }
+
+  while (off < st.st_size && (n = read(fd, buf + off, st.st_size - off)) > 0)
+    off += n;
+  close(fd);
+
+  buf[off] = '\0';
+  *len = off;
+  return buf;
+}
+
+static void
+bench_read(const char *path)
+{
+  struct bench_stage_t *stage = bench_stage("read", 0, 0);
+  unsigned int i;
+  double start;
+  char *buf;
+
+  for (i = 0; i < reps; i++)
+    {
+      start = bench_now();
+      buf = bench_read_file(path, &stage->bytes);
+      bench_record(stage, start);
+      free(buf);
+    }
+}
+
+static size_t
+bench_tokenise_once(const char *buf, size_t len)
+{
+  struct lease_lexer_t lexer;
+  struct lease_token_t token;
+  size_t tokens = 0;
+
+  lease_lexer_init(&lexer, buf, len, 1);
+  while (lease_lexer_next(&lexer, &token) > LEASE_TOKEN_NEED_MORE)
+    tokens++;
+
+  return tokens;
+}
+
+static void
+bench_tokenise(const char *buf, size_t len)
+{
+  static const char *backends[] = { "scalar", "sse2", "avx2" };
+  const char *current = lease_lexer_backend();
+  struct bench_stage_t *stage;
+  char name[32];
+  unsigned int i;
+  double start;
+  int b;
+
+  for (b = 0; b < ARRAYSIZE(backends); b++)
+    {
+      if (lease_lexer_set_backend(backends[b]) < 0)
+        continue;
+
+      snprintf(name, sizeof(name), "tokenise_%s", backends[b]);
+      stage = bench_stage(name, len, 0);
+      for (i = 0; i < reps; i++)
+        {
+          start = bench_now();
+          stage->items = bench_tokenise_once(buf, len);
+          bench_record(stage, start);
+        }
+    }
+
+  lease_lexer_set_backend(current);
+}
+
+static int
+bench_word_is(const char *buf, const struct lease_token_t *token,
+    const char *str)
+{
+  return token->length == strlen(str)
+      && !memcmp(buf + token->offset, str, token->length);
+}
+
+/*
+ * statement keys and time values of the file, collected up front so the
+ * keyword and time stages measure nothing but the lookup and the decode
+ */
+static int
+bench_collect(const char *buf, size_t len, struct bench_span_t **keys,
+    size_t *key_count, struct bench_span_t **times, size_t *time_count)
+{
+  static const char *time_keys[] =
+      { "starts", "ends", "tstp", "cltt", "tsfp", "atsfp" };
+  struct lease_lexer_t lexer;
+  struct lease_token_t token, first = { 0 };
+  size_t words = 0, capacity = bench_tokenise_once(buf, len) + 1;
+  const char *semicolon;
+  int k, is_time = 0, is_prefix = 0;
+
+  *keys = malloc(capacity * sizeof(**keys));
+  *times = malloc(capacity * sizeof(**times));
+  if (!*keys || !*times)
+    {
+      logg_err("Cannot allocate memory.");
+      return -1;
+    }
+  *key_count = *time_count = 0;
+
+  lease_lexer_init(&lexer, buf, len, 1);
+  while (lease_lexer_next(&lexer, &token) > LEASE_TOKEN_NEED_MORE)
+    {
+      if (token.type != LEASE_TOKEN_WORD && token.type != LEASE_TOKEN_STRING)
+        {
+          words = 0;
+          continue;
+        }
+
+      if (words++ == 0)
+        {
+          first = token;
+          is_prefix = bench_word_is(buf, &token, "set")
+              || bench_word_is(buf, &token, "option");
+          for (k = 0, is_time = 0; k < ARRAYSIZE(time_keys); k++)
+            is_time |= bench_word_is(buf, &token, time_keys[k]);
+
+          if (!is_prefix)
+            (*keys)[(*key_count)++] = (struct bench_span_t)
+              { buf + token.offset, token.length };
+          continue;
+        }
+
+      if (words != 2)
+        continue;
+
+      // "set x" and "option x" are keyed on two words
+      if (is_prefix)
+        (*keys)[(*key_count)++] = (struct bench_span_t)
+          { buf + first.offset, token.offset + token.length - first.offset };
+
+      // the value of a time statement runs up to the ';'
+      semicolon = is_time ? memchr(buf + token.offset, ';', len - token.offset)
+          : NULL;
+      if (semicolon)
+        (*times)[(*time_count)++] = (struct bench_span_t)
+          { buf + token.offset, semicolon - buf - token.offset };
+    }
+
+  return 0;
+}
+
+static void
+bench_keywords(const struct bench_span_t *keys, size_t count)
+{
+  struct bench_stage_t *stage = bench_stage("keyword_dispatch", 0, count);
+  volatile int sink = 0;
+  unsigned int r;
+  double start;
+  size_t i;
+
+  for (r = 0; r < reps; r++)
+    {
+      start = bench_now();
+      for (i = 0; i < count; i++)
+        sink += lease_parser_element_type(keys[i].str, keys[i].len);
+      bench_record(stage, start);
+    }
+}
+
+static void
+bench_time_decode(const struct bench_span_t *times, size_t count)
+{
+  struct bench_stage_t *cached = bench_stage("time_decode", 0, count);
+  struct bench_stage_t *uncached = bench_stage("time_decode_nocache", 0, count);
+  struct bench_stage_t *libc = bench_stage("time_decode_strptime", 0, count);
+  struct lease_time_cache_t cache;
+  char (*strs)[BENCH_TIME_STR_SIZE];
+  volatile time_t sink = 0;
+  struct tm tm;
+  unsigned int r;
+  double start;
+  time_t t;
+  size_t i;
+
+  // strptime() wants terminated strings, copied outside of the timing
+  strs = malloc(count * sizeof(*strs));
+  if (!strs)
+    {
+      logg_err("Cannot allocate memory.");
+      return;
+    }
+  for (i = 0; i < count; i++)
+    snprintf(strs[i], sizeof(strs[i]), "%.*s", (int) times[i].len,
+        times[i].str);
+
+  for (r = 0; r < reps; r++)
+    {
+      memset(&cache, 0, sizeof(cache));
+      start = bench_now();
+      for (i = 0; i < count; i++)
+        {
+          lease_time_parse(times[i].str, times[i].len, &t, &cache);
+          sink += t;
+        }
+      bench_record(cached, start);
+
+      start = bench_now();
+      for (i = 0; i < count; i++)
+        {
+          lease_time_parse(times[i].str, times[i].len, &t, NULL);
+          sink += t;
+        }
+      bench_record(uncached, start);
+
+      start = bench_now();
+      for (i = 0; i < count; i++)
+        {
+          memset(&tm, 0, sizeof(tm));
+          if (strptime(strs[i], "%w %Y/%m/%d %H:%M:%S", &tm))
+            sink += timegm(&tm);
+        }
+      bench_record(libc, start);
+    }
+
+  free(strs);
+}
+
+static struct lease_table_t *
+bench_parse(const char *path, size_t len, size_t blocks)
+{
+  static const unsigned int thread_counts[] = { 1, 2, 4, 8, 16 };
+  struct bench_stage_t *stage;
+  struct lease_table_t *table = NULL;
+  char name[32];
+  unsigned int r, used, last = 0;
+  double start;
+  int t;
+
+  stage = bench_stage("parse_mmap", len, blocks);
+  for (r = 0; r < reps; r++)
+    {
+      // the last table is kept for the record build stage
+      lease_table_destroy(table);
+      start = bench_now();
+      table = lease_parser_reade_file(path, LEASE_PARSER_READ_MODE_MMAP);
+      bench_record(stage, start);
+      if (!table)
+        return NULL;
+    }
+
+  // the same with every counter and stage timer on
+  stage = bench_stage("parse_mmap_metrics", len, blocks);
+  lease_metrics_enable(1);
+  for (r = 0; r < reps; r++)
+    {
+      struct lease_table_t *tmp;
+
+      start = bench_now();
+      tmp = lease_parser_reade_file(path, LEASE_PARSER_READ_MODE_MMAP);
+      bench_record(stage, start);
+      lease_table_destroy(tmp);
+    }
+  lease_metrics_enable(0);
+
+  stage = bench_stage("parse_stream", len, blocks);
+  for (r = 0; r < reps; r++)
+    {
+      struct lease_table_t *tmp;
+
+      start = bench_now();
+      tmp = lease_parser_reade_file(path, LEASE_PARSER_READ_MODE_STREAM);
+      bench_record(stage, start);
+      lease_table_destroy(tmp);
+    }
+
+  for (t = 0; t < ARRAYSIZE(thread_counts); t++)
+    {
+      // small inputs get fewer threads than asked for, named as run
+      used = lease_parser_thread_count(thread_counts[t], len);
+      if (used == last)
+        continue;
+      last = used;
+
+      snprintf(name, sizeof(name), "parse_threads_%u", used);
+      stage = bench_stage(name, len, blocks);
+
+      for (r = 0; r < reps; r++)
+        {
+          struct lease_table_t *tmp;
+
+          start = bench_now();
+          tmp = lease_parser_reade_file_parallel(path, thread_counts[t]);
+          bench_record(stage, start);
+          lease_table_destroy(tmp);
+        }
+    }
+
+  return table;
+}
+
+static void
+bench_record_build(const struct lease_table_t *src)
+{
+  struct bench_stage_t *stage = bench_stage("record_build", 0, src->count);
+  struct lease_table_t *table;
+  unsigned int r;
+  double start;
+  size_t i;
+
+  // the strings stay in src, only records and indexes are built
+  for (r = 0; r < reps; r++)
+    {
+      table = lease_table_new();
+      if (!table)
+        return;
+
+      start = bench_now();
+      for (i = 0; i < src->count; i++)
+        lease_table_upsert(table, &src->leases[i], NULL);
+      bench_record(stage, start);
+
+      lease_table_destroy(table);
+    }
+}
+
+// what lease_server publishes after every refresh
+static void
+bench_copy(const struct lease_table_t *src)
+{
+  struct bench_stage_t *stage = bench_stage("table_copy", 0, src->count);
+  struct lease_table_t *table;
+  unsigned int r;
+  double start;
+
+  for (r = 0; r < reps; r++)
+    {
+      start = bench_now();
+      table = lease_table_copy(src);
+      bench_record(stage, start);
+      lease_table_destroy(table);
+    }
+}
+
+static void
+bench_diff_count(enum lease_change_t change,
+    const struct lease_element_t *lease,
+    const struct lease_element_t *previous, uint32_t fields, void *user)
+{
+  (*(size_t *) user)++;
+}
+
+// src against a copy with every 50th lease extended and every 1000th gone
+static void
+bench_diff(const struct lease_table_t *src)
+{
+  struct bench_stage_t *stage = bench_stage("table_diff", 0, src->count);
+  struct lease_element_t lease;
+  struct lease_table_t *table;
+  size_t i, changes;
+  unsigned int r;
+  double start;
+
+  table = lease_table_new();
+  if (!table)
+    return;
+
+  for (i = 0; i < src->count; i++)
+    {
+      if (i % 1000 == 999)
+        continue;
+
+      lease = src->leases[i];
+      if (i % 50 == 49)
+        lease.ends += 3600;
+      if (lease_table_upsert(table, &lease, NULL) < 0)
+        goto end;
+    }
+
+  for (r = 0; r < reps; r++)
+    {
+      changes = 0;
+      start = bench_now();
+      lease_table_diff(src, table, bench_diff_count, &changes);
+      bench_record(stage, start);
+    }
+
+  end:
+  lease_table_destroy(table);
+}
+
+// a lease as kept before the table, one allocation per list node
+struct bench_list_lease_t
+{
+  struct lease_element_t lease;
+  struct dllist link;
+};
+
+/*
+ * expired leases counted by walking a dllist of separately allocated
+ * leases, as before the table, by walking the table records and through
+ * the ends column of the table
+ */
+static void
+bench_scan(const struct lease_table_t *src)
+{
+  struct bench_stage_t *list_stage = bench_stage("scan_list", 0, src->count);
+  struct bench_stage_t *table_stage = bench_stage("scan_table", 0, src->count);
+  struct bench_stage_t *column_stage = bench_stage("scan_table_expired", 0,
+      src->count);
+  struct bench_list_lease_t *node, *tmp;
+  const struct lease_element_t *lease;
+  volatile size_t sink = 0;
+  struct dllist list;
+  size_t i, count;
+  time_t now = time(NULL);
+  unsigned int r;
+  double start;
+
+  dllist_init(&list);
+  for (i = 0; i < src->count; i++)
+    {
+      node = malloc(sizeof(*node));
+      if (!node)
+        {
+          logg_err("Cannot allocate memory.");
+          goto end;
+        }
+      node->lease = src->leases[i];
+      dllist_insert(list.prev, &node->link);
+    }
+
+  for (r = 0; r < reps; r++)
+    {
+      count = 0;
+      start = bench_now();
+      dllist_for_each(node, &list, link)
+        count += node->lease.ends < now;
+      bench_record(list_stage, start);
+      sink += count;
+
+      count = 0;
+      start = bench_now();
+      lease_table_for_each(lease, src)
+        count += lease->ends < now;
+      bench_record(table_stage, start);
+      sink += count;
+
+      start = bench_now();
+      sink += lease_table_count_expired(src, now);
+      bench_record(column_stage, start);
+    }
+
+  end:
+  dllist_for_each_safe(node, tmp, &list, link)
+    free(node);
+}
+
+static void
+bench_snapshot(const char *path)
+{
+  struct bench_stage_t *save, *load;
+  struct lease_parser_t *parser;
+  struct lease_table_t *table;
+  struct stat st;
+  char *snap_path;
+  unsigned int r;
+  double start;
+
+  parser = lease_parser_open(path, LEASE_PARSER_READ_MODE_MMAP);
+  snap_path = lease_snapshot_path(path, NULL);
+  if (!parser || !snap_path)
+    goto end;
+
+  save = bench_stage("snapshot_save", 0, parser->table->count);
+  load = bench_stage("snapshot_load", 0, parser->table->count);
+
+  for (r = 0; r < reps; r++)
+    {
+      start = bench_now();
+      if (lease_snapshot_save(parser, snap_path) < 0)
+        goto end;
+      bench_record(save, start);
+
+      start = bench_now();
+      table = lease_snapshot_load(snap_path, NULL);
+      bench_record(load, start);
+      lease_table_destroy(table);
+    }
+
+  if (stat(snap_path, &st) == 0)
+    save->bytes = load->bytes = st.st_size;
+
+  end:
+  if (snap_path)
+    unlink(snap_path);
+  free(snap_path);
+  if (parser)
+    lease_parser_close(parser);
+}
+
+static void
+bench_print(const struct lease_gen_options_t *options, size_t bytes,
+    ssize_t records)
+{
+  const struct bench_stage_t *stage;
+  int i;
+
+  printf("{\"version\":\"%s\",\"lexer\":\"%s\",\"reps\":%u,\n", VERSION,
+      lease_lexer_backend(), reps);
+  printf(" \"input\":{\"leases\":%zu,\"duplicates\":%u,\"v6\":%u,"
+      "\"comments\":%u,\"fields\":%u,\"crlf\":%s,\"seed\":%llu,"
+      "\"bytes\":%zu,\"records\":%zd},\n", options->count, options->duplicates,
+      options->v6, options->comments, options->fields,
+      options->crlf ? "true" : "false", (unsigned long long) options->seed,
+      bytes, records);
+  printf(" \"stages\":[\n");
+
+  for (i = 0; i < stage_count; i++)
+    {
+      stage = &stages[i];
+      printf("  {\"name\":\"%s\",\"seconds\":%.6f", stage->name,
+          stage->seconds);
+      if (stage->bytes)
+        printf(",\"bytes\":%zu,\"mb_per_s\":%.1f", stage->bytes,
+            stage->seconds > 0 ? stage->bytes / 1e6 / stage->seconds : 0);
+      if (stage->items)
+        printf(",\"items\":%zu,\"items_per_s\":%.0f", stage->items,
+            stage->seconds > 0 ? stage->items / stage->seconds : 0);
+      printf("}%s\n", i + 1 < stage_count ? "," : "");
+    }
+
+  printf(" ]}\n");
+}
+
+static void
+usage(const char *name)
+{
+  printf("usage: %s [-n leases] [-d duplicates%%] [-6 v6%%] [-c comment every n]\n"
+      "       [-f fields] [-C] [-s seed] [-r reps] [-o file]\n", name);
+  printf("  -f  optional statements: hostname,uid,vendor,ddns,agent,states, all\n"
+      "      or none (default %s)\n", LEASE_GEN_FIELDS_DEFAULT);
+  printf("  -C  CRLF line ends\n");
+  printf("  -o  only write the generated lease file\n");
+  printf("  prints the fastest of reps runs of every stage as JSON\n");
+}
+
+int
+main(int argn, char *args[])
+{
+  struct lease_gen_options_t options;
+  struct bench_span_t *keys = NULL, *times = NULL;
+  struct lease_table_t *table;
+  size_t len, key_count, time_count;
+  const char *out_path = NULL;
+  char path[] = "/tmp/lease_bench.XXXXXX";
+  struct bench_stage_t *stage;
+  ssize_t records;
+  double start;
+  char *buf = NULL;
+  FILE *fp;
+  int opt, fd, ret = -1;
+
+  lease_gen_options_init(&options);
+
+  while ((opt = getopt(argn, args, "n:d:6:c:f:Cs:r:o:h")) != -1)
+    {
+      switch (opt)
+        {
+      case 'n':
+        options.count = strtoull(optarg, NULL, 10);
+        break;
+      case 'd':
+        options.duplicates = strtoul(optarg, NULL, 10);
+        break;
+      case '6':
+        options.v6 = strtoul(optarg, NULL, 10);
+        break;
+      case 'c':
+        options.comments = strtoul(optarg, NULL, 10);
+        break;
+      case 'f':
+        if (lease_gen_fields_parse(optarg, &options.fields) < 0)
+          return -1;
+        break;
+      case 'C':
+        options.crlf = 1;
+        break;
+      case 's':
+        options.seed = strtoull(optarg, NULL, 10);
+        break;
+      case 'r':
+        reps = strtoul(optarg, NULL, 10);
+        if (!reps)
+          reps = 1;
+        break;
+      case 'o':
+        out_path = optarg;
+        break;
+      case 'h':
+        usage(args[0]);
+        return 0;
+      default:
+        usage(args[0]);
+        return -1;
+        }
+    }
+
+  if (out_path)
+    {
+      fp = fopen(out_path, "w");
+      if (!fp)
+        {
+          logg_err("can't create %s (%s)", out_path, strerror(errno));
+          return -1;
+        }
+      records = lease_gen_write(fp, &options);
+      if (fclose(fp) || records < 0)
+        return -1;
+      return 0;
+    }
+
+  fd = mkstemp(path);
+  if (fd < 0 || !(fp = fdopen(fd, "w")))
+    {
+      logg_err("can't create %s (%s)", path, strerror(errno));
+      return -1;
+    }
+
+  stage = bench_stage("generate", 0, options.count);
+  start = bench_now();
+  records = lease_gen_write(fp, &options);
+  if (fclose(fp) || records < 0)
+    goto end;
+  bench_record(stage, start);
+
+  bench_read(path);
+  buf = bench_read_file(path, &len);
+  if (!buf)
+    goto end;
+  stage->bytes = len;
+
+  bench_tokenise(buf, len);
+  if (bench_collect(buf, len, &keys, &key_count, &times, &time_count) < 0)
+    goto end;
+  bench_keywords(keys, key_count);
+  bench_time_decode(times, time_count);
+
+  table = bench_parse(path, len, options.count);
+  if (!table)
+    goto end;
+  bench_record_build(table);
+  bench_copy(table);
+  bench_diff(table);
+  bench_scan(table);
+
+  stage = bench_stage("teardown", 0, table->count);
+  start = bench_now();
+  lease_table_destroy(table);
+  bench_record(stage, start);
+
+  bench_snapshot(path);
+  bench_print(&options, len, records);
+  ret = 0;
+
+  end:
+  unlink(path);
+  free(buf);
+  free(keys);
+  free(times);
+  return ret;
+}
@@ -0,0 +1,147 @@
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+
+#include "lease_parser.h"
+#include "lease_table.h"
+#include "log.h"
+
+#define FUZZ_INPUT_MAX          (64 * 1024 * 1024)
+
+/**
+ *
+ * \brief fuzz target for the parser
+ *
+ * Every input is parsed by the mmap path, the one that matters for
+ * throughput, with the same lexer backend as in production, and the
+ * resulting table is checked: every lease has to be found again through
+ * the address index. A parser that crashes, reads outside of the input
+ * or leaks is caught by the sanitizers the target is built with.
+ *
+ * The input is copied into a buffer of exactly its size, so reads past
+ * its end are seen by AddressSanitizer.
+ *
+ * libFuzzer:   make fuzz FUZZ_CC=clang FUZZ_FLAGS="-fsanitize=fuzzer,address
+ *                  -DLEASE_FUZZ_LIBFUZZER"
+ *              ./lease_fuzz corpus/
+ * AFL:         make fuzz FUZZ_CC=afl-gcc
+ *              afl-fuzz -i corpus -o findings ./lease_fuzz @@
+ * replay:      ./lease_fuzz crash-1234 ...   (or the input on stdin)
+ */
+
+static void
+fuzz_check(const struct lease_table_t *table)
+{
+  const struct lease_element_t *lease;
+
+  lease_table_for_each(lease, table)
+  {
+    if (lease_table_lookup_by_ip(table, &lease->ip) != lease)
+      {
+        logg_err("lease %zu not found by its address",
+            (size_t) (lease - table->leases));
+        abort();
+      }
+  }
+}
+
+int
+LLVMFuzzerTestOneInput(const uint8_t *data, size_t size)
+{
+  struct lease_table_t *table;
+  char *buf;
+
+  log_set_level(LOG_ERR);
+
+  buf = malloc(size ? size : 1);
+  if (!buf)
+    return 0;
+  memcpy(buf, data, size);
+
+  table = lease_parser_parse_buffer(buf, size, 1);
+  if (table)
+    fuzz_check(table);
+
+  lease_table_destroy(table);
+  free(buf);
+  return 0;
+}
+
+// libFuzzer brings its own main()
+#ifndef LEASE_FUZZ_LIBFUZZER
+
+static int
+fuzz_file(FILE *fp, const char *name)
+{
+  char *buf = NULL, *tmp;
+  size_t len = 0, size = 0;
+  size_t n;
+
+  do
+    {
+      if (len == size)
+        {
+          size = size ? size * 2 : 64 * 1024;
+          if (size > FUZZ_INPUT_MAX)
+            {
+              logg_err("%s exceeds %d bytes", name, FUZZ_INPUT_MAX);
+              free(buf);
+              return -1;
+            }
+          tmp = realloc(buf, size);
+          if (!tmp)
+            {
+              logg_err("Cannot allocate memory.");
+              free(buf);
+              return -1;
+            }
+          buf = tmp;
+        }
+      n = fread(buf + len, 1, size - len, fp);
+      len += n;
+    }
+  while (n);
+
+  if (ferror(fp))
+    {
+      logg_err("can't read %s (%s)", name, strerror(errno));
+      free(buf);
+      return -1;
+    }
+
+  LLVMFuzzerTestOneInput((const uint8_t *) buf, len);
+  free(buf);
+  return 0;
+}
+
+int
+main(int argn, char *args[])
+{
+  FILE *fp;
+  int i, ret = 0;
+
+  if (argn < 2)
+    return fuzz_file(stdin, "stdin") < 0 ? EXIT_FAILURE : EXIT_SUCCESS;
+
+  for (i = 1; i < argn; i++)
+    {
+      fp = fopen(args[i], "r");
+      if (!fp)
+        {
+          logg_err("can't open %s (%s)", args[i], strerror(errno));
+          ret = -1;
+          continue;
+        }
+      if (fuzz_file(fp, args[i]) < 0)
+        ret = -1;
+      fclose(fp);
+    }
+
+  return ret < 0 ? EXIT_FAILURE : EXIT_SUCCESS;
+}
+
+#endif /* LEASE_FUZZ_LIBFUZZER */
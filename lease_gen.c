@@ -0,0 +1,274 @@
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "lease_gen.h"
+#include "log.h"
+
+#define ARRAYSIZE(n) (sizeof(n)/sizeof(n[0]))
+
+// 2023-11-14 22:13:20 UTC, generated times are counted from here
+#define LEASE_GEN_EPOCH         1700000000
+
+static const struct
+{
+  unsigned int field;
+  const char *str;
+} lease_gen_field_2_str_map[] =
+    {
+        { LEASE_GEN_FIELD_HOSTNAME, "hostname" },
+        { LEASE_GEN_FIELD_UID, "uid" },
+        { LEASE_GEN_FIELD_VENDOR, "vendor" },
+        { LEASE_GEN_FIELD_DDNS, "ddns" },
+        { LEASE_GEN_FIELD_AGENT, "agent" },
+        { LEASE_GEN_FIELD_STATES, "states" },
+        { LEASE_GEN_FIELD_ALL, "all" },
+        { 0, "none" },
+    };
+
+static const char *lease_gen_states[] =
+    {
+        "active", "active", "active", "free", "expired", "released", "backup",
+    };
+
+static const char *lease_gen_vendors[] =
+    {
+        "MSFT 5.0", "android-dhcp-13", "udhcp 1.36.1", "dhcpcd-9.4.1:Linux",
+    };
+
+struct lease_gen_t
+{
+  const struct lease_gen_options_t *options;
+  FILE *fp;
+  const char *eol;
+  uint64_t state;
+};
+
+void
+lease_gen_options_init(struct lease_gen_options_t *options)
+{
+  memset(options, 0, sizeof(*options));
+  options->count = 100000;
+  options->duplicates = 20;
+  options->comments = 0;
+  options->seed = 1;
+  lease_gen_fields_parse(LEASE_GEN_FIELDS_DEFAULT, &options->fields);
+}
+
+int
+lease_gen_fields_parse(const char *list, unsigned int *fields)
+{
+  const char *p = list;
+  size_t len;
+  int i;
+
+  *fields = 0;
+
+  for (;;)
+    {
+      len = strcspn(p, ",");
+
+      for (i = 0; i < ARRAYSIZE(lease_gen_field_2_str_map); i++)
+        {
+          if (strlen(lease_gen_field_2_str_map[i].str) == len
+              && !memcmp(lease_gen_field_2_str_map[i].str, p, len))
+            break;
+        }
+
+      if (i == ARRAYSIZE(lease_gen_field_2_str_map))
+        {
+          logg_err("unknown field: %.*s", (int) len, p);
+          return -1;
+        }
+      *fields |= lease_gen_field_2_str_map[i].field;
+
+      if (!p[len])
+        break;
+      p += len + 1;
+    }
+
+  return 0;
+}
+
+// xorshift64*
+static uint64_t
+lease_gen_random(struct lease_gen_t *gen)
+{
+  gen->state ^= gen->state >> 12;
+  gen->state ^= gen->state << 25;
+  gen->state ^= gen->state >> 27;
+
+  return gen->state * 0x2545f4914f6cdd1dull;
+}
+
+// fixed per address, so a rewritten address keeps its family
+static int
+lease_gen_is_v6(const struct lease_gen_t *gen, uint64_t addr)
+{
+  uint64_t h = (addr + gen->options->seed) * 0x9e3779b97f4a7c15ull;
+
+  return (h >> 32) % 100 < gen->options->v6;
+}
+
+static void
+lease_gen_time(struct lease_gen_t *gen, const char *indent, const char *name,
+    time_t t)
+{
+  char buf[32];
+  struct tm tm;
+
+  gmtime_r(&t, &tm);
+  strftime(buf, sizeof(buf), "%w %Y/%m/%d %H:%M:%S", &tm);
+  fprintf(gen->fp, "%s%s %s;%s", indent, name, buf, gen->eol);
+}
+
+// "\001\000\026>" style client identifier derived from addr
+static void
+lease_gen_octets(struct lease_gen_t *gen, const char *prefix, uint64_t addr)
+{
+  int i;
+
+  fputs(prefix, gen->fp);
+  for (i = 2; i >= 0; i--)
+    fprintf(gen->fp, "\\%03o", (unsigned int) (addr >> (8 * i)) & 0xff);
+}
+
+static void
+lease_gen_statements(struct lease_gen_t *gen, const char *indent,
+    uint64_t addr, const char *state)
+{
+  const char *eol = gen->eol;
+  FILE *fp = gen->fp;
+
+  if (gen->options->fields & LEASE_GEN_FIELD_STATES)
+    {
+      fprintf(fp, "%snext binding state %s;%s", indent,
+          strcmp(state, "active") ? "free" : "expired", eol);
+      fprintf(fp, "%srewind binding state free;%s", indent, eol);
+    }
+
+  if (gen->options->fields & LEASE_GEN_FIELD_VENDOR)
+    fprintf(fp, "%sset vendor-class-identifier = \"%s\";%s", indent,
+        lease_gen_vendors[addr % ARRAYSIZE(lease_gen_vendors)], eol);
+
+  if (gen->options->fields & LEASE_GEN_FIELD_DDNS)
+    {
+      fprintf(fp, "%sset ddns-txt = \"31%014llx\";%s", indent,
+          (unsigned long long) addr, eol);
+      fprintf(fp, "%sset ddns-fwd-name = \"host-%llu.example.com\";%s",
+          indent, (unsigned long long) addr, eol);
+    }
+
+  if (gen->options->fields & LEASE_GEN_FIELD_AGENT)
+    {
+      fprintf(fp, "%soption agent.circuit-id \"eth0:%llu\";%s", indent,
+          (unsigned long long) addr % 4096, eol);
+      fprintf(fp, "%soption agent.remote-id \"sw-%llu\";%s", indent,
+          (unsigned long long) addr / 4096, eol);
+    }
+}
+
+static void
+lease_gen_v4(struct lease_gen_t *gen, uint64_t addr, time_t starts,
+    time_t ends, const char *state)
+{
+  const char *eol = gen->eol;
+  FILE *fp = gen->fp;
+
+  fprintf(fp, "lease 10.%u.%u.%u {%s", (unsigned int) (addr >> 16) & 0xff,
+      (unsigned int) (addr >> 8) & 0xff, (unsigned int) addr & 0xff, eol);
+  lease_gen_time(gen, "  ", "starts", starts);
+  lease_gen_time(gen, "  ", "ends", ends);
+  lease_gen_time(gen, "  ", "cltt", starts);
+  fprintf(fp, "  binding state %s;%s", state, eol);
+  lease_gen_statements(gen, "  ", addr, state);
+  fprintf(fp, "  hardware ethernet 00:16:3e:%02x:%02x:%02x;%s",
+      (unsigned int) (addr >> 16) & 0xff, (unsigned int) (addr >> 8) & 0xff,
+      (unsigned int) addr & 0xff, eol);
+
+  if (gen->options->fields & LEASE_GEN_FIELD_UID)
+    {
+      lease_gen_octets(gen, "  uid \"\\001\\000\\026>", addr);
+      fprintf(fp, "\";%s", eol);
+    }
+
+  if (gen->options->fields & LEASE_GEN_FIELD_HOSTNAME)
+    fprintf(fp, "  client-hostname \"host-%llu\";%s",
+        (unsigned long long) addr, eol);
+
+  fprintf(fp, "}%s", eol);
+}
+
+static void
+lease_gen_v6(struct lease_gen_t *gen, uint64_t addr, time_t starts,
+    time_t ends, const char *state)
+{
+  const char *eol = gen->eol;
+  FILE *fp = gen->fp;
+
+  lease_gen_octets(gen, "ia-na \"\\000", addr);
+  fprintf(fp, "\\000\\001\\000\\001\\031\\177\\332\\337\\010\\000'\\270\\037\\203\" {%s",
+      eol);
+  lease_gen_time(gen, "  ", "cltt", starts);
+  fprintf(fp, "  iaaddr 2001:db8:%x::%x {%s", (unsigned int) (addr >> 16),
+      (unsigned int) addr & 0xffff, eol);
+  fprintf(fp, "    binding state %s;%s", state, eol);
+  fprintf(fp, "    preferred-life 375;%s", eol);
+  fprintf(fp, "    max-life 600;%s", eol);
+  lease_gen_time(gen, "    ", "ends", ends);
+  lease_gen_statements(gen, "    ", addr, state);
+  fprintf(fp, "  }%s}%s", eol, eol);
+}
+
+ssize_t
+lease_gen_write(FILE *fp, const struct lease_gen_options_t *options)
+{
+  struct lease_gen_t gen;
+  uint64_t unique = 0, addr, r;
+  time_t starts;
+  size_t i;
+
+  gen.options = options;
+  gen.fp = fp;
+  gen.eol = options->crlf ? "\r\n" : "\n";
+  gen.state = options->seed ? options->seed : 1;
+
+  fprintf(fp, "# The format of this file is documented in the dhcpd.leases(5) manual page.%s"
+      "# This lease file was written by lease_gen%s%s", gen.eol, gen.eol,
+      gen.eol);
+  fprintf(fp, "authoring-byte-order little-endian;%s%s", gen.eol, gen.eol);
+  if (options->v6)
+    fprintf(fp, "server-duid \"\\000\\001\\000\\001!\\324\\240\\340\\010\\000'\\246\\032\\356\";%s%s",
+        gen.eol, gen.eol);
+
+  for (i = 0; i < options->count; i++)
+    {
+      r = lease_gen_random(&gen);
+
+      if (unique && r % 100 < options->duplicates)
+        addr = (r >> 8) % unique;
+      else
+        addr = unique++;
+
+      if (options->comments && i && i % options->comments == 0)
+        fprintf(fp, "# %zu leases written%s", i, gen.eol);
+
+      // a block every 10 s on average, renewals follow the file order
+      starts = LEASE_GEN_EPOCH + i * 10 + (r >> 40) % 10;
+      r = lease_gen_random(&gen);
+      if (lease_gen_is_v6(&gen, addr))
+        lease_gen_v6(&gen, addr, starts, starts + 600 + r % 7200,
+            lease_gen_states[(r >> 32) % ARRAYSIZE(lease_gen_states)]);
+      else
+        lease_gen_v4(&gen, addr, starts, starts + 600 + r % 7200,
+            lease_gen_states[(r >> 32) % ARRAYSIZE(lease_gen_states)]);
+    }
+
+  if (ferror(fp))
+    {
+      logg_err("write failed");
+      return -1;
+    }
+
+  return unique;
+}
@@ -0,0 +1,70 @@
+/*
+ * lease_gen.h
+ *
+ */
+
+#ifndef _LEASE_GEN_H_
+#define _LEASE_GEN_H_
+
+#include <stdio.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+// optional statements of a generated lease
+#define LEASE_GEN_FIELD_HOSTNAME        (1 << 0)
+#define LEASE_GEN_FIELD_UID             (1 << 1)
+#define LEASE_GEN_FIELD_VENDOR          (1 << 2)
+#define LEASE_GEN_FIELD_DDNS            (1 << 3)
+#define LEASE_GEN_FIELD_AGENT           (1 << 4)
+#define LEASE_GEN_FIELD_STATES          (1 << 5)
+#define LEASE_GEN_FIELD_ALL             ((1 << 6) - 1)
+
+#define LEASE_GEN_FIELDS_DEFAULT        "hostname,uid,states"
+
+/**
+ *
+ * \brief synthetic dhcpd.leases files
+ *
+ * Writes count lease blocks as dhcpd would. The output only depends on
+ * the options: addresses, times and strings come from a xorshift
+ * generator seeded with seed, and times are counted from a fixed epoch
+ * instead of now, so the same options always give the same bytes.
+ *
+ * duplicates   percentage of blocks that rewrite an address written
+ *              before, as dhcpd appends a new block on every renewal
+ * v6           percentage of blocks that are DHCPv6 ia-na blocks
+ * comments     a comment line every n blocks, 0 for none
+ * fields       LEASE_GEN_FIELD_* statements each lease carries; starts,
+ *              ends, cltt, binding state and hardware are always written
+ * crlf         CRLF instead of LF line ends
+ *
+ * IPv4 leases are numbered within 10.0.0.0/8, so more than 16M distinct
+ * addresses wrap around.
+ *
+ * struct lease_gen_options_t options;
+ *
+ * lease_gen_options_init(&options);
+ * options.count = 1000000;
+ * lease_gen_write(fp, &options);
+ */
+
+struct lease_gen_options_t
+{
+  size_t count;
+  unsigned int duplicates;
+  unsigned int v6;
+  unsigned int comments;
+  unsigned int fields;
+  int crlf;
+  uint64_t seed;
+};
+
+void lease_gen_options_init(struct lease_gen_options_t *options);
+// comma separated field names, or "all" / "none"; -1 on an unknown name
+int lease_gen_fields_parse(const char *list, unsigned int *fields);
+
+// number of records the file parses into, -1 on a write error
+ssize_t lease_gen_write(FILE *fp, const struct lease_gen_options_t *options);
+
+#endif /* _LEASE_GEN_H_ */
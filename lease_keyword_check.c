@@ -0,0 +1,77 @@
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#include "lease_parser.h"
+#include "log.h"
+
+#define CHECK_SEED_MAX          100000
+
+#define ARRAYSIZE(x)            (sizeof(x) / sizeof((x)[0]))
+
+/**
+ *
+ * \brief check of the element keyword hash
+ *
+ * LEASE_KEYWORD_SEED has to map every key of the element table to a slot
+ * of its own; the parser refuses to run otherwise. After the table was
+ * changed this fails and names the first seed that does, to be set in
+ * lease_parser.h.
+ *
+ * Run by "make check", fails with a non zero exit status.
+ */
+
+int
+main(void)
+{
+  static const char *keys[] = {
+    "starts", "ends", "hardware", "uid", "set vendor-class-identifier",
+    "option agent.remote-id"
+  };
+  unsigned int failed = 0;
+  uint32_t seed;
+  size_t i;
+
+  log_set_level(LOG_ERR);
+
+  if (lease_parser_keyword_seed_check(LEASE_KEYWORD_SEED) < 0)
+    {
+      for (seed = 0; seed < CHECK_SEED_MAX; seed++)
+        {
+          if (lease_parser_keyword_seed_check(seed) == 0)
+            break;
+        }
+
+      if (seed < CHECK_SEED_MAX)
+        fprintf(stderr, "lease_keyword_check: LEASE_KEYWORD_SEED %u "
+            "collides, set it to %u\n", LEASE_KEYWORD_SEED, seed);
+      else
+        fprintf(stderr, "lease_keyword_check: no seed below %u maps the "
+            "element table without collisions\n", CHECK_SEED_MAX);
+      return EXIT_FAILURE;
+    }
+
+  for (i = 0; i < ARRAYSIZE(keys); i++)
+    {
+      if (lease_parser_element_type(keys[i], strlen(keys[i])) < 0)
+        {
+          fprintf(stderr, "lease_keyword_check: '%s' not found\n", keys[i]);
+          failed++;
+        }
+    }
+
+  if (lease_parser_element_type("ia-na", sizeof("ia-na") - 1) >= 0)
+    {
+      fprintf(stderr, "lease_keyword_check: 'ia-na' found\n");
+      failed++;
+    }
+
+  if (failed)
+    return EXIT_FAILURE;
+
+  printf("lease_keyword_check: seed %u ok\n", LEASE_KEYWORD_SEED);
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,373 @@
+#include <pthread.h>
+#include <string.h>
+
+#include "lease_lexer.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define LEASE_LEXER_X86
+#endif
+
+/*
+ * byte classes: everything up to ' ' is white space, ';' '{' '}' '"'
+ * and '#' end a word as well.
+ */
+static const unsigned char lease_lexer_delim_table[256] =
+  {
+    [0 ... ' '] = 1,
+    [';'] = 1, ['{'] = 1, ['}'] = 1, ['"'] = 1, ['#'] = 1,
+  };
+
+int
+lease_lexer_is_delim(char c)
+{
+  return lease_lexer_delim_table[(unsigned char) c];
+}
+
+static size_t
+lease_lexer_scan_delim_scalar(const char *p, size_t len)
+{
+  size_t i;
+
+  for (i = 0; i < len; i++)
+    {
+      if (lease_lexer_delim_table[(unsigned char) p[i]])
+        break;
+    }
+
+  return i;
+}
+
+#ifdef LEASE_LEXER_X86
+__attribute__((target("sse2")))
+static size_t
+lease_lexer_scan_delim_sse2(const char *p, size_t len)
+{
+  const __m128i space = _mm_set1_epi8(' ');
+  const __m128i semicolon = _mm_set1_epi8(';');
+  const __m128i lbrace = _mm_set1_epi8('{');
+  const __m128i rbrace = _mm_set1_epi8('}');
+  const __m128i quote = _mm_set1_epi8('"');
+  const __m128i hash = _mm_set1_epi8('#');
+  size_t i;
+
+  for (i = 0; i + 16 <= len; i += 16)
+    {
+      __m128i v = _mm_loadu_si128((const __m128i *) (p + i));
+      __m128i m;
+      int mask;
+
+      // unsigned v <= ' '
+      m = _mm_cmpeq_epi8(_mm_max_epu8(v, space), space);
+      m = _mm_or_si128(m, _mm_cmpeq_epi8(v, semicolon));
+      m = _mm_or_si128(m, _mm_cmpeq_epi8(v, lbrace));
+      m = _mm_or_si128(m, _mm_cmpeq_epi8(v, rbrace));
+      m = _mm_or_si128(m, _mm_cmpeq_epi8(v, quote));
+      m = _mm_or_si128(m, _mm_cmpeq_epi8(v, hash));
+
+      mask = _mm_movemask_epi8(m);
+      if (mask)
+        return i + __builtin_ctz(mask);
+    }
+
+  return i + lease_lexer_scan_delim_scalar(p + i, len - i);
+}
+
+__attribute__((target("avx2")))
+static size_t
+lease_lexer_scan_delim_avx2(const char *p, size_t len)
+{
+  const __m256i space = _mm256_set1_epi8(' ');
+  const __m256i semicolon = _mm256_set1_epi8(';');
+  const __m256i lbrace = _mm256_set1_epi8('{');
+  const __m256i rbrace = _mm256_set1_epi8('}');
+  const __m256i quote = _mm256_set1_epi8('"');
+  const __m256i hash = _mm256_set1_epi8('#');
+  size_t i;
+
+  for (i = 0; i + 32 <= len; i += 32)
+    {
+      __m256i v = _mm256_loadu_si256((const __m256i *) (p + i));
+      __m256i m;
+      unsigned int mask;
+
+      m = _mm256_cmpeq_epi8(_mm256_max_epu8(v, space), space);
+      m = _mm256_or_si256(m, _mm256_cmpeq_epi8(v, semicolon));
+      m = _mm256_or_si256(m, _mm256_cmpeq_epi8(v, lbrace));
+      m = _mm256_or_si256(m, _mm256_cmpeq_epi8(v, rbrace));
+      m = _mm256_or_si256(m, _mm256_cmpeq_epi8(v, quote));
+      m = _mm256_or_si256(m, _mm256_cmpeq_epi8(v, hash));
+
+      mask = _mm256_movemask_epi8(m);
+      if (mask)
+        return i + __builtin_ctz(mask);
+    }
+
+  return i + lease_lexer_scan_delim_sse2(p + i, len - i);
+}
+#endif
+
+struct lease_lexer_backend_t
+{
+  const char *name;
+  size_t (*scan_delim)(const char *p, size_t len);
+};
+
+static const struct lease_lexer_backend_t lease_lexer_backends[] =
+  {
+#ifdef LEASE_LEXER_X86
+      { .name = "avx2",   .scan_delim = lease_lexer_scan_delim_avx2, },
+      { .name = "sse2",   .scan_delim = lease_lexer_scan_delim_sse2, },
+#endif
+      { .name = "scalar", .scan_delim = lease_lexer_scan_delim_scalar, },
+  };
+
+#define ARRAYSIZE(n) (sizeof(n)/sizeof(n[0]))
+
+static int
+lease_lexer_backend_supported(const struct lease_lexer_backend_t *backend)
+{
+#ifdef LEASE_LEXER_X86
+  __builtin_cpu_init();
+  if (!strcmp(backend->name, "avx2"))
+    return __builtin_cpu_supports("avx2");
+  if (!strcmp(backend->name, "sse2"))
+    return __builtin_cpu_supports("sse2");
+#endif
+  return 1;
+}
+
+static size_t lease_lexer_scan_delim_resolve(const char *p, size_t len);
+
+/*
+ * the scan resolves itself on first use. Parser threads may get there
+ * at the same time: the selection runs once and the pointers are only
+ * accessed atomically (plain moves on x86).
+ */
+typedef size_t (*lease_lexer_scan_fn_t)(const char *p, size_t len);
+
+static const struct lease_lexer_backend_t *lease_lexer_active;
+static lease_lexer_scan_fn_t lease_lexer_scan_fn = lease_lexer_scan_delim_resolve;
+static pthread_once_t lease_lexer_once = PTHREAD_ONCE_INIT;
+
+static void
+lease_lexer_use(const struct lease_lexer_backend_t *backend)
+{
+  __atomic_store_n(&lease_lexer_active, backend, __ATOMIC_RELEASE);
+  __atomic_store_n(&lease_lexer_scan_fn, backend->scan_delim, __ATOMIC_RELEASE);
+}
+
+static void
+lease_lexer_select(void)
+{
+  int i;
+
+  for (i = 0; i < ARRAYSIZE(lease_lexer_backends); i++)
+    {
+      if (lease_lexer_backend_supported(&lease_lexer_backends[i]))
+        break;
+    }
+
+  lease_lexer_use(&lease_lexer_backends[i]);
+}
+
+static lease_lexer_scan_fn_t
+lease_lexer_scan(void)
+{
+  return __atomic_load_n(&lease_lexer_scan_fn, __ATOMIC_ACQUIRE);
+}
+
+static size_t
+lease_lexer_scan_delim_resolve(const char *p, size_t len)
+{
+  pthread_once(&lease_lexer_once, lease_lexer_select);
+  return lease_lexer_scan()(p, len);
+}
+
+size_t
+lease_lexer_scan_delim(const char *p, size_t len)
+{
+  return lease_lexer_scan()(p, len);
+}
+
+const char *
+lease_lexer_backend(void)
+{
+  pthread_once(&lease_lexer_once, lease_lexer_select);
+
+  return __atomic_load_n(&lease_lexer_active, __ATOMIC_ACQUIRE)->name;
+}
+
+int
+lease_lexer_set_backend(const char *name)
+{
+  int i;
+
+  for (i = 0; i < ARRAYSIZE(lease_lexer_backends); i++)
+    {
+      if (strcmp(name, lease_lexer_backends[i].name))
+        continue;
+
+      if (!lease_lexer_backend_supported(&lease_lexer_backends[i]))
+        return -1;
+
+      // or a later first use would select again
+      pthread_once(&lease_lexer_once, lease_lexer_select);
+      lease_lexer_use(&lease_lexer_backends[i]);
+      return 0;
+    }
+
+  return -1;
+}
+
+void
+lease_lexer_init(struct lease_lexer_t *lexer, const char *buf, size_t len,
+    int eof)
+{
+  lexer->buf = buf;
+  lexer->len = len;
+  lexer->pos = 0;
+  lexer->eof = eof;
+}
+
+/*
+ * closing quote of a string starting at from, honouring backslash
+ * escapes. The search ends at the end of the line, dhcpd escapes a
+ * newline in a string; *line_end is that newline or NULL.
+ */
+static const char *
+lease_lexer_find_quote(const char *from, const char *end,
+    const char **line_end)
+{
+  const char *q, *b;
+
+  for (q = from; q < end; q++)
+    {
+      q = memchr(q, '"', end - q);
+      if (!q)
+        break;
+
+      for (b = q; b > from && b[-1] == '\\'; b--)
+        ;
+
+      // an even number of backslashes does not escape the quote
+      if ((q - b) % 2 == 0)
+        break;
+    }
+
+  // the string is short, the line end only needs to be searched in it
+  *line_end = memchr(from, '\n', (q ? q : end) - from);
+
+  return *line_end ? NULL : q;
+}
+
+enum lease_token_type_t
+lease_lexer_next(struct lease_lexer_t *lexer, struct lease_token_t *token)
+{
+  const char *buf = lexer->buf;
+  size_t len = lexer->len;
+  size_t pos = lexer->pos;
+
+  for (;;)
+    {
+      while (pos < len && (unsigned char) buf[pos] <= ' ')
+        pos++;
+
+      if (pos >= len)
+        {
+          lexer->pos = pos;
+          token->type = lexer->eof ? LEASE_TOKEN_EOF : LEASE_TOKEN_NEED_MORE;
+          token->offset = pos;
+          token->length = 0;
+          return token->type;
+        }
+
+      if (buf[pos] != '#')
+        break;
+
+      // skip comments
+      {
+        const char *nl = memchr(buf + pos, '\n', len - pos);
+
+        if (!nl && !lexer->eof)
+          {
+            lexer->pos = pos;
+            token->type = LEASE_TOKEN_NEED_MORE;
+            token->offset = pos;
+            token->length = 0;
+            return token->type;
+          }
+        pos = nl ? nl - buf + 1 : len;
+      }
+    }
+
+  token->offset = pos;
+
+  switch (buf[pos])
+    {
+  case ';':
+    token->type = LEASE_TOKEN_SEMICOLON;
+    token->length = 1;
+    lexer->pos = pos + 1;
+    break;
+  case '{':
+    token->type = LEASE_TOKEN_LBRACE;
+    token->length = 1;
+    lexer->pos = pos + 1;
+    break;
+  case '}':
+    token->type = LEASE_TOKEN_RBRACE;
+    token->length = 1;
+    lexer->pos = pos + 1;
+    break;
+  case '"':
+    {
+      const char *line_end;
+      const char *q = lease_lexer_find_quote(buf + pos + 1, buf + len,
+          &line_end);
+
+      if (!q && !line_end && !lexer->eof)
+        {
+          lexer->pos = pos;
+          token->type = LEASE_TOKEN_NEED_MORE;
+          token->length = 0;
+          break;
+        }
+
+      token->offset = pos + 1;
+      if (q)
+        {
+          token->type = LEASE_TOKEN_STRING;
+          token->length = q - (buf + pos + 1);
+          lexer->pos = q - buf + 1;
+          break;
+        }
+
+      // unterminated: up to the end of the line or of the input
+      q = line_end ? line_end : buf + len;
+      token->type = LEASE_TOKEN_UNTERMINATED;
+      token->length = q - (buf + pos + 1);
+      lexer->pos = q - buf;
+    }
+    break;
+  default:
+    {
+      size_t n = lease_lexer_scan()(buf + pos, len - pos);
+
+      if (pos + n >= len && !lexer->eof)
+        {
+          lexer->pos = pos;
+          token->type = LEASE_TOKEN_NEED_MORE;
+          token->length = 0;
+          break;
+        }
+
+      token->type = LEASE_TOKEN_WORD;
+      token->length = n;
+      lexer->pos = pos + n;
+    }
+    break;
+    }
+
+  return token->type;
+}
@@ -0,0 +1,81 @@
+/*
+ * lease_lexer.h
+ *
+ */
+
+#ifndef _LEASE_LEXER_H_
+#define _LEASE_LEXER_H_
+
+#include <stddef.h>
+
+/**
+ *
+ * \brief non-destructive lexer for the dhcpd.leases grammar
+ *
+ * The lexer walks the input once and hands out (offset, length) spans;
+ * the buffer itself is never modified, so it may be a read-only mmap.
+ * Quoted strings are returned without the quotes, comments ('#' up to
+ * the end of the line) and white space are skipped. A string ends at
+ * the end of its line at the latest (LEASE_TOKEN_UNTERMINATED), so that
+ * a stray quote cannot swallow the rest of the file.
+ *
+ * If the input is fed in pieces (eof == 0), a token that may continue
+ * behind the end of the buffer is reported as LEASE_TOKEN_NEED_MORE
+ * and the lexer position is left at the start of that token.
+ *
+ * struct lease_lexer_t lexer;
+ * struct lease_token_t token;
+ *
+ * lease_lexer_init(&lexer, buf, len, 1);
+ * while (lease_lexer_next(&lexer, &token) > LEASE_TOKEN_NEED_MORE)
+ *      Do_something_with(buf + token.offset, token.length);
+ */
+
+enum lease_token_type_t
+{
+  LEASE_TOKEN_EOF,
+  LEASE_TOKEN_NEED_MORE,
+  LEASE_TOKEN_WORD,
+  LEASE_TOKEN_STRING,
+  LEASE_TOKEN_SEMICOLON,
+  LEASE_TOKEN_LBRACE,
+  LEASE_TOKEN_RBRACE,
+  // a string without its closing quote before the end of the line
+  LEASE_TOKEN_UNTERMINATED,
+};
+
+struct lease_token_t
+{
+  enum lease_token_type_t type;
+  size_t offset;
+  size_t length;
+};
+
+struct lease_lexer_t
+{
+  const char *buf;
+  size_t len;
+  size_t pos;
+  int eof;
+};
+
+void lease_lexer_init(struct lease_lexer_t *lexer, const char *buf, size_t len,
+    int eof);
+enum lease_token_type_t lease_lexer_next(struct lease_lexer_t *lexer,
+    struct lease_token_t *token);
+
+// 1 if c ends a bare word (white space, ';', '{', '}', '"' or '#')
+int lease_lexer_is_delim(char c);
+
+// offset of the first delimiter in p[0..len), len if there is none
+size_t lease_lexer_scan_delim(const char *p, size_t len);
+
+/*
+ * the delimiter scan is picked at runtime (avx2, sse2 or scalar).
+ * lease_lexer_set_backend() forces one, e.g. for benchmarks, and
+ * returns -1 if the CPU does not support it.
+ */
+const char *lease_lexer_backend(void);
+int lease_lexer_set_backend(const char *name);
+
+#endif /* _LEASE_LEXER_H_ */
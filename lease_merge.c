@@ -0,0 +1,324 @@
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "arena.h"
+#include "lease_merge.h"
+#include "log.h"
+
+struct lease_merge_file_t
+{
+  const char *path;
+  struct lease_table_t *table;
+  int done;
+};
+
+struct lease_merge_t
+{
+  struct lease_merge_file_t *files;
+  size_t count;
+  enum lease_parser_read_mode_t mode;
+  // next file to parse, taken by the threads with an atomic add
+  size_t next;
+  pthread_mutex_t lock;
+  pthread_cond_t cond;
+
+  struct lease_table_t *table;
+  // file index of every record of table
+  uint32_t *origin;
+  size_t origin_capacity;
+  lease_merge_divergence_cb_t divergence;
+  void *user;
+};
+
+/*
+ * a state that holds on to the address outranks one that gives it
+ * back, which outranks one that was never used
+ */
+static const uint8_t lease_merge_state_rank[LEASE_BINDING_STATE_MAX] =
+    {
+        [LEASE_BINDING_STATE_NONE]      = 0,
+        [LEASE_BINDING_STATE_FREE]      = 1,
+        [LEASE_BINDING_STATE_BACKUP]    = 2,
+        [LEASE_BINDING_STATE_RESET]     = 3,
+        [LEASE_BINDING_STATE_EXPIRED]   = 4,
+        [LEASE_BINDING_STATE_RELEASED]  = 5,
+        [LEASE_BINDING_STATE_ABANDONED] = 6,
+        [LEASE_BINDING_STATE_BOOTP]     = 7,
+        [LEASE_BINDING_STATE_RESERVED]  = 8,
+        [LEASE_BINDING_STATE_ACTIVE]    = 9,
+    };
+
+static int
+lease_merge_cmp_time(time_t a, time_t b)
+{
+  return a > b ? 1 : a < b ? -1 : 0;
+}
+
+int
+lease_merge_compare(const struct lease_element_t *a,
+    const struct lease_element_t *b)
+{
+  int ret;
+
+  if ((ret = lease_merge_cmp_time(a->tstp, b->tstp)))
+    return ret;
+  if ((ret = lease_merge_cmp_time(a->cltt, b->cltt)))
+    return ret;
+  if ((ret = lease_merge_cmp_time(a->ends, b->ends)))
+    return ret;
+
+  if (a->binding_state >= LEASE_BINDING_STATE_MAX
+      || b->binding_state >= LEASE_BINDING_STATE_MAX)
+    return 0;
+
+  return lease_merge_state_rank[a->binding_state]
+      - lease_merge_state_rank[b->binding_state];
+}
+
+static void *
+lease_merge_worker(void *arg)
+{
+  struct lease_merge_t *merge = arg;
+  struct lease_table_t *table;
+  size_t i;
+
+  for (;;)
+    {
+      i = __atomic_fetch_add(&merge->next, 1, __ATOMIC_RELAXED);
+      if (i >= merge->count)
+        break;
+
+      table = lease_parser_reade_file(merge->files[i].path, merge->mode);
+
+      pthread_mutex_lock(&merge->lock);
+      merge->files[i].table = table;
+      merge->files[i].done = 1;
+      pthread_cond_broadcast(&merge->cond);
+      pthread_mutex_unlock(&merge->lock);
+    }
+
+  return NULL;
+}
+
+static struct lease_table_t *
+lease_merge_wait(struct lease_merge_t *merge, size_t i)
+{
+  pthread_mutex_lock(&merge->lock);
+  while (!merge->files[i].done)
+    pthread_cond_wait(&merge->cond, &merge->lock);
+  pthread_mutex_unlock(&merge->lock);
+
+  return merge->files[i].table;
+}
+
+static int
+lease_merge_set_origin(struct lease_merge_t *merge, size_t idx, uint32_t file)
+{
+  uint32_t *tmp;
+  size_t capacity;
+
+  if (idx >= merge->origin_capacity)
+    {
+      capacity = merge->origin_capacity ? merge->origin_capacity * 2 : 1024;
+      while (capacity <= idx)
+        capacity *= 2;
+
+      tmp = realloc(merge->origin, capacity * sizeof(*tmp));
+      if (!tmp)
+        {
+          logg_err("Cannot allocate memory.");
+          return -1;
+        }
+      merge->origin = tmp;
+      merge->origin_capacity = capacity;
+    }
+
+  merge->origin[idx] = file;
+  return 0;
+}
+
+static int
+lease_merge_has_failover(const struct lease_table_t *table, const char *peer)
+{
+  size_t i;
+
+  for (i = 0; i < table->failover_count; i++)
+    {
+      if (!strcmp(table->failover[i].peer, peer))
+        return 1;
+    }
+
+  return 0;
+}
+
+// merge the table of file into merge->table and destroy it
+static int
+lease_merge_table(struct lease_merge_t *merge, struct lease_table_t *src,
+    uint32_t file)
+{
+  struct lease_table_t *dst = merge->table;
+  const struct lease_element_t *lease, *existing;
+  uint32_t fields;
+  size_t i, idx;
+  int take, ret = 0;
+
+  // the strings of the merged records live in the arena of src
+  arena_adopt(&dst->arena, &src->arena);
+
+  lease_table_for_each(lease, src)
+  {
+    existing = lease_table_lookup_by_ip(dst, &lease->ip);
+    if (!existing)
+      {
+        idx = dst->count;
+        if (lease_table_upsert(dst, lease, NULL) < 0
+            || lease_merge_set_origin(merge, idx, file) < 0)
+          {
+            ret = -1;
+            break;
+          }
+        continue;
+      }
+
+    idx = existing - dst->leases;
+    take = lease_merge_compare(lease, existing) > 0;
+
+    fields = lease_element_diff(existing, lease) & ~LEASE_MERGE_FIELDS_IGNORED;
+    if (fields && merge->divergence)
+      {
+        if (take)
+          merge->divergence(lease, file, existing, merge->origin[idx], fields,
+              merge->user);
+        else
+          merge->divergence(existing, merge->origin[idx], lease, file, fields,
+              merge->user);
+      }
+
+    if (take)
+      {
+        if (lease_table_upsert(dst, lease, NULL) < 0)
+          {
+            ret = -1;
+            break;
+          }
+        merge->origin[idx] = file;
+      }
+  }
+
+  // file wide state of the first file that has it
+  if (!dst->server_duid)
+    dst->server_duid = src->server_duid;
+  for (i = 0; ret == 0 && i < src->failover_count; i++)
+    {
+      if (!lease_merge_has_failover(dst, src->failover[i].peer))
+        ret = lease_table_set_failover(dst, &src->failover[i]);
+    }
+
+  lease_table_destroy(src);
+  return ret;
+}
+
+struct lease_table_t *
+lease_merge_files(const char *const *paths, size_t count,
+    enum lease_parser_read_mode_t mode, unsigned int threads,
+    lease_merge_divergence_cb_t divergence, void *user)
+{
+  pthread_t workers[LEASE_MERGE_THREADS_MAX];
+  struct lease_merge_t merge;
+  struct lease_table_t *table;
+  unsigned int started;
+  size_t i;
+  int ret = 0;
+
+  if (!paths || !count)
+    {
+      logg_err("parameter error");
+      return NULL;
+    }
+
+  memset(&merge, 0, sizeof(merge));
+  merge.count = count;
+  merge.mode = mode;
+  merge.divergence = divergence;
+  merge.user = user;
+  pthread_mutex_init(&merge.lock, NULL);
+  pthread_cond_init(&merge.cond, NULL);
+
+  merge.files = calloc(count, sizeof(*merge.files));
+  if (!merge.files)
+    {
+      logg_err("Cannot allocate memory.");
+      goto error_end;
+    }
+  for (i = 0; i < count; i++)
+    merge.files[i].path = paths[i];
+
+  if (!threads || threads > count)
+    threads = count;
+  if (threads > LEASE_MERGE_THREADS_MAX)
+    threads = LEASE_MERGE_THREADS_MAX;
+
+  for (started = 0; started < threads; started++)
+    {
+      if (pthread_create(&workers[started], NULL, lease_merge_worker, &merge))
+        break;
+    }
+
+  if (!started)
+    {
+      logg_err("can't create parser thread");
+      goto error_end;
+    }
+
+  // merge in file order while the later files are still parsed
+  for (i = 0; i < count; i++)
+    {
+      table = lease_merge_wait(&merge, i);
+      merge.files[i].table = NULL;
+
+      if (!table)
+        {
+          logg_err("can't read file %s", paths[i]);
+          ret = -1;
+        }
+      else if (!merge.table)
+        {
+          merge.table = table;
+          if (table->count && lease_merge_set_origin(&merge, table->count - 1,
+              0) < 0)
+            ret = -1;
+          else if (table->count)
+            memset(merge.origin, 0, table->count * sizeof(*merge.origin));
+        }
+      else
+        ret = lease_merge_table(&merge, table, i);
+
+      if (ret < 0)
+        {
+          // no new files for the threads
+          __atomic_store_n(&merge.next, count, __ATOMIC_RELAXED);
+          break;
+        }
+    }
+
+  for (i = 0; i < started; i++)
+    pthread_join(workers[i], NULL);
+
+  // tables parsed after an error
+  for (i = 0; i < count; i++)
+    lease_table_destroy(merge.files[i].table);
+
+  if (ret < 0)
+    {
+      lease_table_destroy(merge.table);
+      merge.table = NULL;
+    }
+
+  error_end:
+  free(merge.origin);
+  free(merge.files);
+  pthread_mutex_destroy(&merge.lock);
+  pthread_cond_destroy(&merge.cond);
+  return merge.table;
+}
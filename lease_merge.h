@@ -0,0 +1,60 @@
+/*
+ * lease_merge.h
+ *
+ */
+
+#ifndef _LEASE_MERGE_H_
+#define _LEASE_MERGE_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "lease.h"
+#include "lease_parser.h"
+#include "lease_table.h"
+
+#define LEASE_MERGE_THREADS_MAX         64
+
+// fields that differ between failover peers by design, not reported
+#define LEASE_MERGE_FIELDS_IGNORED      (LEASE_FIELD_TSTP | LEASE_FIELD_TSFP \
+                                         | LEASE_FIELD_ATSFP)
+
+/**
+ *
+ * \brief one view of the lease files of several servers
+ *
+ * Every file is parsed into a table of its own, by up to one thread per
+ * file, and the tables are merged in the order of the files while later
+ * ones are still being parsed. Of two leases for the same address the
+ * more recent one is kept: the later tstp, then cltt, then ends, and on
+ * a tie the binding state that holds on to the address (active before
+ * expired before free, see lease_merge_compare()). On a complete tie
+ * the earlier file wins.
+ *
+ * Whenever the two leases differ in more than LEASE_MERGE_FIELDS_IGNORED
+ * the divergence callback gets both, the kept one first, with the
+ * indexes of their files and the differing LEASE_FIELD_* bits.
+ *
+ * const char *paths[] = { "peer1.leases", "peer2.leases" };
+ *
+ * table = lease_merge_files(paths, 2, LEASE_PARSER_READ_MODE_MMAP, 0,
+ *     Report_divergence, NULL);
+ */
+
+typedef void (*lease_merge_divergence_cb_t)(const struct lease_element_t *kept,
+    size_t kept_file, const struct lease_element_t *other, size_t other_file,
+    uint32_t fields, void *user);
+
+// > 0 if a is more recent than b, < 0 if b is, 0 if neither
+int lease_merge_compare(const struct lease_element_t *a,
+    const struct lease_element_t *b);
+
+/*
+ * threads == 0 uses one thread per file (at most LEASE_MERGE_THREADS_MAX).
+ * NULL if any of the files can't be parsed.
+ */
+struct lease_table_t *lease_merge_files(const char *const *paths,
+    size_t count, enum lease_parser_read_mode_t mode, unsigned int threads,
+    lease_merge_divergence_cb_t divergence, void *user);
+
+#endif /* _LEASE_MERGE_H_ */
@@ -0,0 +1,652 @@
+#define _GNU_SOURCE
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <poll.h>
+#include <pthread.h>
+#include <time.h>
+#include <unistd.h>
+#include <netdb.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <sys/un.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#include "lease_metrics.h"
+#include "log.h"
+#include "toolbox.h"
+
+#define ARRAYSIZE(n) (sizeof(n)/sizeof(n[0]))
+
+// how long a client gets to send its request before plain text is sent
+#define LEASE_METRICS_REQUEST_MS        100
+
+static const struct
+{
+  const char *name;
+  const char *help;
+} lease_metrics_counters[] =
+    {
+        [LEASE_METRIC_BYTES_READ] =
+            { "lease_parser_bytes_read_total", "Bytes of lease files read." },
+        [LEASE_METRIC_LINES] =
+            { "lease_parser_lines_total", "Lines of lease files read." },
+        [LEASE_METRIC_LEASE_BLOCKS] =
+            { "lease_parser_lease_blocks_total", "Lease blocks parsed." },
+        [LEASE_METRIC_UNKNOWN_STATEMENTS] =
+            { "lease_parser_unknown_statements_total",
+                "Statements in lease blocks the parser does not store." },
+        [LEASE_METRIC_ALLOCATIONS] =
+            { "lease_parser_allocations_total",
+                "Arena chunks, string pools, tables and indexes allocated." },
+    };
+
+static const char *lease_metrics_stage_names[] =
+    {
+        [LEASE_METRICS_STAGE_READ] = "read",
+        [LEASE_METRICS_STAGE_LOCK] = "lock",
+        [LEASE_METRICS_STAGE_PARSE] = "parse",
+        [LEASE_METRICS_STAGE_TEARDOWN] = "teardown",
+    };
+
+// upper bounds of the finite buckets in ns and as printed
+static const uint64_t lease_metrics_bounds[LEASE_METRICS_BUCKETS - 1] =
+    { 100000, 1000000, 10000000, 100000000, 1000000000, 10000000000 };
+static const char *lease_metrics_bound_names[LEASE_METRICS_BUCKETS] =
+    { "0.0001", "0.001", "0.01", "0.1", "1", "10", "+Inf" };
+
+int lease_metrics_enabled;
+__thread struct lease_metrics_slot_t *lease_metrics_self;
+
+static struct lease_metrics_slot_t lease_metrics_slots[LEASE_METRICS_THREADS_MAX];
+static struct lease_metrics_slot_t lease_metrics_overflow = { .shared = 1 };
+// counts of threads that exited
+static struct lease_metrics_slot_t lease_metrics_retired;
+static pthread_mutex_t lease_metrics_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_once_t lease_metrics_once = PTHREAD_ONCE_INIT;
+static pthread_key_t lease_metrics_key;
+
+static struct
+{
+  int fd;
+  int stop;
+  char *unix_path;
+  pthread_t thread;
+} lease_metrics_server = { .fd = -1 };
+
+void
+lease_metrics_enable(int enable)
+{
+  lease_metrics_enabled = enable;
+}
+
+static uint64_t
+lease_metrics_load(const uint64_t *counter)
+{
+  return __atomic_load_n(counter, __ATOMIC_RELAXED);
+}
+
+// add the counts of src to dst, which is not shared
+static void
+lease_metrics_fold(struct lease_metrics_slot_t *dst,
+    const struct lease_metrics_slot_t *src)
+{
+  const struct lease_metrics_keyword_t *keyword;
+  uint64_t count;
+  int i, j;
+
+  for (i = 0; i < LEASE_METRIC_MAX; i++)
+    dst->counters[i] += lease_metrics_load(&src->counters[i]);
+
+  for (i = 0; i < LEASE_PARSER_ERROR_MAX; i++)
+    dst->errors[i] += lease_metrics_load(&src->errors[i]);
+
+  for (i = 0; i < LEASE_METRICS_STAGE_MAX; i++)
+    {
+      dst->stage_ns[i] += lease_metrics_load(&src->stage_ns[i]);
+      for (j = 0; j < LEASE_METRICS_BUCKETS; j++)
+        dst->buckets[i][j] += lease_metrics_load(&src->buckets[i][j]);
+    }
+
+  for (i = 0; i < LEASE_METRICS_KEYWORDS_MAX; i++)
+    {
+      keyword = &src->keywords[i];
+      // the name is complete once the count is set
+      count = __atomic_load_n(&keyword->count, __ATOMIC_ACQUIRE);
+      if (!count)
+        break;
+
+      for (j = 0; j < LEASE_METRICS_KEYWORDS_MAX; j++)
+        {
+          if (!dst->keywords[j].count)
+            memcpy(dst->keywords[j].name, keyword->name, sizeof(keyword->name));
+          if (!strcmp(dst->keywords[j].name, keyword->name))
+            {
+              dst->keywords[j].count += count;
+              break;
+            }
+        }
+    }
+}
+
+static void
+lease_metrics_retire(void *arg)
+{
+  struct lease_metrics_slot_t *slot = arg;
+
+  pthread_mutex_lock(&lease_metrics_lock);
+  lease_metrics_fold(&lease_metrics_retired, slot);
+  memset(slot, 0, sizeof(*slot));
+  pthread_mutex_unlock(&lease_metrics_lock);
+}
+
+static void
+lease_metrics_key_create(void)
+{
+  pthread_key_create(&lease_metrics_key, lease_metrics_retire);
+}
+
+struct lease_metrics_slot_t *
+lease_metrics_slot(void)
+{
+  struct lease_metrics_slot_t *slot = &lease_metrics_overflow;
+  int i;
+
+  if (lease_metrics_self)
+    return lease_metrics_self;
+
+  pthread_once(&lease_metrics_once, lease_metrics_key_create);
+
+  pthread_mutex_lock(&lease_metrics_lock);
+  for (i = 0; i < LEASE_METRICS_THREADS_MAX; i++)
+    {
+      if (!lease_metrics_slots[i].in_use)
+        {
+          slot = &lease_metrics_slots[i];
+          slot->in_use = 1;
+          break;
+        }
+    }
+  pthread_mutex_unlock(&lease_metrics_lock);
+
+  if (slot != &lease_metrics_overflow)
+    pthread_setspecific(lease_metrics_key, slot);
+
+  lease_metrics_self = slot;
+  return slot;
+}
+
+uint64_t
+lease_metrics_clock(void)
+{
+  struct timespec ts;
+
+  if (!lease_metrics_enabled)
+    return 0;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+void
+lease_metrics_observe_ns(enum lease_metrics_stage_t stage, uint64_t ns)
+{
+  struct lease_metrics_slot_t *slot;
+  int i;
+
+  if (!lease_metrics_enabled)
+    return;
+
+  for (i = 0; i < LEASE_METRICS_BUCKETS - 1; i++)
+    {
+      if (ns <= lease_metrics_bounds[i])
+        break;
+    }
+
+  slot = lease_metrics_slot();
+  lease_metrics_bump(slot, &slot->buckets[stage][i], 1);
+  lease_metrics_bump(slot, &slot->stage_ns[stage], ns);
+}
+
+void
+lease_metrics_observe(enum lease_metrics_stage_t stage, uint64_t start)
+{
+  if (lease_metrics_enabled && start)
+    lease_metrics_observe_ns(stage, lease_metrics_clock() - start);
+}
+
+void
+lease_metrics_unknown(const char *keyword, size_t len)
+{
+  struct lease_metrics_slot_t *slot;
+  struct lease_metrics_keyword_t *entry;
+  int i;
+
+  if (!lease_metrics_enabled)
+    return;
+
+  slot = lease_metrics_slot();
+  lease_metrics_bump(slot, &slot->counters[LEASE_METRIC_UNKNOWN_STATEMENTS], 1);
+
+  // names are only kept by slots with a single writer
+  if (slot->shared)
+    return;
+
+  if (len >= LEASE_METRICS_KEYWORD_LEN)
+    len = LEASE_METRICS_KEYWORD_LEN - 1;
+
+  for (i = 0; i < LEASE_METRICS_KEYWORDS_MAX; i++)
+    {
+      entry = &slot->keywords[i];
+
+      if (!entry->count)
+        {
+          memcpy(entry->name, keyword, len);
+          entry->name[len] = '\0';
+          __atomic_store_n(&entry->count, 1, __ATOMIC_RELEASE);
+          return;
+        }
+
+      if (!strncmp(entry->name, keyword, len) && !entry->name[len])
+        {
+          lease_metrics_bump(slot, &entry->count, 1);
+          return;
+        }
+    }
+}
+
+// a line is ~25 bytes, so a memchr() per line would cost more than this
+void
+lease_metrics_count_lines(const char *buf, size_t len)
+{
+  uint64_t lines = 0;
+  size_t i = 0;
+
+  if (!lease_metrics_enabled)
+    return;
+
+#ifdef __SSE2__
+  const __m128i newline = _mm_set1_epi8('\n');
+  __m128i acc, sum;
+  size_t j;
+
+  // per byte counters, summed up before they can wrap at 255
+  while (i + 16 <= len)
+    {
+      acc = _mm_setzero_si128();
+      for (j = 0; j < 255 && i + 16 <= len; j++, i += 16)
+        acc = _mm_sub_epi8(acc, _mm_cmpeq_epi8(
+            _mm_loadu_si128((const __m128i *) (buf + i)), newline));
+
+      sum = _mm_sad_epu8(acc, _mm_setzero_si128());
+      lines += _mm_cvtsi128_si32(sum) + _mm_extract_epi16(sum, 4);
+    }
+#endif
+
+  for (; i < len; i++)
+    lines += buf[i] == '\n';
+
+  lease_metrics_add(LEASE_METRIC_LINES, lines);
+}
+
+static void
+lease_metrics_sum(struct lease_metrics_slot_t *total)
+{
+  int i;
+
+  memset(total, 0, sizeof(*total));
+
+  pthread_mutex_lock(&lease_metrics_lock);
+  lease_metrics_fold(total, &lease_metrics_retired);
+  lease_metrics_fold(total, &lease_metrics_overflow);
+  for (i = 0; i < LEASE_METRICS_THREADS_MAX; i++)
+    {
+      if (lease_metrics_slots[i].in_use)
+        lease_metrics_fold(total, &lease_metrics_slots[i]);
+    }
+  pthread_mutex_unlock(&lease_metrics_lock);
+}
+
+static void
+lease_metrics_print_label(FILE *fp, const char *value)
+{
+  for (; *value; value++)
+    {
+      if (*value == '\\' || *value == '"')
+        fputc('\\', fp);
+      if (*value == '\n')
+        fputs("\\n", fp);
+      else
+        fputc(*value, fp);
+    }
+}
+
+static void
+lease_metrics_print_header(FILE *fp, const char *name, const char *type,
+    const char *help)
+{
+  fprintf(fp, "# HELP %s %s\n# TYPE %s %s\n", name, help, name, type);
+}
+
+void
+lease_metrics_print(FILE *fp)
+{
+  struct lease_metrics_slot_t total;
+  struct toolbox_lock_stats_t lock;
+  uint64_t cumulative;
+  int i, j;
+
+  lease_metrics_sum(&total);
+  toolbox_lock_stats(&lock);
+
+  for (i = 0; i < LEASE_METRIC_MAX; i++)
+    {
+      lease_metrics_print_header(fp, lease_metrics_counters[i].name, "counter",
+          lease_metrics_counters[i].help);
+      fprintf(fp, "%s %llu\n", lease_metrics_counters[i].name,
+          (unsigned long long) total.counters[i]);
+    }
+
+  lease_metrics_print_header(fp, "lease_parser_unknown_keyword_total",
+      "counter", "Unknown statements by first word.");
+  for (i = 0; i < LEASE_METRICS_KEYWORDS_MAX && total.keywords[i].count; i++)
+    {
+      fputs("lease_parser_unknown_keyword_total{keyword=\"", fp);
+      lease_metrics_print_label(fp, total.keywords[i].name);
+      fprintf(fp, "\"} %llu\n", (unsigned long long) total.keywords[i].count);
+    }
+
+  lease_metrics_print_header(fp, "lease_parser_errors_total", "counter",
+      "Damage in lease files the parser recovered from, by kind.");
+  for (i = 0; i < LEASE_PARSER_ERROR_MAX; i++)
+    fprintf(fp, "lease_parser_errors_total{error=\"%s\"} %llu\n",
+        lease_parser_error_2_str(i), (unsigned long long) total.errors[i]);
+
+  lease_metrics_print_header(fp, "lease_parser_stage_seconds", "histogram",
+      "Time spent per stage of reading a lease file.");
+  for (i = 0; i < LEASE_METRICS_STAGE_MAX; i++)
+    {
+      for (j = 0, cumulative = 0; j < LEASE_METRICS_BUCKETS; j++)
+        {
+          cumulative += total.buckets[i][j];
+          fprintf(fp, "lease_parser_stage_seconds_bucket{stage=\"%s\",le=\"%s\"} %llu\n",
+              lease_metrics_stage_names[i], lease_metrics_bound_names[j],
+              (unsigned long long) cumulative);
+        }
+      fprintf(fp, "lease_parser_stage_seconds_sum{stage=\"%s\"} %.9f\n",
+          lease_metrics_stage_names[i], total.stage_ns[i] / 1e9);
+      fprintf(fp, "lease_parser_stage_seconds_count{stage=\"%s\"} %llu\n",
+          lease_metrics_stage_names[i], (unsigned long long) cumulative);
+    }
+
+  lease_metrics_print_header(fp, "lease_parser_lock_acquired_total", "counter",
+      "File locks acquired.");
+  fprintf(fp, "lease_parser_lock_acquired_total %llu\n",
+      (unsigned long long) lock.acquired);
+  lease_metrics_print_header(fp, "lease_parser_lock_wait_seconds_total",
+      "counter", "Time spent waiting for file locks.");
+  fprintf(fp, "lease_parser_lock_wait_seconds_total %.9f\n",
+      lock.wait_ns / 1e9);
+  lease_metrics_print_header(fp, "lease_parser_lock_wait_max_seconds", "gauge",
+      "Longest wait for a file lock.");
+  fprintf(fp, "lease_parser_lock_wait_max_seconds %.9f\n",
+      lock.max_wait_ns / 1e9);
+  lease_metrics_print_header(fp, "lease_parser_lock_retries_total", "counter",
+      "Lockless reads retried because the file changed.");
+  fprintf(fp, "lease_parser_lock_retries_total %llu\n",
+      (unsigned long long) lock.retries);
+  lease_metrics_print_header(fp, "lease_parser_lock_copied_bytes_total",
+      "counter", "Bytes copied while holding the lock in copy mode.");
+  fprintf(fp, "lease_parser_lock_copied_bytes_total %llu\n",
+      (unsigned long long) lock.copied_bytes);
+}
+
+int
+lease_metrics_save(const char *path)
+{
+  char *tmp_path;
+  FILE *fp;
+  int fd, ret = -1;
+
+  if (asprintf(&tmp_path, "%s.XXXXXX", path) < 0)
+    {
+      logg_err("Cannot allocate memory.");
+      return -1;
+    }
+
+  fd = mkstemp(tmp_path);
+  if (fd < 0 || !(fp = fdopen(fd, "w")))
+    {
+      logg_err("can't create %s (%s)", tmp_path, strerror(errno));
+      if (fd >= 0)
+        {
+          close(fd);
+          unlink(tmp_path);
+        }
+      free(tmp_path);
+      return -1;
+    }
+
+  // readable by a node exporter textfile collector
+  fchmod(fd, 0644);
+  lease_metrics_print(fp);
+
+  if (fclose(fp) || rename(tmp_path, path) < 0)
+    {
+      logg_err("can't write %s (%s)", path, strerror(errno));
+      unlink(tmp_path);
+    }
+  else
+    ret = 0;
+
+  free(tmp_path);
+  return ret;
+}
+
+/*
+ * server
+ */
+
+static void
+lease_metrics_respond(int fd)
+{
+  struct pollfd pfd = { .fd = fd, .events = POLLIN };
+  struct iovec iov[2];
+  char request[1024], header[160];
+  char *body = NULL;
+  size_t body_len = 0;
+  ssize_t n = 0;
+  FILE *fp;
+
+  // an HTTP client sends a request first, a plain socket client nothing
+  if (poll(&pfd, 1, LEASE_METRICS_REQUEST_MS) > 0)
+    n = read(fd, request, sizeof(request));
+
+  fp = open_memstream(&body, &body_len);
+  if (!fp)
+    return;
+  lease_metrics_print(fp);
+  if (fclose(fp))
+    {
+      free(body);
+      return;
+    }
+
+  iov[0].iov_base = header;
+  iov[0].iov_len = 0;
+  if (n >= 4 && !memcmp(request, "GET ", 4))
+    iov[0].iov_len = snprintf(header, sizeof(header), "HTTP/1.0 200 OK\r\n"
+        "Content-Type: text/plain; version=0.0.4\r\n"
+        "Content-Length: %zu\r\nConnection: close\r\n\r\n", body_len);
+  iov[1].iov_base = body;
+  iov[1].iov_len = body_len;
+
+  // best effort, the client reconnects on the next scrape
+  if (writev(fd, iov, 2) < 0)
+    logg(LOG_DEBUG, "metrics client: %s", strerror(errno));
+  free(body);
+}
+
+static void *
+lease_metrics_accept(void *arg)
+{
+  int fd;
+
+  while (!__atomic_load_n(&lease_metrics_server.stop, __ATOMIC_ACQUIRE))
+    {
+      fd = accept4(lease_metrics_server.fd, NULL, NULL, SOCK_CLOEXEC);
+      if (fd < 0)
+        {
+          if (errno == EINTR || errno == ECONNABORTED)
+            continue;
+          break;
+        }
+
+      lease_metrics_respond(fd);
+      close(fd);
+    }
+
+  return NULL;
+}
+
+static int
+lease_metrics_listen_unix(const char *path)
+{
+  struct sockaddr_un addr;
+  int fd;
+
+  if (strlen(path) >= sizeof(addr.sun_path))
+    {
+      logg_err("socket path too long: %s", path);
+      return -1;
+    }
+
+  memset(&addr, 0, sizeof(addr));
+  addr.sun_family = AF_UNIX;
+  strcpy(addr.sun_path, path);
+
+  fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+  if (fd < 0)
+    return -1;
+
+  // a socket left behind by an earlier run
+  unlink(path);
+  if (bind(fd, (struct sockaddr *) &addr, sizeof(addr)) < 0)
+    {
+      close(fd);
+      return -1;
+    }
+
+  lease_metrics_server.unix_path = strdup(path);
+  return fd;
+}
+
+static int
+lease_metrics_listen_tcp(const char *address)
+{
+  struct addrinfo hints, *res, *ai;
+  const char *colon = strrchr(address, ':');
+  char host[64] = "127.0.0.1";
+  int fd = -1, one = 1, ret;
+
+  if (colon)
+    {
+      if (colon - address >= sizeof(host))
+        return -1;
+      memcpy(host, address, colon - address);
+      host[colon - address] = '\0';
+      address = colon + 1;
+    }
+
+  memset(&hints, 0, sizeof(hints));
+  hints.ai_family = AF_UNSPEC;
+  hints.ai_socktype = SOCK_STREAM;
+  hints.ai_flags = AI_PASSIVE | AI_NUMERICSERV;
+
+  ret = getaddrinfo(host, address, &hints, &res);
+  if (ret)
+    {
+      logg_err("invalid address %s:%s (%s)", host, address, gai_strerror(ret));
+      return -1;
+    }
+
+  for (ai = res; ai; ai = ai->ai_next)
+    {
+      fd = socket(ai->ai_family, ai->ai_socktype | SOCK_CLOEXEC,
+          ai->ai_protocol);
+      if (fd < 0)
+        continue;
+
+      setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+      if (bind(fd, ai->ai_addr, ai->ai_addrlen) == 0)
+        break;
+
+      close(fd);
+      fd = -1;
+    }
+
+  freeaddrinfo(res);
+  return fd;
+}
+
+int
+lease_metrics_serve(const char *address)
+{
+  int fd;
+
+  if (lease_metrics_server.fd >= 0)
+    return -1;
+
+  if (!strncmp(address, "unix:", 5))
+    fd = lease_metrics_listen_unix(address + 5);
+  else
+    fd = lease_metrics_listen_tcp(address);
+
+  if (fd < 0 || listen(fd, 16) < 0)
+    {
+      logg_err("can't listen on %s (%s)", address, strerror(errno));
+      if (fd >= 0)
+        close(fd);
+      return -1;
+    }
+
+  lease_metrics_server.fd = fd;
+  lease_metrics_server.stop = 0;
+  if (pthread_create(&lease_metrics_server.thread, NULL, lease_metrics_accept,
+      NULL))
+    {
+      logg_err("can't start the metrics server");
+      lease_metrics_serve_stop();
+      return -1;
+    }
+
+  return 0;
+}
+
+void
+lease_metrics_serve_stop(void)
+{
+  if (lease_metrics_server.fd < 0)
+    return;
+
+  __atomic_store_n(&lease_metrics_server.stop, 1, __ATOMIC_RELEASE);
+  // wakes accept()
+  shutdown(lease_metrics_server.fd, SHUT_RDWR);
+  if (lease_metrics_server.thread)
+    pthread_join(lease_metrics_server.thread, NULL);
+
+  close(lease_metrics_server.fd);
+  lease_metrics_server.fd = -1;
+  lease_metrics_server.thread = 0;
+
+  if (lease_metrics_server.unix_path)
+    {
+      unlink(lease_metrics_server.unix_path);
+      free(lease_metrics_server.unix_path);
+      lease_metrics_server.unix_path = NULL;
+    }
+}
@@ -0,0 +1,147 @@
+/*
+ * lease_metrics.h
+ *
+ */
+
+#ifndef _LEASE_METRICS_H_
+#define _LEASE_METRICS_H_
+
+#include <stdio.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "liblease_parser.h"
+
+#define LEASE_METRICS_CACHE_LINE        64
+// threads with a slot of their own, later ones share one
+#define LEASE_METRICS_THREADS_MAX       64
+// distinct unknown statement names counted per thread
+#define LEASE_METRICS_KEYWORDS_MAX      16
+#define LEASE_METRICS_KEYWORD_LEN       32
+// stage histogram buckets: 100us, 1ms, ... 10s and +Inf
+#define LEASE_METRICS_BUCKETS           7
+
+enum lease_metric_t
+{
+  LEASE_METRIC_BYTES_READ,
+  LEASE_METRIC_LINES,
+  LEASE_METRIC_LEASE_BLOCKS,
+  LEASE_METRIC_UNKNOWN_STATEMENTS,
+  LEASE_METRIC_ALLOCATIONS,
+  LEASE_METRIC_MAX,
+};
+
+enum lease_metrics_stage_t
+{
+  LEASE_METRICS_STAGE_READ,
+  LEASE_METRICS_STAGE_LOCK,
+  LEASE_METRICS_STAGE_PARSE,
+  LEASE_METRICS_STAGE_TEARDOWN,
+  LEASE_METRICS_STAGE_MAX,
+};
+
+/**
+ *
+ * \brief parser counters and stage timings
+ *
+ * Every thread that counts something gets a slot of its own, aligned to
+ * a cache line, and updates it with plain loads and stores: no atomic
+ * read-modify-write and no cache line shared between parser threads.
+ * Readers sum the slots; when a thread exits, its counts are folded
+ * into a retired slot so the totals stay monotonic.
+ *
+ * Nothing is counted until lease_metrics_enable(), a disabled counter
+ * costs one predictable branch.
+ *
+ * The totals are written in the Prometheus text format, to a file or
+ * to clients of a unix or TCP socket (a minimal HTTP/1.0 responder, so
+ * a Prometheus server can scrape it directly).
+ *
+ * lease_metrics_enable(1);
+ * lease_metrics_serve("127.0.0.1:9267");
+ * start = lease_metrics_clock();
+ * Parse_something();
+ * lease_metrics_observe(LEASE_METRICS_STAGE_PARSE, start);
+ */
+
+struct lease_metrics_keyword_t
+{
+  char name[LEASE_METRICS_KEYWORD_LEN];
+  uint64_t count;
+};
+
+struct lease_metrics_slot_t
+{
+  uint64_t counters[LEASE_METRIC_MAX];
+  uint64_t buckets[LEASE_METRICS_STAGE_MAX][LEASE_METRICS_BUCKETS];
+  uint64_t stage_ns[LEASE_METRICS_STAGE_MAX];
+  struct lease_metrics_keyword_t keywords[LEASE_METRICS_KEYWORDS_MAX];
+  uint64_t errors[LEASE_PARSER_ERROR_MAX];
+  // used by more than one thread, updated atomically
+  int shared;
+  int in_use;
+} __attribute__((aligned(LEASE_METRICS_CACHE_LINE)));
+
+extern int lease_metrics_enabled;
+extern __thread struct lease_metrics_slot_t *lease_metrics_self;
+
+void lease_metrics_enable(int enable);
+// slot of the calling thread, assigned on first use
+struct lease_metrics_slot_t *lease_metrics_slot(void);
+
+static inline void
+lease_metrics_bump(struct lease_metrics_slot_t *slot, uint64_t *counter,
+    uint64_t n)
+{
+  if (slot->shared)
+    __atomic_fetch_add(counter, n, __ATOMIC_RELAXED);
+  else
+    __atomic_store_n(counter, *counter + n, __ATOMIC_RELAXED);
+}
+
+static inline void
+lease_metrics_add(enum lease_metric_t metric, uint64_t n)
+{
+  struct lease_metrics_slot_t *slot;
+
+  if (!lease_metrics_enabled)
+    return;
+
+  slot = lease_metrics_self ? lease_metrics_self : lease_metrics_slot();
+  lease_metrics_bump(slot, &slot->counters[metric], n);
+}
+
+static inline void
+lease_metrics_error(enum lease_parser_error_t error)
+{
+  struct lease_metrics_slot_t *slot;
+
+  if (!lease_metrics_enabled)
+    return;
+
+  slot = lease_metrics_self ? lease_metrics_self : lease_metrics_slot();
+  lease_metrics_bump(slot, &slot->errors[error], 1);
+}
+
+// monotonic nanoseconds, 0 while disabled
+uint64_t lease_metrics_clock(void);
+// account the time since start (from lease_metrics_clock()) to stage
+void lease_metrics_observe(enum lease_metrics_stage_t stage, uint64_t start);
+void lease_metrics_observe_ns(enum lease_metrics_stage_t stage, uint64_t ns);
+// count an unknown statement by its first word
+void lease_metrics_unknown(const char *keyword, size_t len);
+// number of '\n' in buf, if enabled
+void lease_metrics_count_lines(const char *buf, size_t len);
+
+void lease_metrics_print(FILE *fp);
+// write to a temporary file renamed to path
+int lease_metrics_save(const char *path);
+
+/*
+ * answer every connection to "unix:/path" or "[host:]port" with the
+ * metrics, from a thread of its own. host defaults to 127.0.0.1.
+ */
+int lease_metrics_serve(const char *address);
+void lease_metrics_serve_stop(void);
+
+#endif /* _LEASE_METRICS_H_ */
@@ -0,0 +1,1952 @@
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <unistd.h>
+#include <errno.h>
+#include <stdint.h>
+#include <pthread.h>
+
+#include "lease.h"
+#include "lease_lexer.h"
+#include "lease_metrics.h"
+#include "lease_parser.h"
+#include "lease_table.h"
+#include "lease_time.h"
+#include "log.h"
+#include "toolbox.h"
+
+#define LEASE_PARSER_CHUNK_SIZE   (64 * 1024)
+#define LEASE_PARSER_CHUNK_MAX    (16 * 1024 * 1024)
+#define LEASE_PARSER_WORDS_MAX    16
+#define LEASE_PARSER_RANGE_MIN    (1024 * 1024)
+#define LEASE_PARSER_THREADS_MAX  64
+#define LEASE_PARSER_DEPTH_MAX    16
+// errors logged per parse, later ones are only counted
+#define LEASE_PARSER_ERRORS_LOGGED 16
+// bytes of the damaged input quoted in an error message
+#define LEASE_PARSER_ERROR_QUOTE  64
+
+enum lease_element_value_type_t
+{
+  ELEMENT_VALUE_TYPE_TIME,
+  ELEMENT_VALUE_TYPE_STRING,
+  ELEMENT_VALUE_TYPE_INT,
+  ELEMENT_VALUE_TYPE_FLAG,
+  ELEMENT_VALUE_TYPE_PREFIX,
+};
+
+enum lease_element_type_t
+{
+  LEASE_ELEMENT_TYPE_TIME_STARTS,
+  LEASE_ELEMENT_TYPE_TIME_ENDS,
+  LEASE_ELEMENT_TYPE_TIME_TSTP,
+  LEASE_ELEMENT_TYPE_TIME_CLTT,
+  LEASE_ELEMENT_TYPE_TIME_TSFP,
+  LEASE_ELEMENT_TYPE_TIME_ATSFP,
+  LEASE_ELEMENT_TYPE_BINDING_STATE,
+  LEASE_ELEMENT_TYPE_HARDWARE,
+  LEASE_ELEMENT_TYPE_NEXT_BINDING_STATE,
+  LEASE_ELEMENT_TYPE_REWIND_BINDING_STATE,
+  LEASE_ELEMENT_TYPE_CLIENT_HOSTNAME,
+  LEASE_ELEMENT_TYPE_UID,
+  LEASE_ELEMENT_TYPE_BILLING_CLASS,
+  LEASE_ELEMENT_TYPE_VENDOR_CLASS_IDENTIFIER,
+  LEASE_ELEMENT_TYPE_DDNS_FWD_NAME,
+  LEASE_ELEMENT_TYPE_DDNS_REV_NAME,
+  LEASE_ELEMENT_TYPE_DDNS_TXT,
+  LEASE_ELEMENT_TYPE_DDNS_CLIENT_FQDN,
+  LEASE_ELEMENT_TYPE_AGENT_CIRCUIT_ID,
+  LEASE_ELEMENT_TYPE_AGENT_REMOTE_ID,
+  LEASE_ELEMENT_TYPE_AGENT_SUBSCRIBER_ID,
+  LEASE_ELEMENT_TYPE_ABANDONED,
+  LEASE_ELEMENT_TYPE_BOOTP,
+  LEASE_ELEMENT_TYPE_RESERVED,
+  LEASE_ELEMENT_TYPE_SET,
+  LEASE_ELEMENT_TYPE_OPTION,
+};
+
+struct dhcpd_lease_parser
+{
+  const char *element_name;
+  size_t element_name_size;
+  int value_column;
+  enum lease_element_type_t type;
+  enum lease_element_value_type_t value_type;
+  size_t key_size;
+};
+
+#define ARRAYSIZE(n) (sizeof(n)/sizeof(n[0]))
+
+struct lease_element_type_2_str_t
+{
+  enum lease_element_type_t type;
+  const char *str;
+};
+
+struct lease_element_type_2_str_t lease_element_type_2_str_map[] =
+    {
+        {.type = LEASE_ELEMENT_TYPE_TIME_STARTS,          .str = "starts",               },
+        {.type = LEASE_ELEMENT_TYPE_TIME_ENDS,            .str = "ends",                 },
+        {.type = LEASE_ELEMENT_TYPE_TIME_TSTP,            .str = "tstp",                 },
+        {.type = LEASE_ELEMENT_TYPE_TIME_CLTT,            .str = "cltt",                 },
+        {.type = LEASE_ELEMENT_TYPE_TIME_TSFP,            .str = "tsfp",                 },
+        {.type = LEASE_ELEMENT_TYPE_TIME_ATSFP,           .str = "atsfp",                },
+        {.type = LEASE_ELEMENT_TYPE_BINDING_STATE,        .str = "binding state",        },
+        {.type = LEASE_ELEMENT_TYPE_HARDWARE,             .str = "hardware",             },
+        {.type = LEASE_ELEMENT_TYPE_NEXT_BINDING_STATE,   .str = "next binding state",   },
+        {.type = LEASE_ELEMENT_TYPE_REWIND_BINDING_STATE, .str = "rewind binding state", },
+        {.type = LEASE_ELEMENT_TYPE_CLIENT_HOSTNAME,      .str = "client hostname",      },
+        {.type = LEASE_ELEMENT_TYPE_UID,                  .str = "uid",                  },
+        {.type = LEASE_ELEMENT_TYPE_BILLING_CLASS,        .str = "billing class",        },
+        {.type = LEASE_ELEMENT_TYPE_VENDOR_CLASS_IDENTIFIER, .str = "vendor class identifier", },
+        {.type = LEASE_ELEMENT_TYPE_DDNS_FWD_NAME,        .str = "ddns fwd name",        },
+        {.type = LEASE_ELEMENT_TYPE_DDNS_REV_NAME,        .str = "ddns rev name",        },
+        {.type = LEASE_ELEMENT_TYPE_DDNS_TXT,             .str = "ddns txt",             },
+        {.type = LEASE_ELEMENT_TYPE_DDNS_CLIENT_FQDN,     .str = "ddns client fqdn",     },
+        {.type = LEASE_ELEMENT_TYPE_AGENT_CIRCUIT_ID,     .str = "agent circuit id",     },
+        {.type = LEASE_ELEMENT_TYPE_AGENT_REMOTE_ID,      .str = "agent remote id",      },
+        {.type = LEASE_ELEMENT_TYPE_AGENT_SUBSCRIBER_ID,  .str = "agent subscriber id",  },
+        {.type = LEASE_ELEMENT_TYPE_ABANDONED,            .str = "abandoned",            },
+        {.type = LEASE_ELEMENT_TYPE_BOOTP,                .str = "bootp",                },
+        {.type = LEASE_ELEMENT_TYPE_RESERVED,             .str = "reserved",             },
+    };
+
+
+static const char *
+lease_element_type_2_str(enum lease_element_type_t type)
+{
+  int i;
+  for (i = 0; i < ARRAYSIZE(lease_element_type_2_str_map); i++)
+    {
+      if (type == lease_element_type_2_str_map[i].type)
+        return lease_element_type_2_str_map[i].str;
+    }
+
+  return NULL;
+}
+
+/*
+ * value_column = max. 9
+ *
+ * "set" and "option" statements are keyed on their first two words, every
+ * other statement on its first word. Elements are looked up through a
+ * perfect hash built from this table (see lease_parser_keywords_init()),
+ * so unknown statements cost one hash and at most one compare no matter
+ * how many elements are listed.
+ */
+struct dhcpd_lease_parser dhcp_lease_parser_map[] =
+  {
+      { .element_name = "starts",                      .element_name_size = sizeof("starts") -1,                      .value_column = 1, .value_type = ELEMENT_VALUE_TYPE_TIME,   .type = LEASE_ELEMENT_TYPE_TIME_STARTS},
+      { .element_name = "tstp",                        .element_name_size = sizeof("tstp") -1,                        .value_column = 1, .value_type = ELEMENT_VALUE_TYPE_TIME,   .type = LEASE_ELEMENT_TYPE_TIME_TSTP},
+      { .element_name = "ends",                        .element_name_size = sizeof("ends") -1,                        .value_column = 1, .value_type = ELEMENT_VALUE_TYPE_TIME,   .type = LEASE_ELEMENT_TYPE_TIME_ENDS},
+      { .element_name = "cltt",                        .element_name_size = sizeof("cltt") -1,                        .value_column = 1, .value_type = ELEMENT_VALUE_TYPE_TIME,   .type = LEASE_ELEMENT_TYPE_TIME_CLTT},
+      { .element_name = "tsfp",                        .element_name_size = sizeof("tsfp") -1,                        .value_column = 1, .value_type = ELEMENT_VALUE_TYPE_TIME,   .type = LEASE_ELEMENT_TYPE_TIME_TSFP},
+      { .element_name = "atsfp",                       .element_name_size = sizeof("atsfp") -1,                       .value_column = 1, .value_type = ELEMENT_VALUE_TYPE_TIME,   .type = LEASE_ELEMENT_TYPE_TIME_ATSFP},
+      { .element_name = "binding state",               .element_name_size = sizeof("binding state") -1,               .value_column = 2, .value_type = ELEMENT_VALUE_TYPE_STRING, .type = LEASE_ELEMENT_TYPE_BINDING_STATE},
+      { .element_name = "hardware",                    .element_name_size = sizeof("hardware") -1,                    .value_column = 2, .value_type = ELEMENT_VALUE_TYPE_STRING, .type = LEASE_ELEMENT_TYPE_HARDWARE},
+      { .element_name = "next binding state",          .element_name_size = sizeof("next binding state") -1,          .value_column = 3, .value_type = ELEMENT_VALUE_TYPE_STRING, .type = LEASE_ELEMENT_TYPE_NEXT_BINDING_STATE},
+      { .element_name = "rewind binding state",        .element_name_size = sizeof("rewind binding state") -1,        .value_column = 3, .value_type = ELEMENT_VALUE_TYPE_STRING, .type = LEASE_ELEMENT_TYPE_REWIND_BINDING_STATE},
+      { .element_name = "client-hostname",             .element_name_size = sizeof("client-hostname") -1,             .value_column = 1, .value_type = ELEMENT_VALUE_TYPE_STRING, .type = LEASE_ELEMENT_TYPE_CLIENT_HOSTNAME},
+      { .element_name = "uid",                         .element_name_size = sizeof("uid") -1,                         .value_column = 1, .value_type = ELEMENT_VALUE_TYPE_STRING, .type = LEASE_ELEMENT_TYPE_UID},
+      { .element_name = "billing class",               .element_name_size = sizeof("billing class") -1,               .value_column = 2, .value_type = ELEMENT_VALUE_TYPE_STRING, .type = LEASE_ELEMENT_TYPE_BILLING_CLASS},
+      { .element_name = "abandoned",                   .element_name_size = sizeof("abandoned") -1,                   .value_column = 0, .value_type = ELEMENT_VALUE_TYPE_FLAG,   .type = LEASE_ELEMENT_TYPE_ABANDONED},
+      { .element_name = "bootp",                       .element_name_size = sizeof("bootp") -1,                       .value_column = 0, .value_type = ELEMENT_VALUE_TYPE_FLAG,   .type = LEASE_ELEMENT_TYPE_BOOTP},
+      { .element_name = "reserved",                    .element_name_size = sizeof("reserved") -1,                    .value_column = 0, .value_type = ELEMENT_VALUE_TYPE_FLAG,   .type = LEASE_ELEMENT_TYPE_RESERVED},
+      { .element_name = "set",                         .element_name_size = sizeof("set") -1,                         .value_column = 1, .value_type = ELEMENT_VALUE_TYPE_PREFIX, .type = LEASE_ELEMENT_TYPE_SET},
+      { .element_name = "set vendor-class-identifier", .element_name_size = sizeof("set vendor-class-identifier") -1, .value_column = 3, .value_type = ELEMENT_VALUE_TYPE_STRING, .type = LEASE_ELEMENT_TYPE_VENDOR_CLASS_IDENTIFIER},
+      { .element_name = "set ddns-fwd-name",           .element_name_size = sizeof("set ddns-fwd-name") -1,           .value_column = 3, .value_type = ELEMENT_VALUE_TYPE_STRING, .type = LEASE_ELEMENT_TYPE_DDNS_FWD_NAME},
+      { .element_name = "set ddns-rev-name",           .element_name_size = sizeof("set ddns-rev-name") -1,           .value_column = 3, .value_type = ELEMENT_VALUE_TYPE_STRING, .type = LEASE_ELEMENT_TYPE_DDNS_REV_NAME},
+      { .element_name = "set ddns-txt",                .element_name_size = sizeof("set ddns-txt") -1,                .value_column = 3, .value_type = ELEMENT_VALUE_TYPE_STRING, .type = LEASE_ELEMENT_TYPE_DDNS_TXT},
+      { .element_name = "set ddns-client-fqdn",        .element_name_size = sizeof("set ddns-client-fqdn") -1,        .value_column = 3, .value_type = ELEMENT_VALUE_TYPE_STRING, .type = LEASE_ELEMENT_TYPE_DDNS_CLIENT_FQDN},
+      { .element_name = "option",                      .element_name_size = sizeof("option") -1,                      .value_column = 1, .value_type = ELEMENT_VALUE_TYPE_PREFIX, .type = LEASE_ELEMENT_TYPE_OPTION},
+      { .element_name = "option agent.circuit-id",     .element_name_size = sizeof("option agent.circuit-id") -1,     .value_column = 2, .value_type = ELEMENT_VALUE_TYPE_STRING, .type = LEASE_ELEMENT_TYPE_AGENT_CIRCUIT_ID},
+      { .element_name = "option agent.remote-id",      .element_name_size = sizeof("option agent.remote-id") -1,      .value_column = 2, .value_type = ELEMENT_VALUE_TYPE_STRING, .type = LEASE_ELEMENT_TYPE_AGENT_REMOTE_ID},
+      { .element_name = "option agent.subscriber-id",  .element_name_size = sizeof("option agent.subscriber-id") -1,  .value_column = 2, .value_type = ELEMENT_VALUE_TYPE_STRING, .type = LEASE_ELEMENT_TYPE_AGENT_SUBSCRIBER_ID},
+  };
+
+#define LEASE_KEYWORD_SLOTS       256
+
+// slot -> index into dhcp_lease_parser_map + 1, 0 = empty
+static unsigned char lease_keyword_slots[LEASE_KEYWORD_SLOTS];
+static pthread_once_t lease_keyword_once = PTHREAD_ONCE_INIT;
+// 1 once the slots are filled, -1 if LEASE_KEYWORD_SEED collides
+static int lease_keyword_ready;
+
+static uint32_t
+lease_keyword_hash(const char *key, size_t key_size, uint32_t seed)
+{
+  uint32_t h = 2166136261u ^ seed;
+  size_t i;
+
+  for (i = 0; i < key_size; i++)
+    {
+      h ^= (unsigned char) key[i];
+      h *= 16777619u;
+    }
+
+  return (h ^ (h >> 15)) & (LEASE_KEYWORD_SLOTS - 1);
+}
+
+// 0 if seed maps all keys to distinct slots, which are then filled
+static int
+lease_keyword_fill(uint32_t seed, unsigned char *slots)
+{
+  uint32_t slot;
+  int i;
+
+  memset(slots, 0, LEASE_KEYWORD_SLOTS);
+
+  for (i = 0; i < ARRAYSIZE(dhcp_lease_parser_map); i++)
+    {
+      slot = lease_keyword_hash(dhcp_lease_parser_map[i].element_name,
+          dhcp_lease_parser_map[i].key_size, seed);
+
+      if (slots[slot])
+        return -1;
+
+      slots[slot] = i + 1;
+    }
+
+  return 0;
+}
+
+/*
+ * compute the key of every element and fill the slots with
+ * LEASE_KEYWORD_SEED. A seed that collides after the table was changed
+ * fails "make check", which names one that does not.
+ */
+static void
+lease_parser_keywords_build(void)
+{
+  int i;
+
+  for (i = 0; i < ARRAYSIZE(dhcp_lease_parser_map); i++)
+    {
+      struct dhcpd_lease_parser *entry = &dhcp_lease_parser_map[i];
+      const char *space = memchr(entry->element_name, ' ',
+          entry->element_name_size);
+      int j;
+
+      entry->key_size = space ? space - entry->element_name
+          : entry->element_name_size;
+
+      // elements below a prefix ("set x", "option x") keep both words
+      for (j = 0; space && j < ARRAYSIZE(dhcp_lease_parser_map); j++)
+        {
+          if (dhcp_lease_parser_map[j].value_type == ELEMENT_VALUE_TYPE_PREFIX
+              && dhcp_lease_parser_map[j].element_name_size == entry->key_size
+              && !memcmp(dhcp_lease_parser_map[j].element_name,
+                  entry->element_name, entry->key_size))
+            entry->key_size = entry->element_name_size;
+        }
+    }
+
+  if (lease_keyword_fill(LEASE_KEYWORD_SEED, lease_keyword_slots) < 0)
+    {
+      logg_err("LEASE_KEYWORD_SEED %u maps two elements to one slot",
+          LEASE_KEYWORD_SEED);
+      lease_keyword_ready = -1;
+      return;
+    }
+
+  lease_keyword_ready = 1;
+}
+
+// thread safe, the first caller builds the table
+static int
+lease_parser_keywords_init(void)
+{
+  pthread_once(&lease_keyword_once, lease_parser_keywords_build);
+
+  return lease_keyword_ready < 0 ? -1 : 0;
+}
+
+int
+lease_parser_keyword_seed_check(uint32_t seed)
+{
+  unsigned char slots[LEASE_KEYWORD_SLOTS];
+
+  pthread_once(&lease_keyword_once, lease_parser_keywords_build);
+
+  return lease_keyword_fill(seed, slots);
+}
+
+static const struct dhcpd_lease_parser *
+lease_parser_lookup_element(const char *key, size_t key_size)
+{
+  const struct dhcpd_lease_parser *entry;
+  unsigned char idx;
+
+  idx = lease_keyword_slots[lease_keyword_hash(key, key_size,
+      LEASE_KEYWORD_SEED)];
+  if (!idx)
+    return NULL;
+
+  entry = &dhcp_lease_parser_map[idx - 1];
+  if (entry->key_size != key_size || memcmp(entry->element_name, key, key_size))
+    return NULL;
+
+  return entry;
+}
+
+int
+lease_parser_element_type(const char *key, size_t key_size)
+{
+  const struct dhcpd_lease_parser *entry;
+
+  if (lease_parser_keywords_init() < 0)
+    return -1;
+
+  entry = lease_parser_lookup_element(key, key_size);
+  return entry ? entry->type : -1;
+}
+
+enum lease_parser_state_t
+{
+  LEASE_PARSER_STATE_SEARCH_ELEMENT, LEASE_PARSER_STATE_ELEMENT,
+};
+
+/*
+ * kind of an open block. A lease record is collected in a top level
+ * "lease" block or in an iaaddr / iaprefix block directly inside an
+ * ia-na, ia-ta or ia-pd block; everything else nested is skipped.
+ */
+enum lease_parser_block_t
+{
+  LEASE_PARSER_BLOCK_OTHER,
+  LEASE_PARSER_BLOCK_LEASE,
+  LEASE_PARSER_BLOCK_IA,
+  LEASE_PARSER_BLOCK_IAADDR,
+  LEASE_PARSER_BLOCK_FAILOVER,
+};
+
+/*
+ * parser state shared by the mmap and the streaming reader. A statement
+ * is collected as token spans into the (untouched) input buffer and
+ * handled when its ';', '{' or '}' is seen.
+ *
+ * Blocks nest without recursion: blocks[] is a stack of the kinds of
+ * the open blocks, depth its height. Blocks nested deeper than
+ * LEASE_PARSER_DEPTH_MAX are only counted.
+ *
+ * base is the file offset of the buffer passed to lease_parser_feed(),
+ * committed the file offset behind the last complete top level statement
+ * or block. Unless final is set, a trailing incomplete statement is left
+ * unparsed so that it can be picked up by the next refresh.
+ *
+ * dhcpd starts every top level block in the first column. One that
+ * opens while a block is still open ends the broken block, which is
+ * dropped: the parser resynchronises on the next top level line instead
+ * of swallowing every following lease. block_start is the file offset
+ * of the open top level block, for error messages.
+ */
+struct lease_parser_ctx_t
+{
+  enum lease_parser_state_t parser_state;
+  off_t base;
+  off_t committed;
+  int final;
+  int depth;
+  uint8_t blocks[LEASE_PARSER_DEPTH_MAX];
+  // the enclosing ia-na / ia-ta / ia-pd block
+  uint8_t ia_type;
+  const char *ia_id;
+  time_t ia_cltt;
+  struct lease_failover_t failover;
+  struct lease_element_t *lease_element;
+  struct lease_element_t pending;
+  struct lease_table_t *table;
+  const char *buf;
+  struct lease_token_t words[LEASE_PARSER_WORDS_MAX];
+  int word_count;
+  struct lease_time_cache_t time_cache;
+  lease_parser_filter_cb_t filter;
+  void *filter_user;
+  int skip_block;
+  off_t block_start;
+  struct lease_parser_errors_t errors;
+  int errors_logged;
+};
+
+static const char *lease_parser_error_names[] =
+    {
+        [LEASE_PARSER_ERROR_ADDRESS]      = "address",
+        [LEASE_PARSER_ERROR_TIME]         = "time",
+        [LEASE_PARSER_ERROR_HARDWARE]     = "hardware",
+        [LEASE_PARSER_ERROR_BRACE]        = "brace",
+        [LEASE_PARSER_ERROR_UNTERMINATED] = "unterminated",
+        [LEASE_PARSER_ERROR_TRUNCATED]    = "truncated",
+        [LEASE_PARSER_ERROR_TOO_LONG]     = "too_long",
+    };
+
+const char *
+lease_parser_error_2_str(enum lease_parser_error_t error)
+{
+  if (error >= ARRAYSIZE(lease_parser_error_names))
+    return NULL;
+
+  return lease_parser_error_names[error];
+}
+
+/*
+ * count an error at file offset, quoting len bytes of text. Only the
+ * first errors of a parse are logged, a corrupt file must not flood the
+ * log.
+ */
+static void
+lease_parser_error(struct lease_parser_ctx_t *ctx,
+    enum lease_parser_error_t error, off_t offset, const char *text,
+    size_t len)
+{
+  ctx->errors.count[error]++;
+  ctx->errors.offset[error] = offset;
+  lease_metrics_error(error);
+
+  if (ctx->errors_logged > LEASE_PARSER_ERRORS_LOGGED)
+    return;
+
+  if (ctx->errors_logged++ == LEASE_PARSER_ERRORS_LOGGED)
+    {
+      logg(LOG_WARNING, "more parse errors, only counted");
+      return;
+    }
+
+  if (len > LEASE_PARSER_ERROR_QUOTE)
+    len = LEASE_PARSER_ERROR_QUOTE;
+  logg(LOG_WARNING, "parse error at offset %lld (%s)%s%.*s",
+      (long long) offset, lease_parser_error_2_str(error), len ? ": " : "",
+      (int) len, text);
+}
+
+// errors of src added to dst
+static void
+lease_parser_errors_add(struct lease_parser_errors_t *dst,
+    const struct lease_parser_errors_t *src)
+{
+  int i;
+
+  for (i = 0; i < LEASE_PARSER_ERROR_MAX; i++)
+    {
+      if (!src->count[i])
+        continue;
+      dst->count[i] += src->count[i];
+      dst->offset[i] = src->offset[i];
+    }
+}
+
+// forget all open blocks and a lease being parsed
+static void
+lease_parser_reset(struct lease_parser_ctx_t *ctx)
+{
+  ctx->depth = 0;
+  ctx->parser_state = LEASE_PARSER_STATE_SEARCH_ELEMENT;
+  ctx->lease_element = NULL;
+  ctx->ia_type = LEASE_IA_TYPE_NONE;
+  ctx->ia_id = NULL;
+  ctx->ia_cltt = 0;
+  ctx->skip_block = 0;
+}
+
+static int
+lease_parser_word_is(const struct lease_parser_ctx_t *ctx, int word,
+    const char *str, size_t str_size)
+{
+  return word < ctx->word_count && ctx->words[word].length == str_size
+      && !memcmp(ctx->buf + ctx->words[word].offset, str, str_size);
+}
+
+/*
+ * match a (possibly multi word) element name against the start of the
+ * statement; end is the offset of the terminating ';'.
+ */
+static int
+lease_parser_match_element(const struct lease_parser_ctx_t *ctx, size_t end,
+    const struct dhcpd_lease_parser *entry)
+{
+  size_t start = ctx->words[0].offset;
+
+  if (start + entry->element_name_size > end)
+    return 0;
+
+  if (memcmp(ctx->buf + start, entry->element_name, entry->element_name_size))
+    return 0;
+
+  return lease_lexer_is_delim(ctx->buf[start + entry->element_name_size]);
+}
+
+// NULL if out of memory, which fails the parse
+static const char *
+lease_parser_word_intern(struct lease_parser_ctx_t *ctx, int word)
+{
+  const char *str;
+
+  str = lease_table_intern(ctx->table, ctx->buf + ctx->words[word].offset,
+      ctx->words[word].length);
+  if (!str)
+    logg_err("Cannot allocate memory.");
+
+  return str;
+}
+
+static const char *
+lease_parser_word_dup(struct lease_parser_ctx_t *ctx, int word)
+{
+  const char *str;
+
+  str = lease_table_strndup(ctx->table, ctx->buf + ctx->words[word].offset,
+      ctx->words[word].length);
+  if (!str)
+    logg_err("Cannot allocate memory.");
+
+  return str;
+}
+
+static struct lease_element_ext_t *
+lease_parser_element_ext(struct lease_parser_ctx_t *ctx)
+{
+  struct lease_element_t *lease_element = ctx->lease_element;
+
+  if (!lease_element->ext)
+    {
+      lease_element->ext = arena_calloc(&ctx->table->arena,
+          sizeof(*lease_element->ext));
+      if (!lease_element->ext)
+        logg_err("Cannot allocate memory.");
+    }
+
+  return lease_element->ext;
+}
+
+static enum lease_parser_block_t
+lease_parser_block(const struct lease_parser_ctx_t *ctx)
+{
+  if (!ctx->depth || ctx->depth > LEASE_PARSER_DEPTH_MAX)
+    return LEASE_PARSER_BLOCK_OTHER;
+
+  return ctx->blocks[ctx->depth - 1];
+}
+
+// time value starting at word column up to end
+static int
+lease_parser_word_time(struct lease_parser_ctx_t *ctx, int column, size_t end,
+    time_t *out)
+{
+  size_t start;
+
+  if (column >= ctx->word_count)
+    return -1;
+
+  start = ctx->words[column].offset;
+  if (lease_time_parse(ctx->buf + start, end - start, out, &ctx->time_cache) < 0)
+    {
+      lease_parser_error(ctx, LEASE_PARSER_ERROR_TIME, ctx->base + start,
+          ctx->buf + start, end - start);
+      return -1;
+    }
+
+  return 0;
+}
+
+// "lease <ip> {", "iaaddr <ip> {" or "iaprefix <ip>/<len> {"
+static enum lease_parser_block_t
+lease_parser_open_lease(struct lease_parser_ctx_t *ctx,
+    enum lease_parser_block_t type)
+{
+  struct lease_addr_t ip;
+  unsigned int prefix_len;
+
+  if (ctx->word_count < 2 || lease_addr_parse_prefix(ctx->buf
+      + ctx->words[1].offset, ctx->words[1].length, &ip, &prefix_len) < 0)
+    {
+      lease_parser_error(ctx, LEASE_PARSER_ERROR_ADDRESS,
+          ctx->base + ctx->words[0].offset, ctx->buf + ctx->words[0].offset,
+          ctx->words[ctx->word_count - 1].offset
+          + ctx->words[ctx->word_count - 1].length - ctx->words[0].offset);
+      return LEASE_PARSER_BLOCK_OTHER;
+    }
+
+  if (ip.family == AF_INET6 && prefix_len < 128)
+    ip.prefix_len = prefix_len;
+
+  // nothing in the block is parsed or stored
+  if (ctx->filter && !ctx->filter(&ip, ctx->filter_user))
+    {
+      ctx->skip_block = type == LEASE_PARSER_BLOCK_LEASE;
+      return LEASE_PARSER_BLOCK_OTHER;
+    }
+
+  memset(&ctx->pending, 0, sizeof(ctx->pending));
+  ctx->lease_element = &ctx->pending;
+  ctx->lease_element->ip = ip;
+  if (type == LEASE_PARSER_BLOCK_IAADDR)
+    {
+      ctx->lease_element->ia_type = ctx->ia_type;
+      ctx->lease_element->uid = ctx->ia_id;
+      ctx->lease_element->cltt = ctx->ia_cltt;
+    }
+  logg(LOG_DEBUG, "ip: %.*s", (int) ctx->words[1].length,
+      ctx->buf + ctx->words[1].offset);
+
+  ctx->parser_state = LEASE_PARSER_STATE_ELEMENT;
+  return type;
+}
+
+// -1 if out of memory
+static int
+lease_parser_open_top(struct lease_parser_ctx_t *ctx,
+    enum lease_parser_block_t *type)
+{
+  static const char *ia_names[] = { "ia-na", "ia-ta", "ia-pd" };
+  static const uint8_t ia_types[] =
+      { LEASE_IA_TYPE_NA, LEASE_IA_TYPE_TA, LEASE_IA_TYPE_PD };
+  int i;
+
+  *type = LEASE_PARSER_BLOCK_OTHER;
+
+  if (lease_parser_word_is(ctx, 0, "lease", sizeof("lease") - 1))
+    {
+      *type = lease_parser_open_lease(ctx, LEASE_PARSER_BLOCK_LEASE);
+      return 0;
+    }
+
+  // failover peer "name" state {
+  if (lease_parser_word_is(ctx, 0, "failover", sizeof("failover") - 1)
+      && lease_parser_word_is(ctx, 1, "peer", sizeof("peer") - 1)
+      && lease_parser_word_is(ctx, 3, "state", sizeof("state") - 1))
+    {
+      memset(&ctx->failover, 0, sizeof(ctx->failover));
+      ctx->failover.peer = lease_parser_word_intern(ctx, 2);
+      if (!ctx->failover.peer)
+        return -1;
+      *type = LEASE_PARSER_BLOCK_FAILOVER;
+      return 0;
+    }
+
+  for (i = 0; i < ARRAYSIZE(ia_names); i++)
+    {
+      if (lease_parser_word_is(ctx, 0, ia_names[i], strlen(ia_names[i])))
+        {
+          ctx->ia_type = ia_types[i];
+          ctx->ia_id = NULL;
+          if (ctx->word_count > 1
+              && !(ctx->ia_id = lease_parser_word_intern(ctx, 1)))
+            return -1;
+          ctx->ia_cltt = 0;
+          *type = LEASE_PARSER_BLOCK_IA;
+          return 0;
+        }
+    }
+
+  return 0;
+}
+
+// the statement starts in the first column with a top level block name
+static int
+lease_parser_is_top(const struct lease_parser_ctx_t *ctx)
+{
+  size_t start;
+
+  if (!ctx->word_count)
+    return 0;
+
+  start = ctx->words[0].offset;
+
+  // a buffer starts at a statement, which has to do for the first column
+  if (start && ctx->buf[start - 1] != '\n')
+    return 0;
+
+  return lease_parser_word_is(ctx, 0, "lease", sizeof("lease") - 1)
+      || lease_parser_word_is(ctx, 0, "ia-na", sizeof("ia-na") - 1)
+      || lease_parser_word_is(ctx, 0, "ia-ta", sizeof("ia-ta") - 1)
+      || lease_parser_word_is(ctx, 0, "ia-pd", sizeof("ia-pd") - 1)
+      || lease_parser_word_is(ctx, 0, "failover", sizeof("failover") - 1);
+}
+
+static int
+lease_parser_open_block(struct lease_parser_ctx_t *ctx)
+{
+  enum lease_parser_block_t type = LEASE_PARSER_BLOCK_OTHER;
+
+  if (ctx->depth && lease_parser_is_top(ctx))
+    {
+      lease_parser_error(ctx, LEASE_PARSER_ERROR_UNTERMINATED,
+          ctx->block_start, NULL, 0);
+      lease_parser_reset(ctx);
+      // the dropped block is not parsed again by the next refresh
+      ctx->committed = ctx->base + ctx->words[0].offset;
+    }
+
+  if (!ctx->depth)
+    {
+      ctx->block_start = ctx->word_count ? ctx->base + ctx->words[0].offset
+          : ctx->committed;
+      if (lease_parser_open_top(ctx, &type) < 0)
+        return -1;
+    }
+  else if (lease_parser_block(ctx) == LEASE_PARSER_BLOCK_IA
+      && (lease_parser_word_is(ctx, 0, "iaaddr", sizeof("iaaddr") - 1)
+          || lease_parser_word_is(ctx, 0, "iaprefix", sizeof("iaprefix") - 1)))
+    type = lease_parser_open_lease(ctx, LEASE_PARSER_BLOCK_IAADDR);
+
+  if (ctx->depth < LEASE_PARSER_DEPTH_MAX)
+    ctx->blocks[ctx->depth] = type;
+  ctx->depth++;
+
+  return 0;
+}
+
+static int
+lease_parser_commit_lease(struct lease_parser_ctx_t *ctx)
+{
+  if (ctx->parser_state != LEASE_PARSER_STATE_ELEMENT)
+    return 0;
+
+  ctx->parser_state = LEASE_PARSER_STATE_SEARCH_ELEMENT;
+  ctx->lease_element = NULL;
+  lease_metrics_add(LEASE_METRIC_LEASE_BLOCKS, 1);
+
+  // a later block for the same address supersedes the earlier one
+  return lease_table_upsert(ctx->table, &ctx->pending, NULL) < 0 ? -1 : 0;
+}
+
+static int
+lease_parser_close_block(struct lease_parser_ctx_t *ctx)
+{
+  enum lease_parser_block_t type = lease_parser_block(ctx);
+
+  if (!ctx->depth)
+    return 0;
+
+  ctx->depth--;
+
+  switch (type)
+    {
+  case LEASE_PARSER_BLOCK_LEASE:
+  case LEASE_PARSER_BLOCK_IAADDR:
+    return lease_parser_commit_lease(ctx);
+  case LEASE_PARSER_BLOCK_IA:
+    ctx->ia_type = LEASE_IA_TYPE_NONE;
+    ctx->ia_id = NULL;
+    ctx->ia_cltt = 0;
+    return 0;
+  case LEASE_PARSER_BLOCK_FAILOVER:
+    return lease_table_set_failover(ctx->table, &ctx->failover);
+  default:
+    return 0;
+    }
+}
+
+/*
+ * statements outside of lease records: server-duid at the top level,
+ * the cltt of an IA and "my|partner state <state> [at <time>]" of a
+ * failover peer
+ */
+static int
+lease_parser_parse_other(struct lease_parser_ctx_t *ctx, size_t end)
+{
+  const char **state;
+  time_t *when;
+
+  switch (ctx->depth ? lease_parser_block(ctx) : LEASE_PARSER_BLOCK_OTHER)
+    {
+  case LEASE_PARSER_BLOCK_OTHER:
+    if (!ctx->depth && ctx->word_count > 1
+        && lease_parser_word_is(ctx, 0, "server-duid", sizeof("server-duid") - 1))
+      {
+        ctx->table->server_duid = lease_parser_word_intern(ctx, 1);
+        if (!ctx->table->server_duid)
+          return -1;
+      }
+    break;
+  case LEASE_PARSER_BLOCK_IA:
+    if (lease_parser_word_is(ctx, 0, "cltt", sizeof("cltt") - 1))
+      lease_parser_word_time(ctx, 1, end, &ctx->ia_cltt);
+    break;
+  case LEASE_PARSER_BLOCK_FAILOVER:
+    if (!lease_parser_word_is(ctx, 1, "state", sizeof("state") - 1)
+        || ctx->word_count < 3)
+      break;
+
+    if (lease_parser_word_is(ctx, 0, "my", sizeof("my") - 1))
+      {
+        state = &ctx->failover.my_state;
+        when = &ctx->failover.my_time;
+      }
+    else if (lease_parser_word_is(ctx, 0, "partner", sizeof("partner") - 1))
+      {
+        state = &ctx->failover.partner_state;
+        when = &ctx->failover.partner_time;
+      }
+    else
+      break;
+
+    *state = lease_parser_word_intern(ctx, 2);
+    if (!*state)
+      return -1;
+    if (lease_parser_word_is(ctx, 3, "at", sizeof("at") - 1))
+      lease_parser_word_time(ctx, 4, end, when);
+    break;
+  default:
+    break;
+    }
+
+  return 0;
+}
+
+static int
+lease_parser_parse_statement(struct lease_parser_ctx_t *ctx, size_t end)
+{
+  struct lease_element_t *lease_element = ctx->lease_element;
+  const struct dhcpd_lease_parser *entry;
+  int column;
+
+  if (!ctx->word_count)
+    return 0;
+
+  // only direct children of a lease block make up the record
+  if (lease_parser_block(ctx) != LEASE_PARSER_BLOCK_LEASE
+      && lease_parser_block(ctx) != LEASE_PARSER_BLOCK_IAADDR)
+    return lease_parser_parse_other(ctx, end);
+
+  if (ctx->parser_state != LEASE_PARSER_STATE_ELEMENT)
+    return 0;
+
+  entry = lease_parser_lookup_element(ctx->buf + ctx->words[0].offset,
+      ctx->words[0].length);
+
+  if (entry && entry->value_type == ELEMENT_VALUE_TYPE_PREFIX)
+    entry = ctx->word_count < 2 ? NULL : lease_parser_lookup_element(
+        ctx->buf + ctx->words[0].offset,
+        ctx->words[1].offset + ctx->words[1].length - ctx->words[0].offset);
+
+  if (!entry || !lease_parser_match_element(ctx, end, entry))
+    {
+      logg(LOG_DEBUG, "unknown: %.*s", (int) ctx->words[0].length,
+          ctx->buf + ctx->words[0].offset);
+      lease_metrics_unknown(ctx->buf + ctx->words[0].offset,
+          ctx->words[0].length);
+      return 0;
+    }
+
+  column = entry->value_column;
+
+  if (entry->value_type == ELEMENT_VALUE_TYPE_FLAG)
+    {
+      switch (entry->type)
+        {
+      case LEASE_ELEMENT_TYPE_ABANDONED:
+        lease_element->flags |= LEASE_FLAG_ABANDONED;
+        break;
+      case LEASE_ELEMENT_TYPE_BOOTP:
+        lease_element->flags |= LEASE_FLAG_BOOTP;
+        break;
+      case LEASE_ELEMENT_TYPE_RESERVED:
+        lease_element->flags |= LEASE_FLAG_RESERVED;
+        break;
+      default:
+        logg_err("unknown flag element type");
+        break;
+        }
+    }
+  else if (entry->value_type == ELEMENT_VALUE_TYPE_TIME)
+    {
+      time_t epoch_time;
+
+      if (lease_parser_word_time(ctx, column, end, &epoch_time) < 0)
+        return 0;
+      logg(LOG_DEBUG, "%s: %ld",
+          lease_element_type_2_str(entry->type), epoch_time);
+      switch (entry->type)
+        {
+      case LEASE_ELEMENT_TYPE_TIME_STARTS:
+        lease_element->starts = epoch_time;
+        break;
+      case LEASE_ELEMENT_TYPE_TIME_ENDS:
+        lease_element->ends = epoch_time;
+        break;
+      case LEASE_ELEMENT_TYPE_TIME_TSTP:
+        lease_element->tstp = epoch_time;
+        break;
+      case LEASE_ELEMENT_TYPE_TIME_CLTT:
+        lease_element->cltt = epoch_time;
+        break;
+      case LEASE_ELEMENT_TYPE_TIME_TSFP:
+        lease_element->tsfp = epoch_time;
+        break;
+      case LEASE_ELEMENT_TYPE_TIME_ATSFP:
+        lease_element->atsfp = epoch_time;
+        break;
+      default:
+        logg_err("unknown time element type");
+        break;
+        }
+    }
+  else
+    {
+      const char *word;
+      size_t word_len;
+      struct lease_element_ext_t *ext;
+
+      if (column >= ctx->word_count)
+        return 0;
+
+      word = ctx->buf + ctx->words[column].offset;
+      word_len = ctx->words[column].length;
+
+      switch (entry->type)
+        {
+      case LEASE_ELEMENT_TYPE_BINDING_STATE:
+        lease_element->binding_state = lease_binding_state_parse(word, word_len);
+        break;
+      case LEASE_ELEMENT_TYPE_NEXT_BINDING_STATE:
+        lease_element->next_binding_state = lease_binding_state_parse(word,
+            word_len);
+        break;
+      case LEASE_ELEMENT_TYPE_REWIND_BINDING_STATE:
+        lease_element->rewind_binding_state = lease_binding_state_parse(word,
+            word_len);
+        break;
+      case LEASE_ELEMENT_TYPE_HARDWARE:
+        if (lease_hwaddr_parse(ctx->buf + ctx->words[1].offset,
+            ctx->words[1].length, word, word_len, &lease_element->hardware) < 0)
+          lease_parser_error(ctx, LEASE_PARSER_ERROR_HARDWARE,
+              ctx->base + ctx->words[0].offset, ctx->buf + ctx->words[0].offset,
+              end - ctx->words[0].offset);
+        break;
+      case LEASE_ELEMENT_TYPE_CLIENT_HOSTNAME:
+        lease_element->client_hostname = lease_parser_word_intern(ctx, column);
+        if (!lease_element->client_hostname)
+          return -1;
+        break;
+      case LEASE_ELEMENT_TYPE_UID:
+        lease_element->uid = lease_parser_word_intern(ctx, column);
+        if (!lease_element->uid)
+          return -1;
+        break;
+      case LEASE_ELEMENT_TYPE_VENDOR_CLASS_IDENTIFIER:
+        lease_element->vendor_class_identifier = lease_parser_word_intern(ctx,
+            column);
+        if (!lease_element->vendor_class_identifier)
+          return -1;
+        break;
+      case LEASE_ELEMENT_TYPE_BILLING_CLASS:
+        if (!(ext = lease_parser_element_ext(ctx)))
+          return -1;
+        ext->billing_class = lease_parser_word_intern(ctx, column);
+        if (!ext->billing_class)
+          return -1;
+        break;
+      case LEASE_ELEMENT_TYPE_DDNS_FWD_NAME:
+        if (!(ext = lease_parser_element_ext(ctx)))
+          return -1;
+        ext->ddns_fwd_name = lease_parser_word_dup(ctx, column);
+        if (!ext->ddns_fwd_name)
+          return -1;
+        break;
+      case LEASE_ELEMENT_TYPE_DDNS_REV_NAME:
+        if (!(ext = lease_parser_element_ext(ctx)))
+          return -1;
+        ext->ddns_rev_name = lease_parser_word_dup(ctx, column);
+        if (!ext->ddns_rev_name)
+          return -1;
+        break;
+      case LEASE_ELEMENT_TYPE_DDNS_TXT:
+        if (!(ext = lease_parser_element_ext(ctx)))
+          return -1;
+        ext->ddns_txt = lease_parser_word_dup(ctx, column);
+        if (!ext->ddns_txt)
+          return -1;
+        break;
+      case LEASE_ELEMENT_TYPE_DDNS_CLIENT_FQDN:
+        if (!(ext = lease_parser_element_ext(ctx)))
+          return -1;
+        ext->ddns_client_fqdn = lease_parser_word_dup(ctx, column);
+        if (!ext->ddns_client_fqdn)
+          return -1;
+        break;
+      case LEASE_ELEMENT_TYPE_AGENT_CIRCUIT_ID:
+        if (!(ext = lease_parser_element_ext(ctx)))
+          return -1;
+        ext->agent_circuit_id = lease_parser_word_dup(ctx, column);
+        if (!ext->agent_circuit_id)
+          return -1;
+        break;
+      case LEASE_ELEMENT_TYPE_AGENT_REMOTE_ID:
+        if (!(ext = lease_parser_element_ext(ctx)))
+          return -1;
+        ext->agent_remote_id = lease_parser_word_dup(ctx, column);
+        if (!ext->agent_remote_id)
+          return -1;
+        break;
+      case LEASE_ELEMENT_TYPE_AGENT_SUBSCRIBER_ID:
+        if (!(ext = lease_parser_element_ext(ctx)))
+          return -1;
+        ext->agent_subscriber_id = lease_parser_word_dup(ctx, column);
+        if (!ext->agent_subscriber_id)
+          return -1;
+        break;
+      default:
+        logg_err("unknown element type");
+        return 0;
+        }
+      logg(LOG_DEBUG, "%s: %.*s", lease_element_type_2_str(entry->type),
+          (int) word_len, word);
+    }
+
+  return 0;
+}
+
+/*
+ * feed the next piece of the lease file. Returns the number of bytes
+ * consumed: everything up to the start of the last incomplete statement,
+ * which has to be passed in again together with the following data. With
+ * eof set the whole buffer is consumed.
+ */
+static ssize_t
+lease_parser_feed(struct lease_parser_ctx_t *ctx, const char *buf, size_t len,
+    int eof)
+{
+  struct lease_lexer_t lexer;
+  struct lease_token_t token;
+  size_t statement_start = 0;
+
+  lease_lexer_init(&lexer, buf, len, eof);
+  ctx->buf = buf;
+  ctx->word_count = 0;
+
+  for (;;)
+    {
+      switch (lease_lexer_next(&lexer, &token))
+        {
+      case LEASE_TOKEN_EOF:
+        if (eof && ctx->depth)
+          lease_parser_error(ctx, LEASE_PARSER_ERROR_TRUNCATED,
+              ctx->block_start, NULL, 0);
+        else if (eof && ctx->word_count)
+          lease_parser_error(ctx, LEASE_PARSER_ERROR_TRUNCATED,
+              ctx->base + statement_start, buf + statement_start,
+              len - statement_start);
+        return len;
+      case LEASE_TOKEN_NEED_MORE:
+        return ctx->word_count ? statement_start : token.offset;
+      case LEASE_TOKEN_WORD:
+      case LEASE_TOKEN_STRING:
+        if (!ctx->word_count)
+          statement_start = token.offset;
+        // extra columns are not needed by any element
+        if (ctx->word_count < LEASE_PARSER_WORDS_MAX)
+          ctx->words[ctx->word_count++] = token;
+        continue;
+      case LEASE_TOKEN_SEMICOLON:
+        if (lease_parser_parse_statement(ctx, token.offset) < 0)
+          return -1;
+        break;
+      case LEASE_TOKEN_LBRACE:
+        if (lease_parser_open_block(ctx) < 0)
+          return -1;
+        /*
+         * dhcpd closes a lease block with a '}' in the first column,
+         * nested blocks are indented. If that is not in the buffer yet
+         * the block is tokenised as usual.
+         */
+        if (ctx->skip_block)
+          {
+            const char *end = memmem(buf + lexer.pos, len - lexer.pos, "\n}", 2);
+
+            ctx->skip_block = 0;
+            if (end)
+              lexer.pos = end - buf + 1;
+          }
+        break;
+      case LEASE_TOKEN_UNTERMINATED:
+        // the statement is dropped, parsing goes on with the next line
+        lease_parser_error(ctx, LEASE_PARSER_ERROR_UNTERMINATED,
+            ctx->base + token.offset - 1, buf + token.offset - 1,
+            token.length + 1);
+        break;
+      case LEASE_TOKEN_RBRACE:
+        if (!ctx->depth)
+          lease_parser_error(ctx, LEASE_PARSER_ERROR_BRACE,
+              ctx->base + token.offset, NULL, 0);
+        else if (lease_parser_close_block(ctx) < 0)
+          return -1;
+        break;
+        }
+
+      ctx->word_count = 0;
+      if (!ctx->depth)
+        ctx->committed = ctx->base + lexer.pos;
+    }
+}
+
+static int
+lease_parser_read_mmap(struct lease_parser_ctx_t *ctx, int fd, off_t offset,
+    size_t length)
+{
+  const char *contents;
+  void *map_base;
+  size_t map_len;
+  uint64_t start;
+  int ret;
+
+  start = lease_metrics_clock();
+  contents = toolbox_map_range(fd, offset, length, &map_base, &map_len);
+  if (!contents)
+    return -1;
+  lease_metrics_observe(LEASE_METRICS_STAGE_READ, start);
+  lease_metrics_add(LEASE_METRIC_BYTES_READ, length);
+  lease_metrics_count_lines(contents, length);
+
+  start = lease_metrics_clock();
+  ctx->base = offset;
+  ret = lease_parser_feed(ctx, contents, length, ctx->final) < 0 ? -1 : 0;
+  toolbox_unmap(map_base, map_len);
+  lease_metrics_observe(LEASE_METRICS_STAGE_PARSE, start);
+
+  return ret;
+}
+
+/*
+ * bytes of buf in front of the next top level "lease" line. Without one
+ * *found is 0 and the bytes that may start one are left over.
+ */
+static size_t
+lease_parser_skip_to_lease(const char *buf, size_t len, int *found)
+{
+  static const char line[] = "\nlease ";
+  const char *next;
+
+  next = memmem(buf, len, line, sizeof(line) - 1);
+  *found = next != NULL;
+  if (next)
+    return next - buf + 1;
+
+  return len < sizeof(line) - 2 ? 0 : len - (sizeof(line) - 2);
+}
+
+// read from the current position of fd, which is at file offset ctx->base
+static int
+lease_parser_read_stream(struct lease_parser_ctx_t *ctx, int fd)
+{
+  char *chunk, *tmp;
+  size_t chunk_size = LEASE_PARSER_CHUNK_SIZE;
+  size_t fill = 0, skipped;
+  ssize_t n, consumed;
+  uint64_t start, read_ns = 0, parse_ns = 0;
+  int ret = 0, skipping = 0, found;
+
+  chunk = malloc(chunk_size);
+  if (!chunk)
+    {
+      logg_err("Cannot allocate memory.");
+      return -1;
+    }
+
+  for (;;)
+    {
+      // a statement beyond a sane limit is skipped up to the next lease
+      if (fill == chunk_size && chunk_size >= LEASE_PARSER_CHUNK_MAX
+          && !skipping)
+        {
+          lease_parser_error(ctx, LEASE_PARSER_ERROR_TOO_LONG, ctx->base,
+              chunk, fill);
+          lease_parser_reset(ctx);
+          skipping = 1;
+        }
+
+      if (skipping)
+        {
+          skipped = lease_parser_skip_to_lease(chunk, fill, &found);
+          memmove(chunk, chunk + skipped, fill - skipped);
+          fill -= skipped;
+          ctx->base += skipped;
+          ctx->committed = ctx->base;
+          skipping = !found;
+        }
+      // a single statement larger than the chunk: grow
+      else if (fill == chunk_size)
+        {
+          tmp = realloc(chunk, chunk_size * 2);
+          if (!tmp)
+            {
+              logg_err("Cannot allocate memory.");
+              ret = -1;
+              break;
+            }
+          chunk = tmp;
+          chunk_size *= 2;
+        }
+
+      start = lease_metrics_clock();
+      n = read(fd, chunk + fill, chunk_size - fill);
+      if (n < 0 && errno == EINTR)
+        continue;
+      if (n < 0)
+        {
+          logg_err("read failed (%s)", strerror(errno));
+          ret = -1;
+          break;
+        }
+
+      if (start)
+        {
+          read_ns += lease_metrics_clock() - start;
+          lease_metrics_add(LEASE_METRIC_BYTES_READ, n);
+          lease_metrics_count_lines(chunk + fill, n);
+          start = lease_metrics_clock();
+        }
+
+      fill += n;
+      if (skipping)
+        {
+          if (n == 0)
+            break;
+          continue;
+        }
+
+      consumed = lease_parser_feed(ctx, chunk, fill, n == 0 && ctx->final);
+      if (start)
+        parse_ns += lease_metrics_clock() - start;
+      if (consumed < 0)
+        {
+          ret = -1;
+          break;
+        }
+      if (n == 0)
+        break;
+
+      memmove(chunk, chunk + consumed, fill - consumed);
+      fill -= consumed;
+      ctx->base += consumed;
+    }
+
+  if (lease_metrics_enabled)
+    {
+      lease_metrics_observe_ns(LEASE_METRICS_STAGE_READ, read_ns);
+      lease_metrics_observe_ns(LEASE_METRICS_STAGE_PARSE, parse_ns);
+    }
+
+  free(chunk);
+  return ret;
+}
+
+static int
+lease_parser_ctx_init(struct lease_parser_ctx_t *ctx, struct lease_table_t *table,
+    off_t offset, int final)
+{
+  if (lease_parser_keywords_init() < 0)
+    return -1;
+
+  memset(ctx, 0, sizeof(*ctx));
+  ctx->parser_state = LEASE_PARSER_STATE_SEARCH_ELEMENT;
+  ctx->table = table;
+  ctx->base = offset;
+  ctx->committed = offset;
+  ctx->final = final;
+
+  return 0;
+}
+
+// parse [offset, st_size) of a locked file
+static int
+lease_parser_read_fd(struct lease_parser_ctx_t *ctx,
+    enum lease_parser_read_mode_t mode, int fd, off_t offset, off_t size)
+{
+  if (mode == LEASE_PARSER_READ_MODE_MMAP)
+    return lease_parser_read_mmap(ctx, fd, offset, size - offset);
+
+  if (lseek(fd, offset, SEEK_SET) < 0)
+    {
+      logg_err("lseek failed (%s)", strerror(errno));
+      return -1;
+    }
+
+  return lease_parser_read_stream(ctx, fd);
+}
+
+/*
+ * parse a whole file into a new table. Returns 0, -1 on error or 1 if a
+ * lockless read has to be retried.
+ */
+static int
+lease_parser_read_path(const char *file_path,
+    enum lease_parser_read_mode_t mode, enum toolbox_lock_mode_t lock_mode,
+    lease_parser_filter_cb_t filter, void *filter_user,
+    struct lease_table_t **table_out)
+{
+  struct lease_parser_ctx_t ctx;
+  struct lease_table_t *table;
+  struct toolbox_file_t file;
+  uint64_t start;
+  int ret;
+
+  table = lease_table_new();
+
+  if (!table)
+    return -1;
+
+  if (lease_parser_ctx_init(&ctx, table, 0, 1) < 0)
+    goto error_end_free_table;
+
+  ctx.filter = filter;
+  ctx.filter_user = filter_user;
+
+  if (strcmp(file_path, "-") == 0)
+    {
+      ret = lease_parser_read_stream(&ctx, STDIN_FILENO);
+    }
+  else
+    {
+      start = lease_metrics_clock();
+      if (toolbox_open_locked(&file, file_path, lock_mode) < 0)
+        goto error_end_free_table;
+
+      ret = toolbox_copy_locked(&file, 0);
+      lease_metrics_observe(LEASE_METRICS_STAGE_LOCK, start);
+      if (!ret)
+        ret = lease_parser_read_fd(&ctx, mode, file.fd, 0, file.st.st_size);
+
+      if (toolbox_close_locked(&file) < 0 && ret == 0)
+        {
+          lease_table_destroy(table);
+          return 1;
+        }
+    }
+
+  if (ret < 0)
+    {
+      logg_err("can't read file %s", file_path);
+      goto error_end_free_table;
+    }
+
+  // a truncated trailing block is dropped
+  *table_out = table;
+  return 0;
+
+  error_end_free_table:
+  lease_table_destroy(table);
+  return -1;
+}
+
+struct lease_table_t *
+lease_parser_reade_file(const char *file_path,
+    enum lease_parser_read_mode_t mode)
+{
+  return lease_parser_reade_file_filter(file_path, mode, NULL, NULL);
+}
+
+struct lease_table_t *
+lease_parser_reade_file_filter(const char *file_path,
+    enum lease_parser_read_mode_t mode, lease_parser_filter_cb_t filter,
+    void *user)
+{
+  struct lease_table_t *table = NULL;
+  int attempt, ret;
+
+  if (!file_path)
+    {
+      logg_err("parameter error");
+      return NULL;
+    }
+
+  for (attempt = 0; ; attempt++)
+    {
+      ret = lease_parser_read_path(file_path, mode, toolbox_lock_mode(attempt),
+          filter, user, &table);
+      if (ret <= 0)
+        break;
+    }
+
+  return ret < 0 ? NULL : table;
+}
+
+struct lease_parser_worker_t
+{
+  pthread_t thread;
+  const char *buf;
+  size_t start;
+  size_t end;
+  struct lease_table_t *table;
+  int ret;
+};
+
+/*
+ * start of the first line at or after pos that follows a top level
+ * block. dhcpd writes the closing '}' of a top level block (lease, ia-na,
+ * failover peer, ...) in the first column and indents nested ones, so
+ * this is a safe point to split the file.
+ */
+static size_t
+lease_parser_next_block(const char *buf, size_t len, size_t pos)
+{
+  const char *found;
+
+  if (pos == 0 || pos >= len)
+    return pos < len ? pos : len;
+
+  // behind a '}' in the first column, which closes a top level block
+  for (found = buf + pos - 1;
+      (found = memmem(found, buf + len - found, "\n}", 2)); found += 2)
+    {
+      if (found + 2 < buf + len && found[2] == '\n')
+        return found - buf + 3;
+      // CRLF line ends
+      if (found + 3 < buf + len && found[2] == '\r' && found[3] == '\n')
+        return found - buf + 4;
+    }
+
+  return len;
+}
+
+static void *
+lease_parser_worker(void *arg)
+{
+  struct lease_parser_worker_t *worker = arg;
+  struct lease_parser_ctx_t ctx;
+
+  worker->ret = -1;
+
+  worker->table = lease_table_new();
+  if (!worker->table)
+    return NULL;
+
+  if (lease_parser_ctx_init(&ctx, worker->table, worker->start, 1) < 0)
+    return NULL;
+
+  // counted by the worker itself, each thread has a metrics slot of its own
+  lease_metrics_add(LEASE_METRIC_BYTES_READ, worker->end - worker->start);
+  lease_metrics_count_lines(worker->buf + worker->start,
+      worker->end - worker->start);
+
+  if (lease_parser_feed(&ctx, worker->buf + worker->start,
+      worker->end - worker->start, 1) < 0)
+    return NULL;
+
+  worker->ret = 0;
+  return NULL;
+}
+
+unsigned int
+lease_parser_thread_count(unsigned int threads, size_t size)
+{
+  long cpus;
+
+  if (!threads)
+    {
+      cpus = sysconf(_SC_NPROCESSORS_ONLN);
+      threads = cpus > 0 ? cpus : 1;
+    }
+
+  if (threads > LEASE_PARSER_THREADS_MAX)
+    threads = LEASE_PARSER_THREADS_MAX;
+
+  // small files are not worth the threads
+  if (threads > size / LEASE_PARSER_RANGE_MIN)
+    threads = size / LEASE_PARSER_RANGE_MIN;
+
+  return threads ? threads : 1;
+}
+
+static struct lease_table_t *
+lease_parser_parse_parallel(const char *buf, size_t len, unsigned int threads)
+{
+  struct lease_parser_worker_t workers[LEASE_PARSER_THREADS_MAX];
+  struct lease_table_t *table = NULL;
+  unsigned int i, started;
+  uint64_t start;
+  int ret = 0;
+
+  // shared lazily initialised state must be set up before the workers run
+  if (lease_parser_keywords_init() < 0)
+    return NULL;
+  lease_lexer_backend();
+
+  memset(workers, 0, sizeof(workers));
+  for (i = 0; i < threads; i++)
+    {
+      workers[i].buf = buf;
+      workers[i].start = i ? workers[i - 1].end : 0;
+      workers[i].end = i + 1 < threads
+          ? lease_parser_next_block(buf, len, len / threads * (i + 1)) : len;
+      if (workers[i].end < workers[i].start)
+        workers[i].end = workers[i].start;
+    }
+
+  start = lease_metrics_clock();
+
+  // the first range is parsed by the calling thread
+  for (started = 1; started < threads; started++)
+    {
+      if (pthread_create(&workers[started].thread, NULL, lease_parser_worker,
+          &workers[started]))
+        {
+          logg_err("can't create parser thread");
+          ret = -1;
+          break;
+        }
+    }
+
+  if (!ret)
+    lease_parser_worker(&workers[0]);
+
+  for (i = 1; i < started; i++)
+    pthread_join(workers[i].thread, NULL);
+
+  // merge in file order, later blocks still win
+  for (i = 0; i < started; i++)
+    {
+      if (ret < 0 || workers[i].ret < 0)
+        {
+          ret = -1;
+          lease_table_destroy(workers[i].table);
+        }
+      else if (!table)
+        table = workers[i].table;
+      else if (lease_table_merge(table, workers[i].table, NULL, NULL) < 0)
+        ret = -1;
+    }
+
+  lease_metrics_observe(LEASE_METRICS_STAGE_PARSE, start);
+
+  if (ret < 0)
+    {
+      lease_table_destroy(table);
+      return NULL;
+    }
+
+  return table;
+}
+
+struct lease_table_t *
+lease_parser_parse_buffer(const char *buf, size_t len, unsigned int threads)
+{
+  if (!buf && len)
+    {
+      logg_err("parameter error");
+      return NULL;
+    }
+
+  return lease_parser_parse_parallel(buf, len,
+      lease_parser_thread_count(threads, len));
+}
+
+struct lease_table_t *
+lease_parser_reade_file_parallel(const char *file_path, unsigned int threads)
+{
+  struct lease_table_t *table;
+  struct toolbox_file_t file;
+  const char *contents;
+  void *map_base;
+  size_t map_len;
+  uint64_t start;
+  int attempt;
+
+  if (!file_path)
+    {
+      logg_err("parameter error");
+      return NULL;
+    }
+
+  if (strcmp(file_path, "-") == 0)
+    return lease_parser_reade_file(file_path, LEASE_PARSER_READ_MODE_STREAM);
+
+  for (attempt = 0; ; attempt++)
+    {
+      start = lease_metrics_clock();
+      if (toolbox_open_locked(&file, file_path, toolbox_lock_mode(attempt)) < 0)
+        return NULL;
+
+      if (toolbox_copy_locked(&file, 0) < 0)
+        {
+          toolbox_close_locked(&file);
+          return NULL;
+        }
+      lease_metrics_observe(LEASE_METRICS_STAGE_LOCK, start);
+
+      start = lease_metrics_clock();
+      contents = toolbox_map_range(file.fd, 0, file.st.st_size, &map_base,
+          &map_len);
+      if (!contents)
+        {
+          toolbox_close_locked(&file);
+          return NULL;
+        }
+      lease_metrics_observe(LEASE_METRICS_STAGE_READ, start);
+
+      table = lease_parser_parse_parallel(contents, file.st.st_size,
+          lease_parser_thread_count(threads, file.st.st_size));
+
+      toolbox_unmap(map_base, map_len);
+
+      if (toolbox_close_locked(&file) == 0 || !table)
+        break;
+
+      lease_table_destroy(table);
+    }
+
+  if (!table)
+    logg_err("can't read file %s", file_path);
+
+  return table;
+}
+
+struct lease_parser_t *
+lease_parser_open(const char *file_path, enum lease_parser_read_mode_t mode)
+{
+  struct lease_parser_t *parser;
+
+  if (!file_path)
+    {
+      logg_err("parameter error");
+      return NULL;
+    }
+
+  parser = calloc(1, sizeof(*parser));
+  if (!parser)
+    {
+      logg_err("Cannot allocate memory.");
+      return NULL;
+    }
+
+  parser->path = strdup(file_path);
+  parser->mode = mode;
+
+  if (!parser->path || lease_parser_refresh(parser) < 0)
+    {
+      lease_parser_close(parser);
+      return NULL;
+    }
+
+  return parser;
+}
+
+struct lease_parser_t *
+lease_parser_resume(const char *file_path, enum lease_parser_read_mode_t mode,
+    struct lease_table_t *table, dev_t dev, ino_t ino, off_t offset)
+{
+  struct lease_parser_t *parser;
+
+  if (!file_path || !table)
+    {
+      logg_err("parameter error");
+      lease_table_destroy(table);
+      return NULL;
+    }
+
+  parser = calloc(1, sizeof(*parser));
+  if (!parser)
+    {
+      logg_err("Cannot allocate memory.");
+      lease_table_destroy(table);
+      return NULL;
+    }
+
+  parser->path = strdup(file_path);
+  parser->mode = mode;
+  parser->table = table;
+  parser->dev = dev;
+  parser->ino = ino;
+  parser->offset = offset;
+
+  if (!parser->path || lease_parser_refresh(parser) < 0)
+    {
+      lease_parser_close(parser);
+      return NULL;
+    }
+
+  return parser;
+}
+
+// on_change knows no removed leases, they are only reported by a diff
+static void
+lease_parser_reload_change(enum lease_change_t change,
+    const struct lease_element_t *lease,
+    const struct lease_element_t *previous, uint32_t fields, void *user)
+{
+  struct lease_parser_t *parser = user;
+
+  if (change != LEASE_CHANGE_REMOVED)
+    parser->on_change(lease, previous, parser->user);
+}
+
+// report every lease of a rewritten file that differs from the old table
+static void
+lease_parser_report_reload(struct lease_parser_t *parser,
+    const struct lease_table_t *table)
+{
+  if (parser->on_diff)
+    lease_table_diff(parser->table, table, parser->on_diff, parser->diff_user);
+  else if (parser->on_change)
+    lease_table_diff(parser->table, table, lease_parser_reload_change, parser);
+}
+
+// a lockless read raced with a change of the file
+#define LEASE_PARSER_REFRESH_RETRY      (LEASE_PARSER_REFRESH_RELOADED + 1)
+
+// arena chunks of an increment table, which the table it is merged into keeps
+#define LEASE_PARSER_INCREMENT_CHUNK_MIN        4096
+
+static int
+lease_parser_refresh_once(struct lease_parser_t *parser,
+    enum toolbox_lock_mode_t lock_mode)
+{
+  struct lease_parser_ctx_t ctx;
+  struct lease_table_t *table;
+  struct toolbox_file_t file;
+  struct stat *st = &file.st;
+  uint64_t start;
+  off_t appended;
+  int ret, reload;
+
+  start = lease_metrics_clock();
+  if (toolbox_open_locked(&file, parser->path, lock_mode) < 0)
+    return LEASE_PARSER_REFRESH_ERROR;
+
+  // dhcpd rewrites the file from time to time and renames it into place
+  reload = !parser->table || st->st_dev != parser->dev
+      || st->st_ino != parser->ino || st->st_size < parser->offset;
+
+  parser->size = st->st_size;
+  parser->mtime = st->st_mtim;
+
+  if (!reload && st->st_size == parser->offset)
+    {
+      toolbox_close_locked(&file);
+      parser->last_parsed = 0;
+      return LEASE_PARSER_REFRESH_UNCHANGED;
+    }
+
+  /*
+   * an increment is parsed into a table of its own as well and only
+   * merged once it is complete and consistent, so a failed or retried
+   * refresh leaves parser->table as it was and reports nothing twice
+   */
+  table = lease_table_new();
+  if (!table)
+    {
+      toolbox_close_locked(&file);
+      return LEASE_PARSER_REFRESH_ERROR;
+    }
+
+  // parser->table keeps the arena of an increment, sized to what was appended
+  appended = st->st_size - parser->offset;
+  if (!reload && appended < ARENA_CHUNK_SIZE)
+    arena_init(&table->arena, appended < LEASE_PARSER_INCREMENT_CHUNK_MIN
+        ? LEASE_PARSER_INCREMENT_CHUNK_MIN : appended);
+
+  if (lease_parser_ctx_init(&ctx, table, reload ? 0 : parser->offset, 0) < 0
+      || toolbox_copy_locked(&file, ctx.base) < 0)
+    ret = -1;
+  else
+    {
+      lease_metrics_observe(LEASE_METRICS_STAGE_LOCK, start);
+      ret = lease_parser_read_fd(&ctx, parser->mode, file.fd, ctx.base,
+          st->st_size);
+    }
+
+  if (toolbox_close_locked(&file) < 0 && ret == 0)
+    {
+      // what was parsed may be garbage, start over from scratch
+      lease_table_destroy(table);
+      if (!reload)
+        parser->ino = 0;
+      return LEASE_PARSER_REFRESH_RETRY;
+    }
+
+  if (ret < 0)
+    {
+      logg_err("can't read file %s", parser->path);
+      lease_table_destroy(table);
+      return LEASE_PARSER_REFRESH_ERROR;
+    }
+
+  if (!reload)
+    {
+      if (lease_table_merge(parser->table, table, parser->on_change,
+          parser->user) < 0)
+        {
+          // part of it is merged, a reload reports the rest as a diff
+          parser->ino = 0;
+          return LEASE_PARSER_REFRESH_ERROR;
+        }
+
+      lease_parser_errors_add(&parser->errors, &ctx.errors);
+      parser->last_parsed = ctx.committed - parser->offset;
+      parser->offset = ctx.committed;
+
+      // only an incomplete block was added since the last refresh
+      return parser->last_parsed ? LEASE_PARSER_REFRESH_APPENDED
+          : LEASE_PARSER_REFRESH_UNCHANGED;
+    }
+
+  lease_parser_errors_add(&parser->errors, &ctx.errors);
+  parser->last_parsed = ctx.committed;
+  parser->offset = ctx.committed;
+
+  if (parser->table)
+    lease_parser_report_reload(parser, table);
+
+  if (parser->table && parser->on_retire)
+    parser->on_retire(parser->table, parser->retire_user);
+  else
+    lease_table_destroy(parser->table);
+  parser->table = table;
+  parser->dev = st->st_dev;
+  parser->ino = st->st_ino;
+
+  return LEASE_PARSER_REFRESH_RELOADED;
+}
+
+int
+lease_parser_refresh(struct lease_parser_t *parser)
+{
+  int attempt, ret;
+
+  parser->cursor = 0;
+
+  for (attempt = 0; ; attempt++)
+    {
+      ret = lease_parser_refresh_once(parser, toolbox_lock_mode(attempt));
+      if (ret != LEASE_PARSER_REFRESH_RETRY)
+        return ret;
+    }
+}
+
+void
+lease_parser_close(struct lease_parser_t *parser)
+{
+  if (!parser)
+    return;
+
+  lease_table_destroy(parser->table);
+  free(parser->path);
+  free(parser);
+}
+
+// an appended block, reported as a diff
+static void
+lease_parser_diff_change(const struct lease_element_t *lease,
+    const struct lease_element_t *previous, void *user)
+{
+  struct lease_parser_t *parser = user;
+  uint32_t fields;
+
+  if (!previous)
+    {
+      parser->on_diff(LEASE_CHANGE_ADDED, lease, NULL, 0, parser->diff_user);
+      return;
+    }
+
+  // dhcpd rewrites a block unchanged now and then
+  fields = lease_element_diff(previous, lease);
+  if (fields)
+    parser->on_diff(LEASE_CHANGE_MODIFIED, lease, previous, fields,
+        parser->diff_user);
+}
+
+int
+lease_parser_refresh_diff(struct lease_parser_t *parser,
+    lease_table_diff_cb_t cb, void *user)
+{
+  lease_parser_change_cb_t on_change = parser->on_change;
+  void *change_user = parser->user;
+  int ret;
+
+  parser->on_change = lease_parser_diff_change;
+  parser->user = parser;
+  parser->on_diff = cb;
+  parser->diff_user = user;
+
+  ret = lease_parser_refresh(parser);
+
+  parser->on_change = on_change;
+  parser->user = change_user;
+  parser->on_diff = NULL;
+  parser->diff_user = NULL;
+
+  return ret;
+}
+
+int
+lease_parser_api_version(void)
+{
+  return LEASE_PARSER_API_VERSION;
+}
+
+size_t
+lease_parser_count(const struct lease_parser_t *parser)
+{
+  return lease_table_size(parser->table);
+}
+
+uint64_t
+lease_parser_errors(const struct lease_parser_t *parser,
+    enum lease_parser_error_t error, int64_t *offset)
+{
+  if (error >= LEASE_PARSER_ERROR_MAX)
+    return 0;
+
+  if (offset)
+    *offset = parser->errors.count[error] ? parser->errors.offset[error] : -1;
+
+  return parser->errors.count[error];
+}
+
+// lease flags are handed out unchanged
+_Static_assert(LEASE_RECORD_FLAG_ABANDONED == LEASE_FLAG_ABANDONED
+    && LEASE_RECORD_FLAG_BOOTP == LEASE_FLAG_BOOTP
+    && LEASE_RECORD_FLAG_RESERVED == LEASE_FLAG_RESERVED,
+    "record flags differ from lease flags");
+
+static const char *
+lease_parser_record_state(uint8_t state)
+{
+  return state == LEASE_BINDING_STATE_NONE ? NULL
+      : lease_binding_state_2_str(state);
+}
+
+int
+lease_parser_next(struct lease_parser_t *parser, struct lease_record_t *rec)
+{
+  const struct lease_element_t *lease;
+
+  if (!parser->table || parser->cursor >= parser->table->count)
+    return 0;
+
+  lease = &parser->table->leases[parser->cursor++];
+
+  if (!lease_addr_to_str(&lease->ip, rec->ip, sizeof(rec->ip)))
+    rec->ip[0] = 0;
+  if (!lease_hwaddr_to_str(&lease->hardware, rec->hardware,
+      sizeof(rec->hardware)))
+    rec->hardware[0] = 0;
+
+  rec->binding_state = lease_parser_record_state(lease->binding_state);
+  rec->next_binding_state = lease_parser_record_state(
+      lease->next_binding_state);
+  rec->rewind_binding_state = lease_parser_record_state(
+      lease->rewind_binding_state);
+  rec->ia_type = lease->ia_type == LEASE_IA_TYPE_NONE ? NULL
+      : lease_ia_type_2_str(lease->ia_type);
+  rec->flags = lease->flags;
+  rec->starts = lease->starts;
+  rec->ends = lease->ends;
+  rec->tstp = lease->tstp;
+  rec->cltt = lease->cltt;
+  rec->client_hostname = lease->client_hostname;
+  rec->uid = lease->uid;
+  rec->vendor_class_identifier = lease->vendor_class_identifier;
+
+  return 1;
+}
+
+void
+lease_parser_rewind(struct lease_parser_t *parser)
+{
+  parser->cursor = 0;
+}
@@ -0,0 +1,159 @@
+/*
+ * lease_parser.h
+ *
+ */
+
+#ifndef _LEASE_PARSER_H_
+#define _LEASE_PARSER_H_
+
+#include <time.h>
+#include <sys/types.h>
+
+#include "lease_table.h"
+// the read modes, the opaque handle and its exported functions
+#include "liblease_parser.h"
+
+/**
+ *
+ * \brief persistent parser for a lease file that keeps growing
+ *
+ * The handle remembers the inode of the file and the offset behind the
+ * last complete top level block. lease_parser_refresh() only parses what
+ * was appended since and merges it into the table; a partially written
+ * trailing block is left for the next refresh. If dhcpd rewrote the file
+ * (new inode or a shorter file) the table is reloaded from scratch.
+ *
+ * struct lease_parser_t *parser = lease_parser_open(path, mode);
+ * for (;;) {
+ *      sleep(5);
+ *      if (lease_parser_refresh(parser) > LEASE_PARSER_REFRESH_UNCHANGED)
+ *              Do_something_with(parser->table);
+ * }
+ * lease_parser_close(parser);
+ */
+
+/*
+ * called by lease_parser_refresh() for every lease that was added
+ * (previous == NULL) or replaced by a newer block, once the appended
+ * blocks were parsed without error; an address written several times
+ * since the last refresh is reported once. lease points into the table
+ * and is only valid during the call.
+ */
+typedef void (*lease_parser_change_cb_t)(const struct lease_element_t *lease,
+    const struct lease_element_t *previous, void *user);
+
+/*
+ * called by lease_parser_refresh() with the table a reload replaces,
+ * which the callee then owns (e.g. because copies share its strings).
+ * Without it the table is destroyed.
+ */
+typedef void (*lease_parser_retire_cb_t)(struct lease_table_t *table,
+    void *user);
+
+// per kind of error: how often and the file offset of the last one
+struct lease_parser_errors_t
+{
+  uint64_t count[LEASE_PARSER_ERROR_MAX];
+  off_t offset[LEASE_PARSER_ERROR_MAX];
+};
+
+struct lease_parser_t
+{
+  char *path;
+  enum lease_parser_read_mode_t mode;
+  struct lease_table_t *table;
+  dev_t dev;
+  ino_t ino;
+  off_t offset;
+  off_t last_parsed;
+  // size and mtime of the file at the last refresh
+  off_t size;
+  struct timespec mtime;
+  lease_parser_change_cb_t on_change;
+  void *user;
+  lease_parser_retire_cb_t on_retire;
+  void *retire_user;
+  // set by lease_parser_refresh_diff() for the time of the refresh
+  lease_table_diff_cb_t on_diff;
+  void *diff_user;
+  // index of the next lease for lease_parser_next()
+  size_t cursor;
+  // of all refreshes so far
+  struct lease_parser_errors_t errors;
+};
+
+/*
+ * continue from a table that covers [0, offset) of the file dev/ino,
+ * e.g. one loaded from a snapshot, and refresh it. The handle takes
+ * over the table, also on error.
+ */
+struct lease_parser_t *lease_parser_resume(const char *file_path,
+    enum lease_parser_read_mode_t mode, struct lease_table_t *table, dev_t dev,
+    ino_t ino, off_t offset);
+
+/*
+ * refresh and report how the leases changed, as lease_table_diff()
+ * would between the table before and after: appended blocks as added or
+ * modified leases, a rewritten file compared lease by lease including
+ * the removed ones.
+ */
+int lease_parser_refresh_diff(struct lease_parser_t *parser,
+    lease_table_diff_cb_t cb, void *user);
+
+/*
+ * parse a lease file once. "-" reads stdin; LEASE_PARSER_READ_MODE_STREAM
+ * reads the file in chunks instead of mapping it (e.g. for pipes).
+ */
+struct lease_table_t *lease_parser_reade_file(const char *file_path,
+    enum lease_parser_read_mode_t mode);
+
+/*
+ * decides from the address in the header of a lease block whether the
+ * block is parsed at all; 0 skips it without storing anything. As all
+ * blocks of an address are skipped, last-wins is not affected.
+ */
+typedef int (*lease_parser_filter_cb_t)(const struct lease_addr_t *ip,
+    void *user);
+
+struct lease_table_t *lease_parser_reade_file_filter(const char *file_path,
+    enum lease_parser_read_mode_t mode, lease_parser_filter_cb_t filter,
+    void *user);
+
+/*
+ * like lease_parser_reade_file() with mmap, but the file is split into
+ * ranges behind the first column '}' that closes a top level block
+ * (lease, ia-na/ta/pd, failover peer). The ranges are parsed by threads
+ * into tables of their own and merged in file order. threads == 0 uses
+ * one thread per online CPU; files below 1MB per thread use fewer
+ * threads.
+ */
+struct lease_table_t *lease_parser_reade_file_parallel(const char *file_path,
+    unsigned int threads);
+// the number of threads that parse size bytes when threads are asked for
+unsigned int lease_parser_thread_count(unsigned int threads, size_t size);
+
+/*
+ * parse a lease file already in memory with the mmap path, e.g. for
+ * fuzzing; threads as for lease_parser_reade_file_parallel()
+ */
+struct lease_table_t *lease_parser_parse_buffer(const char *buf, size_t len,
+    unsigned int threads);
+
+/*
+ * element type of a statement key as looked up while parsing: the first
+ * word, or the first two words of "set" and "option" statements. -1 if
+ * the statement is not stored.
+ */
+int lease_parser_element_type(const char *key, size_t key_size);
+
+/*
+ * seed of the perfect hash the element keys are looked up through, it
+ * has to map every key to a slot of its own. "make check" tests it and
+ * names one that does after the element table was changed.
+ */
+#define LEASE_KEYWORD_SEED        3
+
+// 0 if seed maps every element key to a slot of its own, -1 if not
+int lease_parser_keyword_seed_check(uint32_t seed);
+
+#endif /* _LEASE_PARSER_H_ */
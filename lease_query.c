@@ -0,0 +1,906 @@
+#include <stdlib.h>
+#include <string.h>
+#include <stddef.h>
+#include <errno.h>
+#include <sys/socket.h>
+
+#include "lease_query.h"
+#include "lease_time.h"
+#include "log.h"
+
+#define ARRAYSIZE(n) (sizeof(n)/sizeof(n[0]))
+
+#define LEASE_QUERY_OP_CHARS    "=!<>^~"
+
+static const struct lease_query_field_desc_t lease_query_fields[] =
+    {
+        {
+            .name = "ip", .field = LEASE_QUERY_FIELD_IP,
+            .kind = LEASE_QUERY_KIND_ADDR,
+            .offset = offsetof(struct lease_element_t, ip),
+        },
+        {
+            .name = "mac", .field = LEASE_QUERY_FIELD_MAC,
+            .kind = LEASE_QUERY_KIND_HWADDR,
+            .offset = offsetof(struct lease_element_t, hardware),
+        },
+        {
+            .name = "state", .field = LEASE_QUERY_FIELD_STATE,
+            .kind = LEASE_QUERY_KIND_STATE,
+            .offset = offsetof(struct lease_element_t, binding_state),
+        },
+        {
+            .name = "next_state", .field = LEASE_QUERY_FIELD_NEXT_STATE,
+            .kind = LEASE_QUERY_KIND_STATE,
+            .offset = offsetof(struct lease_element_t, next_binding_state),
+        },
+        {
+            .name = "starts", .field = LEASE_QUERY_FIELD_STARTS,
+            .kind = LEASE_QUERY_KIND_TIME,
+            .offset = offsetof(struct lease_element_t, starts),
+        },
+        {
+            .name = "ends", .field = LEASE_QUERY_FIELD_ENDS,
+            .kind = LEASE_QUERY_KIND_TIME,
+            .offset = offsetof(struct lease_element_t, ends),
+        },
+        {
+            .name = "tstp", .field = LEASE_QUERY_FIELD_TSTP,
+            .kind = LEASE_QUERY_KIND_TIME,
+            .offset = offsetof(struct lease_element_t, tstp),
+        },
+        {
+            .name = "cltt", .field = LEASE_QUERY_FIELD_CLTT,
+            .kind = LEASE_QUERY_KIND_TIME,
+            .offset = offsetof(struct lease_element_t, cltt),
+        },
+        {
+            .name = "tsfp", .field = LEASE_QUERY_FIELD_TSFP,
+            .kind = LEASE_QUERY_KIND_TIME,
+            .offset = offsetof(struct lease_element_t, tsfp),
+        },
+        {
+            .name = "atsfp", .field = LEASE_QUERY_FIELD_ATSFP,
+            .kind = LEASE_QUERY_KIND_TIME,
+            .offset = offsetof(struct lease_element_t, atsfp),
+        },
+        {
+            .name = "hostname", .field = LEASE_QUERY_FIELD_HOSTNAME,
+            .kind = LEASE_QUERY_KIND_STRING,
+            .offset = offsetof(struct lease_element_t, client_hostname),
+        },
+        {
+            .name = "uid", .field = LEASE_QUERY_FIELD_UID,
+            .kind = LEASE_QUERY_KIND_STRING,
+            .offset = offsetof(struct lease_element_t, uid),
+        },
+        {
+            .name = "vendor_class", .field = LEASE_QUERY_FIELD_VENDOR_CLASS,
+            .kind = LEASE_QUERY_KIND_STRING,
+            .offset = offsetof(struct lease_element_t, vendor_class_identifier),
+        },
+        {
+            .name = "abandoned", .field = LEASE_QUERY_FIELD_ABANDONED,
+            .kind = LEASE_QUERY_KIND_FLAG, .flag = LEASE_FLAG_ABANDONED,
+        },
+        {
+            .name = "bootp", .field = LEASE_QUERY_FIELD_BOOTP,
+            .kind = LEASE_QUERY_KIND_FLAG, .flag = LEASE_FLAG_BOOTP,
+        },
+        {
+            .name = "reserved", .field = LEASE_QUERY_FIELD_RESERVED,
+            .kind = LEASE_QUERY_KIND_FLAG, .flag = LEASE_FLAG_RESERVED,
+        },
+    };
+
+static const char *lease_query_op_names[] =
+    {
+        [LEASE_QUERY_OP_EQ] = "=",
+        [LEASE_QUERY_OP_NE] = "!=",
+        [LEASE_QUERY_OP_LT] = "<",
+        [LEASE_QUERY_OP_LE] = "<=",
+        [LEASE_QUERY_OP_GT] = ">",
+        [LEASE_QUERY_OP_GE] = ">=",
+        [LEASE_QUERY_OP_IN] = "in",
+        [LEASE_QUERY_OP_PREFIX] = "^=",
+        [LEASE_QUERY_OP_CONTAINS] = "~",
+    };
+
+#define LEASE_QUERY_FIELD(lease, type, offset) \
+        ((const type *) ((const char *) (lease) + (offset)))
+
+static const struct lease_query_field_desc_t *
+lease_query_field_lookup(const char *name, size_t len)
+{
+  int i;
+
+  for (i = 0; i < ARRAYSIZE(lease_query_fields); i++)
+    {
+      if (strlen(lease_query_fields[i].name) == len
+          && !memcmp(lease_query_fields[i].name, name, len))
+        return &lease_query_fields[i];
+    }
+
+  return NULL;
+}
+
+const struct lease_query_field_desc_t *
+lease_query_field_desc(enum lease_query_field_t field)
+{
+  int i;
+
+  for (i = 0; i < ARRAYSIZE(lease_query_fields); i++)
+    {
+      if (lease_query_fields[i].field == field)
+        return &lease_query_fields[i];
+    }
+
+  return NULL;
+}
+
+/*
+ * predicates
+ */
+
+static int
+lease_query_addr_in(const struct lease_query_node_t *node,
+    const struct lease_addr_t *ip)
+{
+  const struct lease_addr_t *net = &node->value.ip.addr;
+  unsigned int bits = node->value.ip.prefix_len;
+  uint8_t mask;
+
+  if (ip->family != net->family)
+    return 0;
+
+  if (ip->family != AF_INET6)
+    return bits == 0 || !((ip->v4 ^ net->v4) & (~(uint32_t) 0 << (32 - bits)));
+
+  if (memcmp(ip->v6, net->v6, bits / 8))
+    return 0;
+  if (!(bits % 8))
+    return 1;
+
+  mask = 0xff << (8 - bits % 8);
+  return !((ip->v6[bits / 8] ^ net->v6[bits / 8]) & mask);
+}
+
+static int
+lease_query_match_addr(const struct lease_query_node_t *node,
+    const struct lease_element_t *lease)
+{
+  return lease_query_addr_in(node, &lease->ip);
+}
+
+static int
+lease_query_match_hwaddr(const struct lease_query_node_t *node,
+    const struct lease_element_t *lease)
+{
+  return lease->hardware.type != LEASE_HWADDR_TYPE_NONE
+      && !memcmp(lease->hardware.addr, node->value.mac.addr,
+          sizeof(lease->hardware.addr));
+}
+
+static int
+lease_query_match_state(const struct lease_query_node_t *node,
+    const struct lease_element_t *lease)
+{
+  return *LEASE_QUERY_FIELD(lease, uint8_t, node->offset) == node->value.state;
+}
+
+static int
+lease_query_match_flag(const struct lease_query_node_t *node,
+    const struct lease_element_t *lease)
+{
+  return (lease->flags & node->value.flag) != 0;
+}
+
+static int
+lease_query_match_time(const struct lease_query_node_t *node,
+    const struct lease_element_t *lease)
+{
+  time_t t = *LEASE_QUERY_FIELD(lease, time_t, node->offset);
+
+  switch (node->op)
+    {
+  case LEASE_QUERY_OP_LT:
+    return t < node->value.time;
+  case LEASE_QUERY_OP_LE:
+    return t <= node->value.time;
+  case LEASE_QUERY_OP_GT:
+    return t > node->value.time;
+  case LEASE_QUERY_OP_GE:
+    return t >= node->value.time;
+  default:
+    return t == node->value.time;
+    }
+}
+
+static int
+lease_query_match_string(const struct lease_query_node_t *node,
+    const struct lease_element_t *lease)
+{
+  const char *str = *LEASE_QUERY_FIELD(lease, const char *, node->offset);
+
+  if (!str)
+    return 0;
+
+  switch (node->op)
+    {
+  case LEASE_QUERY_OP_PREFIX:
+    return !strncmp(str, node->value.str.str, node->value.str.len);
+  case LEASE_QUERY_OP_CONTAINS:
+    return strstr(str, node->value.str.str) != NULL;
+  default:
+    return !strcmp(str, node->value.str.str);
+    }
+}
+
+/*
+ * compiler
+ */
+
+enum lease_query_token_type_t
+{
+  LEASE_QUERY_TOKEN_END,
+  LEASE_QUERY_TOKEN_WORD,
+  LEASE_QUERY_TOKEN_STRING,
+  LEASE_QUERY_TOKEN_OP,
+  LEASE_QUERY_TOKEN_LPAREN,
+  LEASE_QUERY_TOKEN_RPAREN,
+};
+
+struct lease_query_token_t
+{
+  enum lease_query_token_type_t type;
+  const char *str;
+  size_t len;
+};
+
+struct lease_query_compiler_t
+{
+  struct lease_query_t *query;
+  const char *expr;
+  const char *pos;
+  struct lease_query_token_t token;
+};
+
+static void
+lease_query_error(const struct lease_query_compiler_t *compiler,
+    const char *msg)
+{
+  logg_err("query: %s at offset %d: %.*s", msg,
+      (int) (compiler->token.str - compiler->expr), (int) compiler->token.len,
+      compiler->token.str);
+}
+
+static int
+lease_query_next(struct lease_query_compiler_t *compiler)
+{
+  struct lease_query_token_t *token = &compiler->token;
+  const char *p = compiler->pos;
+
+  while (*p == ' ' || *p == '\t' || *p == '\n')
+    p++;
+
+  token->str = p;
+  token->len = 1;
+
+  if (!*p)
+    {
+      token->type = LEASE_QUERY_TOKEN_END;
+      token->len = 0;
+    }
+  else if (*p == '(')
+    token->type = LEASE_QUERY_TOKEN_LPAREN;
+  else if (*p == ')')
+    token->type = LEASE_QUERY_TOKEN_RPAREN;
+  else if (*p == '"')
+    {
+      const char *q = strchr(p + 1, '"');
+
+      if (!q)
+        {
+          compiler->token.len = strlen(p);
+          lease_query_error(compiler, "unterminated string");
+          return -1;
+        }
+
+      token->type = LEASE_QUERY_TOKEN_STRING;
+      token->str = p + 1;
+      token->len = q - (p + 1);
+      compiler->pos = q + 1;
+      return 0;
+    }
+  else if (strchr(LEASE_QUERY_OP_CHARS, *p))
+    {
+      token->type = LEASE_QUERY_TOKEN_OP;
+      if (p[1] == '=' && strchr("!<>^", *p))
+        token->len = 2;
+    }
+  else
+    {
+      token->type = LEASE_QUERY_TOKEN_WORD;
+      token->len = strcspn(p, " \t\n()\"" LEASE_QUERY_OP_CHARS);
+    }
+
+  compiler->pos = p + token->len;
+  return 0;
+}
+
+static int
+lease_query_token_is(const struct lease_query_compiler_t *compiler,
+    const char *word)
+{
+  return compiler->token.type == LEASE_QUERY_TOKEN_WORD
+      && compiler->token.len == strlen(word)
+      && !memcmp(compiler->token.str, word, compiler->token.len);
+}
+
+static int
+lease_query_add_node(struct lease_query_t *query,
+    enum lease_query_node_type_t type, int left, int right)
+{
+  struct lease_query_node_t *node;
+
+  if (query->count == query->capacity)
+    {
+      size_t capacity = query->capacity ? query->capacity * 2 : 16;
+
+      node = realloc(query->nodes, capacity * sizeof(*node));
+      if (!node)
+        {
+          logg_err("Cannot allocate memory.");
+          return -1;
+        }
+
+      query->nodes = node;
+      query->capacity = capacity;
+    }
+
+  node = &query->nodes[query->count];
+  memset(node, 0, sizeof(*node));
+  node->type = type;
+  node->left = left;
+  node->right = right;
+
+  return query->count++;
+}
+
+// epoch, never, now, now+N or now-N with an optional s/m/h/d suffix
+static int
+lease_query_parse_time(const struct lease_query_t *query, const char *str,
+    size_t len, time_t *out)
+{
+  char buf[32], *end;
+  long long n;
+  int sign = 1;
+
+  if (len >= sizeof(buf))
+    return -1;
+
+  memcpy(buf, str, len);
+  buf[len] = '\0';
+
+  if (!strcmp(buf, "never"))
+    {
+      *out = LEASE_TIME_NEVER;
+      return 0;
+    }
+
+  if (strncmp(buf, "now", 3))
+    {
+      errno = 0;
+      n = strtoll(buf, &end, 10);
+      if (errno || end == buf || *end)
+        return -1;
+      *out = n;
+      return 0;
+    }
+
+  if (!buf[3])
+    {
+      *out = query->now;
+      return 0;
+    }
+
+  if (buf[3] == '-')
+    sign = -1;
+  else if (buf[3] != '+')
+    return -1;
+
+  errno = 0;
+  n = strtoll(buf + 4, &end, 10);
+  if (errno || end == buf + 4 || n < 0)
+    return -1;
+
+  switch (*end)
+    {
+  case 'd':
+    n *= 24;
+    // fall through
+  case 'h':
+    n *= 60;
+    // fall through
+  case 'm':
+    n *= 60;
+    // fall through
+  case 's':
+    end++;
+    break;
+    }
+
+  if (*end)
+    return -1;
+
+  *out = query->now + sign * n;
+  return 0;
+}
+
+static int
+lease_query_build_predicate(struct lease_query_compiler_t *compiler, int idx,
+    const struct lease_query_field_desc_t *desc, enum lease_query_op_t op,
+    const char *str, size_t len)
+{
+  struct lease_query_node_t *node = &compiler->query->nodes[idx];
+  int ok;
+
+  node->field = desc->field;
+  node->offset = desc->offset;
+  node->op = op;
+
+  // != is the negation of =
+  if (op == LEASE_QUERY_OP_NE)
+    {
+      node->negate = 1;
+      node->op = LEASE_QUERY_OP_EQ;
+    }
+
+  switch (desc->kind)
+    {
+  case LEASE_QUERY_KIND_ADDR:
+    ok = node->op == LEASE_QUERY_OP_EQ || node->op == LEASE_QUERY_OP_IN;
+    node->match = lease_query_match_addr;
+    if (ok && lease_addr_parse_prefix(str, len, &node->value.ip.addr,
+        &node->value.ip.prefix_len) < 0)
+      {
+        lease_query_error(compiler, "invalid address");
+        return -1;
+      }
+    break;
+  case LEASE_QUERY_KIND_HWADDR:
+    ok = node->op == LEASE_QUERY_OP_EQ;
+    node->match = lease_query_match_hwaddr;
+    if (ok && lease_hwaddr_parse("ethernet", sizeof("ethernet") - 1, str, len,
+        &node->value.mac) < 0)
+      {
+        lease_query_error(compiler, "invalid hardware address");
+        return -1;
+      }
+    break;
+  case LEASE_QUERY_KIND_STATE:
+    ok = node->op == LEASE_QUERY_OP_EQ;
+    node->match = lease_query_match_state;
+    node->value.state = lease_binding_state_parse(str, len);
+    if (ok && node->value.state == LEASE_BINDING_STATE_NONE)
+      {
+        lease_query_error(compiler, "invalid binding state");
+        return -1;
+      }
+    break;
+  case LEASE_QUERY_KIND_TIME:
+    ok = node->op <= LEASE_QUERY_OP_GE;
+    node->match = lease_query_match_time;
+    if (ok && lease_query_parse_time(compiler->query, str, len,
+        &node->value.time) < 0)
+      {
+        lease_query_error(compiler, "invalid time");
+        return -1;
+      }
+    break;
+  case LEASE_QUERY_KIND_STRING:
+    ok = node->op == LEASE_QUERY_OP_EQ || node->op == LEASE_QUERY_OP_PREFIX
+        || node->op == LEASE_QUERY_OP_CONTAINS;
+    node->match = lease_query_match_string;
+    if (ok)
+      {
+        node->value.str.str = strndup(str, len);
+        node->value.str.len = len;
+        if (!node->value.str.str)
+          {
+            logg_err("Cannot allocate memory.");
+            return -1;
+          }
+      }
+    break;
+  default:
+    ok = 0;
+    break;
+    }
+
+  if (!ok)
+    {
+      lease_query_error(compiler, "operator not supported for this field");
+      return -1;
+    }
+
+  return 0;
+}
+
+static int lease_query_parse_expr(struct lease_query_compiler_t *compiler);
+
+static int
+lease_query_parse_predicate(struct lease_query_compiler_t *compiler)
+{
+  const struct lease_query_field_desc_t *desc;
+  enum lease_query_op_t op;
+  int idx, i;
+
+  if (compiler->token.type != LEASE_QUERY_TOKEN_WORD
+      || !(desc = lease_query_field_lookup(compiler->token.str,
+          compiler->token.len)))
+    {
+      lease_query_error(compiler, "unknown field");
+      return -1;
+    }
+
+  idx = lease_query_add_node(compiler->query, LEASE_QUERY_NODE_PREDICATE, -1,
+      -1);
+  if (idx < 0 || lease_query_next(compiler) < 0)
+    return -1;
+
+  if (desc->kind == LEASE_QUERY_KIND_FLAG)
+    {
+      compiler->query->nodes[idx].field = desc->field;
+      compiler->query->nodes[idx].op = LEASE_QUERY_OP_SET;
+      compiler->query->nodes[idx].value.flag = desc->flag;
+      compiler->query->nodes[idx].match = lease_query_match_flag;
+      return idx;
+    }
+
+  for (i = 0; i < ARRAYSIZE(lease_query_op_names); i++)
+    {
+      if (compiler->token.type != LEASE_QUERY_TOKEN_END
+          && compiler->token.type != LEASE_QUERY_TOKEN_STRING
+          && strlen(lease_query_op_names[i]) == compiler->token.len
+          && !memcmp(lease_query_op_names[i], compiler->token.str,
+              compiler->token.len))
+        break;
+    }
+
+  if (i == ARRAYSIZE(lease_query_op_names))
+    {
+      lease_query_error(compiler, "expected an operator");
+      return -1;
+    }
+  op = i;
+
+  if (lease_query_next(compiler) < 0)
+    return -1;
+
+  if (compiler->token.type != LEASE_QUERY_TOKEN_WORD
+      && compiler->token.type != LEASE_QUERY_TOKEN_STRING)
+    {
+      lease_query_error(compiler, "expected a value");
+      return -1;
+    }
+
+  if (lease_query_build_predicate(compiler, idx, desc, op, compiler->token.str,
+      compiler->token.len) < 0)
+    return -1;
+
+  if (lease_query_next(compiler) < 0)
+    return -1;
+
+  return idx;
+}
+
+static int
+lease_query_parse_factor(struct lease_query_compiler_t *compiler)
+{
+  int idx;
+
+  if (lease_query_token_is(compiler, "not"))
+    {
+      if (lease_query_next(compiler) < 0
+          || (idx = lease_query_parse_factor(compiler)) < 0)
+        return -1;
+
+      return lease_query_add_node(compiler->query, LEASE_QUERY_NODE_NOT, idx,
+          -1);
+    }
+
+  if (compiler->token.type != LEASE_QUERY_TOKEN_LPAREN)
+    return lease_query_parse_predicate(compiler);
+
+  if (lease_query_next(compiler) < 0
+      || (idx = lease_query_parse_expr(compiler)) < 0)
+    return -1;
+
+  if (compiler->token.type != LEASE_QUERY_TOKEN_RPAREN)
+    {
+      lease_query_error(compiler, "expected ')'");
+      return -1;
+    }
+
+  return lease_query_next(compiler) < 0 ? -1 : idx;
+}
+
+static int
+lease_query_parse_term(struct lease_query_compiler_t *compiler)
+{
+  int left, right;
+
+  if ((left = lease_query_parse_factor(compiler)) < 0)
+    return -1;
+
+  while (lease_query_token_is(compiler, "and"))
+    {
+      if (lease_query_next(compiler) < 0
+          || (right = lease_query_parse_factor(compiler)) < 0)
+        return -1;
+
+      left = lease_query_add_node(compiler->query, LEASE_QUERY_NODE_AND, left,
+          right);
+      if (left < 0)
+        return -1;
+    }
+
+  return left;
+}
+
+static int
+lease_query_parse_expr(struct lease_query_compiler_t *compiler)
+{
+  int left, right;
+
+  if ((left = lease_query_parse_term(compiler)) < 0)
+    return -1;
+
+  while (lease_query_token_is(compiler, "or"))
+    {
+      if (lease_query_next(compiler) < 0
+          || (right = lease_query_parse_term(compiler)) < 0)
+        return -1;
+
+      left = lease_query_add_node(compiler->query, LEASE_QUERY_NODE_OR, left,
+          right);
+      if (left < 0)
+        return -1;
+    }
+
+  return left;
+}
+
+struct lease_query_t *
+lease_query_compile(const char *expr)
+{
+  struct lease_query_compiler_t compiler;
+  struct lease_query_t *query;
+
+  if (!expr)
+    {
+      logg_err("parameter error");
+      return NULL;
+    }
+
+  query = calloc(1, sizeof(*query));
+  if (!query)
+    {
+      logg_err("Cannot allocate memory.");
+      return NULL;
+    }
+
+  query->now = time(NULL);
+
+  memset(&compiler, 0, sizeof(compiler));
+  compiler.query = query;
+  compiler.expr = expr;
+  compiler.pos = expr;
+
+  if (lease_query_next(&compiler) < 0)
+    goto error;
+
+  query->root = lease_query_parse_expr(&compiler);
+  if (query->root < 0)
+    goto error;
+
+  if (compiler.token.type != LEASE_QUERY_TOKEN_END)
+    {
+      lease_query_error(&compiler, "unexpected trailing input");
+      goto error;
+    }
+
+  return query;
+
+  error:
+  lease_query_free(query);
+  return NULL;
+}
+
+void
+lease_query_free(struct lease_query_t *query)
+{
+  size_t i;
+
+  if (!query)
+    return;
+
+  for (i = 0; i < query->count; i++)
+    {
+      if (query->nodes[i].type == LEASE_QUERY_NODE_PREDICATE
+          && query->nodes[i].match == lease_query_match_string)
+        free(query->nodes[i].value.str.str);
+    }
+
+  free(query->nodes);
+  free(query);
+}
+
+/*
+ * evaluation
+ */
+
+static int
+lease_query_eval(const struct lease_query_t *query, int idx,
+    const struct lease_element_t *lease)
+{
+  const struct lease_query_node_t *node = &query->nodes[idx];
+
+  switch (node->type)
+    {
+  case LEASE_QUERY_NODE_AND:
+    return lease_query_eval(query, node->left, lease)
+        && lease_query_eval(query, node->right, lease);
+  case LEASE_QUERY_NODE_OR:
+    return lease_query_eval(query, node->left, lease)
+        || lease_query_eval(query, node->right, lease);
+  case LEASE_QUERY_NODE_NOT:
+    return !lease_query_eval(query, node->left, lease);
+  default:
+    return node->match(node, lease) ^ node->negate;
+    }
+}
+
+int
+lease_query_match(const struct lease_query_t *query,
+    const struct lease_element_t *lease)
+{
+  return lease_query_eval(query, query->root, lease);
+}
+
+// 1 true, 0 false, -1 depends on more than the address
+static int
+lease_query_eval_ip(const struct lease_query_t *query, int idx,
+    const struct lease_addr_t *ip)
+{
+  const struct lease_query_node_t *node = &query->nodes[idx];
+  int left, right;
+
+  switch (node->type)
+    {
+  case LEASE_QUERY_NODE_AND:
+    if (!(left = lease_query_eval_ip(query, node->left, ip)))
+      return 0;
+    if (!(right = lease_query_eval_ip(query, node->right, ip)))
+      return 0;
+    return left == 1 && right == 1 ? 1 : -1;
+  case LEASE_QUERY_NODE_OR:
+    if ((left = lease_query_eval_ip(query, node->left, ip)) == 1)
+      return 1;
+    if ((right = lease_query_eval_ip(query, node->right, ip)) == 1)
+      return 1;
+    return !left && !right ? 0 : -1;
+  case LEASE_QUERY_NODE_NOT:
+    left = lease_query_eval_ip(query, node->left, ip);
+    return left < 0 ? -1 : !left;
+  default:
+    if (node->field != LEASE_QUERY_FIELD_IP)
+      return -1;
+    return lease_query_addr_in(node, ip) ^ node->negate;
+    }
+}
+
+int
+lease_query_match_ip(const struct lease_addr_t *ip, void *query)
+{
+  const struct lease_query_t *q = query;
+
+  return lease_query_eval_ip(q, q->root, ip) != 0;
+}
+
+/*
+ * projection
+ */
+
+int
+lease_projection_parse(struct lease_projection_t *projection,
+    const char *list)
+{
+  const struct lease_query_field_desc_t *desc;
+  const char *p = list;
+  size_t len;
+
+  projection->count = 0;
+
+  for (;;)
+    {
+      len = strcspn(p, ",");
+
+      desc = lease_query_field_lookup(p, len);
+      if (!desc)
+        {
+          logg_err("unknown field: %.*s", (int) len, p);
+          return -1;
+        }
+
+      if (projection->count == LEASE_PROJECTION_MAX)
+        {
+          logg_err("more than %d fields", LEASE_PROJECTION_MAX);
+          return -1;
+        }
+
+      projection->fields[projection->count++] = desc->field;
+
+      if (!p[len])
+        break;
+      p += len + 1;
+    }
+
+  return 0;
+}
+
+static void
+lease_projection_print_field(FILE *fp, enum lease_query_field_t field,
+    const struct lease_element_t *lease)
+{
+  const struct lease_query_field_desc_t *desc = lease_query_field_desc(field);
+  char buf[LEASE_ADDR_STR_SIZE];
+  const char *str;
+  time_t t;
+
+  switch (desc->kind)
+    {
+  case LEASE_QUERY_KIND_ADDR:
+    fputs(lease_addr_to_str(&lease->ip, buf, sizeof(buf)), fp);
+    break;
+  case LEASE_QUERY_KIND_HWADDR:
+    str = lease_hwaddr_to_str(&lease->hardware, buf, sizeof(buf));
+    fputs(str ? str : "-", fp);
+    break;
+  case LEASE_QUERY_KIND_STATE:
+    str = lease_binding_state_2_str(*LEASE_QUERY_FIELD(lease, uint8_t,
+        desc->offset));
+    fputs(str ? str : "-", fp);
+    break;
+  case LEASE_QUERY_KIND_TIME:
+    t = *LEASE_QUERY_FIELD(lease, time_t, desc->offset);
+    if (t == LEASE_TIME_NEVER)
+      fputs("never", fp);
+    else
+      fprintf(fp, "%lld", (long long) t);
+    break;
+  case LEASE_QUERY_KIND_STRING:
+    str = *LEASE_QUERY_FIELD(lease, const char *, desc->offset);
+    fputs(str ? str : "-", fp);
+    break;
+  case LEASE_QUERY_KIND_FLAG:
+    fputc(lease->flags & desc->flag ? '1' : '0', fp);
+    break;
+    }
+}
+
+void
+lease_projection_print(FILE *fp, const struct lease_projection_t *projection,
+    const struct lease_element_t *lease)
+{
+  int i;
+
+  for (i = 0; i < projection->count; i++)
+    {
+      if (i)
+        fputc('\t', fp);
+      lease_projection_print_field(fp, projection->fields[i], lease);
+    }
+  fputc('\n', fp);
+}
@@ -0,0 +1,196 @@
+/*
+ * lease_query.h
+ *
+ */
+
+#ifndef _LEASE_QUERY_H_
+#define _LEASE_QUERY_H_
+
+#include <stdio.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <time.h>
+
+#include "lease.h"
+
+/**
+ *
+ * \brief filter expressions over lease records
+ *
+ * expr    := term { "or" term }
+ * term    := factor { "and" factor }
+ * factor  := "not" factor | "(" expr ")" | flag | field op value
+ *
+ * ip                   = != in         address or address/prefix
+ * mac                  = !=            aa:bb:cc:dd:ee:ff
+ * state, next_state    = !=            free, active, expired, ...
+ * starts, ends, tstp, cltt, tsfp, atsfp
+ *                      = != < <= > >=  epoch, never, now, now+N, now-N
+ *                                      (N in seconds or with s/m/h/d)
+ * hostname, uid, vendor_class
+ *                      = != ^= ~       equal, prefix, substring
+ * abandoned, bootp, reserved           the flag is set
+ *
+ * Values containing blanks, parentheses or operator characters are
+ * quoted with '"'. The expression is compiled once into a tree of
+ * predicate nodes, each carrying the match function for its field and
+ * operator; "now" is resolved at compile time.
+ *
+ * lease_query_match_ip() evaluates only the address predicates and can
+ * be handed to the parser as lease_parser_filter_cb_t: blocks that
+ * cannot match are skipped before anything in them is parsed.
+ *
+ * struct lease_query_t *query;
+ *
+ * query = lease_query_compile("state=active and ends<now+600 and ip in 10.1.0.0/16");
+ * lease_table_for_each(lease, table) {
+ *      if (lease_query_match(query, lease))
+ *              Do_something_with(lease);
+ * }
+ * lease_query_free(query);
+ */
+
+enum lease_query_field_t
+{
+  LEASE_QUERY_FIELD_IP,
+  LEASE_QUERY_FIELD_MAC,
+  LEASE_QUERY_FIELD_STATE,
+  LEASE_QUERY_FIELD_NEXT_STATE,
+  LEASE_QUERY_FIELD_STARTS,
+  LEASE_QUERY_FIELD_ENDS,
+  LEASE_QUERY_FIELD_TSTP,
+  LEASE_QUERY_FIELD_CLTT,
+  LEASE_QUERY_FIELD_TSFP,
+  LEASE_QUERY_FIELD_ATSFP,
+  LEASE_QUERY_FIELD_HOSTNAME,
+  LEASE_QUERY_FIELD_UID,
+  LEASE_QUERY_FIELD_VENDOR_CLASS,
+  LEASE_QUERY_FIELD_ABANDONED,
+  LEASE_QUERY_FIELD_BOOTP,
+  LEASE_QUERY_FIELD_RESERVED,
+  LEASE_QUERY_FIELD_MAX,
+};
+
+enum lease_query_kind_t
+{
+  LEASE_QUERY_KIND_ADDR,
+  LEASE_QUERY_KIND_HWADDR,
+  LEASE_QUERY_KIND_STATE,
+  LEASE_QUERY_KIND_TIME,
+  LEASE_QUERY_KIND_STRING,
+  LEASE_QUERY_KIND_FLAG,
+};
+
+// name, value type and location of a field in struct lease_element_t
+struct lease_query_field_desc_t
+{
+  const char *name;
+  enum lease_query_field_t field;
+  enum lease_query_kind_t kind;
+  size_t offset;
+  uint8_t flag;
+};
+
+enum lease_query_op_t
+{
+  LEASE_QUERY_OP_EQ,
+  LEASE_QUERY_OP_NE,
+  LEASE_QUERY_OP_LT,
+  LEASE_QUERY_OP_LE,
+  LEASE_QUERY_OP_GT,
+  LEASE_QUERY_OP_GE,
+  LEASE_QUERY_OP_IN,
+  LEASE_QUERY_OP_PREFIX,
+  LEASE_QUERY_OP_CONTAINS,
+  LEASE_QUERY_OP_SET,
+};
+
+enum lease_query_node_type_t
+{
+  LEASE_QUERY_NODE_AND,
+  LEASE_QUERY_NODE_OR,
+  LEASE_QUERY_NODE_NOT,
+  LEASE_QUERY_NODE_PREDICATE,
+};
+
+struct lease_query_node_t;
+
+typedef int (*lease_query_match_t)(const struct lease_query_node_t *node,
+    const struct lease_element_t *lease);
+
+struct lease_query_node_t
+{
+  enum lease_query_node_type_t type;
+  // children by index, right is unused for NOT
+  int left;
+  int right;
+  // predicates: match() ^ negate
+  enum lease_query_field_t field;
+  enum lease_query_op_t op;
+  lease_query_match_t match;
+  int negate;
+  size_t offset;
+  union
+  {
+    struct
+    {
+      struct lease_addr_t addr;
+      unsigned int prefix_len;
+    } ip;
+    struct lease_hwaddr_t mac;
+    uint8_t state;
+    uint8_t flag;
+    time_t time;
+    struct
+    {
+      char *str;
+      size_t len;
+    } str;
+  } value;
+};
+
+struct lease_query_t
+{
+  struct lease_query_node_t *nodes;
+  size_t count;
+  size_t capacity;
+  int root;
+  time_t now;
+};
+
+const struct lease_query_field_desc_t *lease_query_field_desc(
+    enum lease_query_field_t field);
+
+// NULL on a syntax error, which is logged
+struct lease_query_t *lease_query_compile(const char *expr);
+void lease_query_free(struct lease_query_t *query);
+
+int lease_query_match(const struct lease_query_t *query,
+    const struct lease_element_t *lease);
+// 0 if no lease with this address can match, query is the user pointer
+int lease_query_match_ip(const struct lease_addr_t *ip, void *query);
+
+/**
+ *
+ * \brief columns to print for each lease
+ *
+ * A comma separated list of the field names above, e.g.
+ * "ip,mac,state,ends,hostname". Printed tab separated, times as epoch
+ * seconds, missing strings as "-".
+ */
+
+#define LEASE_PROJECTION_MAX            16
+#define LEASE_PROJECTION_DEFAULT        "ip,mac,state,ends,hostname"
+
+struct lease_projection_t
+{
+  int count;
+  enum lease_query_field_t fields[LEASE_PROJECTION_MAX];
+};
+
+int lease_projection_parse(struct lease_projection_t *projection,
+    const char *list);
+void lease_projection_print(FILE *fp, const struct lease_projection_t *projection,
+    const struct lease_element_t *lease);
+
+#endif /* _LEASE_QUERY_H_ */
@@ -0,0 +1,656 @@
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include "lease_server.h"
+#include "lease_writer.h"
+#include "log.h"
+
+// refresh interval if none is given
+#define LEASE_SERVER_INTERVAL           5
+
+struct lease_server_version_t
+{
+  struct lease_table_t *table;
+  struct lease_server_strings_t *strings;
+  uint64_t generation;
+  // epoch in which it was replaced
+  uint64_t retired;
+  struct lease_server_version_t *next;
+};
+
+// a table of the parser, whose arena holds the strings of versions
+struct lease_server_strings_t
+{
+  struct lease_table_t *table;
+  size_t refs;
+  // replaced by a reload, destroyed with the last version using it
+  int retired;
+  struct lease_server_strings_t *next;
+};
+
+/*
+ * versions and strings, only touched by the thread running
+ * lease_server_run()
+ */
+
+static struct lease_server_strings_t *
+lease_server_strings_get(struct lease_server_t *server)
+{
+  struct lease_server_strings_t *strings = server->strings;
+
+  if (strings && strings->table == server->parser->table)
+    return strings;
+
+  strings = calloc(1, sizeof(*strings));
+  if (!strings)
+    {
+      logg_err("Cannot allocate memory.");
+      return NULL;
+    }
+
+  strings->table = server->parser->table;
+  strings->next = server->strings;
+  server->strings = strings;
+
+  return strings;
+}
+
+static void
+lease_server_strings_free(struct lease_server_t *server,
+    struct lease_server_strings_t *strings)
+{
+  struct lease_server_strings_t **pos;
+
+  for (pos = &server->strings; *pos; pos = &(*pos)->next)
+    {
+      if (*pos == strings)
+        {
+          *pos = strings->next;
+          break;
+        }
+    }
+
+  lease_table_destroy(strings->table);
+  free(strings);
+}
+
+static void
+lease_server_strings_put(struct lease_server_t *server,
+    struct lease_server_strings_t *strings)
+{
+  if (--strings->refs == 0 && strings->retired)
+    lease_server_strings_free(server, strings);
+}
+
+// a reload replaced the parser's table, versions may still use it
+static void
+lease_server_retire_table(struct lease_table_t *table, void *user)
+{
+  struct lease_server_t *server = user;
+  struct lease_server_strings_t *strings;
+
+  for (strings = server->strings; strings; strings = strings->next)
+    {
+      if (strings->table == table)
+        break;
+    }
+
+  if (!strings)
+    {
+      lease_table_destroy(table);
+      return;
+    }
+
+  strings->retired = 1;
+  if (!strings->refs)
+    lease_server_strings_free(server, strings);
+}
+
+static void
+lease_server_version_free(struct lease_server_t *server,
+    struct lease_server_version_t *version)
+{
+  lease_table_destroy(version->table);
+  lease_server_strings_put(server, version->strings);
+  free(version);
+}
+
+// free the replaced versions no reader can still be using
+static void
+lease_server_reclaim(struct lease_server_t *server)
+{
+  struct lease_server_version_t **pos, *version;
+  uint64_t oldest = UINT64_MAX, epoch;
+  int i;
+
+  for (i = 0; i < LEASE_SERVER_CLIENTS_MAX; i++)
+    {
+      epoch = __atomic_load_n(&server->slots[i].epoch, __ATOMIC_SEQ_CST);
+      if (epoch && epoch < oldest)
+        oldest = epoch;
+    }
+
+  // a reader that entered after the swap got the successor
+  for (pos = &server->retired; *pos;)
+    {
+      version = *pos;
+      if (version->retired <= oldest)
+        {
+          *pos = version->next;
+          lease_server_version_free(server, version);
+        }
+      else
+        pos = &version->next;
+    }
+}
+
+static int
+lease_server_publish(struct lease_server_t *server)
+{
+  struct lease_server_version_t *version, *old;
+
+  version = calloc(1, sizeof(*version));
+  if (!version)
+    {
+      logg_err("Cannot allocate memory.");
+      return -1;
+    }
+
+  version->strings = lease_server_strings_get(server);
+  if (!version->strings)
+    {
+      free(version);
+      return -1;
+    }
+
+  version->table = lease_table_copy(server->parser->table);
+  if (!version->table)
+    {
+      free(version);
+      return -1;
+    }
+
+  version->strings->refs++;
+  version->generation = ++server->generation;
+
+  old = __atomic_exchange_n(&server->current, version, __ATOMIC_SEQ_CST);
+  if (old)
+    {
+      old->retired = __atomic_add_fetch(&server->epoch, 1, __ATOMIC_SEQ_CST);
+      old->next = server->retired;
+      server->retired = old;
+    }
+
+  return 0;
+}
+
+/*
+ * readers
+ */
+
+static struct lease_server_version_t *
+lease_server_enter(struct lease_server_slot_t *slot)
+{
+  struct lease_server_t *server = slot->server;
+
+  __atomic_store_n(&slot->epoch,
+      __atomic_load_n(&server->epoch, __ATOMIC_SEQ_CST), __ATOMIC_SEQ_CST);
+
+  return __atomic_load_n(&server->current, __ATOMIC_SEQ_CST);
+}
+
+static void
+lease_server_leave(struct lease_server_slot_t *slot)
+{
+  __atomic_store_n(&slot->epoch, 0, __ATOMIC_RELEASE);
+}
+
+static void
+lease_server_le(unsigned char *p, uint64_t v, int n)
+{
+  int i;
+
+  for (i = 0; i < n; i++)
+    p[i] = v >> (8 * i);
+}
+
+static int
+lease_server_read_full(int fd, void *buf, size_t len)
+{
+  size_t off = 0;
+  ssize_t n;
+
+  while (off < len)
+    {
+      n = read(fd, (char *) buf + off, len - off);
+      if (n < 0 && errno == EINTR)
+        continue;
+      if (n <= 0)
+        return -1;
+      off += n;
+    }
+
+  return 0;
+}
+
+static void
+lease_server_handle(struct lease_server_slot_t *slot, int op, const char *arg,
+    size_t len)
+{
+  enum lease_server_status_t status = LEASE_SERVER_STATUS_OK;
+  struct lease_writer_t *writer = slot->writer;
+  struct lease_server_version_t *version;
+  const struct lease_element_t *lease = NULL;
+  const struct lease_table_t *table;
+  struct lease_query_t *query = NULL;
+  struct lease_hwaddr_t mac;
+  struct lease_addr_t ip;
+  unsigned char header[9], trailer[12];
+  uint64_t count = 0;
+
+  // the argument is parsed before a version is held
+  switch (op)
+    {
+  case LEASE_SERVER_OP_LOOKUP_IP:
+    if (lease_addr_parse(arg, len, &ip) < 0)
+      status = LEASE_SERVER_STATUS_BAD_REQUEST;
+    break;
+  case LEASE_SERVER_OP_LOOKUP_MAC:
+    if (lease_hwaddr_parse("ethernet", 8, arg, len, &mac) < 0)
+      status = LEASE_SERVER_STATUS_BAD_REQUEST;
+    break;
+  case LEASE_SERVER_OP_FILTER:
+  case LEASE_SERVER_OP_COUNT:
+    if (len && !(query = lease_query_compile(arg)))
+      status = LEASE_SERVER_STATUS_BAD_REQUEST;
+    break;
+  default:
+    status = LEASE_SERVER_STATUS_BAD_REQUEST;
+    break;
+    }
+
+  version = lease_server_enter(slot);
+  table = version->table;
+
+  if (status == LEASE_SERVER_STATUS_OK)
+    {
+      if (op == LEASE_SERVER_OP_LOOKUP_IP)
+        lease = lease_table_lookup_by_ip(table, &ip);
+      else if (op == LEASE_SERVER_OP_LOOKUP_MAC)
+        lease = lease_table_lookup_by_mac(table, &mac);
+
+      if ((op == LEASE_SERVER_OP_LOOKUP_IP || op == LEASE_SERVER_OP_LOOKUP_MAC)
+          && !lease)
+        status = LEASE_SERVER_STATUS_NOT_FOUND;
+    }
+
+  header[0] = status;
+  lease_server_le(header + 1, version->generation, 8);
+  if (lease_writer_write_bytes(writer, header, sizeof(header)) < 0)
+    goto end;
+
+  if (status == LEASE_SERVER_STATUS_OK)
+    {
+      switch (op)
+        {
+      case LEASE_SERVER_OP_LOOKUP_IP:
+      case LEASE_SERVER_OP_LOOKUP_MAC:
+        count = 1;
+        lease_writer_write(writer, lease);
+        break;
+      case LEASE_SERVER_OP_FILTER:
+        lease_table_for_each(lease, table)
+        {
+          if (query && !lease_query_match(query, lease))
+            continue;
+          count++;
+          if (lease_writer_write(writer, lease) < 0)
+            break;
+        }
+        break;
+      case LEASE_SERVER_OP_COUNT:
+        if (!query)
+          count = lease_table_size(table);
+        else
+          lease_table_for_each(lease, table)
+          {
+            count += lease_query_match(query, lease);
+          }
+        break;
+        }
+    }
+
+  lease_server_le(trailer, 0, 4);
+  lease_server_le(trailer + 4, count, 8);
+  lease_writer_write_bytes(writer, trailer, sizeof(trailer));
+
+  end:
+  lease_server_leave(slot);
+  lease_query_free(query);
+}
+
+static void *
+lease_server_client(void *arg)
+{
+  struct lease_server_slot_t *slot = arg;
+  char request[LEASE_SERVER_REQUEST_MAX + 1];
+  unsigned char prefix[4];
+  uint32_t len;
+
+  // the record layout first
+  if (lease_writer_flush(slot->writer) < 0)
+    goto end;
+
+  while (!slot->server->stop)
+    {
+      if (lease_server_read_full(slot->fd, prefix, sizeof(prefix)) < 0)
+        break;
+
+      len = prefix[0] | prefix[1] << 8 | prefix[2] << 16
+          | (uint32_t) prefix[3] << 24;
+      if (!len || len > LEASE_SERVER_REQUEST_MAX)
+        {
+          logg(LOG_WARNING, "client request of %u bytes, disconnected", len);
+          break;
+        }
+
+      if (lease_server_read_full(slot->fd, request, len) < 0)
+        break;
+      // the filter expression is a C string
+      request[len] = '\0';
+
+      lease_server_handle(slot, (unsigned char) request[0], request + 1,
+          len - 1);
+      if (lease_writer_flush(slot->writer) < 0)
+        break;
+    }
+
+  end:
+  __atomic_store_n(&slot->done, 1, __ATOMIC_RELEASE);
+  return NULL;
+}
+
+/*
+ * clients
+ */
+
+// join the thread of a slot and close its connection
+static void
+lease_server_slot_release(struct lease_server_slot_t *slot)
+{
+  if (!slot->started)
+    return;
+
+  pthread_join(slot->thread, NULL);
+  lease_writer_close(slot->writer);
+  close(slot->fd);
+  slot->writer = NULL;
+  slot->fd = -1;
+  slot->started = 0;
+}
+
+static struct lease_server_slot_t *
+lease_server_slot_get(struct lease_server_t *server)
+{
+  struct lease_server_slot_t *slot;
+  int i;
+
+  for (i = 0; i < LEASE_SERVER_CLIENTS_MAX; i++)
+    {
+      slot = &server->slots[i];
+      if (slot->started && !__atomic_load_n(&slot->done, __ATOMIC_ACQUIRE))
+        continue;
+
+      lease_server_slot_release(slot);
+      return slot;
+    }
+
+  return NULL;
+}
+
+static void *
+lease_server_accept(void *arg)
+{
+  struct lease_server_t *server = arg;
+  struct lease_server_slot_t *slot;
+  int fd;
+
+  while (!server->stop)
+    {
+      fd = accept4(server->fd, NULL, NULL, SOCK_CLOEXEC);
+      if (fd < 0)
+        {
+          if (errno == EINTR || errno == ECONNABORTED)
+            continue;
+          break;
+        }
+
+      slot = lease_server_slot_get(server);
+      if (!slot)
+        {
+          logg(LOG_WARNING, "%d clients connected, client refused",
+              LEASE_SERVER_CLIENTS_MAX);
+          close(fd);
+          continue;
+        }
+
+      slot->writer = lease_writer_new(fd, LEASE_WRITER_FORMAT_BINARY,
+          &server->projection);
+      if (!slot->writer)
+        {
+          close(fd);
+          continue;
+        }
+
+      slot->fd = fd;
+      slot->done = 0;
+      if (pthread_create(&slot->thread, NULL, lease_server_client, slot))
+        {
+          logg_err("can't create client thread");
+          lease_writer_close(slot->writer);
+          slot->writer = NULL;
+          close(fd);
+          continue;
+        }
+      slot->started = 1;
+    }
+
+  return NULL;
+}
+
+static int
+lease_server_listen(struct lease_server_t *server, const char *path)
+{
+  struct sockaddr_un addr;
+
+  if (strlen(path) >= sizeof(addr.sun_path))
+    {
+      logg_err("socket path too long: %s", path);
+      return -1;
+    }
+
+  memset(&addr, 0, sizeof(addr));
+  addr.sun_family = AF_UNIX;
+  strcpy(addr.sun_path, path);
+
+  server->fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+  if (server->fd < 0)
+    goto error;
+
+  // a socket left behind by an earlier run
+  unlink(path);
+  if (bind(server->fd, (struct sockaddr *) &addr, sizeof(addr)) < 0)
+    goto error;
+
+  server->socket_path = strdup(path);
+  if (!server->socket_path)
+    {
+      logg_err("Cannot allocate memory.");
+      return -1;
+    }
+
+  if (listen(server->fd, LEASE_SERVER_CLIENTS_MAX) < 0)
+    goto error;
+
+  return 0;
+
+  error:
+  logg_err("can't listen on %s (%s)", path, strerror(errno));
+  return -1;
+}
+
+struct lease_server_t *
+lease_server_new(const char *file_path, enum lease_parser_read_mode_t mode,
+    const char *socket_path, unsigned int interval,
+    const struct lease_projection_t *projection)
+{
+  struct lease_server_t *server;
+  int i;
+
+  server = calloc(1, sizeof(*server));
+  if (!server)
+    {
+      logg_err("Cannot allocate memory.");
+      return NULL;
+    }
+
+  server->fd = -1;
+  server->interval = interval ? interval : LEASE_SERVER_INTERVAL;
+  server->projection = *projection;
+  // 0 is the epoch of a slot reading nothing
+  server->epoch = 1;
+  for (i = 0; i < LEASE_SERVER_CLIENTS_MAX; i++)
+    {
+      server->slots[i].server = server;
+      server->slots[i].fd = -1;
+    }
+
+  server->parser = lease_parser_open(file_path, mode);
+  if (!server->parser)
+    goto error;
+
+  server->parser->on_retire = lease_server_retire_table;
+  server->parser->retire_user = server;
+
+  if (lease_server_publish(server) < 0)
+    goto error;
+
+  // a client gone before its response is not worth dying for
+  signal(SIGPIPE, SIG_IGN);
+
+  if (lease_server_listen(server, socket_path) < 0)
+    goto error;
+
+  if (pthread_create(&server->acceptor, NULL, lease_server_accept, server))
+    {
+      logg_err("can't create accept thread");
+      goto error;
+    }
+  server->accepting = 1;
+
+  return server;
+
+  error:
+  lease_server_destroy(server);
+  return NULL;
+}
+
+void
+lease_server_destroy(struct lease_server_t *server)
+{
+  struct lease_server_strings_t *strings;
+  struct lease_server_version_t *version;
+  struct lease_server_slot_t *slot;
+  int i;
+
+  if (!server)
+    return;
+
+  server->stop = 1;
+  if (server->fd >= 0)
+    shutdown(server->fd, SHUT_RDWR);
+  if (server->accepting)
+    pthread_join(server->acceptor, NULL);
+
+  for (i = 0; i < LEASE_SERVER_CLIENTS_MAX; i++)
+    {
+      slot = &server->slots[i];
+      // wakes the read() of the client thread
+      if (slot->started)
+        shutdown(slot->fd, SHUT_RDWR);
+      lease_server_slot_release(slot);
+    }
+
+  if (server->fd >= 0)
+    close(server->fd);
+  if (server->socket_path)
+    {
+      unlink(server->socket_path);
+      free(server->socket_path);
+    }
+
+  // no reader is left
+  while ((version = server->retired))
+    {
+      server->retired = version->next;
+      lease_server_version_free(server, version);
+    }
+  if (server->current)
+    lease_server_version_free(server, server->current);
+
+  // the strings of the parser's table go with the parser
+  lease_parser_close(server->parser);
+  while ((strings = server->strings))
+    {
+      server->strings = strings->next;
+      free(strings);
+    }
+
+  free(server);
+}
+
+int
+lease_server_run(struct lease_server_t *server)
+{
+  while (!server->stop)
+    {
+      sleep(server->interval);
+      if (server->stop)
+        break;
+
+      switch (lease_parser_refresh(server->parser))
+        {
+      case LEASE_PARSER_REFRESH_APPENDED:
+      case LEASE_PARSER_REFRESH_RELOADED:
+        if (lease_server_publish(server) < 0)
+          logg_err("can't publish lease table");
+        else
+          logg(LOG_DEBUG, "version %llu published, %zu leases",
+              (unsigned long long) server->generation,
+              lease_table_size(server->parser->table));
+        break;
+      case LEASE_PARSER_REFRESH_UNCHANGED:
+        break;
+      default:
+        logg_err("error refresh lease file");
+        break;
+        }
+
+      lease_server_reclaim(server);
+    }
+
+  return 0;
+}
+
+void
+lease_server_stop(struct lease_server_t *server)
+{
+  server->stop = 1;
+}
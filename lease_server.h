@@ -0,0 +1,122 @@
+/*
+ * lease_server.h
+ *
+ */
+
+#ifndef _LEASE_SERVER_H_
+#define _LEASE_SERVER_H_
+
+#include <pthread.h>
+#include <signal.h>
+#include <stdint.h>
+
+#include "lease_parser.h"
+#include "lease_table.h"
+#include "lease_writer.h"
+
+#define LEASE_SERVER_CLIENTS_MAX        64
+#define LEASE_SERVER_REQUEST_MAX        4096
+#define LEASE_SERVER_CACHE_LINE         64
+
+enum lease_server_op_t
+{
+  LEASE_SERVER_OP_LOOKUP_IP = 1,
+  LEASE_SERVER_OP_LOOKUP_MAC,
+  LEASE_SERVER_OP_FILTER,
+  LEASE_SERVER_OP_COUNT,
+};
+
+enum lease_server_status_t
+{
+  LEASE_SERVER_STATUS_OK,
+  LEASE_SERVER_STATUS_NOT_FOUND,
+  LEASE_SERVER_STATUS_BAD_REQUEST,
+  LEASE_SERVER_STATUS_ERROR,
+};
+
+/**
+ *
+ * \brief lease queries over a unix socket
+ *
+ * One process parses the lease file and answers the lookups of local
+ * clients from memory. The table the clients read is never changed:
+ * after a refresh that changed something the refresh thread publishes a
+ * copy of the parser's table (lease_table_copy(), records and indexes
+ * only, the strings are shared) with an atomic pointer swap. A reader
+ * takes no lock, it announces the epoch it entered in and loads the
+ * current version; a replaced version is freed once no reader is left in
+ * an epoch older than its replacement. Readers never wait for a refresh
+ * and the refresh never waits for readers, a slow reader only delays
+ * freeing memory. The table a reload replaces lives on as long as a
+ * version still points to its strings.
+ *
+ * Each client gets a thread of its own. The protocol, integers little
+ * endian:
+ *
+ * on connect   the header of lease_writer binary output: "LEASEREC",
+ *              u16 version, u16 field count, u8 field id per field
+ * request      u32 length, u8 op (enum lease_server_op_t) and the
+ *              argument: an address, a MAC address or a filter
+ *              expression (lease_query_compile(), empty matches all)
+ * response     u8 status (enum lease_server_status_t), u64 version of
+ *              the table, the matching leases as binary records (u32
+ *              length and the fields), a u32 0 and the u64 count of
+ *              matching leases; LEASE_SERVER_OP_COUNT sends no records
+ *
+ * server = lease_server_new(path, mode, "/run/lease_parser.sock", 5,
+ *              &projection);
+ * lease_server_run(server);    // until lease_server_stop()
+ * lease_server_destroy(server);
+ */
+
+struct lease_server_version_t;
+struct lease_server_strings_t;
+struct lease_server_t;
+
+// a client thread, epoch is 0 while it reads no version
+struct lease_server_slot_t
+{
+  uint64_t epoch __attribute__((aligned(LEASE_SERVER_CACHE_LINE)));
+  struct lease_server_t *server;
+  struct lease_writer_t *writer;
+  pthread_t thread;
+  int fd;
+  int started;
+  int done;
+};
+
+struct lease_server_t
+{
+  struct lease_parser_t *parser;
+  struct lease_projection_t projection;
+  unsigned int interval;
+  char *socket_path;
+  int fd;
+  pthread_t acceptor;
+  int accepting;
+  volatile sig_atomic_t stop;
+  // version the clients read and the epoch it was published in
+  struct lease_server_version_t *current;
+  uint64_t epoch;
+  uint64_t generation;
+  // replaced versions not freed yet, newest first
+  struct lease_server_version_t *retired;
+  // owners of the strings of the versions, the parser's table first
+  struct lease_server_strings_t *strings;
+  struct lease_server_slot_t slots[LEASE_SERVER_CLIENTS_MAX];
+};
+
+/*
+ * parse file_path, listen on socket_path and accept clients; the table
+ * is refreshed every interval seconds by lease_server_run()
+ */
+struct lease_server_t *lease_server_new(const char *file_path,
+    enum lease_parser_read_mode_t mode, const char *socket_path,
+    unsigned int interval, const struct lease_projection_t *projection);
+void lease_server_destroy(struct lease_server_t *server);
+
+int lease_server_run(struct lease_server_t *server);
+// async signal safe
+void lease_server_stop(struct lease_server_t *server);
+
+#endif /* _LEASE_SERVER_H_ */
@@ -0,0 +1,695 @@
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stddef.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "lease_snapshot.h"
+#include "log.h"
+#include "toolbox.h"
+
+#define ARRAYSIZE(n) (sizeof(n)/sizeof(n[0]))
+
+#define LEASE_SNAPSHOT_ALIGN(n)         (((n) + 7) & ~(uint64_t) 7)
+
+// string fields of the records and of their extension
+static const size_t lease_snapshot_record_strings[] =
+    {
+        offsetof(struct lease_element_t, client_hostname),
+        offsetof(struct lease_element_t, uid),
+        offsetof(struct lease_element_t, vendor_class_identifier),
+    };
+
+static const size_t lease_snapshot_ext_strings[] =
+    {
+        offsetof(struct lease_element_ext_t, billing_class),
+        offsetof(struct lease_element_ext_t, ddns_fwd_name),
+        offsetof(struct lease_element_ext_t, ddns_rev_name),
+        offsetof(struct lease_element_ext_t, ddns_txt),
+        offsetof(struct lease_element_ext_t, ddns_client_fqdn),
+        offsetof(struct lease_element_ext_t, agent_circuit_id),
+        offsetof(struct lease_element_ext_t, agent_remote_id),
+        offsetof(struct lease_element_ext_t, agent_subscriber_id),
+    };
+
+static const size_t lease_snapshot_failover_strings[] =
+    {
+        offsetof(struct lease_failover_t, peer),
+        offsetof(struct lease_failover_t, my_state),
+        offsetof(struct lease_failover_t, partner_state),
+    };
+
+#define LEASE_SNAPSHOT_FIELD(base, offset) \
+        (*(const char **) ((char *) (base) + (offset)))
+
+/*
+ * offsets of the strings in the blob, keyed by pointer: interned strings
+ * are shared by many records but stored once
+ */
+struct lease_snapshot_strings_t
+{
+  const char **keys;
+  uint64_t *offsets;
+  size_t size;
+  size_t count;
+  uint64_t len;
+};
+
+static size_t
+lease_snapshot_strings_find(const struct lease_snapshot_strings_t *strings,
+    const char *str)
+{
+  uint64_t h = (uintptr_t) str;
+  size_t i, mask = strings->size - 1;
+
+  h ^= h >> 33;
+  h *= 0xff51afd7ed558ccdull;
+  h ^= h >> 33;
+
+  for (i = h & mask; strings->keys[i] && strings->keys[i] != str;
+      i = (i + 1) & mask)
+    ;
+
+  return i;
+}
+
+static int
+lease_snapshot_strings_resize(struct lease_snapshot_strings_t *strings)
+{
+  struct lease_snapshot_strings_t grown;
+  size_t i, slot;
+
+  grown.size = strings->size ? strings->size * 2 : 1024;
+  grown.count = strings->count;
+  grown.len = strings->len;
+  grown.keys = calloc(grown.size, sizeof(*grown.keys));
+  grown.offsets = malloc(grown.size * sizeof(*grown.offsets));
+  if (!grown.keys || !grown.offsets)
+    {
+      logg_err("Cannot allocate memory.");
+      free(grown.keys);
+      free(grown.offsets);
+      return -1;
+    }
+
+  for (i = 0; i < strings->size; i++)
+    {
+      if (!strings->keys[i])
+        continue;
+
+      slot = lease_snapshot_strings_find(&grown, strings->keys[i]);
+      grown.keys[slot] = strings->keys[i];
+      grown.offsets[slot] = strings->offsets[i];
+    }
+
+  free(strings->keys);
+  free(strings->offsets);
+  *strings = grown;
+
+  return 0;
+}
+
+static int
+lease_snapshot_strings_add(struct lease_snapshot_strings_t *strings,
+    const char *str)
+{
+  size_t slot;
+
+  if (!str)
+    return 0;
+
+  if ((strings->count + 1) * 2 > strings->size
+      && lease_snapshot_strings_resize(strings) < 0)
+    return -1;
+
+  slot = lease_snapshot_strings_find(strings, str);
+  if (strings->keys[slot])
+    return 0;
+
+  strings->keys[slot] = str;
+  strings->offsets[slot] = strings->len;
+  strings->count++;
+  strings->len += strlen(str) + 1;
+
+  return 0;
+}
+
+// offset + 1 of a string added before, 0 for NULL
+static uint64_t
+lease_snapshot_strings_ref(const struct lease_snapshot_strings_t *strings,
+    const char *str)
+{
+  if (!str)
+    return 0;
+
+  return strings->offsets[lease_snapshot_strings_find(strings, str)] + 1;
+}
+
+static void
+lease_snapshot_strings_release(struct lease_snapshot_strings_t *strings)
+{
+  free(strings->keys);
+  free(strings->offsets);
+}
+
+char *
+lease_snapshot_path(const char *file_path, const char *cache_dir)
+{
+  const char *name;
+  char *path;
+
+  if (!cache_dir)
+    {
+      if (asprintf(&path, "%s%s", file_path, LEASE_SNAPSHOT_SUFFIX) < 0)
+        return NULL;
+      return path;
+    }
+
+  name = strrchr(file_path, '/');
+  name = name ? name + 1 : file_path;
+
+  if (asprintf(&path, "%s/%s%s", cache_dir, name, LEASE_SNAPSHOT_SUFFIX) < 0)
+    return NULL;
+
+  return path;
+}
+
+static void
+lease_snapshot_layout(struct lease_snapshot_header_t *header,
+    const struct lease_table_t *table)
+{
+  uint64_t off = LEASE_SNAPSHOT_ALIGN(sizeof(*header));
+
+  header->count = table->count;
+  header->records_off = off;
+  off += table->count * sizeof(struct lease_element_t);
+  header->ends_off = off = LEASE_SNAPSHOT_ALIGN(off);
+  off += table->count * sizeof(time_t);
+  header->state_off = off;
+  off += table->count;
+  header->ip_index_off = off = LEASE_SNAPSHOT_ALIGN(off);
+  header->ip_index_size = table->ip_index.size;
+  header->ip_index_count = table->ip_index.count;
+  off += table->ip_index.size * sizeof(uint32_t);
+  header->mac_index_off = off = LEASE_SNAPSHOT_ALIGN(off);
+  header->mac_index_size = table->mac_index.size;
+  header->mac_index_count = table->mac_index.count;
+  off += table->mac_index.size * sizeof(uint32_t);
+  header->ext_off = off = LEASE_SNAPSHOT_ALIGN(off);
+  off += header->ext_count * sizeof(struct lease_element_ext_t);
+  header->failover_off = off = LEASE_SNAPSHOT_ALIGN(off);
+  header->failover_count = table->failover_count;
+  off += table->failover_count * sizeof(struct lease_failover_t);
+  header->strings_off = off;
+  header->file_size = off + header->strings_len;
+}
+
+// write data at offset off of the snapshot, padding the gap behind pos
+static int
+lease_snapshot_write(FILE *fp, uint64_t *pos, uint64_t off, const void *data,
+    size_t len)
+{
+  static const char zero[8];
+
+  if (off - *pos > sizeof(zero) || fwrite(zero, 1, off - *pos, fp) != off - *pos)
+    return -1;
+
+  if (len && fwrite(data, 1, len, fp) != len)
+    return -1;
+
+  *pos = off + len;
+  return 0;
+}
+
+// append the strings of fields that start the rest of the blob
+static int
+lease_snapshot_write_strings(FILE *fp, uint64_t *pos,
+    const struct lease_snapshot_header_t *header,
+    const struct lease_snapshot_strings_t *strings, const char *const *fields,
+    int n, uint64_t *written)
+{
+  size_t len;
+  int i;
+
+  for (i = 0; i < n; i++)
+    {
+      if (lease_snapshot_strings_ref(strings, fields[i]) != *written + 1)
+        continue;
+
+      len = strlen(fields[i]) + 1;
+      if (lease_snapshot_write(fp, pos, header->strings_off + *written,
+          fields[i], len) < 0)
+        return -1;
+      *written += len;
+    }
+
+  return 0;
+}
+
+static int
+lease_snapshot_write_table(FILE *fp, struct lease_snapshot_header_t *header,
+    const struct lease_table_t *table,
+    const struct lease_snapshot_strings_t *strings)
+{
+  const struct lease_element_t *lease;
+  struct lease_element_t record;
+  struct lease_element_ext_t ext;
+  struct lease_failover_t failover;
+  uint64_t pos = 0, off, ext_idx = 0, written = 0;
+  size_t k;
+  int i;
+
+  if (lease_snapshot_write(fp, &pos, 0, header, sizeof(*header)) < 0)
+    return -1;
+
+  off = header->records_off;
+  lease_table_for_each(lease, table)
+  {
+    record = *lease;
+    for (i = 0; i < ARRAYSIZE(lease_snapshot_record_strings); i++)
+      LEASE_SNAPSHOT_FIELD(&record, lease_snapshot_record_strings[i]) =
+          (const char *) (uintptr_t) lease_snapshot_strings_ref(strings,
+              LEASE_SNAPSHOT_FIELD(lease, lease_snapshot_record_strings[i]));
+    record.ext = lease->ext ? (void *) (uintptr_t) ++ext_idx : NULL;
+
+    if (lease_snapshot_write(fp, &pos, off, &record, sizeof(record)) < 0)
+      return -1;
+    off += sizeof(record);
+  }
+
+  if (lease_snapshot_write(fp, &pos, header->ends_off, table->ends,
+      table->count * sizeof(*table->ends)) < 0
+      || lease_snapshot_write(fp, &pos, header->state_off, table->binding_state,
+          table->count) < 0
+      || lease_snapshot_write(fp, &pos, header->ip_index_off,
+          table->ip_index.slots, table->ip_index.size * sizeof(uint32_t)) < 0
+      || lease_snapshot_write(fp, &pos, header->mac_index_off,
+          table->mac_index.slots, table->mac_index.size * sizeof(uint32_t)) < 0)
+    return -1;
+
+  off = header->ext_off;
+  lease_table_for_each(lease, table)
+  {
+    if (!lease->ext)
+      continue;
+
+    ext = *lease->ext;
+    for (i = 0; i < ARRAYSIZE(lease_snapshot_ext_strings); i++)
+      LEASE_SNAPSHOT_FIELD(&ext, lease_snapshot_ext_strings[i]) =
+          (const char *) (uintptr_t) lease_snapshot_strings_ref(strings,
+              LEASE_SNAPSHOT_FIELD(lease->ext, lease_snapshot_ext_strings[i]));
+
+    if (lease_snapshot_write(fp, &pos, off, &ext, sizeof(ext)) < 0)
+      return -1;
+    off += sizeof(ext);
+  }
+
+  off = header->failover_off;
+  for (k = 0; k < table->failover_count; k++)
+    {
+      failover = table->failover[k];
+      for (i = 0; i < ARRAYSIZE(lease_snapshot_failover_strings); i++)
+        LEASE_SNAPSHOT_FIELD(&failover, lease_snapshot_failover_strings[i]) =
+            (const char *) (uintptr_t) lease_snapshot_strings_ref(strings,
+                LEASE_SNAPSHOT_FIELD(&table->failover[k],
+                    lease_snapshot_failover_strings[i]));
+
+      if (lease_snapshot_write(fp, &pos, off, &failover, sizeof(failover)) < 0)
+        return -1;
+      off += sizeof(failover);
+    }
+
+  /*
+   * walking the records in the same order as when the offsets were
+   * assigned meets every string first at the end of the blob
+   */
+  lease_table_for_each(lease, table)
+  {
+    const char *fields[ARRAYSIZE(lease_snapshot_record_strings)
+        + ARRAYSIZE(lease_snapshot_ext_strings)];
+    int n = 0;
+
+    for (i = 0; i < ARRAYSIZE(lease_snapshot_record_strings); i++)
+      fields[n++] = LEASE_SNAPSHOT_FIELD(lease, lease_snapshot_record_strings[i]);
+    for (i = 0; lease->ext && i < ARRAYSIZE(lease_snapshot_ext_strings); i++)
+      fields[n++] = LEASE_SNAPSHOT_FIELD(lease->ext, lease_snapshot_ext_strings[i]);
+
+    if (lease_snapshot_write_strings(fp, &pos, header, strings, fields, n,
+        &written) < 0)
+      return -1;
+  }
+
+  // the file-wide strings were added last
+  if (lease_snapshot_write_strings(fp, &pos, header, strings,
+      &table->server_duid, 1, &written) < 0)
+    return -1;
+
+  for (k = 0; k < table->failover_count; k++)
+    {
+      const char *fields[ARRAYSIZE(lease_snapshot_failover_strings)];
+
+      for (i = 0; i < ARRAYSIZE(lease_snapshot_failover_strings); i++)
+        fields[i] = LEASE_SNAPSHOT_FIELD(&table->failover[k],
+            lease_snapshot_failover_strings[i]);
+
+      if (lease_snapshot_write_strings(fp, &pos, header, strings, fields,
+          ARRAYSIZE(fields), &written) < 0)
+        return -1;
+    }
+
+  return pos == header->file_size ? 0 : -1;
+}
+
+int
+lease_snapshot_save(const struct lease_parser_t *parser, const char *snap_path)
+{
+  const struct lease_table_t *table = parser->table;
+  struct lease_snapshot_strings_t strings;
+  struct lease_snapshot_header_t header;
+  const struct lease_element_t *lease;
+  char *tmp_path = NULL;
+  FILE *fp = NULL;
+  int i, fd, ret = -1;
+  size_t k;
+
+  memset(&strings, 0, sizeof(strings));
+  memset(&header, 0, sizeof(header));
+
+  lease_table_for_each(lease, table)
+  {
+    for (i = 0; i < ARRAYSIZE(lease_snapshot_record_strings); i++)
+      if (lease_snapshot_strings_add(&strings,
+          LEASE_SNAPSHOT_FIELD(lease, lease_snapshot_record_strings[i])) < 0)
+        goto end;
+
+    if (!lease->ext)
+      continue;
+
+    header.ext_count++;
+    for (i = 0; i < ARRAYSIZE(lease_snapshot_ext_strings); i++)
+      if (lease_snapshot_strings_add(&strings,
+          LEASE_SNAPSHOT_FIELD(lease->ext, lease_snapshot_ext_strings[i])) < 0)
+        goto end;
+  }
+
+  if (lease_snapshot_strings_add(&strings, table->server_duid) < 0)
+    goto end;
+
+  for (k = 0; k < table->failover_count; k++)
+    {
+      for (i = 0; i < ARRAYSIZE(lease_snapshot_failover_strings); i++)
+        if (lease_snapshot_strings_add(&strings,
+            LEASE_SNAPSHOT_FIELD(&table->failover[k],
+                lease_snapshot_failover_strings[i])) < 0)
+          goto end;
+    }
+
+  memcpy(header.magic, LEASE_SNAPSHOT_MAGIC, sizeof(header.magic));
+  header.version = LEASE_SNAPSHOT_VERSION;
+  header.record_size = sizeof(struct lease_element_t);
+  header.dev = parser->dev;
+  header.ino = parser->ino;
+  header.size = parser->size;
+  header.mtime_sec = parser->mtime.tv_sec;
+  header.mtime_nsec = parser->mtime.tv_nsec;
+  header.offset = parser->offset;
+  header.server_duid = lease_snapshot_strings_ref(&strings, table->server_duid);
+  header.strings_len = strings.len;
+  lease_snapshot_layout(&header, table);
+
+  if (asprintf(&tmp_path, "%s.XXXXXX", snap_path) < 0)
+    {
+      tmp_path = NULL;
+      logg_err("Cannot allocate memory.");
+      goto end;
+    }
+
+  fd = mkstemp(tmp_path);
+  if (fd < 0)
+    {
+      logg_err("can't create %s (%s)", tmp_path, strerror(errno));
+      goto end;
+    }
+
+  fp = fdopen(fd, "w");
+  if (!fp)
+    {
+      close(fd);
+      goto error_unlink;
+    }
+
+  if (lease_snapshot_write_table(fp, &header, table, &strings) < 0
+      || fflush(fp) || fsync(fd) < 0)
+    {
+      logg_err("can't write %s (%s)", tmp_path, strerror(errno));
+      fclose(fp);
+      goto error_unlink;
+    }
+
+  if (fclose(fp) || rename(tmp_path, snap_path) < 0)
+    {
+      logg_err("can't write %s (%s)", snap_path, strerror(errno));
+      goto error_unlink;
+    }
+
+  ret = 0;
+  goto end;
+
+  error_unlink:
+  unlink(tmp_path);
+  end:
+  free(tmp_path);
+  lease_snapshot_strings_release(&strings);
+  return ret;
+}
+
+// [off, off + count * size) lies within the snapshot and is aligned
+static int
+lease_snapshot_section_ok(const struct lease_snapshot_header_t *header,
+    uint64_t off, uint64_t count, uint64_t size)
+{
+  if (off % 8 || off > header->file_size)
+    return 0;
+
+  return count <= (header->file_size - off) / size;
+}
+
+static int
+lease_snapshot_header_ok(const struct lease_snapshot_header_t *header,
+    size_t file_size)
+{
+  if (memcmp(header->magic, LEASE_SNAPSHOT_MAGIC, sizeof(header->magic))
+      || header->version != LEASE_SNAPSHOT_VERSION
+      || header->record_size != sizeof(struct lease_element_t)
+      || header->file_size != file_size)
+    return 0;
+
+  // the index code relies on power of two sizes below half load
+  if ((header->ip_index_size & (header->ip_index_size - 1))
+      || (header->mac_index_size & (header->mac_index_size - 1))
+      || header->ip_index_count * 2 > header->ip_index_size
+      || header->mac_index_count * 2 > header->mac_index_size
+      || header->count > UINT32_MAX - 1)
+    return 0;
+
+  return lease_snapshot_section_ok(header, header->records_off, header->count,
+      sizeof(struct lease_element_t))
+      && lease_snapshot_section_ok(header, header->ends_off, header->count,
+          sizeof(time_t))
+      && lease_snapshot_section_ok(header, header->ip_index_off,
+          header->ip_index_size, sizeof(uint32_t))
+      && lease_snapshot_section_ok(header, header->mac_index_off,
+          header->mac_index_size, sizeof(uint32_t))
+      && lease_snapshot_section_ok(header, header->ext_off, header->ext_count,
+          sizeof(struct lease_element_ext_t))
+      && lease_snapshot_section_ok(header, header->failover_off,
+          header->failover_count, sizeof(struct lease_failover_t))
+      && header->state_off <= header->file_size
+      && header->count <= header->file_size - header->state_off
+      && header->strings_off <= header->file_size
+      && header->strings_len == header->file_size - header->strings_off;
+}
+
+// turn a string reference back into a pointer into the blob
+static int
+lease_snapshot_fix_string(const char **field, const char *strings,
+    uint64_t strings_len)
+{
+  uint64_t ref = (uintptr_t) *field;
+
+  if (!ref)
+    return 0;
+
+  if (ref - 1 >= strings_len)
+    return -1;
+
+  *field = strings + ref - 1;
+  return 0;
+}
+
+static int
+lease_snapshot_fixup(char *base, const struct lease_snapshot_header_t *header)
+{
+  struct lease_element_t *records = (void *) (base + header->records_off);
+  struct lease_element_ext_t *ext = (void *) (base + header->ext_off);
+  struct lease_failover_t *failover = (void *) (base + header->failover_off);
+  const uint32_t *slots;
+  const char *strings = base + header->strings_off;
+  uint64_t i, ref;
+  int j;
+
+  // every string ends within the blob
+  if (header->strings_len && strings[header->strings_len - 1])
+    return -1;
+
+  if (header->server_duid && header->server_duid - 1 >= header->strings_len)
+    return -1;
+
+  for (i = 0; i < header->count; i++)
+    {
+      for (j = 0; j < ARRAYSIZE(lease_snapshot_record_strings); j++)
+        if (lease_snapshot_fix_string(&LEASE_SNAPSHOT_FIELD(&records[i],
+            lease_snapshot_record_strings[j]), strings, header->strings_len) < 0)
+          return -1;
+
+      ref = (uintptr_t) records[i].ext;
+      if (ref > header->ext_count)
+        return -1;
+      records[i].ext = ref ? &ext[ref - 1] : NULL;
+    }
+
+  for (i = 0; i < header->ext_count; i++)
+    {
+      for (j = 0; j < ARRAYSIZE(lease_snapshot_ext_strings); j++)
+        if (lease_snapshot_fix_string(&LEASE_SNAPSHOT_FIELD(&ext[i],
+            lease_snapshot_ext_strings[j]), strings, header->strings_len) < 0)
+          return -1;
+    }
+
+  for (i = 0; i < header->failover_count; i++)
+    {
+      for (j = 0; j < ARRAYSIZE(lease_snapshot_failover_strings); j++)
+        if (lease_snapshot_fix_string(&LEASE_SNAPSHOT_FIELD(&failover[i],
+            lease_snapshot_failover_strings[j]), strings,
+            header->strings_len) < 0)
+          return -1;
+
+      if (!failover[i].peer)
+        return -1;
+    }
+
+  slots = (const uint32_t *) (base + header->ip_index_off);
+  for (i = 0; i < header->ip_index_size; i++)
+    if (slots[i] > header->count)
+      return -1;
+
+  slots = (const uint32_t *) (base + header->mac_index_off);
+  for (i = 0; i < header->mac_index_size; i++)
+    if (slots[i] > header->count)
+      return -1;
+
+  return 0;
+}
+
+struct lease_table_t *
+lease_snapshot_load(const char *snap_path,
+    struct lease_snapshot_header_t *header)
+{
+  const struct lease_snapshot_header_t *hdr;
+  struct lease_table_t *table;
+  struct stat st;
+  char *base;
+  int fd;
+
+  fd = open(snap_path, O_RDONLY | O_CLOEXEC);
+  if (fd < 0)
+    return NULL;
+
+  if (fstat(fd, &st) < 0 || st.st_size < sizeof(*hdr))
+    {
+      close(fd);
+      return NULL;
+    }
+
+  // private and writable: the string references are patched in place
+  base = mmap(NULL, st.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (base == MAP_FAILED)
+    {
+      logg_err("mmap %s failed (%s)", snap_path, strerror(errno));
+      return NULL;
+    }
+
+  hdr = (const struct lease_snapshot_header_t *) base;
+  if (!lease_snapshot_header_ok(hdr, st.st_size)
+      || lease_snapshot_fixup(base, hdr) < 0)
+    {
+      logg_err("invalid snapshot %s", snap_path);
+      munmap(base, st.st_size);
+      return NULL;
+    }
+
+  table = lease_table_new();
+  if (!table)
+    {
+      munmap(base, st.st_size);
+      return NULL;
+    }
+
+  table->leases = (void *) (base + hdr->records_off);
+  table->ends = (void *) (base + hdr->ends_off);
+  table->binding_state = (void *) (base + hdr->state_off);
+  table->count = hdr->count;
+  table->ip_index.slots = (void *) (base + hdr->ip_index_off);
+  table->ip_index.size = hdr->ip_index_size;
+  table->ip_index.count = hdr->ip_index_count;
+  table->mac_index.slots = (void *) (base + hdr->mac_index_off);
+  table->mac_index.size = hdr->mac_index_size;
+  table->mac_index.count = hdr->mac_index_count;
+  table->server_duid = hdr->server_duid ?
+      base + hdr->strings_off + hdr->server_duid - 1 : NULL;
+  table->failover = (void *) (base + hdr->failover_off);
+  table->failover_count = hdr->failover_count;
+  table->failover_capacity = hdr->failover_count;
+  table->map_base = base;
+  table->map_len = st.st_size;
+  table->borrowed = 1;
+
+  if (header)
+    *header = *hdr;
+
+  return table;
+}
+
+struct lease_parser_t *
+lease_snapshot_open(const char *file_path, enum lease_parser_read_mode_t mode,
+    const char *snap_path)
+{
+  struct lease_snapshot_header_t header;
+  struct lease_table_t *table;
+  struct stat st;
+
+  table = lease_snapshot_load(snap_path, &header);
+  if (!table)
+    return lease_parser_open(file_path, mode);
+
+  // same file, and not modified in place since the snapshot was taken
+  if (stat(file_path, &st) < 0 || st.st_dev != header.dev
+      || st.st_ino != header.ino || st.st_size < header.size
+      || (st.st_size == header.size && (st.st_mtim.tv_sec != header.mtime_sec
+          || st.st_mtim.tv_nsec != header.mtime_nsec)))
+    {
+      logg(LOG_INFO, "snapshot %s does not match %s", snap_path, file_path);
+      lease_table_destroy(table);
+      return lease_parser_open(file_path, mode);
+    }
+
+  return lease_parser_resume(file_path, mode, table, header.dev, header.ino,
+      header.offset);
+}
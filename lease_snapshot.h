@@ -0,0 +1,90 @@
+/*
+ * lease_snapshot.h
+ *
+ */
+
+#ifndef _LEASE_SNAPSHOT_H_
+#define _LEASE_SNAPSHOT_H_
+
+#include <stdint.h>
+
+#include "lease_parser.h"
+#include "lease_table.h"
+
+#define LEASE_SNAPSHOT_MAGIC            "LEASESNP"
+#define LEASE_SNAPSHOT_VERSION          2
+#define LEASE_SNAPSHOT_SUFFIX           ".snap"
+
+/**
+ *
+ * \brief binary image of a parsed lease table
+ *
+ * The snapshot holds the records as fixed width structs, the ends and
+ * binding state columns, the IP and MAC hash indexes exactly as they
+ * are laid out in memory, the server-duid and failover peer states and
+ * one blob with all strings. Loading maps
+ * the file privately and turns the string offsets in the records back
+ * into pointers; the table then borrows everything from the mapping,
+ * nothing is parsed or copied.
+ *
+ * The header records the inode, size and mtime of the lease file and
+ * the offset of the text the snapshot covers. lease_snapshot_open()
+ * only replays what was appended behind that offset and falls back to
+ * a full parse if the snapshot is missing, damaged, written by another
+ * version or for another file.
+ *
+ * parser = lease_snapshot_open(path, mode, snap_path);
+ * if (parser->last_parsed)
+ *      lease_snapshot_save(parser, snap_path);
+ */
+
+struct lease_snapshot_header_t
+{
+  char magic[8];
+  uint32_t version;
+  uint32_t record_size;
+  uint64_t file_size;
+  // lease file covered by the snapshot
+  uint64_t dev;
+  uint64_t ino;
+  uint64_t size;
+  int64_t mtime_sec;
+  int64_t mtime_nsec;
+  uint64_t offset;
+  // sections, offsets are relative to the start of the snapshot
+  uint64_t count;
+  uint64_t records_off;
+  uint64_t ends_off;
+  uint64_t state_off;
+  uint64_t ip_index_off;
+  uint64_t ip_index_size;
+  uint64_t ip_index_count;
+  uint64_t mac_index_off;
+  uint64_t mac_index_size;
+  uint64_t mac_index_count;
+  uint64_t ext_off;
+  uint64_t ext_count;
+  // string reference, 0 if none
+  uint64_t server_duid;
+  uint64_t failover_off;
+  uint64_t failover_count;
+  uint64_t strings_off;
+  uint64_t strings_len;
+};
+
+// <lease file>.snap, inside cache_dir if given; free() the result
+char *lease_snapshot_path(const char *file_path, const char *cache_dir);
+
+// write the table of parser to snap_path atomically (temp file + rename)
+int lease_snapshot_save(const struct lease_parser_t *parser,
+    const char *snap_path);
+
+// NULL if the snapshot is missing or invalid; header may be NULL
+struct lease_table_t *lease_snapshot_load(const char *snap_path,
+    struct lease_snapshot_header_t *header);
+
+// lease_parser_open() that starts from the snapshot if it is usable
+struct lease_parser_t *lease_snapshot_open(const char *file_path,
+    enum lease_parser_read_mode_t mode, const char *snap_path);
+
+#endif /* _LEASE_SNAPSHOT_H_ */
@@ -0,0 +1,947 @@
+#include <stdlib.h>
+#include <string.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+
+#include "lease_metrics.h"
+#include "lease_table.h"
+#include "log.h"
+#include "toolbox.h"
+
+#define LEASE_TABLE_INITIAL_CAPACITY    1024
+#define LEASE_INDEX_INITIAL_SIZE        2048
+#define LEASE_TIME_PENDING_MIN          1024
+
+enum lease_index_key_t
+{
+  LEASE_INDEX_KEY_IP,
+  LEASE_INDEX_KEY_MAC,
+};
+
+static uint64_t
+lease_index_mix(uint64_t h)
+{
+  h ^= h >> 33;
+  h *= 0xff51afd7ed558ccdull;
+  h ^= h >> 33;
+  h *= 0xc4ceb9fe1a85ec53ull;
+  h ^= h >> 33;
+  return h;
+}
+
+static uint64_t
+lease_addr_hash(const struct lease_addr_t *ip)
+{
+  uint64_t a, b;
+
+  if (ip->family != AF_INET6)
+    return lease_index_mix(ip->v4);
+
+  memcpy(&a, ip->v6, sizeof(a));
+  memcpy(&b, ip->v6 + sizeof(a), sizeof(b));
+  return lease_index_mix(a ^ lease_index_mix(b));
+}
+
+static int
+lease_addr_equal(const struct lease_addr_t *a, const struct lease_addr_t *b)
+{
+  if (a->family != b->family || a->prefix_len != b->prefix_len)
+    return 0;
+
+  if (a->family != AF_INET6)
+    return a->v4 == b->v4;
+
+  return !memcmp(a->v6, b->v6, sizeof(a->v6));
+}
+
+static uint64_t
+lease_hwaddr_hash(const struct lease_hwaddr_t *mac)
+{
+  uint64_t h = mac->type;
+  int i;
+
+  for (i = 0; i < LEASE_HWADDR_LEN; i++)
+    h = (h << 8) | mac->addr[i];
+
+  return lease_index_mix(h);
+}
+
+static int
+lease_hwaddr_equal(const struct lease_hwaddr_t *a,
+    const struct lease_hwaddr_t *b)
+{
+  return a->type == b->type && !memcmp(a->addr, b->addr, sizeof(a->addr));
+}
+
+static uint64_t
+lease_index_hash_record(enum lease_index_key_t key,
+    const struct lease_element_t *element)
+{
+  return key == LEASE_INDEX_KEY_IP ? lease_addr_hash(&element->ip)
+      : lease_hwaddr_hash(&element->hardware);
+}
+
+/*
+ * slot of the record matching the key of element, or of the empty slot
+ * where it would go
+ */
+static size_t
+lease_index_find(const struct lease_table_t *table,
+    const struct lease_index_t *index, enum lease_index_key_t key,
+    const struct lease_element_t *element)
+{
+  size_t mask = index->size - 1;
+  size_t i;
+
+  for (i = lease_index_hash_record(key, element) & mask; index->slots[i];
+      i = (i + 1) & mask)
+    {
+      const struct lease_element_t *other = &table->leases[index->slots[i] - 1];
+
+      if (key == LEASE_INDEX_KEY_IP ? lease_addr_equal(&other->ip, &element->ip)
+          : lease_hwaddr_equal(&other->hardware, &element->hardware))
+        break;
+    }
+
+  return i;
+}
+
+static int
+lease_index_resize(struct lease_table_t *table, struct lease_index_t *index,
+    enum lease_index_key_t key, size_t size)
+{
+  uint32_t *slots;
+  size_t i, mask = size - 1;
+
+  slots = calloc(size, sizeof(*slots));
+  if (!slots)
+    {
+      logg_err("Cannot allocate memory.");
+      return -1;
+    }
+  lease_metrics_add(LEASE_METRIC_ALLOCATIONS, 1);
+
+  for (i = 0; i < index->size; i++)
+    {
+      size_t j;
+
+      if (!index->slots[i])
+        continue;
+
+      j = lease_index_hash_record(key, &table->leases[index->slots[i] - 1]) & mask;
+      while (slots[j])
+        j = (j + 1) & mask;
+      slots[j] = index->slots[i];
+    }
+
+  free(index->slots);
+  index->slots = slots;
+  index->size = size;
+
+  return 0;
+}
+
+// make room for one more entry, keeping the load factor below 1/2
+static int
+lease_index_reserve(struct lease_table_t *table, struct lease_index_t *index,
+    enum lease_index_key_t key)
+{
+  if ((index->count + 1) * 2 <= index->size)
+    return 0;
+
+  return lease_index_resize(table, index, key,
+      index->size ? index->size * 2 : LEASE_INDEX_INITIAL_SIZE);
+}
+
+// backward shift deletion, keeps probe sequences intact without tombstones
+static void
+lease_index_remove(struct lease_table_t *table, struct lease_index_t *index,
+    enum lease_index_key_t key, size_t slot)
+{
+  size_t mask = index->size - 1;
+  size_t i = slot, j = slot;
+
+  for (;;)
+    {
+      size_t home;
+
+      j = (j + 1) & mask;
+      if (!index->slots[j])
+        break;
+
+      home = lease_index_hash_record(key, &table->leases[index->slots[j] - 1])
+          & mask;
+
+      // move j back into the hole if its home is not within (i, j]
+      if ((j > i && (home <= i || home > j)) || (j < i && home <= i && home > j))
+        {
+          index->slots[i] = index->slots[j];
+          i = j;
+        }
+    }
+
+  index->slots[i] = 0;
+  index->count--;
+}
+
+struct lease_table_t *
+lease_table_new(void)
+{
+  struct lease_table_t *table;
+
+  table = calloc(1, sizeof(*table));
+  if (!table)
+    {
+      logg_err("Cannot allocate memory.");
+      return NULL;
+    }
+
+  arena_init(&table->arena, 0);
+  if (string_pool_init(&table->strings, &table->arena) < 0)
+    {
+      logg_err("Cannot allocate memory.");
+      free(table);
+      return NULL;
+    }
+
+  return table;
+}
+
+void
+lease_table_destroy(struct lease_table_t *table)
+{
+  uint64_t start;
+  int key;
+
+  if (!table)
+    return;
+
+  start = lease_metrics_clock();
+
+  if (!table->borrowed)
+    {
+      free(table->leases);
+      free(table->ends);
+      free(table->binding_state);
+      free(table->ip_index.slots);
+      free(table->mac_index.slots);
+      free(table->failover);
+    }
+  for (key = 0; key < LEASE_TIME_KEY_MAX; key++)
+    {
+      free(table->time_index[key].entries);
+      free(table->time_index[key].pending);
+    }
+  if (table->map_base)
+    toolbox_unmap(table->map_base, table->map_len);
+  string_pool_release(&table->strings);
+  arena_release(&table->arena);
+  free(table);
+  lease_metrics_observe(LEASE_METRICS_STAGE_TEARDOWN, start);
+}
+
+static int
+lease_table_grow(struct lease_table_t *table)
+{
+  size_t capacity;
+  void *tmp;
+
+  capacity = table->capacity ? table->capacity * 2
+      : LEASE_TABLE_INITIAL_CAPACITY;
+
+  tmp = realloc(table->leases, capacity * sizeof(*table->leases));
+  if (!tmp)
+    goto error;
+  table->leases = tmp;
+
+  tmp = realloc(table->ends, capacity * sizeof(*table->ends));
+  if (!tmp)
+    goto error;
+  table->ends = tmp;
+
+  tmp = realloc(table->binding_state, capacity * sizeof(*table->binding_state));
+  if (!tmp)
+    goto error;
+  table->binding_state = tmp;
+
+  lease_metrics_add(LEASE_METRIC_ALLOCATIONS, 3);
+  table->capacity = capacity;
+  return 0;
+
+  error:
+  logg_err("Cannot allocate memory.");
+  return -1;
+}
+
+static void *
+lease_table_dup_array(const void *src, size_t count, size_t capacity,
+    size_t size)
+{
+  void *dst = malloc(capacity * size);
+
+  if (dst && count)
+    memcpy(dst, src, count * size);
+
+  return dst;
+}
+
+// copy the arrays borrowed from a snapshot mapping to the heap
+static int
+lease_table_unborrow(struct lease_table_t *table)
+{
+  struct lease_element_t *leases;
+  time_t *ends;
+  uint8_t *binding_state;
+  uint32_t *ip_slots, *mac_slots;
+  struct lease_failover_t *failover;
+  size_t capacity = table->count > LEASE_TABLE_INITIAL_CAPACITY
+      ? table->count : LEASE_TABLE_INITIAL_CAPACITY;
+
+  leases = lease_table_dup_array(table->leases, table->count, capacity,
+      sizeof(*leases));
+  ends = lease_table_dup_array(table->ends, table->count, capacity,
+      sizeof(*ends));
+  binding_state = lease_table_dup_array(table->binding_state, table->count,
+      capacity, sizeof(*binding_state));
+  ip_slots = lease_table_dup_array(table->ip_index.slots, table->ip_index.size,
+      table->ip_index.size, sizeof(*ip_slots));
+  mac_slots = lease_table_dup_array(table->mac_index.slots,
+      table->mac_index.size, table->mac_index.size, sizeof(*mac_slots));
+  failover = lease_table_dup_array(table->failover, table->failover_count,
+      table->failover_count, sizeof(*failover));
+
+  if (!leases || !ends || !binding_state
+      || (table->ip_index.size && !ip_slots)
+      || (table->mac_index.size && !mac_slots)
+      || (table->failover_count && !failover))
+    {
+      logg_err("Cannot allocate memory.");
+      free(leases);
+      free(ends);
+      free(binding_state);
+      free(ip_slots);
+      free(mac_slots);
+      free(failover);
+      return -1;
+    }
+
+  table->leases = leases;
+  table->ends = ends;
+  table->binding_state = binding_state;
+  table->capacity = capacity;
+  table->ip_index.slots = ip_slots;
+  table->mac_index.slots = mac_slots;
+  table->failover = failover;
+  table->failover_capacity = table->failover_count;
+  table->borrowed = 0;
+
+  return 0;
+}
+
+static time_t
+lease_time_key_get(const struct lease_element_t *element,
+    enum lease_time_key_t key)
+{
+  switch (key)
+    {
+  case LEASE_TIME_KEY_CLTT:
+    return element->cltt;
+  case LEASE_TIME_KEY_TSTP:
+    return element->tstp;
+  default:
+    return element->ends;
+    }
+}
+
+/*
+ * note that record idx changed for the time indexes whose field
+ * differs from old, or all of them for a new record (old NULL)
+ */
+static void
+lease_table_time_touch(struct lease_table_t *table, size_t idx,
+    const struct lease_element_t *old, const struct lease_element_t *element)
+{
+  int key;
+
+  for (key = 0; key < LEASE_TIME_KEY_MAX; key++)
+    {
+      struct lease_time_index_t *index = &table->time_index[key];
+
+      if (!index->enabled || index->rebuild)
+        continue;
+      if (old && lease_time_key_get(old, key) == lease_time_key_get(element, key))
+        continue;
+
+      // past this point rebuilding is cheaper than merging
+      if (index->pending_count >= index->count / 4 + LEASE_TIME_PENDING_MIN)
+        {
+          index->rebuild = 1;
+          index->pending_count = 0;
+          continue;
+        }
+
+      if (index->pending_count == index->pending_capacity)
+        {
+          size_t capacity = index->pending_capacity ?
+              index->pending_capacity * 2 : LEASE_TIME_PENDING_MIN;
+          uint32_t *tmp = realloc(index->pending, capacity * sizeof(*tmp));
+
+          if (!tmp)
+            {
+              index->rebuild = 1;
+              index->pending_count = 0;
+              continue;
+            }
+          index->pending = tmp;
+          index->pending_capacity = capacity;
+        }
+
+      index->pending[index->pending_count++] = idx;
+    }
+}
+
+static void
+lease_table_set(struct lease_table_t *table, size_t idx,
+    const struct lease_element_t *element)
+{
+  table->leases[idx] = *element;
+  table->ends[idx] = element->ends;
+  table->binding_state[idx] = element->binding_state;
+}
+
+// point the MAC index at record idx, which now carries element's MAC
+static void
+lease_table_index_mac(struct lease_table_t *table, size_t idx)
+{
+  size_t slot;
+
+  if (table->leases[idx].hardware.type == LEASE_HWADDR_TYPE_NONE)
+    return;
+
+  slot = lease_index_find(table, &table->mac_index, LEASE_INDEX_KEY_MAC,
+      &table->leases[idx]);
+  if (!table->mac_index.slots[slot])
+    table->mac_index.count++;
+  table->mac_index.slots[slot] = idx + 1;
+}
+
+int
+lease_table_upsert(struct lease_table_t *table,
+    const struct lease_element_t *element, struct lease_element_t *previous)
+{
+  struct lease_element_t *old;
+  size_t slot, idx;
+
+  if (table->borrowed && lease_table_unborrow(table) < 0)
+    return -1;
+
+  if (lease_index_reserve(table, &table->ip_index, LEASE_INDEX_KEY_IP) < 0
+      || lease_index_reserve(table, &table->mac_index, LEASE_INDEX_KEY_MAC) < 0)
+    return -1;
+
+  slot = lease_index_find(table, &table->ip_index, LEASE_INDEX_KEY_IP, element);
+
+  if (!table->ip_index.slots[slot])
+    {
+      if (table->count == table->capacity && lease_table_grow(table) < 0)
+        return -1;
+
+      idx = table->count++;
+      lease_table_time_touch(table, idx, NULL, element);
+      lease_table_set(table, idx, element);
+      table->ip_index.slots[slot] = idx + 1;
+      table->ip_index.count++;
+      lease_table_index_mac(table, idx);
+      return 0;
+    }
+
+  idx = table->ip_index.slots[slot] - 1;
+  old = &table->leases[idx];
+
+  if (previous)
+    *previous = *old;
+
+  // drop the old MAC if it still refers to this record
+  if (old->hardware.type != LEASE_HWADDR_TYPE_NONE
+      && !lease_hwaddr_equal(&old->hardware, &element->hardware))
+    {
+      size_t mac_slot = lease_index_find(table, &table->mac_index,
+          LEASE_INDEX_KEY_MAC, old);
+
+      if (table->mac_index.slots[mac_slot] == idx + 1)
+        lease_index_remove(table, &table->mac_index, LEASE_INDEX_KEY_MAC,
+            mac_slot);
+    }
+
+  lease_table_time_touch(table, idx, old, element);
+  lease_table_set(table, idx, element);
+  lease_table_index_mac(table, idx);
+
+  return 1;
+}
+
+struct lease_table_t *
+lease_table_copy(const struct lease_table_t *src)
+{
+  struct lease_table_t *table;
+  size_t capacity = src->count > LEASE_TABLE_INITIAL_CAPACITY
+      ? src->count : LEASE_TABLE_INITIAL_CAPACITY;
+
+  table = lease_table_new();
+  if (!table)
+    return NULL;
+
+  table->leases = lease_table_dup_array(src->leases, src->count, capacity,
+      sizeof(*table->leases));
+  table->ends = lease_table_dup_array(src->ends, src->count, capacity,
+      sizeof(*table->ends));
+  table->binding_state = lease_table_dup_array(src->binding_state, src->count,
+      capacity, sizeof(*table->binding_state));
+  table->ip_index.slots = lease_table_dup_array(src->ip_index.slots,
+      src->ip_index.size, src->ip_index.size, sizeof(uint32_t));
+  table->mac_index.slots = lease_table_dup_array(src->mac_index.slots,
+      src->mac_index.size, src->mac_index.size, sizeof(uint32_t));
+  table->failover = lease_table_dup_array(src->failover, src->failover_count,
+      src->failover_count, sizeof(*table->failover));
+
+  if (!table->leases || !table->ends || !table->binding_state
+      || (src->ip_index.size && !table->ip_index.slots)
+      || (src->mac_index.size && !table->mac_index.slots)
+      || (src->failover_count && !table->failover))
+    {
+      logg_err("Cannot allocate memory.");
+      lease_table_destroy(table);
+      return NULL;
+    }
+
+  table->count = src->count;
+  table->capacity = capacity;
+  table->ip_index.size = src->ip_index.size;
+  table->ip_index.count = src->ip_index.count;
+  table->mac_index.size = src->mac_index.size;
+  table->mac_index.count = src->mac_index.count;
+  table->failover_count = table->failover_capacity = src->failover_count;
+  table->server_duid = src->server_duid;
+  lease_metrics_add(LEASE_METRIC_ALLOCATIONS, 6);
+
+  return table;
+}
+
+int
+lease_table_merge(struct lease_table_t *dst, struct lease_table_t *src,
+    lease_table_merge_cb_t cb, void *user)
+{
+  const struct lease_element_t *lease;
+  struct lease_element_t previous;
+  size_t i;
+  int ret = 0, replaced;
+
+  // the strings of the merged records live in the arena of src
+  arena_adopt(&dst->arena, &src->arena);
+
+  lease_table_for_each(lease, src)
+  {
+    replaced = lease_table_upsert(dst, lease, cb ? &previous : NULL);
+    if (replaced < 0)
+      {
+        ret = -1;
+        break;
+      }
+
+    if (cb)
+      cb(lease_table_lookup_by_ip(dst, &lease->ip),
+          replaced ? &previous : NULL, user);
+  }
+
+  if (src->server_duid)
+    dst->server_duid = src->server_duid;
+  for (i = 0; ret == 0 && i < src->failover_count; i++)
+    ret = lease_table_set_failover(dst, &src->failover[i]);
+
+  lease_table_destroy(src);
+  return ret;
+}
+
+int
+lease_table_set_failover(struct lease_table_t *table,
+    const struct lease_failover_t *failover)
+{
+  size_t i;
+
+  if (table->borrowed && lease_table_unborrow(table) < 0)
+    return -1;
+
+  for (i = 0; i < table->failover_count; i++)
+    {
+      if (!strcmp(table->failover[i].peer, failover->peer))
+        break;
+    }
+
+  if (i == table->failover_capacity)
+    {
+      size_t capacity = table->failover_capacity ?
+          table->failover_capacity * 2 : 4;
+      void *tmp = realloc(table->failover, capacity * sizeof(*table->failover));
+
+      if (!tmp)
+        {
+          logg_err("Cannot allocate memory.");
+          return -1;
+        }
+      table->failover = tmp;
+      table->failover_capacity = capacity;
+    }
+
+  table->failover[i] = *failover;
+  if (i == table->failover_count)
+    table->failover_count++;
+
+  return 0;
+}
+
+const struct lease_failover_t *
+lease_table_get_failover(const struct lease_table_t *table, const char *peer)
+{
+  size_t i;
+
+  for (i = 0; i < table->failover_count; i++)
+    {
+      if (!strcmp(table->failover[i].peer, peer))
+        return &table->failover[i];
+    }
+
+  return NULL;
+}
+
+ssize_t
+lease_table_diff(const struct lease_table_t *old_table,
+    const struct lease_table_t *table, lease_table_diff_cb_t cb, void *user)
+{
+  const struct lease_element_t *lease, *previous;
+  uint64_t *matched;
+  size_t i, idx, matched_count = 0;
+  ssize_t changes = 0;
+  uint32_t fields;
+
+  matched = calloc(old_table->count / 64 + 1, sizeof(*matched));
+  if (!matched)
+    {
+      logg_err("Cannot allocate memory.");
+      return -1;
+    }
+
+  for (i = 0; i < table->count; i++)
+    {
+      lease = &table->leases[i];
+
+      if (i < old_table->count
+          && lease_addr_equal(&old_table->leases[i].ip, &lease->ip))
+        previous = &old_table->leases[i];
+      else
+        previous = lease_table_lookup_by_ip(old_table, &lease->ip);
+
+      if (!previous)
+        {
+          cb(LEASE_CHANGE_ADDED, lease, NULL, 0, user);
+          changes++;
+          continue;
+        }
+
+      idx = previous - old_table->leases;
+      matched[idx / 64] |= 1ull << (idx % 64);
+      matched_count++;
+
+      fields = lease_element_diff(previous, lease);
+      if (fields)
+        {
+          cb(LEASE_CHANGE_MODIFIED, lease, previous, fields, user);
+          changes++;
+        }
+    }
+
+  for (i = 0; matched_count < old_table->count && i < old_table->count; i++)
+    {
+      if (matched[i / 64] & (1ull << (i % 64)))
+        continue;
+
+      cb(LEASE_CHANGE_REMOVED, &old_table->leases[i], NULL, 0, user);
+      matched_count++;
+      changes++;
+    }
+
+  free(matched);
+  return changes;
+}
+
+const struct lease_element_t *
+lease_table_lookup_by_ip(const struct lease_table_t *table,
+    const struct lease_addr_t *ip)
+{
+  struct lease_element_t key;
+  size_t slot;
+
+  if (!table->ip_index.size)
+    return NULL;
+
+  key.ip = *ip;
+  slot = lease_index_find(table, &table->ip_index, LEASE_INDEX_KEY_IP, &key);
+
+  return table->ip_index.slots[slot] ?
+      &table->leases[table->ip_index.slots[slot] - 1] : NULL;
+}
+
+const struct lease_element_t *
+lease_table_lookup_by_mac(const struct lease_table_t *table,
+    const struct lease_hwaddr_t *mac)
+{
+  struct lease_element_t key;
+  size_t slot;
+
+  if (!table->mac_index.size)
+    return NULL;
+
+  key.hardware = *mac;
+  slot = lease_index_find(table, &table->mac_index, LEASE_INDEX_KEY_MAC, &key);
+
+  return table->mac_index.slots[slot] ?
+      &table->leases[table->mac_index.slots[slot] - 1] : NULL;
+}
+
+size_t
+lease_table_count_state(const struct lease_table_t *table,
+    enum lease_binding_state_t state)
+{
+  const uint8_t *column = table->binding_state;
+  size_t i, count = 0;
+
+  for (i = 0; i < table->count; i++)
+    count += column[i] == state;
+
+  return count;
+}
+
+size_t
+lease_table_count_expired(const struct lease_table_t *table, time_t now)
+{
+  const time_t *column = table->ends;
+  size_t i, count = 0;
+
+  for (i = 0; i < table->count; i++)
+    count += column[i] < now;
+
+  return count;
+}
+
+size_t
+lease_table_next_expired(const struct lease_table_t *table, time_t now,
+    size_t from)
+{
+  size_t i;
+
+  for (i = from; i < table->count; i++)
+    {
+      if (table->ends[i] < now)
+        break;
+    }
+
+  return i;
+}
+
+static int
+lease_time_entry_cmp(const void *a, const void *b)
+{
+  const struct lease_time_entry_t *x = a, *y = b;
+
+  if (x->time != y->time)
+    return x->time < y->time ? -1 : 1;
+
+  return (x->idx > y->idx) - (x->idx < y->idx);
+}
+
+static int
+lease_time_index_rebuild(struct lease_table_t *table,
+    struct lease_time_index_t *index, enum lease_time_key_t key)
+{
+  struct lease_time_entry_t *entries;
+  size_t i;
+
+  entries = realloc(index->entries, (table->count + 1) * sizeof(*entries));
+  if (!entries)
+    {
+      logg_err("Cannot allocate memory.");
+      return -1;
+    }
+
+  for (i = 0; i < table->count; i++)
+    {
+      entries[i].time = lease_time_key_get(&table->leases[i], key);
+      entries[i].idx = i;
+    }
+  qsort(entries, table->count, sizeof(*entries), lease_time_entry_cmp);
+
+  index->entries = entries;
+  index->count = table->count;
+  index->pending_count = 0;
+  index->rebuild = 0;
+
+  return 0;
+}
+
+// merge the sorted entries of the pending records into the index
+static int
+lease_time_index_merge(struct lease_table_t *table,
+    struct lease_time_index_t *index, enum lease_time_key_t key)
+{
+  struct lease_time_entry_t *fresh = NULL, *merged = NULL;
+  uint64_t *changed;
+  size_t i, j, n, fresh_count = 0;
+
+  changed = calloc((table->count + 63) / 64, sizeof(*changed));
+  fresh = malloc(index->pending_count * sizeof(*fresh));
+  merged = malloc((index->count + index->pending_count) * sizeof(*merged));
+  if (!changed || !fresh || !merged)
+    {
+      logg_err("Cannot allocate memory.");
+      free(changed);
+      free(fresh);
+      free(merged);
+      return -1;
+    }
+
+  for (i = 0; i < index->pending_count; i++)
+    {
+      uint32_t idx = index->pending[i];
+
+      if (changed[idx / 64] & (1ull << (idx % 64)))
+        continue;
+      changed[idx / 64] |= 1ull << (idx % 64);
+
+      fresh[fresh_count].time = lease_time_key_get(&table->leases[idx], key);
+      fresh[fresh_count].idx = idx;
+      fresh_count++;
+    }
+  qsort(fresh, fresh_count, sizeof(*fresh), lease_time_entry_cmp);
+
+  // entries of changed records are stale, their fresh copy replaces them
+  for (i = j = n = 0; i < index->count || j < fresh_count;)
+    {
+      const struct lease_time_entry_t *old = i < index->count ?
+          &index->entries[i] : NULL;
+
+      if (old && changed[old->idx / 64] & (1ull << (old->idx % 64)))
+        {
+          i++;
+          continue;
+        }
+
+      if (!old || (j < fresh_count && lease_time_entry_cmp(&fresh[j], old) < 0))
+        merged[n++] = fresh[j++];
+      else
+        merged[n++] = index->entries[i++];
+    }
+
+  free(changed);
+  free(fresh);
+  free(index->entries);
+  index->entries = merged;
+  index->count = n;
+  index->pending_count = 0;
+
+  return 0;
+}
+
+static struct lease_time_index_t *
+lease_time_index_sync(struct lease_table_t *table, enum lease_time_key_t key)
+{
+  struct lease_time_index_t *index;
+
+  if (key < 0 || key >= LEASE_TIME_KEY_MAX)
+    return NULL;
+
+  index = &table->time_index[key];
+  if (!index->enabled)
+    {
+      index->enabled = 1;
+      index->rebuild = 1;
+    }
+
+  if (index->rebuild)
+    return lease_time_index_rebuild(table, index, key) < 0 ? NULL : index;
+
+  if (index->pending_count && lease_time_index_merge(table, index, key) < 0)
+    return NULL;
+
+  return index;
+}
+
+// first entry with time >= t
+static size_t
+lease_time_index_lower_bound(const struct lease_time_index_t *index, time_t t)
+{
+  size_t lo = 0, hi = index->count;
+
+  while (lo < hi)
+    {
+      size_t mid = lo + (hi - lo) / 2;
+
+      if (index->entries[mid].time < t)
+        lo = mid + 1;
+      else
+        hi = mid;
+    }
+
+  return lo;
+}
+
+int
+lease_table_time_index_enable(struct lease_table_t *table,
+    enum lease_time_key_t key)
+{
+  return lease_time_index_sync(table, key) ? 0 : -1;
+}
+
+ssize_t
+lease_table_count_range(struct lease_table_t *table, enum lease_time_key_t key,
+    time_t from, time_t to)
+{
+  const struct lease_time_entry_t *first;
+  size_t count;
+
+  if (lease_table_time_range(table, key, from, to, &first, &count) < 0)
+    return -1;
+
+  return count;
+}
+
+int
+lease_table_time_range(struct lease_table_t *table, enum lease_time_key_t key,
+    time_t from, time_t to, const struct lease_time_entry_t **first,
+    size_t *count)
+{
+  struct lease_time_index_t *index;
+  size_t begin, end;
+
+  index = lease_time_index_sync(table, key);
+  if (!index)
+    return -1;
+
+  begin = lease_time_index_lower_bound(index, from);
+  end = to > from ? lease_time_index_lower_bound(index, to) : begin;
+
+  *first = index->entries + begin;
+  *count = end - begin;
+
+  return 0;
+}
+
+const char *
+lease_table_intern(struct lease_table_t *table, const char *str, size_t len)
+{
+  return string_pool_intern(&table->strings, str, len);
+}
+
+char *
+lease_table_strndup(struct lease_table_t *table, const char *str, size_t len)
+{
+  return arena_strndup(&table->arena, str, len);
+}
@@ -0,0 +1,242 @@
+/*
+ * lease_table.h
+ *
+ */
+
+#ifndef _LEASE_TABLE_H_
+#define _LEASE_TABLE_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include <time.h>
+#include <sys/types.h>
+
+#include "arena.h"
+#include "lease.h"
+#include "string_pool.h"
+
+/**
+ *
+ * \brief result of a parse
+ *
+ * Leases are stored in file order in one contiguous, growable array.
+ * The fields scanned most (ends, binding state) are additionally kept
+ * as columns of their own, so table-wide scans touch only a few bytes
+ * per lease and can be vectorised by the compiler. The size is O(1).
+ *
+ * dhcpd.leases is a journal, a later block for the same address replaces
+ * the earlier one in place (lease_table_upsert()). Open addressing hash
+ * indexes on the address and on the hardware address make lookups O(1);
+ * lease_table_lookup_by_mac() returns the most recently written lease
+ * of a client.
+ *
+ * The table owns all strings through a single arena;
+ * lease_table_destroy() releases everything in one go. Pointers into
+ * the table are only valid until the next lease_table_upsert().
+ *
+ * Besides the leases the table keeps the file wide statements: the
+ * server-duid of a DHCPv6 server and the state of every failover peer.
+ *
+ * A table loaded from a snapshot has its strings in a private mapping
+ * (map_base) and borrows its arrays and indexes from it as well; they
+ * are copied to the heap by the first lease_table_upsert().
+ *
+ * const struct lease_element_t *lease;
+ * lease_table_for_each(lease, table) {
+ *      Do_something_with(lease);
+ * }
+ */
+
+enum lease_time_key_t
+{
+  LEASE_TIME_KEY_ENDS,
+  LEASE_TIME_KEY_CLTT,
+  LEASE_TIME_KEY_TSTP,
+  LEASE_TIME_KEY_MAX,
+};
+
+struct lease_time_entry_t
+{
+  time_t time;
+  uint32_t idx;
+};
+
+/**
+ *
+ * \brief ordered index on a time field
+ *
+ * An array of (time, record index) sorted by time, enabled per key with
+ * lease_table_time_index_enable(). lease_table_upsert() only notes the
+ * index of the changed record; the next range query sorts the noted
+ * records and merges them into the array, dropping their stale entries.
+ * After too many changes (a reload, a merge) the array is rebuilt from
+ * the records instead. Range counts and lookups are binary searches.
+ *
+ * const struct lease_time_entry_t *entry;
+ * size_t count;
+ *
+ * lease_table_time_index_enable(table, LEASE_TIME_KEY_ENDS);
+ * lease_table_time_range(table, LEASE_TIME_KEY_ENDS, now, now + 300,
+ *     &entry, &count);
+ * while (count--)
+ *      Do_something_with(lease_table_get(table, entry++->idx));
+ */
+
+struct lease_time_index_t
+{
+  int enabled;
+  int rebuild;
+  struct lease_time_entry_t *entries;
+  size_t count;
+  uint32_t *pending;
+  size_t pending_count;
+  size_t pending_capacity;
+};
+
+#define lease_table_for_each(pos, table)                                \
+        for (pos = (table)->leases;                                     \
+             pos < (table)->leases + (table)->count;                    \
+             pos++)
+
+// slot = record index + 1, 0 = empty
+struct lease_index_t
+{
+  uint32_t *slots;
+  size_t size;
+  size_t count;
+};
+
+// last state written by a failover peer statement
+struct lease_failover_t
+{
+  const char *peer;
+  const char *my_state;
+  time_t my_time;
+  const char *partner_state;
+  time_t partner_time;
+};
+
+struct lease_table_t
+{
+  struct arena_t arena;
+  struct string_pool_t strings;
+  struct lease_element_t *leases;
+  time_t *ends;
+  uint8_t *binding_state;
+  size_t count;
+  size_t capacity;
+  struct lease_index_t ip_index;
+  struct lease_index_t mac_index;
+  void *map_base;
+  size_t map_len;
+  int borrowed;
+  struct lease_time_index_t time_index[LEASE_TIME_KEY_MAX];
+  // file wide statements
+  const char *server_duid;
+  struct lease_failover_t *failover;
+  size_t failover_count;
+  size_t failover_capacity;
+};
+
+struct lease_table_t *lease_table_new(void);
+void lease_table_destroy(struct lease_table_t *table);
+
+/*
+ * add a record or replace the one with the same address. Returns 1 if a
+ * record was replaced (copied to previous unless NULL), 0 if it was
+ * added and -1 on error.
+ */
+int lease_table_upsert(struct lease_table_t *table,
+    const struct lease_element_t *element, struct lease_element_t *previous);
+
+/*
+ * a table with the records, columns and hash indexes of src but not its
+ * strings: they stay in the arena of src, which has to outlive the
+ * copy. Time indexes are not copied.
+ */
+struct lease_table_t *lease_table_copy(const struct lease_table_t *src);
+
+// a record upserted by lease_table_merge(), previous is NULL if it was added
+typedef void (*lease_table_merge_cb_t)(const struct lease_element_t *lease,
+    const struct lease_element_t *previous, void *user);
+
+/*
+ * upsert all records of src into dst in src order and take over the
+ * memory of src, which is destroyed in any case. Merging the tables of
+ * consecutive parts of a file in file order gives the same table as
+ * parsing it in one go. cb, if set, is called for every upserted record.
+ */
+int lease_table_merge(struct lease_table_t *dst, struct lease_table_t *src,
+    lease_table_merge_cb_t cb, void *user);
+
+/*
+ * called by lease_table_diff() for every address whose lease differs:
+ * added (previous == NULL), removed (lease is the old record) or
+ * modified with the LEASE_FIELD_* bits that changed.
+ */
+typedef void (*lease_table_diff_cb_t)(enum lease_change_t change,
+    const struct lease_element_t *lease,
+    const struct lease_element_t *previous, uint32_t fields, void *user);
+
+/*
+ * compare the leases of two tables by address, a hash join on the IP
+ * index of old_table. Tables of the same file share most of their
+ * order, so a record is first compared with the one at the same index
+ * and only looked up if the addresses differ; removed records are only
+ * searched for if not all of old_table was matched. Changes come in the
+ * order of table, removals last. Returns the number of changes, -1 on
+ * error.
+ */
+ssize_t lease_table_diff(const struct lease_table_t *old_table,
+    const struct lease_table_t *table, lease_table_diff_cb_t cb, void *user);
+
+// add or replace the state of failover->peer; the strings must be the table's
+int lease_table_set_failover(struct lease_table_t *table,
+    const struct lease_failover_t *failover);
+const struct lease_failover_t *lease_table_get_failover(
+    const struct lease_table_t *table, const char *peer);
+
+const struct lease_element_t *lease_table_lookup_by_ip(
+    const struct lease_table_t *table, const struct lease_addr_t *ip);
+const struct lease_element_t *lease_table_lookup_by_mac(
+    const struct lease_table_t *table, const struct lease_hwaddr_t *mac);
+
+static inline size_t
+lease_table_size(const struct lease_table_t *table)
+{
+  return table->count;
+}
+
+static inline const struct lease_element_t *
+lease_table_get(const struct lease_table_t *table, size_t idx)
+{
+  return idx < table->count ? &table->leases[idx] : NULL;
+}
+
+size_t lease_table_count_state(const struct lease_table_t *table,
+    enum lease_binding_state_t state);
+size_t lease_table_count_expired(const struct lease_table_t *table,
+    time_t now);
+// index of the first lease at or after from with ends < now, count if none
+size_t lease_table_next_expired(const struct lease_table_t *table,
+    time_t now, size_t from);
+
+int lease_table_time_index_enable(struct lease_table_t *table,
+    enum lease_time_key_t key);
+// number of leases with from <= time < to, -1 on error
+ssize_t lease_table_count_range(struct lease_table_t *table,
+    enum lease_time_key_t key, time_t from, time_t to);
+/*
+ * the entries with from <= time < to, in time order. Valid until the
+ * next lease_table_upsert().
+ */
+int lease_table_time_range(struct lease_table_t *table,
+    enum lease_time_key_t key, time_t from, time_t to,
+    const struct lease_time_entry_t **first, size_t *count);
+
+const char *lease_table_intern(struct lease_table_t *table, const char *str,
+    size_t len);
+char *lease_table_strndup(struct lease_table_t *table, const char *str,
+    size_t len);
+
+#endif /* _LEASE_TABLE_H_ */
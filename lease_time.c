@@ -0,0 +1,124 @@
+#include <string.h>
+
+#include "lease_time.h"
+
+int64_t
+lease_time_days_from_civil(int64_t y, unsigned m, unsigned d)
+{
+  int64_t era;
+  unsigned yoe, doy, doe;
+
+  y -= m <= 2;
+  era = (y >= 0 ? y : y - 399) / 400;
+  yoe = (unsigned) (y - era * 400);
+  doy = (153 * (m > 2 ? m - 3 : m + 9) + 2) / 5 + d - 1;
+  doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+
+  return era * 146097 + (int64_t) doe - 719468;
+}
+
+static int
+lease_time_digits(const char *p, int n, unsigned *out)
+{
+  unsigned v = 0;
+  int i;
+
+  for (i = 0; i < n; i++)
+    {
+      unsigned c = (unsigned char) p[i] - '0';
+
+      if (c > 9)
+        return -1;
+      v = v * 10 + c;
+    }
+
+  *out = v;
+  return 0;
+}
+
+static int
+lease_time_parse_epoch(const char *str, size_t len, time_t *out)
+{
+  int64_t v = 0;
+  size_t i;
+
+  if (!len)
+    return -1;
+
+  for (i = 0; i < len; i++)
+    {
+      unsigned c = (unsigned char) str[i] - '0';
+
+      if (c > 9 || v > (INT64_MAX - c) / 10)
+        return -1;
+      v = v * 10 + c;
+    }
+
+  *out = v;
+  return 0;
+}
+
+int
+lease_time_parse(const char *str, size_t len, time_t *out,
+    struct lease_time_cache_t *cache)
+{
+  unsigned year, mon, day, hour, min, sec;
+  int64_t days;
+  const char *p;
+
+  while (len && (unsigned char) str[len - 1] <= ' ')
+    len--;
+
+  if (len == sizeof("never") - 1 && !memcmp(str, "never", len))
+    {
+      *out = LEASE_TIME_NEVER;
+      return 0;
+    }
+
+  if (len > sizeof("epoch ") - 1 && !memcmp(str, "epoch ", sizeof("epoch ") - 1))
+    return lease_time_parse_epoch(str + sizeof("epoch ") - 1,
+        len - (sizeof("epoch ") - 1), out);
+
+  // "W YYYY/MM/DD HH:MM:SS"
+  if (len != sizeof("0 2000/01/01 00:00:00") - 1 || str[1] != ' ')
+    return -1;
+
+  p = str + 2;
+
+  if (cache && cache->valid && !memcmp(cache->date, p, sizeof(cache->date)))
+    {
+      days = cache->days;
+    }
+  else
+    {
+      if (lease_time_digits(p, 4, &year) || p[4] != '/'
+          || lease_time_digits(p + 5, 2, &mon) || p[7] != '/'
+          || lease_time_digits(p + 8, 2, &day))
+        return -1;
+
+      if (mon < 1 || mon > 12 || day < 1 || day > 31)
+        return -1;
+
+      days = lease_time_days_from_civil(year, mon, day);
+
+      if (cache)
+        {
+          memcpy(cache->date, p, sizeof(cache->date));
+          cache->days = days;
+          cache->valid = 1;
+        }
+    }
+
+  p += sizeof("2000/01/01 ") - 1;
+
+  if (lease_time_digits(p, 2, &hour) || p[2] != ':'
+      || lease_time_digits(p + 3, 2, &min) || p[5] != ':'
+      || lease_time_digits(p + 6, 2, &sec))
+    return -1;
+
+  if (hour > 23 || min > 59 || sec > 60)
+    return -1;
+
+  *out = days * 86400 + hour * 3600 + min * 60 + sec;
+  return 0;
+}
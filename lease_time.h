@@ -0,0 +1,40 @@
+/*
+ * lease_time.h
+ *
+ */
+
+#ifndef _LEASE_TIME_H_
+#define _LEASE_TIME_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include <time.h>
+
+// "ends never;" and friends
+#define LEASE_TIME_NEVER        ((time_t) INT64_MAX)
+
+/*
+ * consecutive leases are mostly written on the same day, so the day
+ * number of the last "YYYY/MM/DD" is kept and reused if the next date
+ * matches byte for byte.
+ */
+struct lease_time_cache_t
+{
+  char date[10];
+  int64_t days;
+  int valid;
+};
+
+// days since 1970-01-01 of a proleptic gregorian date
+int64_t lease_time_days_from_civil(int64_t y, unsigned m, unsigned d);
+
+/*
+ * decode the value of a dhcpd.leases time statement (without the
+ * keyword and the ';'): "W YYYY/MM/DD HH:MM:SS", "epoch N" or "never".
+ * dhcpd writes UTC, the result is seconds since the epoch. cache may be
+ * NULL. Returns -1 on a malformed value.
+ */
+int lease_time_parse(const char *str, size_t len, time_t *out,
+    struct lease_time_cache_t *cache);
+
+#endif /* _LEASE_TIME_H_ */
@@ -0,0 +1,142 @@
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <inttypes.h>
+#include <time.h>
+
+#include "lease_time.h"
+
+// 1900/01/01 00:00:00 up to 2230/01/01 00:00:00
+#define CHECK_TIME_FIRST        ((time_t) -2208988800LL)
+#define CHECK_TIME_LAST         ((time_t) 8206444800LL)
+// prime and below a day: every day is seen, at other times of day
+#define CHECK_TIME_STEP         25013
+
+#define ARRAYSIZE(x)            (sizeof(x) / sizeof((x)[0]))
+
+/**
+ *
+ * \brief round trip check of lease_time_parse()
+ *
+ * Every time stamp of the range is printed the way dhcpd writes it,
+ * "W YYYY/MM/DD HH:MM:SS" from gmtime_r(), and has to be parsed back to
+ * itself, once through a date cache shared by the whole run and once
+ * without. "epoch N" and "never" are checked as well, and a few malformed
+ * values have to be rejected.
+ *
+ * Run by "make check", fails with a non zero exit status.
+ */
+
+static unsigned int check_failed;
+
+static void
+check_expect(const char *str, int ret, time_t t, int want_ret, time_t want)
+{
+  if (ret == want_ret && (ret < 0 || t == want))
+    return;
+
+  if (!want_ret)
+    fprintf(stderr, "'%s': got %d/%" PRId64 ", want %" PRId64 "\n",
+        str, ret, (int64_t) t, (int64_t) want);
+  else
+    fprintf(stderr, "'%s': accepted as %" PRId64 ", want an error\n",
+        str, (int64_t) t);
+  check_failed++;
+}
+
+static void
+check_parse(const char *str, struct lease_time_cache_t *cache, int want_ret,
+    time_t want)
+{
+  time_t t = 0;
+  int ret;
+
+  ret = lease_time_parse(str, strlen(str), &t, cache);
+  check_expect(str, ret, t, want_ret, want);
+}
+
+static unsigned long
+check_gmtime(void)
+{
+  struct lease_time_cache_t cache;
+  struct tm tm;
+  char str[64];
+  unsigned long count = 0;
+  time_t t;
+
+  memset(&cache, 0, sizeof(cache));
+
+  for (t = CHECK_TIME_FIRST; t < CHECK_TIME_LAST; t += CHECK_TIME_STEP)
+    {
+      if (!gmtime_r(&t, &tm))
+        {
+          fprintf(stderr, "gmtime_r(%" PRId64 ") failed\n", (int64_t) t);
+          check_failed++;
+          continue;
+        }
+
+      snprintf(str, sizeof(str), "%d %04d/%02d/%02d %02d:%02d:%02d",
+          tm.tm_wday, tm.tm_year + 1900, tm.tm_mon + 1, tm.tm_mday,
+          tm.tm_hour, tm.tm_min, tm.tm_sec);
+
+      check_parse(str, &cache, 0, t);
+      check_parse(str, NULL, 0, t);
+      count++;
+    }
+
+  return count;
+}
+
+static void
+check_keywords(void)
+{
+  static const int64_t epochs[] = {
+    0, 1, 59, 86399, 86400, 951782400, 1700000000, 2147483647, 2147483648LL,
+    4102444800LL, INT64_MAX / 10, INT64_MAX - 1, INT64_MAX
+  };
+  static const char *malformed[] = {
+    "", "nevers", "epoch ", "epoch x", "epoch -1", "epoch 1x",
+    "epoch 9223372036854775808", "epoch 99999999999999999999",
+    "2026/01/01 00:00:00",
+    "4 2026/13/01 00:00:00", "4 2026/00/01 00:00:00",
+    "4 2026/01/32 00:00:00", "4 2026/01/00 00:00:00",
+    "4 2026/01/01 24:00:00", "4 2026/01/01 00:60:00",
+    "4 2026/01/01 00:00:61", "4 2026-01-01 00:00:00",
+    "4 2026/01/01 00:00:0a", "4 2026/01/01 00:00:00x"
+  };
+  char str[64];
+  size_t i;
+
+  check_parse("never", NULL, 0, LEASE_TIME_NEVER);
+  check_parse("never ", NULL, 0, LEASE_TIME_NEVER);
+
+  for (i = 0; i < ARRAYSIZE(epochs); i++)
+    {
+      snprintf(str, sizeof(str), "epoch %" PRId64, epochs[i]);
+      check_parse(str, NULL, 0, (time_t) epochs[i]);
+    }
+
+  for (i = 0; i < ARRAYSIZE(malformed); i++)
+    check_parse(malformed[i], NULL, -1, 0);
+}
+
+int
+main(void)
+{
+  unsigned long count;
+
+  count = check_gmtime();
+  check_keywords();
+
+  if (check_failed)
+    {
+      fprintf(stderr, "lease_time_check: %u checks failed\n", check_failed);
+      return EXIT_FAILURE;
+    }
+
+  printf("lease_time_check: %lu time stamps ok\n", count);
+  return EXIT_SUCCESS;
+}
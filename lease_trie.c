@@ -0,0 +1,493 @@
+#define _GNU_SOURCE
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <sys/socket.h>
+
+#include "lease_trie.h"
+#include "log.h"
+
+#define LEASE_TRIE_INITIAL_CAPACITY     1024
+#define LEASE_POOLS_INITIAL_CAPACITY    16
+
+static int
+lease_trie_family(const struct lease_addr_t *addr)
+{
+  return addr->family == AF_INET6;
+}
+
+static unsigned int
+lease_trie_max_len(const struct lease_addr_t *addr)
+{
+  return addr->family == AF_INET6 ? 128 : 32;
+}
+
+static int
+lease_trie_bit(const struct lease_addr_t *addr, unsigned int i)
+{
+  if (addr->family != AF_INET6)
+    return (addr->v4 >> (31 - i)) & 1;
+
+  return (addr->v6[i / 8] >> (7 - i % 8)) & 1;
+}
+
+// number of leading bits a and b share, at most limit
+static unsigned int
+lease_trie_common(const struct lease_addr_t *a, const struct lease_addr_t *b,
+    unsigned int limit)
+{
+  unsigned int n, i;
+
+  if (a->family != AF_INET6)
+    {
+      uint32_t x = a->v4 ^ b->v4;
+
+      n = x ? __builtin_clz(x) : 32;
+    }
+  else
+    {
+      for (i = 0; i < sizeof(a->v6) && a->v6[i] == b->v6[i]; i++)
+        ;
+      n = i * 8;
+      if (i < sizeof(a->v6))
+        n += __builtin_clz((unsigned int) (a->v6[i] ^ b->v6[i])) - 24;
+    }
+
+  return n < limit ? n : limit;
+}
+
+// addr with all bits after prefix_len cleared
+static void
+lease_trie_mask(const struct lease_addr_t *addr, unsigned int prefix_len,
+    struct lease_addr_t *out)
+{
+  unsigned int i;
+
+  *out = *addr;
+  out->prefix_len = 0;
+
+  if (addr->family != AF_INET6)
+    {
+      out->v4 = prefix_len ? addr->v4 & (~(uint32_t) 0 << (32 - prefix_len)) : 0;
+      return;
+    }
+
+  for (i = 0; i < sizeof(out->v6); i++)
+    {
+      if (prefix_len >= 8 * (i + 1))
+        continue;
+      out->v6[i] &= prefix_len > 8 * i ? 0xff << (8 - (prefix_len - 8 * i)) : 0;
+    }
+}
+
+void
+lease_trie_init(struct lease_trie_t *trie)
+{
+  memset(trie, 0, sizeof(*trie));
+  trie->root[0] = trie->root[1] = LEASE_TRIE_NONE;
+}
+
+void
+lease_trie_release(struct lease_trie_t *trie)
+{
+  free(trie->nodes);
+  lease_trie_init(trie);
+}
+
+// room for n more nodes
+static int
+lease_trie_reserve(struct lease_trie_t *trie, size_t n)
+{
+  size_t capacity;
+  void *tmp;
+
+  if (trie->count + n <= trie->capacity)
+    return 0;
+
+  capacity = trie->capacity ? trie->capacity * 2 : LEASE_TRIE_INITIAL_CAPACITY;
+  tmp = realloc(trie->nodes, capacity * sizeof(*trie->nodes));
+  if (!tmp)
+    {
+      logg_err("Cannot allocate memory.");
+      return -1;
+    }
+
+  trie->nodes = tmp;
+  trie->capacity = capacity;
+  return 0;
+}
+
+static int32_t
+lease_trie_node_new(struct lease_trie_t *trie, const struct lease_addr_t *addr,
+    unsigned int prefix_len)
+{
+  struct lease_trie_node_t *node = &trie->nodes[trie->count];
+
+  memset(node, 0, sizeof(*node));
+  lease_trie_mask(addr, prefix_len, &node->key);
+  node->prefix_len = prefix_len;
+  node->child[0] = node->child[1] = LEASE_TRIE_NONE;
+
+  return trie->count++;
+}
+
+static void
+lease_trie_link(struct lease_trie_t *trie, int family, int32_t parent, int bit,
+    int32_t node)
+{
+  if (parent == LEASE_TRIE_NONE)
+    trie->root[family] = node;
+  else
+    trie->nodes[parent].child[bit] = node;
+}
+
+int
+lease_trie_insert(struct lease_trie_t *trie, const struct lease_addr_t *addr,
+    unsigned int prefix_len, uint32_t value, enum lease_binding_state_t state)
+{
+  int32_t path[129], parent = LEASE_TRIE_NONE, cur, node, glue;
+  struct lease_trie_node_t *n;
+  int family = lease_trie_family(addr), bit = 0, depth = 0, i;
+  unsigned int common;
+
+  if (prefix_len > lease_trie_max_len(addr))
+    return -1;
+
+  // a split takes two nodes, keep pointers valid below
+  if (lease_trie_reserve(trie, 2) < 0)
+    return -1;
+
+  for (cur = trie->root[family];; cur = n->child[bit])
+    {
+      if (cur == LEASE_TRIE_NONE)
+        {
+          node = lease_trie_node_new(trie, addr, prefix_len);
+          lease_trie_link(trie, family, parent, bit, node);
+          path[depth++] = node;
+          break;
+        }
+
+      n = &trie->nodes[cur];
+      common = lease_trie_common(addr, &n->key,
+          prefix_len < n->prefix_len ? prefix_len : n->prefix_len);
+
+      if (common == n->prefix_len)
+        {
+          path[depth++] = cur;
+          if (prefix_len == n->prefix_len)
+            {
+              node = cur;
+              break;
+            }
+
+          parent = cur;
+          bit = lease_trie_bit(addr, n->prefix_len);
+          continue;
+        }
+
+      // the new prefix contains cur
+      if (common == prefix_len)
+        {
+          node = lease_trie_node_new(trie, addr, prefix_len);
+          trie->nodes[node].child[lease_trie_bit(&trie->nodes[cur].key,
+              prefix_len)] = cur;
+          trie->nodes[node].usage = trie->nodes[cur].usage;
+          lease_trie_link(trie, family, parent, bit, node);
+          path[depth++] = node;
+          break;
+        }
+
+      // they branch at bit common
+      glue = lease_trie_node_new(trie, addr, common);
+      node = lease_trie_node_new(trie, addr, prefix_len);
+      trie->nodes[glue].usage = trie->nodes[cur].usage;
+      trie->nodes[glue].child[lease_trie_bit(addr, common)] = node;
+      trie->nodes[glue].child[!lease_trie_bit(addr, common)] = cur;
+      lease_trie_link(trie, family, parent, bit, glue);
+      path[depth++] = glue;
+      path[depth++] = node;
+      break;
+    }
+
+  n = &trie->nodes[node];
+  for (i = 0; n->value && i < depth; i++)
+    {
+      trie->nodes[path[i]].usage.state[n->state]--;
+      trie->nodes[path[i]].usage.total--;
+    }
+
+  n->value = value;
+  n->state = state < LEASE_BINDING_STATE_MAX ? state : LEASE_BINDING_STATE_NONE;
+  for (i = 0; i < depth; i++)
+    {
+      trie->nodes[path[i]].usage.state[n->state]++;
+      trie->nodes[path[i]].usage.total++;
+    }
+
+  return 0;
+}
+
+int
+lease_trie_build(struct lease_trie_t *trie, const struct lease_table_t *table)
+{
+  size_t i;
+
+  for (i = 0; i < table->count; i++)
+    {
+      const struct lease_element_t *lease = &table->leases[i];
+
+      if (lease->ip.family != AF_INET && lease->ip.family != AF_INET6)
+        continue;
+
+      // a delegated prefix is an entry of its own length
+      if (lease_trie_insert(trie, &lease->ip, lease->ip.prefix_len ?
+          lease->ip.prefix_len : lease_trie_max_len(&lease->ip), i + 1,
+          lease->binding_state) < 0)
+        return -1;
+    }
+
+  return 0;
+}
+
+const struct lease_trie_node_t *
+lease_trie_match(const struct lease_trie_t *trie, const struct lease_addr_t *addr)
+{
+  const struct lease_trie_node_t *n, *best = NULL;
+  int32_t cur;
+
+  for (cur = trie->root[lease_trie_family(addr)]; cur != LEASE_TRIE_NONE;
+      cur = n->child[lease_trie_bit(addr, n->prefix_len)])
+    {
+      n = &trie->nodes[cur];
+      if (lease_trie_common(addr, &n->key, n->prefix_len) < n->prefix_len)
+        break;
+      if (n->value)
+        best = n;
+      if (n->prefix_len == lease_trie_max_len(addr))
+        break;
+    }
+
+  return best;
+}
+
+// topmost node within prefix
+static int32_t
+lease_trie_find(const struct lease_trie_t *trie,
+    const struct lease_addr_t *prefix, unsigned int prefix_len)
+{
+  const struct lease_trie_node_t *n;
+  int32_t cur;
+
+  for (cur = trie->root[lease_trie_family(prefix)]; cur != LEASE_TRIE_NONE;
+      cur = n->child[lease_trie_bit(prefix, n->prefix_len)])
+    {
+      n = &trie->nodes[cur];
+      if (n->prefix_len >= prefix_len)
+        return lease_trie_common(prefix, &n->key, prefix_len) == prefix_len ?
+            cur : LEASE_TRIE_NONE;
+
+      if (lease_trie_common(prefix, &n->key, n->prefix_len) < n->prefix_len)
+        break;
+    }
+
+  return LEASE_TRIE_NONE;
+}
+
+void
+lease_trie_usage(const struct lease_trie_t *trie,
+    const struct lease_addr_t *prefix, unsigned int prefix_len,
+    struct lease_usage_t *usage)
+{
+  int32_t node = lease_trie_find(trie, prefix, prefix_len);
+
+  if (node == LEASE_TRIE_NONE)
+    memset(usage, 0, sizeof(*usage));
+  else
+    *usage = trie->nodes[node].usage;
+}
+
+static void
+lease_trie_walk_node(const struct lease_trie_t *trie, int32_t cur,
+    unsigned int unit_len, lease_trie_walk_cb_t cb, void *user)
+{
+  const struct lease_trie_node_t *n = &trie->nodes[cur];
+  struct lease_addr_t subnet;
+
+  // the first node at or below unit_len holds all of its subnet
+  if (n->prefix_len >= unit_len)
+    {
+      lease_trie_mask(&n->key, unit_len, &subnet);
+      cb(&subnet, unit_len, &n->usage, user);
+      return;
+    }
+
+  if (n->child[0] != LEASE_TRIE_NONE)
+    lease_trie_walk_node(trie, n->child[0], unit_len, cb, user);
+  if (n->child[1] != LEASE_TRIE_NONE)
+    lease_trie_walk_node(trie, n->child[1], unit_len, cb, user);
+}
+
+void
+lease_trie_walk(const struct lease_trie_t *trie,
+    const struct lease_addr_t *prefix, unsigned int prefix_len,
+    unsigned int unit_len, lease_trie_walk_cb_t cb, void *user)
+{
+  int32_t node = lease_trie_find(trie, prefix, prefix_len);
+
+  if (node == LEASE_TRIE_NONE)
+    return;
+
+  if (unit_len < prefix_len)
+    unit_len = prefix_len;
+  if (unit_len > lease_trie_max_len(prefix))
+    unit_len = lease_trie_max_len(prefix);
+
+  lease_trie_walk_node(trie, node, unit_len, cb, user);
+}
+
+static int
+lease_pools_add(struct lease_pools_t *pools, const char *prefix, size_t len,
+    const char *name, size_t name_len)
+{
+  struct lease_pool_t *pool;
+
+  if (pools->count == pools->capacity)
+    {
+      size_t capacity = pools->capacity ? pools->capacity * 2
+          : LEASE_POOLS_INITIAL_CAPACITY;
+      void *tmp = realloc(pools->pools, capacity * sizeof(*pools->pools));
+
+      if (!tmp)
+        goto error_memory;
+      pools->pools = tmp;
+      pools->capacity = capacity;
+    }
+
+  pool = &pools->pools[pools->count];
+  memset(pool, 0, sizeof(*pool));
+
+  if (lease_addr_parse_prefix(prefix, len, &pool->addr, &pool->prefix_len) < 0)
+    {
+      logg_err("invalid pool prefix %.*s", (int) len, prefix);
+      return -1;
+    }
+
+  pool->name = name_len ? strndup(name, name_len) : strndup(prefix, len);
+  if (!pool->name)
+    goto error_memory;
+
+  if (lease_trie_insert(&pools->trie, &pool->addr, pool->prefix_len,
+      pools->count + 1, LEASE_BINDING_STATE_NONE) < 0)
+    {
+      free(pool->name);
+      return -1;
+    }
+
+  pools->count++;
+  return 0;
+
+  error_memory:
+  logg_err("Cannot allocate memory.");
+  return -1;
+}
+
+int
+lease_pools_load(struct lease_pools_t *pools, const char *file_path)
+{
+  static const char blank[] = " \t\r\n";
+  FILE *fp;
+  char *line = NULL, *p, *name;
+  size_t size = 0, len, name_len;
+  int ret = 0;
+
+  memset(pools, 0, sizeof(*pools));
+  lease_trie_init(&pools->trie);
+
+  fp = fopen(file_path, "r");
+  if (!fp)
+    {
+      logg_err("can't open %s (%s)", file_path, strerror(errno));
+      return -1;
+    }
+
+  while (getline(&line, &size, fp) >= 0)
+    {
+      p = strchr(line, '#');
+      if (p)
+        *p = '\0';
+
+      p = line + strspn(line, blank);
+      len = strcspn(p, blank);
+      if (!len)
+        continue;
+
+      name = p + len + strspn(p + len, blank);
+      name_len = strcspn(name, blank);
+
+      if (lease_pools_add(pools, p, len, name, name_len) < 0)
+        {
+          ret = -1;
+          break;
+        }
+    }
+
+  free(line);
+  fclose(fp);
+
+  if (ret < 0)
+    lease_pools_release(pools);
+
+  return ret;
+}
+
+void
+lease_pools_release(struct lease_pools_t *pools)
+{
+  size_t i;
+
+  for (i = 0; i < pools->count; i++)
+    free(pools->pools[i].name);
+  free(pools->pools);
+  lease_trie_release(&pools->trie);
+  memset(pools, 0, sizeof(*pools));
+  lease_trie_init(&pools->trie);
+}
+
+void
+lease_pools_account(struct lease_pools_t *pools,
+    const struct lease_table_t *table)
+{
+  const struct lease_element_t *lease;
+  const struct lease_trie_node_t *node;
+  struct lease_usage_t *usage;
+  size_t i;
+
+  for (i = 0; i < pools->count; i++)
+    memset(&pools->pools[i].usage, 0, sizeof(pools->pools[i].usage));
+
+  lease_table_for_each(lease, table)
+  {
+    node = lease_trie_match(&pools->trie, &lease->ip);
+    if (!node)
+      continue;
+
+    usage = &pools->pools[node->value - 1].usage;
+    usage->total++;
+    if (lease->binding_state < LEASE_BINDING_STATE_MAX)
+      usage->state[lease->binding_state]++;
+  }
+}
+
+void
+lease_usage_print(FILE *fp, const char *label, const struct lease_usage_t *usage)
+{
+  const uint32_t *state = usage->state;
+
+  fprintf(fp, "%s\t%u\t%u\t%u\t%u\t%u\t%u\t%u\t%.1f\n", label, usage->total,
+      state[LEASE_BINDING_STATE_ACTIVE], state[LEASE_BINDING_STATE_FREE],
+      state[LEASE_BINDING_STATE_EXPIRED], state[LEASE_BINDING_STATE_RELEASED],
+      state[LEASE_BINDING_STATE_ABANDONED], state[LEASE_BINDING_STATE_BACKUP],
+      usage->total ? 100.0 * state[LEASE_BINDING_STATE_ACTIVE] / usage->total
+          : 0.0);
+}
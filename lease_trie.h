@@ -0,0 +1,143 @@
+/*
+ * lease_trie.h
+ *
+ */
+
+#ifndef _LEASE_TRIE_H_
+#define _LEASE_TRIE_H_
+
+#include <stdio.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "lease.h"
+#include "lease_table.h"
+
+// leases by binding state
+struct lease_usage_t
+{
+  uint32_t total;
+  uint32_t state[LEASE_BINDING_STATE_MAX];
+};
+
+/**
+ *
+ * \brief compressed radix (Patricia) trie over addresses and prefixes
+ *
+ * One tree per address family. Nodes only exist where the keys below
+ * them branch, so a lookup visits at most one node per branching bit
+ * instead of one per address bit. Entries are full addresses (a lease
+ * or an IPv6 iaaddr) or shorter prefixes (an IPv6 iaprefix, a pool).
+ *
+ * Every node counts the entries below it by binding state, so the
+ * usage of any prefix is the counters of the topmost node inside it,
+ * and the usage of every /24 under 10.0.0.0/8 is one walk that stops at
+ * the first node of each /24.
+ *
+ * Nodes live in one growable array and link by index, the trie is
+ * released as a whole.
+ *
+ * struct lease_trie_t trie;
+ *
+ * lease_trie_init(&trie);
+ * lease_trie_build(&trie, table);
+ * lease_addr_parse_prefix("10.0.0.0/8", 10, &net, &len);
+ * lease_trie_walk(&trie, &net, len, 24, print_subnet, NULL);
+ * lease_trie_release(&trie);
+ */
+
+#define LEASE_TRIE_NONE         (-1)
+
+struct lease_trie_node_t
+{
+  struct lease_addr_t key;
+  uint8_t prefix_len;
+  // binding state of an entry
+  uint8_t state;
+  // 0 for a branching node without an entry
+  uint32_t value;
+  int32_t child[2];
+  struct lease_usage_t usage;
+};
+
+struct lease_trie_t
+{
+  struct lease_trie_node_t *nodes;
+  size_t count;
+  size_t capacity;
+  // AF_INET, AF_INET6
+  int32_t root[2];
+};
+
+typedef void (*lease_trie_walk_cb_t)(const struct lease_addr_t *prefix,
+    unsigned int prefix_len, const struct lease_usage_t *usage, void *user);
+
+void lease_trie_init(struct lease_trie_t *trie);
+void lease_trie_release(struct lease_trie_t *trie);
+
+/*
+ * add an entry, or replace value and state of the entry with the same
+ * prefix. value must not be 0.
+ */
+int lease_trie_insert(struct lease_trie_t *trie, const struct lease_addr_t *addr,
+    unsigned int prefix_len, uint32_t value, enum lease_binding_state_t state);
+// every record with value = record index + 1
+int lease_trie_build(struct lease_trie_t *trie, const struct lease_table_t *table);
+
+// entry with the longest prefix containing addr, NULL if none
+const struct lease_trie_node_t *lease_trie_match(const struct lease_trie_t *trie,
+    const struct lease_addr_t *addr);
+// usage of the entries within prefix, all zero if none
+void lease_trie_usage(const struct lease_trie_t *trie,
+    const struct lease_addr_t *prefix, unsigned int prefix_len,
+    struct lease_usage_t *usage);
+/*
+ * call cb with every /unit_len prefix within prefix that holds entries,
+ * in address order. Entries shorter than unit_len are not reported.
+ */
+void lease_trie_walk(const struct lease_trie_t *trie,
+    const struct lease_addr_t *prefix, unsigned int prefix_len,
+    unsigned int unit_len, lease_trie_walk_cb_t cb, void *user);
+
+/**
+ *
+ * \brief address pools
+ *
+ * A pool file lists one prefix per line, optionally followed by a name;
+ * '#' starts a comment:
+ *
+ * 10.1.0.0/16          campus
+ * 10.1.8.0/22          lab
+ * 2001:db8::/48        v6
+ *
+ * Each lease is accounted to the pool with the longest matching prefix,
+ * so 10.1.9.1 counts for lab only.
+ */
+
+struct lease_pool_t
+{
+  char *name;
+  struct lease_addr_t addr;
+  unsigned int prefix_len;
+  struct lease_usage_t usage;
+};
+
+struct lease_pools_t
+{
+  struct lease_pool_t *pools;
+  size_t count;
+  size_t capacity;
+  struct lease_trie_t trie;
+};
+
+int lease_pools_load(struct lease_pools_t *pools, const char *file_path);
+void lease_pools_release(struct lease_pools_t *pools);
+// recount the usage of every pool from table
+void lease_pools_account(struct lease_pools_t *pools,
+    const struct lease_table_t *table);
+
+// "label total active free ... utilisation%" tab separated
+void lease_usage_print(FILE *fp, const char *label,
+    const struct lease_usage_t *usage);
+
+#endif /* _LEASE_TRIE_H_ */
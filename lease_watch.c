@@ -0,0 +1,645 @@
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+#include <unistd.h>
+#include <limits.h>
+#include <time.h>
+#include <sys/epoll.h>
+#include <sys/inotify.h>
+#include <sys/timerfd.h>
+
+#include "lease_watch.h"
+#include "lease_time.h"
+#include "log.h"
+
+#define ARRAYSIZE(n) (sizeof(n)/sizeof(n[0]))
+
+#define LEASE_WATCH_INOTIFY_MASK \
+        (IN_MODIFY | IN_CLOSE_WRITE | IN_MOVED_TO | IN_CREATE)
+
+struct lease_watch_callback_t
+{
+  lease_event_cb_t cb;
+  void *user;
+  struct dllist link;
+};
+
+struct lease_watch_timer_t
+{
+  struct lease_wheel_timer_t timer;
+  // ends of the active record the timer last fired for
+  time_t fired;
+};
+
+struct lease_event_type_2_str_t
+{
+  enum lease_event_type_t type;
+  const char *str;
+};
+
+static const struct lease_event_type_2_str_t lease_event_type_2_str_map[] =
+    {
+        {.type = LEASE_EVENT_ADDED,         .str = "added",         },
+        {.type = LEASE_EVENT_RENEWED,       .str = "renewed",       },
+        {.type = LEASE_EVENT_EXPIRED,       .str = "expired",       },
+        {.type = LEASE_EVENT_RELEASED,      .str = "released",      },
+        {.type = LEASE_EVENT_STATE_CHANGED, .str = "state_changed", },
+    };
+
+const char *
+lease_event_type_2_str(enum lease_event_type_t type)
+{
+  int i;
+
+  for (i = 0; i < ARRAYSIZE(lease_event_type_2_str_map); i++)
+    {
+      if (type == lease_event_type_2_str_map[i].type)
+        return lease_event_type_2_str_map[i].str;
+    }
+
+  return NULL;
+}
+
+enum lease_event_type_t
+lease_event_classify(const struct lease_element_t *lease,
+    const struct lease_element_t *previous)
+{
+  if (!previous)
+    return LEASE_EVENT_ADDED;
+
+  if (lease->binding_state == previous->binding_state)
+    {
+      if (lease->binding_state == LEASE_BINDING_STATE_ACTIVE
+          && (lease->ends != previous->ends || lease->starts != previous->starts))
+        return LEASE_EVENT_RENEWED;
+
+      return LEASE_EVENT_NONE;
+    }
+
+  switch (lease->binding_state)
+    {
+  case LEASE_BINDING_STATE_EXPIRED:
+    return LEASE_EVENT_EXPIRED;
+  case LEASE_BINDING_STATE_RELEASED:
+    return LEASE_EVENT_RELEASED;
+  default:
+    return LEASE_EVENT_STATE_CHANGED;
+    }
+}
+
+static void
+lease_json_print_str(FILE *fp, const char *str)
+{
+  const unsigned char *p;
+
+  if (!str)
+    {
+      fputs("null", fp);
+      return;
+    }
+
+  fputc('"', fp);
+  for (p = (const unsigned char *) str; *p; p++)
+    {
+      if (*p == '"' || *p == '\\')
+        fprintf(fp, "\\%c", *p);
+      else if (*p < 0x20)
+        fprintf(fp, "\\u%04x", *p);
+      else
+        fputc(*p, fp);
+    }
+  fputc('"', fp);
+}
+
+void
+lease_event_print_json(const struct lease_event_t *event, void *user)
+{
+  const struct lease_element_t *lease = event->lease;
+  char ip[LEASE_ADDR_STR_SIZE], mac[LEASE_HWADDR_STR_SIZE];
+  FILE *fp = user ? user : stdout;
+
+  fprintf(fp, "{\"event\":\"%s\",\"ip\":", lease_event_type_2_str(event->type));
+  lease_json_print_str(fp, lease_addr_to_str(&lease->ip, ip, sizeof(ip)));
+  fputs(",\"mac\":", fp);
+  lease_json_print_str(fp, lease_hwaddr_to_str(&lease->hardware, mac,
+      sizeof(mac)));
+  fputs(",\"state\":", fp);
+  lease_json_print_str(fp, lease_binding_state_2_str(lease->binding_state));
+  fputs(",\"previous_state\":", fp);
+  lease_json_print_str(fp, event->previous ?
+      lease_binding_state_2_str(event->previous->binding_state) : NULL);
+  fprintf(fp, ",\"starts\":%lld,\"ends\":%lld,\"client_hostname\":",
+      (long long) lease->starts, (long long) lease->ends);
+  lease_json_print_str(fp, lease->client_hostname);
+  fputs("}\n", fp);
+  fflush(fp);
+}
+
+static void
+lease_watch_emit(struct lease_watch_t *watch, const struct lease_event_t *event)
+{
+  struct lease_watch_callback_t *callback;
+
+  dllist_for_each(callback, &watch->callbacks, link)
+  {
+    callback->cb(event, callback->user);
+  }
+}
+
+// index of lease in the current table, -1 if it is not a record of it
+static ssize_t
+lease_watch_record_idx(const struct lease_watch_t *watch,
+    const struct lease_element_t *lease)
+{
+  const struct lease_table_t *table = watch->parser->table;
+
+  if (!lease || !table || lease < table->leases
+      || lease >= table->leases + table->count)
+    return -1;
+
+  return lease - table->leases;
+}
+
+static int
+lease_watch_note_changed(struct lease_watch_t *watch, uint32_t idx)
+{
+  if (watch->changed_count == watch->changed_capacity)
+    {
+      size_t capacity = watch->changed_capacity ?
+          watch->changed_capacity * 2 : 64;
+      uint32_t *tmp = realloc(watch->changed, capacity * sizeof(*tmp));
+
+      if (!tmp)
+        {
+          logg_err("Cannot allocate memory.");
+          return -1;
+        }
+      watch->changed = tmp;
+      watch->changed_capacity = capacity;
+    }
+
+  watch->changed[watch->changed_count++] = idx;
+  return 0;
+}
+
+static void
+lease_watch_on_change(const struct lease_element_t *lease,
+    const struct lease_element_t *previous, void *user)
+{
+  struct lease_watch_t *watch = user;
+  struct lease_event_t event;
+  ssize_t idx;
+
+  /*
+   * an incremental refresh passes records of the current table, a reload
+   * those of the new one with previous from the current table
+   */
+  idx = lease_watch_record_idx(watch, lease);
+  if (idx >= 0)
+    lease_watch_note_changed(watch, idx);
+  else
+    idx = lease_watch_record_idx(watch, previous);
+
+  event.type = lease_event_classify(lease, previous);
+  if (event.type == LEASE_EVENT_NONE)
+    return;
+
+  // already reported by the expiry timer
+  if (event.type == LEASE_EVENT_EXPIRED && idx >= 0 && idx < watch->timers_size
+      && watch->timers[idx] && previous->ends == watch->timers[idx]->fired
+      && previous->binding_state == LEASE_BINDING_STATE_ACTIVE)
+    return;
+
+  event.lease = lease;
+  event.previous = previous;
+
+  lease_watch_emit(watch, &event);
+}
+
+static void
+lease_watch_on_expiry(struct lease_wheel_timer_t *timer, void *user)
+{
+  struct lease_watch_t *watch = user;
+  struct lease_watch_timer_t *expiry = container_of(timer,
+      struct lease_watch_timer_t, timer);
+  const struct lease_element_t *lease;
+  struct lease_element_t expired;
+  struct lease_event_t event;
+
+  lease = lease_table_get(watch->parser->table, timer->idx);
+  if (!lease || lease->binding_state != LEASE_BINDING_STATE_ACTIVE
+      || lease->ends != timer->expires)
+    return;
+
+  expiry->fired = lease->ends;
+
+  expired = *lease;
+  expired.binding_state = LEASE_BINDING_STATE_EXPIRED;
+
+  event.type = LEASE_EVENT_EXPIRED;
+  event.lease = &expired;
+  event.previous = lease;
+
+  lease_watch_emit(watch, &event);
+}
+
+// put record idx on the wheel if it is active and its end is ahead
+static int
+lease_watch_schedule(struct lease_watch_t *watch, size_t idx)
+{
+  const struct lease_element_t *lease = lease_table_get(watch->parser->table, idx);
+  struct lease_watch_timer_t *expiry;
+
+  if (idx >= watch->timers_size)
+    {
+      size_t size = watch->timers_size ? watch->timers_size : 1024;
+      struct lease_watch_timer_t **tmp;
+
+      while (size <= idx)
+        size *= 2;
+
+      tmp = realloc(watch->timers, size * sizeof(*tmp));
+      if (!tmp)
+        goto error;
+
+      memset(tmp + watch->timers_size, 0,
+          (size - watch->timers_size) * sizeof(*tmp));
+      watch->timers = tmp;
+      watch->timers_size = size;
+    }
+
+  expiry = watch->timers[idx];
+
+  if (!lease || lease->binding_state != LEASE_BINDING_STATE_ACTIVE
+      || lease->ends == LEASE_TIME_NEVER || lease->ends < watch->wheel.now
+      || lease->ends == (expiry ? expiry->fired : 0))
+    {
+      if (expiry)
+        lease_wheel_del(&watch->wheel, &expiry->timer);
+      return 0;
+    }
+
+  if (!expiry)
+    {
+      expiry = calloc(1, sizeof(*expiry));
+      if (!expiry)
+        goto error;
+
+      lease_wheel_timer_init(&expiry->timer, idx);
+      watch->timers[idx] = expiry;
+    }
+
+  lease_wheel_add(&watch->wheel, &expiry->timer, lease->ends);
+  return 0;
+
+  error:
+  logg_err("Cannot allocate memory.");
+  return -1;
+}
+
+// the records of a reloaded table have new indexes
+static int
+lease_watch_schedule_all(struct lease_watch_t *watch)
+{
+  size_t idx;
+
+  for (idx = 0; idx < watch->timers_size; idx++)
+    {
+      free(watch->timers[idx]);
+      watch->timers[idx] = NULL;
+    }
+  lease_wheel_init(&watch->wheel, watch->wheel.now);
+
+  for (idx = 0; idx < lease_table_size(watch->parser->table); idx++)
+    {
+      if (lease_watch_schedule(watch, idx) < 0)
+        return -1;
+    }
+
+  return 0;
+}
+
+// sleep until the next timer on the wheel is due
+static int
+lease_watch_arm_expiry(struct lease_watch_t *watch)
+{
+  struct itimerspec its;
+  time_t next = lease_wheel_next(&watch->wheel);
+
+  memset(&its, 0, sizeof(its));
+  if (next != LEASE_TIME_NEVER)
+    its.it_value.tv_sec = next > 0 ? next : 1;
+
+  if (timerfd_settime(watch->expiry_fd, TFD_TIMER_ABSTIME, &its, NULL) < 0)
+    {
+      logg_err("timerfd_settime failed (%s)", strerror(errno));
+      return -1;
+    }
+
+  return 0;
+}
+
+static void
+lease_watch_expire(struct lease_watch_t *watch)
+{
+  uint64_t expirations;
+
+  while (read(watch->expiry_fd, &expirations, sizeof(expirations)) < 0
+      && errno == EINTR)
+    ;
+
+  lease_wheel_advance(&watch->wheel, time(NULL), lease_watch_on_expiry, watch);
+}
+
+static int
+lease_watch_split_path(struct lease_watch_t *watch, const char *file_path)
+{
+  const char *slash = strrchr(file_path, '/');
+
+  if (!slash)
+    {
+      watch->dir = strdup(".");
+      watch->name = strdup(file_path);
+    }
+  else
+    {
+      watch->dir = slash == file_path ? strdup("/")
+          : strndup(file_path, slash - file_path);
+      watch->name = strdup(slash + 1);
+    }
+
+  return watch->dir && watch->name ? 0 : -1;
+}
+
+struct lease_watch_t *
+lease_watch_new(const char *file_path, enum lease_parser_read_mode_t mode,
+    unsigned int debounce_ms)
+{
+  struct lease_watch_t *watch;
+  struct epoll_event ev;
+
+  watch = calloc(1, sizeof(*watch));
+  if (!watch)
+    {
+      logg_err("Cannot allocate memory.");
+      return NULL;
+    }
+
+  watch->epoll_fd = watch->inotify_fd = watch->timer_fd = watch->expiry_fd = -1;
+  watch->debounce_ms = debounce_ms ? debounce_ms : LEASE_WATCH_DEBOUNCE_MS;
+  dllist_init(&watch->callbacks);
+
+  if (lease_watch_split_path(watch, file_path) < 0)
+    {
+      logg_err("Cannot allocate memory.");
+      goto error;
+    }
+
+  watch->parser = lease_parser_open(file_path, mode);
+  if (!watch->parser)
+    goto error;
+
+  watch->parser->on_change = lease_watch_on_change;
+  watch->parser->user = watch;
+
+  watch->epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+  watch->inotify_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+  watch->timer_fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+  // lease times are wall clock times
+  watch->expiry_fd = timerfd_create(CLOCK_REALTIME, TFD_NONBLOCK | TFD_CLOEXEC);
+  if (watch->epoll_fd < 0 || watch->inotify_fd < 0 || watch->timer_fd < 0
+      || watch->expiry_fd < 0)
+    {
+      logg_err("can't create watch fds (%s)", strerror(errno));
+      goto error;
+    }
+
+  // the directory also sees the rewritten file being renamed into place
+  if (inotify_add_watch(watch->inotify_fd, watch->dir,
+      LEASE_WATCH_INOTIFY_MASK) < 0)
+    {
+      logg_err("inotify_add_watch %s failed (%s)", watch->dir, strerror(errno));
+      goto error;
+    }
+
+  memset(&ev, 0, sizeof(ev));
+  ev.events = EPOLLIN;
+  ev.data.fd = watch->inotify_fd;
+  if (epoll_ctl(watch->epoll_fd, EPOLL_CTL_ADD, watch->inotify_fd, &ev) < 0)
+    goto error_epoll;
+
+  ev.data.fd = watch->timer_fd;
+  if (epoll_ctl(watch->epoll_fd, EPOLL_CTL_ADD, watch->timer_fd, &ev) < 0)
+    goto error_epoll;
+
+  ev.data.fd = watch->expiry_fd;
+  if (epoll_ctl(watch->epoll_fd, EPOLL_CTL_ADD, watch->expiry_fd, &ev) < 0)
+    goto error_epoll;
+
+  lease_wheel_init(&watch->wheel, time(NULL));
+  if (lease_watch_schedule_all(watch) < 0)
+    goto error;
+
+  return watch;
+
+  error_epoll:
+  logg_err("epoll_ctl failed (%s)", strerror(errno));
+  error:
+  lease_watch_destroy(watch);
+  return NULL;
+}
+
+void
+lease_watch_destroy(struct lease_watch_t *watch)
+{
+  struct lease_watch_callback_t *callback, *tmp;
+  size_t idx;
+
+  if (!watch)
+    return;
+
+  dllist_for_each_safe(callback, tmp, &watch->callbacks, link)
+  {
+    dllist_remove(&callback->link);
+    free(callback);
+  }
+
+  for (idx = 0; idx < watch->timers_size; idx++)
+    free(watch->timers[idx]);
+  free(watch->timers);
+  free(watch->changed);
+
+  if (watch->expiry_fd >= 0)
+    close(watch->expiry_fd);
+  if (watch->timer_fd >= 0)
+    close(watch->timer_fd);
+  if (watch->inotify_fd >= 0)
+    close(watch->inotify_fd);
+  if (watch->epoll_fd >= 0)
+    close(watch->epoll_fd);
+
+  lease_parser_close(watch->parser);
+  free(watch->dir);
+  free(watch->name);
+  free(watch);
+}
+
+int
+lease_watch_add_callback(struct lease_watch_t *watch, lease_event_cb_t cb,
+    void *user)
+{
+  struct lease_watch_callback_t *callback;
+
+  callback = calloc(1, sizeof(*callback));
+  if (!callback)
+    {
+      logg_err("Cannot allocate memory.");
+      return -1;
+    }
+
+  callback->cb = cb;
+  callback->user = user;
+
+  // keep registration order
+  dllist_insert(watch->callbacks.prev, &callback->link);
+
+  return 0;
+}
+
+void
+lease_watch_stop(struct lease_watch_t *watch)
+{
+  watch->stop = 1;
+}
+
+static int
+lease_watch_arm_timer(struct lease_watch_t *watch)
+{
+  struct itimerspec its;
+
+  if (watch->timer_armed)
+    return 0;
+
+  memset(&its, 0, sizeof(its));
+  its.it_value.tv_sec = watch->debounce_ms / 1000;
+  its.it_value.tv_nsec = (watch->debounce_ms % 1000) * 1000000L;
+
+  if (timerfd_settime(watch->timer_fd, 0, &its, NULL) < 0)
+    {
+      logg_err("timerfd_settime failed (%s)", strerror(errno));
+      return -1;
+    }
+
+  watch->timer_armed = 1;
+  return 0;
+}
+
+// 1 if one of the queued events concerns the lease file
+static int
+lease_watch_read_inotify(struct lease_watch_t *watch)
+{
+  char buf[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+  const struct inotify_event *event;
+  ssize_t len;
+  char *p;
+  int hit = 0;
+
+  for (;;)
+    {
+      len = read(watch->inotify_fd, buf, sizeof(buf));
+      if (len < 0 && errno == EINTR)
+        continue;
+      if (len <= 0)
+        break;
+
+      for (p = buf; p < buf + len; p += sizeof(*event) + event->len)
+        {
+          event = (const struct inotify_event *) p;
+
+          if (event->mask & IN_Q_OVERFLOW)
+            hit = 1;
+          else if (event->len && !strcmp(event->name, watch->name))
+            hit = 1;
+        }
+    }
+
+  return hit;
+}
+
+static void
+lease_watch_refresh(struct lease_watch_t *watch)
+{
+  uint64_t expirations;
+  size_t i;
+
+  while (read(watch->timer_fd, &expirations, sizeof(expirations)) < 0
+      && errno == EINTR)
+    ;
+  watch->timer_armed = 0;
+
+  // leases that ended by now expire before the file catches up
+  lease_wheel_advance(&watch->wheel, time(NULL), lease_watch_on_expiry, watch);
+
+  watch->changed_count = 0;
+  switch (lease_parser_refresh(watch->parser))
+    {
+  case LEASE_PARSER_REFRESH_ERROR:
+    logg_err("error refresh lease file %s", watch->parser->path);
+    break;
+  case LEASE_PARSER_REFRESH_APPENDED:
+    for (i = 0; i < watch->changed_count; i++)
+      lease_watch_schedule(watch, watch->changed[i]);
+    break;
+  case LEASE_PARSER_REFRESH_RELOADED:
+    lease_watch_schedule_all(watch);
+    break;
+  default:
+    break;
+    }
+}
+
+int
+lease_watch_run(struct lease_watch_t *watch)
+{
+  struct epoll_event events[4];
+  int i, n;
+
+  if (lease_watch_arm_expiry(watch) < 0)
+    return -1;
+
+  while (!watch->stop)
+    {
+      n = epoll_wait(watch->epoll_fd, events, ARRAYSIZE(events), -1);
+      if (n < 0 && errno == EINTR)
+        continue;
+      if (n < 0)
+        {
+          logg_err("epoll_wait failed (%s)", strerror(errno));
+          return -1;
+        }
+
+      for (i = 0; i < n; i++)
+        {
+          if (events[i].data.fd == watch->inotify_fd)
+            {
+              if (lease_watch_read_inotify(watch)
+                  && lease_watch_arm_timer(watch) < 0)
+                return -1;
+            }
+          else if (events[i].data.fd == watch->timer_fd)
+            {
+              lease_watch_refresh(watch);
+            }
+          else if (events[i].data.fd == watch->expiry_fd)
+            {
+              lease_watch_expire(watch);
+            }
+        }
+
+      if (lease_watch_arm_expiry(watch) < 0)
+        return -1;
+    }
+
+  return 0;
+}
@@ -0,0 +1,105 @@
+/*
+ * lease_watch.h
+ *
+ */
+
+#ifndef _LEASE_WATCH_H_
+#define _LEASE_WATCH_H_
+
+#include <signal.h>
+#include <stdio.h>
+
+#include "dllist.h"
+#include "lease.h"
+#include "lease_parser.h"
+#include "lease_wheel.h"
+
+#define LEASE_WATCH_DEBOUNCE_MS         20
+
+enum lease_event_type_t
+{
+  LEASE_EVENT_NONE = -1,
+  LEASE_EVENT_ADDED,
+  LEASE_EVENT_RENEWED,
+  LEASE_EVENT_EXPIRED,
+  LEASE_EVENT_RELEASED,
+  LEASE_EVENT_STATE_CHANGED,
+};
+
+struct lease_event_t
+{
+  enum lease_event_type_t type;
+  const struct lease_element_t *lease;
+  const struct lease_element_t *previous;
+};
+
+typedef void (*lease_event_cb_t)(const struct lease_event_t *event, void *user);
+
+/**
+ *
+ * \brief event loop that follows a lease file
+ *
+ * inotify on the directory of the lease file reports writes to the file
+ * as well as dhcpd renaming a rewritten file into place. Bursts of
+ * events are coalesced: the first one arms a timerfd of debounce_ms,
+ * and when it fires the file is refreshed incrementally once. Changed
+ * leases are handed to all registered callbacks as typed events. The
+ * loop sleeps in epoll_wait() while nothing happens.
+ *
+ * dhcpd marks a lease expired in the file only when it gets around to
+ * it. Every active lease therefore also has a timer on a timer wheel,
+ * and a second timerfd sleeps until the next one is due: the expired
+ * event is delivered at ends, with the lease in state expired and the
+ * active record as previous. The later file update of the same expiry
+ * is not reported again.
+ *
+ * struct lease_watch_t *watch = lease_watch_new(path, mode, 0);
+ * lease_watch_add_callback(watch, lease_event_print_json, stdout);
+ * lease_watch_run(watch);      // until lease_watch_stop()
+ * lease_watch_destroy(watch);
+ */
+
+struct lease_watch_timer_t;
+
+struct lease_watch_t
+{
+  struct lease_parser_t *parser;
+  char *dir;
+  char *name;
+  int epoll_fd;
+  int inotify_fd;
+  int timer_fd;
+  unsigned int debounce_ms;
+  int timer_armed;
+  volatile sig_atomic_t stop;
+  struct dllist callbacks;
+  // expiry timers by record index
+  int expiry_fd;
+  struct lease_wheel_t wheel;
+  struct lease_watch_timer_t **timers;
+  size_t timers_size;
+  // records changed by the running incremental refresh
+  uint32_t *changed;
+  size_t changed_count;
+  size_t changed_capacity;
+};
+
+struct lease_watch_t *lease_watch_new(const char *file_path,
+    enum lease_parser_read_mode_t mode, unsigned int debounce_ms);
+void lease_watch_destroy(struct lease_watch_t *watch);
+
+int lease_watch_add_callback(struct lease_watch_t *watch, lease_event_cb_t cb,
+    void *user);
+int lease_watch_run(struct lease_watch_t *watch);
+// async signal safe
+void lease_watch_stop(struct lease_watch_t *watch);
+
+// LEASE_EVENT_NONE if nothing worth reporting changed
+enum lease_event_type_t lease_event_classify(const struct lease_element_t *lease,
+    const struct lease_element_t *previous);
+const char *lease_event_type_2_str(enum lease_event_type_t type);
+
+// callback writing one JSON object per line to the FILE * passed as user
+void lease_event_print_json(const struct lease_event_t *event, void *user);
+
+#endif /* _LEASE_WATCH_H_ */
@@ -0,0 +1,187 @@
+#include "lease_wheel.h"
+#include "lease_time.h"
+
+#define LEASE_WHEEL_MASK        (LEASE_WHEEL_SLOTS - 1)
+// seconds covered by the levels below l
+#define LEASE_WHEEL_SPAN(l)     ((time_t) 1 << (LEASE_WHEEL_SLOT_BITS * (l)))
+
+static uint64_t
+lease_wheel_rotate(uint64_t bits, unsigned int n)
+{
+  n &= LEASE_WHEEL_MASK;
+  return n ? (bits >> n) | (bits << (LEASE_WHEEL_SLOTS - n)) : bits;
+}
+
+void
+lease_wheel_init(struct lease_wheel_t *wheel, time_t now)
+{
+  int l, s;
+
+  wheel->now = now;
+  wheel->count = 0;
+  for (l = 0; l < LEASE_WHEEL_LEVELS; l++)
+    {
+      wheel->occupied[l] = 0;
+      for (s = 0; s < LEASE_WHEEL_SLOTS; s++)
+        dllist_init(&wheel->slots[l][s]);
+    }
+}
+
+void
+lease_wheel_del(struct lease_wheel_t *wheel, struct lease_wheel_timer_t *timer)
+{
+  struct dllist *slot;
+
+  if (timer->level < 0)
+    return;
+
+  slot = &wheel->slots[timer->level][timer->slot];
+  dllist_remove(&timer->link);
+  if (dllist_empty(slot))
+    wheel->occupied[timer->level] &= ~(1ull << timer->slot);
+
+  timer->level = -1;
+  wheel->count--;
+}
+
+void
+lease_wheel_add(struct lease_wheel_t *wheel, struct lease_wheel_timer_t *timer,
+    time_t expires)
+{
+  time_t e = expires, delta;
+  int l;
+
+  lease_wheel_del(wheel, timer);
+  timer->expires = expires;
+
+  if (e < wheel->now)
+    e = wheel->now;
+  delta = e - wheel->now;
+  if (delta >= LEASE_WHEEL_SPAN(LEASE_WHEEL_LEVELS))
+    {
+      delta = LEASE_WHEEL_SPAN(LEASE_WHEEL_LEVELS) - 1;
+      e = wheel->now + delta;
+    }
+
+  for (l = 0; l < LEASE_WHEEL_LEVELS - 1; l++)
+    {
+      if (delta < LEASE_WHEEL_SPAN(l + 1))
+        break;
+    }
+
+  timer->level = l;
+  timer->slot = (e >> (LEASE_WHEEL_SLOT_BITS * l)) & LEASE_WHEEL_MASK;
+  dllist_insert(wheel->slots[l][timer->slot].prev, &timer->link);
+  wheel->occupied[l] |= 1ull << timer->slot;
+  wheel->count++;
+}
+
+time_t
+lease_wheel_next(const struct lease_wheel_t *wheel)
+{
+  time_t next = LEASE_TIME_NEVER;
+  int l;
+
+  // level 0 slots are seconds, counted from now
+  if (wheel->occupied[0])
+    next = wheel->now + __builtin_ctzll(lease_wheel_rotate(wheel->occupied[0],
+        wheel->now));
+
+  /*
+   * upper slots are due when now reaches their start: the current one if
+   * now is at its start and has not been processed, else from the next
+   */
+  for (l = 1; l < LEASE_WHEEL_LEVELS; l++)
+    {
+      time_t first = wheel->now >> (LEASE_WHEEL_SLOT_BITS * l), t;
+
+      if (!wheel->occupied[l])
+        continue;
+
+      if (wheel->now & (LEASE_WHEEL_SPAN(l) - 1))
+        first++;
+      t = first + __builtin_ctzll(lease_wheel_rotate(wheel->occupied[l],
+          first));
+      t <<= LEASE_WHEEL_SLOT_BITS * l;
+      if (t < next)
+        next = t;
+    }
+
+  return next;
+}
+
+// move the timers of a slot to list and mark it empty
+static void
+lease_wheel_take(struct lease_wheel_t *wheel, int level, int slot,
+    struct dllist *list)
+{
+  struct dllist *head = &wheel->slots[level][slot];
+
+  dllist_init(list);
+  if (dllist_empty(head))
+    return;
+
+  dllist_insert_list(list, head);
+  dllist_init(head);
+  wheel->occupied[level] &= ~(1ull << slot);
+}
+
+static void
+lease_wheel_cascade(struct lease_wheel_t *wheel, int level)
+{
+  struct lease_wheel_timer_t *timer, *tmp;
+  struct dllist list;
+
+  lease_wheel_take(wheel, level,
+      (wheel->now >> (LEASE_WHEEL_SLOT_BITS * level)) & LEASE_WHEEL_MASK,
+      &list);
+
+  dllist_for_each_safe(timer, tmp, &list, link)
+  {
+    timer->level = -1;
+    wheel->count--;
+    lease_wheel_add(wheel, timer, timer->expires);
+  }
+}
+
+void
+lease_wheel_advance(struct lease_wheel_t *wheel, time_t to,
+    lease_wheel_cb_t cb, void *user)
+{
+  struct lease_wheel_timer_t *timer, *tmp;
+  struct dllist list;
+  time_t second;
+  int l;
+
+  while (wheel->now <= to)
+    {
+      second = lease_wheel_next(wheel);
+      if (second > to)
+        {
+          wheel->now = to + 1;
+          break;
+        }
+      wheel->now = second;
+
+      // top down, so a cascaded timer can cascade again at once
+      for (l = LEASE_WHEEL_LEVELS - 1; l > 0; l--)
+        {
+          if (!(second & (LEASE_WHEEL_SPAN(l) - 1)))
+            lease_wheel_cascade(wheel, l);
+        }
+
+      lease_wheel_take(wheel, 0, second & LEASE_WHEEL_MASK, &list);
+      wheel->now = second + 1;
+
+      dllist_for_each_safe(timer, tmp, &list, link)
+      {
+        timer->level = -1;
+        wheel->count--;
+        // parked beyond the range of the wheel
+        if (timer->expires > second)
+          lease_wheel_add(wheel, timer, timer->expires);
+        else
+          cb(timer, user);
+      }
+    }
+}
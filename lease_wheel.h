@@ -0,0 +1,89 @@
+/*
+ * lease_wheel.h
+ *
+ */
+
+#ifndef _LEASE_WHEEL_H_
+#define _LEASE_WHEEL_H_
+
+#include <stdint.h>
+#include <time.h>
+
+#include "dllist.h"
+
+#define LEASE_WHEEL_LEVELS      4
+#define LEASE_WHEEL_SLOT_BITS   6
+#define LEASE_WHEEL_SLOTS       (1 << LEASE_WHEEL_SLOT_BITS)
+
+/**
+ *
+ * \brief hierarchical timer wheel with one second resolution
+ *
+ * Level l has 64 slots of 64^l seconds each, so four levels cover
+ * 64^4 seconds (about 194 days) ahead of now; later timers are parked
+ * at the far end and rescheduled when they get there. Adding and
+ * deleting a timer is O(1). When time passes a slot boundary of an
+ * upper level, the timers of that slot are cascaded down a level, until
+ * they reach level 0 and fire in the second they are due.
+ *
+ * A bitmap of the occupied slots per level makes lease_wheel_next() a
+ * few bit scans, so a caller can sleep exactly until the next timer
+ * (or cascade) instead of ticking every second.
+ *
+ * struct lease_wheel_t wheel;
+ *
+ * lease_wheel_init(&wheel, time(NULL));
+ * lease_wheel_add(&wheel, &timer, lease->ends);
+ * Sleep_until(lease_wheel_next(&wheel));
+ * lease_wheel_advance(&wheel, time(NULL), on_expire, user);
+ */
+
+struct lease_wheel_timer_t
+{
+  struct dllist link;
+  time_t expires;
+  // caller data, typically a record index
+  uint32_t idx;
+  // -1 if not scheduled
+  int8_t level;
+  uint8_t slot;
+};
+
+struct lease_wheel_t
+{
+  // first second not processed yet
+  time_t now;
+  struct dllist slots[LEASE_WHEEL_LEVELS][LEASE_WHEEL_SLOTS];
+  uint64_t occupied[LEASE_WHEEL_LEVELS];
+  size_t count;
+};
+
+typedef void (*lease_wheel_cb_t)(struct lease_wheel_timer_t *timer,
+    void *user);
+
+void lease_wheel_init(struct lease_wheel_t *wheel, time_t now);
+static inline void
+lease_wheel_timer_init(struct lease_wheel_timer_t *timer, uint32_t idx)
+{
+  timer->idx = idx;
+  timer->level = -1;
+}
+
+// (re)schedule timer, an expiry in the past fires on the next advance
+void lease_wheel_add(struct lease_wheel_t *wheel,
+    struct lease_wheel_timer_t *timer, time_t expires);
+void lease_wheel_del(struct lease_wheel_t *wheel,
+    struct lease_wheel_timer_t *timer);
+
+/*
+ * fire all timers due at or before to in expiry order. A timer is
+ * unscheduled before cb is called, which may add it again but must not
+ * delete other timers due in the same second.
+ */
+void lease_wheel_advance(struct lease_wheel_t *wheel, time_t to,
+    lease_wheel_cb_t cb, void *user);
+
+// time of the next expiry or cascade, LEASE_TIME_NEVER if empty
+time_t lease_wheel_next(const struct lease_wheel_t *wheel);
+
+#endif /* _LEASE_WHEEL_H_ */
@@ -0,0 +1,753 @@
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/socket.h>
+
+#include "lease_writer.h"
+#include "lease_time.h"
+#include "log.h"
+
+#define ARRAYSIZE(n) (sizeof(n)/sizeof(n[0]))
+
+// room for any field but a string, quoted and with its JSON key
+#define LEASE_WRITER_FIELD_MAX          (LEASE_ADDR_STR_SIZE + 32)
+#define LEASE_WRITER_STRING_NONE        0xffffffff
+// room for the change and the names of all fields, quoted for JSON
+#define LEASE_WRITER_CHANGE_MAX         (64 + 2 * LEASE_FIELDS_STR_SIZE)
+
+static const struct
+{
+  enum lease_writer_format_t format;
+  const char *str;
+} lease_writer_format_2_str_map[] =
+    {
+        { LEASE_WRITER_FORMAT_TSV, "tsv" },
+        { LEASE_WRITER_FORMAT_CSV, "csv" },
+        { LEASE_WRITER_FORMAT_JSON, "json" },
+        { LEASE_WRITER_FORMAT_BINARY, "binary" },
+    };
+
+static const char lease_writer_digits[] =
+    "0001020304050607080910111213141516171819"
+    "2021222324252627282930313233343536373839"
+    "4041424344454647484950515253545556575859"
+    "6061626364656667686970717273747576777879"
+    "8081828384858687888990919293949596979899";
+
+static const char lease_writer_hex[] = "0123456789abcdef";
+
+int
+lease_writer_format_parse(const char *name)
+{
+  int i;
+
+  for (i = 0; i < ARRAYSIZE(lease_writer_format_2_str_map); i++)
+    {
+      if (!strcmp(name, lease_writer_format_2_str_map[i].str))
+        return lease_writer_format_2_str_map[i].format;
+    }
+
+  return -1;
+}
+
+const char *
+lease_writer_format_2_str(enum lease_writer_format_t format)
+{
+  int i;
+
+  for (i = 0; i < ARRAYSIZE(lease_writer_format_2_str_map); i++)
+    {
+      if (format == lease_writer_format_2_str_map[i].format)
+        return lease_writer_format_2_str_map[i].str;
+    }
+
+  return NULL;
+}
+
+/*
+ * formatting, the caller has made room
+ */
+
+static char *
+lease_writer_u64(char *p, uint64_t v)
+{
+  char tmp[20], *t = tmp + sizeof(tmp);
+  size_t len;
+
+  // two digits per division
+  while (v >= 100)
+    {
+      t -= 2;
+      memcpy(t, &lease_writer_digits[(v % 100) * 2], 2);
+      v /= 100;
+    }
+
+  if (v >= 10)
+    {
+      t -= 2;
+      memcpy(t, &lease_writer_digits[v * 2], 2);
+    }
+  else
+    *--t = '0' + v;
+
+  len = tmp + sizeof(tmp) - t;
+  memcpy(p, t, len);
+  return p + len;
+}
+
+static char *
+lease_writer_i64(char *p, int64_t v)
+{
+  if (v >= 0)
+    return lease_writer_u64(p, v);
+
+  *p++ = '-';
+  return lease_writer_u64(p, -(uint64_t) v);
+}
+
+static char *
+lease_writer_addr(char *p, const struct lease_addr_t *addr)
+{
+  int i;
+
+  if (addr->family != AF_INET6)
+    {
+      for (i = 24; i >= 0; i -= 8)
+        {
+          p = lease_writer_u64(p, (addr->v4 >> i) & 0xff);
+          *p++ = '.';
+        }
+      return p - 1;
+    }
+
+  // rare enough for inet_ntop()
+  if (!lease_addr_to_str(addr, p, LEASE_ADDR_STR_SIZE))
+    return p;
+
+  return p + strlen(p);
+}
+
+static char *
+lease_writer_hwaddr(char *p, const struct lease_hwaddr_t *hwaddr)
+{
+  int i;
+
+  for (i = 0; i < LEASE_HWADDR_LEN; i++)
+    {
+      *p++ = lease_writer_hex[hwaddr->addr[i] >> 4];
+      *p++ = lease_writer_hex[hwaddr->addr[i] & 0xf];
+      *p++ = ':';
+    }
+
+  return p - 1;
+}
+
+static char *
+lease_writer_str(char *p, const char *str, size_t len)
+{
+  memcpy(p, str, len);
+  return p + len;
+}
+
+static char *
+lease_writer_json_str(char *p, const char *str, size_t len)
+{
+  const unsigned char *s = (const unsigned char *) str;
+  size_t i;
+
+  *p++ = '"';
+  for (i = 0; i < len; i++)
+    {
+      if (s[i] == '"' || s[i] == '\\')
+        {
+          *p++ = '\\';
+          *p++ = s[i];
+        }
+      else if (s[i] < 0x20)
+        {
+          p = lease_writer_str(p, "\\u00", 4);
+          *p++ = lease_writer_hex[s[i] >> 4];
+          *p++ = lease_writer_hex[s[i] & 0xf];
+        }
+      else
+        *p++ = s[i];
+    }
+  *p++ = '"';
+
+  return p;
+}
+
+static char *
+lease_writer_csv_str(char *p, const char *str, size_t len)
+{
+  size_t i;
+
+  if (!memchr(str, ',', len) && !memchr(str, '"', len)
+      && !memchr(str, '\n', len) && !memchr(str, '\r', len))
+    return lease_writer_str(p, str, len);
+
+  *p++ = '"';
+  for (i = 0; i < len; i++)
+    {
+      if (str[i] == '"')
+        *p++ = '"';
+      *p++ = str[i];
+    }
+  *p++ = '"';
+
+  return p;
+}
+
+static char *
+lease_writer_le(char *p, uint64_t v, int n)
+{
+  int i;
+
+  for (i = 0; i < n; i++)
+    *p++ = v >> (8 * i);
+
+  return p;
+}
+
+/*
+ * output
+ */
+
+int
+lease_writer_flush(struct lease_writer_t *writer)
+{
+  size_t off = 0;
+  ssize_t n;
+
+  while (!writer->error && off < writer->len)
+    {
+      n = write(writer->fd, writer->buf + off, writer->len - off);
+      if (n < 0)
+        {
+          if (errno == EINTR)
+            continue;
+
+          logg_err("write failed (%s)", strerror(errno));
+          writer->error = 1;
+          break;
+        }
+      off += n;
+    }
+
+  writer->len = 0;
+  return writer->error ? -1 : 0;
+}
+
+// room for n more bytes, NULL once a write failed
+static char *
+lease_writer_reserve(struct lease_writer_t *writer, size_t n)
+{
+  char *tmp;
+
+  if (writer->len + n > writer->size)
+    {
+      if (lease_writer_flush(writer) < 0)
+        return NULL;
+
+      if (n > writer->size)
+        {
+          tmp = realloc(writer->buf, n);
+          if (!tmp)
+            {
+              logg_err("Cannot allocate memory.");
+              return NULL;
+            }
+          writer->buf = tmp;
+          writer->size = n;
+        }
+    }
+
+  return writer->error ? NULL : writer->buf + writer->len;
+}
+
+static const char *
+lease_writer_field_str(const struct lease_query_field_desc_t *desc,
+    const struct lease_element_t *lease)
+{
+  return *(const char **) ((const char *) lease + desc->offset);
+}
+
+static time_t
+lease_writer_field_time(const struct lease_query_field_desc_t *desc,
+    const struct lease_element_t *lease)
+{
+  return *(const time_t *) ((const char *) lease + desc->offset);
+}
+
+static uint8_t
+lease_writer_field_state(const struct lease_query_field_desc_t *desc,
+    const struct lease_element_t *lease)
+{
+  return *((const uint8_t *) lease + desc->offset);
+}
+
+// upper bound of the size of the record of lease
+static size_t
+lease_writer_record_size(const struct lease_writer_t *writer,
+    const struct lease_element_t *lease)
+{
+  const struct lease_query_field_desc_t *desc;
+  const char *str;
+  size_t size = 16;
+  int i;
+
+  for (i = 0; i < writer->projection.count; i++)
+    {
+      desc = lease_query_field_desc(writer->projection.fields[i]);
+      size += LEASE_WRITER_FIELD_MAX + strlen(desc->name);
+
+      if (desc->kind != LEASE_QUERY_KIND_STRING)
+        continue;
+
+      // "\u00XX" for a control character in JSON
+      str = lease_writer_field_str(desc, lease);
+      if (str)
+        size += strlen(str) * 6;
+    }
+
+  return size;
+}
+
+static char *
+lease_writer_missing(const struct lease_writer_t *writer, char *p)
+{
+  switch (writer->format)
+    {
+  case LEASE_WRITER_FORMAT_TSV:
+    *p++ = '-';
+    break;
+  case LEASE_WRITER_FORMAT_JSON:
+    p = lease_writer_str(p, "null", 4);
+    break;
+  default:
+    break;
+    }
+
+  return p;
+}
+
+// a value of a text format, quoted for JSON where it is a string
+static char *
+lease_writer_text_field(const struct lease_writer_t *writer, char *p,
+    const struct lease_query_field_desc_t *desc,
+    const struct lease_element_t *lease)
+{
+  int quote = writer->format == LEASE_WRITER_FORMAT_JSON;
+  const char *str;
+  time_t t;
+
+  switch (desc->kind)
+    {
+  case LEASE_QUERY_KIND_ADDR:
+    if (lease->ip.family != AF_INET && lease->ip.family != AF_INET6)
+      return lease_writer_missing(writer, p);
+    if (quote)
+      *p++ = '"';
+    p = lease_writer_addr(p, &lease->ip);
+    if (quote)
+      *p++ = '"';
+    break;
+  case LEASE_QUERY_KIND_HWADDR:
+    if (lease->hardware.type == LEASE_HWADDR_TYPE_NONE)
+      return lease_writer_missing(writer, p);
+    if (quote)
+      *p++ = '"';
+    p = lease_writer_hwaddr(p, &lease->hardware);
+    if (quote)
+      *p++ = '"';
+    break;
+  case LEASE_QUERY_KIND_STATE:
+    str = lease_binding_state_2_str(lease_writer_field_state(desc, lease));
+    if (!str)
+      return lease_writer_missing(writer, p);
+    if (quote)
+      return lease_writer_json_str(p, str, strlen(str));
+    p = lease_writer_str(p, str, strlen(str));
+    break;
+  case LEASE_QUERY_KIND_TIME:
+    t = lease_writer_field_time(desc, lease);
+    if (t != LEASE_TIME_NEVER)
+      p = lease_writer_i64(p, t);
+    else if (quote)
+      p = lease_writer_missing(writer, p);
+    else
+      p = lease_writer_str(p, "never", 5);
+    break;
+  case LEASE_QUERY_KIND_STRING:
+    str = lease_writer_field_str(desc, lease);
+    if (!str)
+      return lease_writer_missing(writer, p);
+    switch (writer->format)
+      {
+    case LEASE_WRITER_FORMAT_JSON:
+      p = lease_writer_json_str(p, str, strlen(str));
+      break;
+    case LEASE_WRITER_FORMAT_CSV:
+      p = lease_writer_csv_str(p, str, strlen(str));
+      break;
+    default:
+      p = lease_writer_str(p, str, strlen(str));
+      break;
+      }
+    break;
+  case LEASE_QUERY_KIND_FLAG:
+    if (quote)
+      p = lease->flags & desc->flag ? lease_writer_str(p, "true", 4)
+          : lease_writer_str(p, "false", 5);
+    else
+      *p++ = lease->flags & desc->flag ? '1' : '0';
+    break;
+    }
+
+  return p;
+}
+
+static char *
+lease_writer_binary_field(char *p, const struct lease_query_field_desc_t *desc,
+    const struct lease_element_t *lease)
+{
+  const char *str;
+  uint32_t v4;
+  size_t len;
+
+  switch (desc->kind)
+    {
+  case LEASE_QUERY_KIND_ADDR:
+    if (lease->ip.family == AF_INET)
+      {
+        *p++ = 4;
+        *p++ = 0;
+        v4 = lease->ip.v4;
+        *p++ = v4 >> 24;
+        *p++ = v4 >> 16;
+        *p++ = v4 >> 8;
+        *p++ = v4;
+      }
+    else if (lease->ip.family == AF_INET6)
+      {
+        *p++ = 6;
+        *p++ = lease->ip.prefix_len;
+        p = lease_writer_str(p, (const char *) lease->ip.v6,
+            sizeof(lease->ip.v6));
+      }
+    else
+      {
+        *p++ = 0;
+        *p++ = 0;
+      }
+    break;
+  case LEASE_QUERY_KIND_HWADDR:
+    *p++ = lease->hardware.type;
+    p = lease_writer_str(p, (const char *) lease->hardware.addr,
+        LEASE_HWADDR_LEN);
+    break;
+  case LEASE_QUERY_KIND_STATE:
+    *p++ = lease_writer_field_state(desc, lease);
+    break;
+  case LEASE_QUERY_KIND_TIME:
+    p = lease_writer_le(p, lease_writer_field_time(desc, lease), 8);
+    break;
+  case LEASE_QUERY_KIND_STRING:
+    str = lease_writer_field_str(desc, lease);
+    if (!str)
+      return lease_writer_le(p, LEASE_WRITER_STRING_NONE, 4);
+    len = strlen(str);
+    p = lease_writer_le(p, len, 4);
+    p = lease_writer_str(p, str, len);
+    break;
+  case LEASE_QUERY_KIND_FLAG:
+    *p++ = !!(lease->flags & desc->flag);
+    break;
+    }
+
+  return p;
+}
+
+// change and fields ahead of the projected fields of a change record
+static char *
+lease_writer_change(const struct lease_writer_t *writer, char *p,
+    enum lease_change_t change, uint32_t fields)
+{
+  char buf[LEASE_FIELDS_STR_SIZE];
+  const char *str, *name;
+  uint32_t field;
+  int n = 0;
+
+  if (writer->format == LEASE_WRITER_FORMAT_BINARY)
+    {
+      *p++ = change;
+      return lease_writer_le(p, fields, 4);
+    }
+
+  str = lease_change_2_str(change);
+  switch (writer->format)
+    {
+  case LEASE_WRITER_FORMAT_JSON:
+    p = lease_writer_str(p, "\"change\":", 9);
+    p = lease_writer_json_str(p, str, strlen(str));
+    p = lease_writer_str(p, ",\"fields\":[", 11);
+    for (field = 1; field && field <= fields; field <<= 1)
+      {
+        if (!(fields & field) || !(name = lease_field_2_str(field)))
+          continue;
+        if (n++)
+          *p++ = ',';
+        p = lease_writer_json_str(p, name, strlen(name));
+      }
+    *p++ = ']';
+    if (writer->projection.count)
+      *p++ = ',';
+    break;
+  case LEASE_WRITER_FORMAT_CSV:
+    p = lease_writer_str(p, str, strlen(str));
+    *p++ = ',';
+    lease_fields_to_str(fields, buf, sizeof(buf));
+    p = lease_writer_csv_str(p, buf, strlen(buf));
+    if (writer->projection.count)
+      *p++ = ',';
+    break;
+  default:
+    p = lease_writer_str(p, str, strlen(str));
+    *p++ = '\t';
+    if (fields)
+      {
+        lease_fields_to_str(fields, buf, sizeof(buf));
+        p = lease_writer_str(p, buf, strlen(buf));
+      }
+    else
+      *p++ = '-';
+    if (writer->projection.count)
+      *p++ = '\t';
+    break;
+    }
+
+  return p;
+}
+
+static int
+lease_writer_record(struct lease_writer_t *writer, int change,
+    uint32_t fields, const struct lease_element_t *lease)
+{
+  const struct lease_query_field_desc_t *desc;
+  size_t size;
+  char *start, *p;
+  int i;
+
+  size = lease_writer_record_size(writer, lease);
+  if (change >= 0)
+    size += LEASE_WRITER_CHANGE_MAX;
+
+  start = p = lease_writer_reserve(writer, size);
+  if (!p)
+    return -1;
+
+  if (writer->format == LEASE_WRITER_FORMAT_BINARY)
+    {
+      // length, filled in below
+      p += 4;
+      if (change >= 0)
+        p = lease_writer_change(writer, p, change, fields);
+      for (i = 0; i < writer->projection.count; i++)
+        p = lease_writer_binary_field(p,
+            lease_query_field_desc(writer->projection.fields[i]), lease);
+      lease_writer_le(start, p - start - 4, 4);
+    }
+  else
+    {
+      if (writer->format == LEASE_WRITER_FORMAT_JSON)
+        *p++ = '{';
+      if (change >= 0)
+        p = lease_writer_change(writer, p, change, fields);
+
+      for (i = 0; i < writer->projection.count; i++)
+        {
+          desc = lease_query_field_desc(writer->projection.fields[i]);
+
+          switch (writer->format)
+            {
+          case LEASE_WRITER_FORMAT_JSON:
+            if (i)
+              *p++ = ',';
+            *p++ = '"';
+            p = lease_writer_str(p, desc->name, strlen(desc->name));
+            p = lease_writer_str(p, "\":", 2);
+            break;
+          case LEASE_WRITER_FORMAT_CSV:
+            if (i)
+              *p++ = ',';
+            break;
+          default:
+            if (i)
+              *p++ = '\t';
+            break;
+            }
+
+          p = lease_writer_text_field(writer, p, desc, lease);
+        }
+
+      if (writer->format == LEASE_WRITER_FORMAT_JSON)
+        *p++ = '}';
+      *p++ = '\n';
+    }
+
+  writer->len += p - start;
+  writer->records++;
+  return 0;
+}
+
+int
+lease_writer_write(struct lease_writer_t *writer,
+    const struct lease_element_t *lease)
+{
+  return lease_writer_record(writer, -1, 0, lease);
+}
+
+int
+lease_writer_write_change(struct lease_writer_t *writer,
+    enum lease_change_t change, uint32_t fields,
+    const struct lease_element_t *lease)
+{
+  if (!writer->changes || change >= LEASE_CHANGE_MAX)
+    {
+      logg_err("parameter error");
+      return -1;
+    }
+
+  return lease_writer_record(writer, change, fields, lease);
+}
+
+int
+lease_writer_write_bytes(struct lease_writer_t *writer, const void *buf,
+    size_t len)
+{
+  char *p;
+
+  p = lease_writer_reserve(writer, len);
+  if (!p)
+    return -1;
+
+  memcpy(p, buf, len);
+  writer->len += len;
+  return 0;
+}
+
+static int
+lease_writer_header(struct lease_writer_t *writer)
+{
+  const struct lease_query_field_desc_t *desc;
+  char *start, *p;
+  int i;
+
+  start = p = lease_writer_reserve(writer,
+      32 + writer->projection.count * LEASE_WRITER_FIELD_MAX);
+  if (!p)
+    return -1;
+
+  switch (writer->format)
+    {
+  case LEASE_WRITER_FORMAT_CSV:
+    if (writer->changes)
+      p = lease_writer_str(p, "change,fields", 13);
+    for (i = 0; i < writer->projection.count; i++)
+      {
+        desc = lease_query_field_desc(writer->projection.fields[i]);
+        if (i || writer->changes)
+          *p++ = ',';
+        p = lease_writer_str(p, desc->name, strlen(desc->name));
+      }
+    *p++ = '\n';
+    break;
+  case LEASE_WRITER_FORMAT_BINARY:
+    if (writer->changes)
+      p = lease_writer_str(p, LEASE_WRITER_CHANGES_MAGIC,
+          sizeof(LEASE_WRITER_CHANGES_MAGIC) - 1);
+    else
+      p = lease_writer_str(p, LEASE_WRITER_BINARY_MAGIC,
+          sizeof(LEASE_WRITER_BINARY_MAGIC) - 1);
+    p = lease_writer_le(p, LEASE_WRITER_BINARY_VERSION, 2);
+    p = lease_writer_le(p, writer->projection.count, 2);
+    for (i = 0; i < writer->projection.count; i++)
+      *p++ = writer->projection.fields[i];
+    break;
+  default:
+    break;
+    }
+
+  writer->len += p - start;
+  return 0;
+}
+
+static struct lease_writer_t *
+lease_writer_create(int fd, enum lease_writer_format_t format,
+    const struct lease_projection_t *projection, int changes)
+{
+  struct lease_writer_t *writer;
+
+  if (format >= LEASE_WRITER_FORMAT_MAX)
+    return NULL;
+
+  writer = calloc(1, sizeof(*writer));
+  if (!writer)
+    {
+      logg_err("Cannot allocate memory.");
+      return NULL;
+    }
+
+  writer->buf = malloc(LEASE_WRITER_BUFFER_SIZE);
+  if (!writer->buf)
+    {
+      logg_err("Cannot allocate memory.");
+      free(writer);
+      return NULL;
+    }
+
+  writer->fd = fd;
+  writer->format = format;
+  writer->projection = *projection;
+  writer->changes = changes;
+  writer->size = LEASE_WRITER_BUFFER_SIZE;
+
+  if (lease_writer_header(writer) < 0)
+    {
+      free(writer->buf);
+      free(writer);
+      return NULL;
+    }
+
+  return writer;
+}
+
+struct lease_writer_t *
+lease_writer_new(int fd, enum lease_writer_format_t format,
+    const struct lease_projection_t *projection)
+{
+  return lease_writer_create(fd, format, projection, 0);
+}
+
+struct lease_writer_t *
+lease_writer_new_changes(int fd, enum lease_writer_format_t format,
+    const struct lease_projection_t *projection)
+{
+  return lease_writer_create(fd, format, projection, 1);
+}
+
+int
+lease_writer_close(struct lease_writer_t *writer)
+{
+  int ret;
+
+  if (!writer)
+    return 0;
+
+  ret = lease_writer_flush(writer);
+  free(writer->buf);
+  free(writer);
+
+  return ret;
+}
@@ -0,0 +1,118 @@
+/*
+ * lease_writer.h
+ *
+ */
+
+#ifndef _LEASE_WRITER_H_
+#define _LEASE_WRITER_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "lease.h"
+#include "lease_query.h"
+
+#define LEASE_WRITER_BUFFER_SIZE        (1 << 20)
+
+#define LEASE_WRITER_BINARY_MAGIC       "LEASEREC"
+#define LEASE_WRITER_BINARY_VERSION     1
+#define LEASE_WRITER_CHANGES_MAGIC      "LEASECHG"
+
+enum lease_writer_format_t
+{
+  LEASE_WRITER_FORMAT_TSV,
+  LEASE_WRITER_FORMAT_CSV,
+  LEASE_WRITER_FORMAT_JSON,
+  LEASE_WRITER_FORMAT_BINARY,
+  LEASE_WRITER_FORMAT_MAX,
+};
+
+/**
+ *
+ * \brief machine readable lease output
+ *
+ * Writes the projected fields of each lease in one of these formats:
+ *
+ * tsv          as lease_projection_print(): tab separated, times as epoch
+ *              seconds or "never", missing values as "-"
+ * csv          RFC 4180 with a header line, missing values empty
+ * json         one object per line (JSON Lines), missing values and
+ *              "never" as null
+ * binary       "LEASEREC", u16 version, u16 field count and one u8 field
+ *              id (enum lease_query_field_t) per field, then per lease a
+ *              u32 length and the fields in projection order:
+ *              addr    u8 family (4, 6 or 0), u8 prefix length, 4 or 16
+ *                      address bytes in network order
+ *              mac     u8 hardware type, 6 bytes
+ *              state   u8
+ *              time    i64 epoch seconds, INT64_MAX for never
+ *              string  u32 length, 0xffffffff if missing, the bytes
+ *              flag    u8
+ *              integers are little endian
+ *
+ * A change writer (lease_writer_new_changes()) puts what changed ahead
+ * of the projected fields of each record, see lease_table_diff():
+ *
+ * tsv          "added", "removed" or "modified", then the changed fields
+ *              as a comma separated list or "-"
+ * csv          "change" and "fields" columns
+ * json         "change":"modified","fields":["ends","binding-state"]
+ * binary       "LEASECHG" instead of "LEASEREC", and each record starts
+ *              with a u8 enum lease_change_t and the u32 LEASE_FIELD_*
+ *              mask after its length
+ *
+ * Records are formatted straight into one large buffer, integers,
+ * addresses and MAC addresses by hand instead of printf, and the buffer
+ * goes out in single write() calls when it is full. The room a record
+ * needs is computed up front, so formatting a field never checks for
+ * space. Nothing reaches fd before lease_writer_flush() or
+ * lease_writer_close().
+ *
+ * writer = lease_writer_new(STDOUT_FILENO, LEASE_WRITER_FORMAT_JSON,
+ *              &projection);
+ * lease_table_for_each(lease, table) {
+ *      lease_writer_write(writer, lease);
+ * }
+ * lease_writer_close(writer);
+ */
+
+struct lease_writer_t
+{
+  int fd;
+  enum lease_writer_format_t format;
+  struct lease_projection_t projection;
+  char *buf;
+  size_t len;
+  size_t size;
+  uint64_t records;
+  // records start with the change, lease_writer_write_change()
+  int changes;
+  // a write failed, later output is dropped
+  int error;
+};
+
+// -1 if name is not tsv, csv, json or binary
+int lease_writer_format_parse(const char *name);
+const char *lease_writer_format_2_str(enum lease_writer_format_t format);
+
+// the header of csv and binary output is buffered right away
+struct lease_writer_t *lease_writer_new(int fd,
+    enum lease_writer_format_t format,
+    const struct lease_projection_t *projection);
+struct lease_writer_t *lease_writer_new_changes(int fd,
+    enum lease_writer_format_t format,
+    const struct lease_projection_t *projection);
+int lease_writer_write(struct lease_writer_t *writer,
+    const struct lease_element_t *lease);
+// fields is the LEASE_FIELD_* mask of a LEASE_CHANGE_MODIFIED record
+int lease_writer_write_change(struct lease_writer_t *writer,
+    enum lease_change_t change, uint32_t fields,
+    const struct lease_element_t *lease);
+// bytes between the records, e.g. the framing of a protocol
+int lease_writer_write_bytes(struct lease_writer_t *writer, const void *buf,
+    size_t len);
+int lease_writer_flush(struct lease_writer_t *writer);
+// flush and free, -1 if any write failed
+int lease_writer_close(struct lease_writer_t *writer);
+
+#endif /* _LEASE_WRITER_H_ */
@@ -0,0 +1,150 @@
+/*
+ * liblease_parser.h
+ *
+ */
+
+#ifndef _LIBLEASE_PARSER_H_
+#define _LIBLEASE_PARSER_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define LEASE_PARSER_API_VERSION        2
+
+// only the functions declared here are exported from liblease_parser.so
+#define LEASE_PARSER_API                __attribute__((visibility("default")))
+
+enum lease_parser_read_mode_t
+{
+  LEASE_PARSER_READ_MODE_MMAP,
+  LEASE_PARSER_READ_MODE_STREAM,
+};
+
+enum lease_parser_refresh_t
+{
+  LEASE_PARSER_REFRESH_ERROR = -1,
+  LEASE_PARSER_REFRESH_UNCHANGED,
+  LEASE_PARSER_REFRESH_APPENDED,
+  LEASE_PARSER_REFRESH_RELOADED,
+};
+
+/*
+ * damage the parser recovers from: the statement or block is skipped
+ * and parsing goes on with the next one, a broken block is dropped up to
+ * the next top level "lease" line
+ */
+enum lease_parser_error_t
+{
+  // lease, iaaddr or iaprefix block with an invalid address, skipped
+  LEASE_PARSER_ERROR_ADDRESS,
+  // the field is left unset
+  LEASE_PARSER_ERROR_TIME,
+  LEASE_PARSER_ERROR_HARDWARE,
+  // '}' outside of any block, ignored
+  LEASE_PARSER_ERROR_BRACE,
+  /*
+   * a block still open at the next top level block, dropped, or a string
+   * without its closing quote on the line, its statement is dropped
+   */
+  LEASE_PARSER_ERROR_UNTERMINATED,
+  // a block or statement cut off by the end of the file, dropped
+  LEASE_PARSER_ERROR_TRUNCATED,
+  // a statement larger than the stream reader buffers, skipped
+  LEASE_PARSER_ERROR_TOO_LONG,
+  LEASE_PARSER_ERROR_MAX,
+};
+
+// text buffer sizes of struct lease_record_t
+#define LEASE_RECORD_ADDR_SIZE          64
+#define LEASE_RECORD_HWADDR_SIZE        32
+
+#define LEASE_RECORD_FLAG_ABANDONED     (1 << 0)
+#define LEASE_RECORD_FLAG_BOOTP         (1 << 1)
+#define LEASE_RECORD_FLAG_RESERVED      (1 << 2)
+
+/**
+ *
+ * \brief public API of liblease_parser
+ *
+ * The handle is opaque. lease_parser_open() parses the file once, every
+ * lease_parser_refresh() parses what dhcpd appended since (or the whole
+ * file again after a rewrite), and lease_parser_next() hands out the
+ * current lease of each address, one per call, in the order they were
+ * first seen. There is a lease per address, the last block of it in the
+ * file.
+ *
+ * A record is filled in place and nothing is allocated per lease: the
+ * addresses are formatted into rec, the strings point into the parser
+ * and stay valid until the next refresh or close. A refresh restarts
+ * the iteration.
+ *
+ * struct lease_parser_t *parser;
+ * struct lease_record_t rec;
+ *
+ * parser = lease_parser_open("/var/lib/dhcp/dhcpd.leases",
+ *     LEASE_PARSER_READ_MODE_MMAP);
+ * for (;;) {
+ *      while (lease_parser_next(parser, &rec) > 0)
+ *              Do_something_with(rec.ip, rec.binding_state, rec.ends);
+ *      sleep(5);
+ *      lease_parser_refresh(parser);
+ * }
+ * lease_parser_close(parser);
+ *
+ * A corrupt file is parsed as far as it can be. Errors are logged (the
+ * first few of a parse) and counted by kind with the file offset of the
+ * last one, see lease_parser_errors().
+ */
+
+struct lease_parser_t;
+
+struct lease_record_t
+{
+  // "10.0.0.1", "2001:db8::1" or a delegated prefix "2001:db8:100::/56"
+  char ip[LEASE_RECORD_ADDR_SIZE];
+  // "00:16:3e:00:00:01", empty if the lease has no hardware statement
+  char hardware[LEASE_RECORD_HWADDR_SIZE];
+  // "active", "free", ...; NULL if not set
+  const char *binding_state;
+  const char *next_binding_state;
+  const char *rewind_binding_state;
+  // "ia-na", "ia-ta" or "ia-pd" for DHCPv6, NULL for DHCPv4
+  const char *ia_type;
+  unsigned int flags;
+  // seconds since the epoch, 0 if not set
+  int64_t starts;
+  int64_t ends;
+  int64_t tstp;
+  int64_t cltt;
+  // as written in the file with the quotes removed, NULL if not set
+  const char *client_hostname;
+  const char *uid;
+  const char *vendor_class_identifier;
+};
+
+LEASE_PARSER_API int lease_parser_api_version(void);
+
+LEASE_PARSER_API struct lease_parser_t *lease_parser_open(
+    const char *file_path, enum lease_parser_read_mode_t mode);
+LEASE_PARSER_API int lease_parser_refresh(struct lease_parser_t *parser);
+LEASE_PARSER_API void lease_parser_close(struct lease_parser_t *parser);
+
+// number of leases, one per address
+LEASE_PARSER_API size_t lease_parser_count(const struct lease_parser_t *parser);
+// 1 and the next lease in rec, 0 after the last one
+LEASE_PARSER_API int lease_parser_next(struct lease_parser_t *parser,
+    struct lease_record_t *rec);
+// start over with the first lease
+LEASE_PARSER_API void lease_parser_rewind(struct lease_parser_t *parser);
+
+LEASE_PARSER_API const char *lease_parser_error_2_str(
+    enum lease_parser_error_t error);
+/*
+ * errors of a kind since lease_parser_open(), and in *offset (unless
+ * NULL) the file offset of the last one or -1
+ */
+LEASE_PARSER_API uint64_t lease_parser_errors(
+    const struct lease_parser_t *parser, enum lease_parser_error_t error,
+    int64_t *offset);
+
+#endif /* _LIBLEASE_PARSER_H_ */
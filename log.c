@@ -0,0 +1,479 @@
+#include <pthread.h>
+#include <stdarg.h>
+#include <stdlib.h>
+#include <string.h>
+#include <syslog.h>
+#include <time.h>
+#include <unistd.h>
+#include <linux/futex.h>
+#include <sys/syscall.h>
+
+#include "log.h"
+
+#define ARRAYSIZE(n) (sizeof(n)/sizeof(n[0]))
+
+#define LOG_CACHE_LINE          64
+// messages written between two flushes
+#define LOG_WRITER_BATCH        4096
+
+enum log_target_t
+{
+  LOG_TARGET_STDERR,
+  LOG_TARGET_SYSLOG,
+  LOG_TARGET_FILE,
+};
+
+struct log_entry_t
+{
+  struct timespec time;
+  const char *file;
+  const char *function;
+  int line;
+  int level;
+  char text[LOG_LINE_MAX];
+};
+
+/*
+ * single producer, single consumer: head is only written by the thread
+ * owning the ring, tail only by the writer thread
+ */
+struct log_ring_t
+{
+  struct log_ring_t *next;
+  int in_use;
+  unsigned long dropped;
+  size_t head __attribute__((aligned(LOG_CACHE_LINE)));
+  size_t tail __attribute__((aligned(LOG_CACHE_LINE)));
+  struct log_entry_t entries[LOG_RING_SIZE];
+};
+
+static const struct
+{
+  int level;
+  const char *str;
+} log_level_2_str_map[] =
+    {
+        { LOG_ERR, "error" },
+        { LOG_WARNING, "warning" },
+        { LOG_INFO, "info" },
+        { LOG_DEBUG, "debug" },
+    };
+
+int log_level = LOG_INFO;
+
+// rings are reused by later threads but never freed, a thread may hold one
+static struct log_ring_t *log_rings;
+static __thread struct log_ring_t *log_self;
+static pthread_key_t log_key;
+static pthread_once_t log_key_once = PTHREAD_ONCE_INIT;
+
+static enum log_target_t log_target;
+static FILE *log_fp;
+static pthread_t log_thread;
+static int log_running;
+/*
+ * held by log_close() from clearing log_running until the target is
+ * closed; a producer that finds log_running cleared after publishing
+ * its message takes it and writes what is left itself
+ */
+static pthread_mutex_t log_close_lock = PTHREAD_MUTEX_INITIALIZER;
+static unsigned long log_dropped_reported;
+/*
+ * 1 while the writer waits on it (futex) for a message; a producer that
+ * sees it set clears it and wakes the writer
+ */
+static int log_writer_idle;
+
+void
+log_set_level(int level)
+{
+  __atomic_store_n(&log_level, level, __ATOMIC_RELAXED);
+}
+
+int
+log_level_parse(const char *str)
+{
+  int i;
+
+  for (i = 0; i < ARRAYSIZE(log_level_2_str_map); i++)
+    {
+      if (strcmp(log_level_2_str_map[i].str, str) == 0)
+        return log_level_2_str_map[i].level;
+    }
+
+  return -1;
+}
+
+static const char *
+log_level_2_str(int level)
+{
+  int i;
+
+  for (i = 0; i < ARRAYSIZE(log_level_2_str_map); i++)
+    {
+      if (log_level_2_str_map[i].level == level)
+        return log_level_2_str_map[i].str;
+    }
+
+  return "unknown";
+}
+
+// to fp, or to syslog if fp is NULL
+static void
+log_emit(FILE *fp, const struct log_entry_t *entry)
+{
+  struct tm tm;
+  char buf[32];
+
+  if (!fp)
+    {
+      syslog(entry->level, "%s:%s (%d): %s", entry->file, entry->function,
+          entry->line, entry->text);
+      return;
+    }
+
+  localtime_r(&entry->time.tv_sec, &tm);
+  strftime(buf, sizeof(buf), "%Y-%m-%d %H:%M:%S", &tm);
+  fprintf(fp, "%s.%03ld %s %s:%s (%d): %s\n", buf,
+      entry->time.tv_nsec / 1000000, log_level_2_str(entry->level),
+      entry->file, entry->function, entry->line, entry->text);
+}
+
+static void
+log_release_ring(void *arg)
+{
+  struct log_ring_t *ring = arg;
+
+  // queued messages stay in the ring until the writer gets to them
+  __atomic_store_n(&ring->in_use, 0, __ATOMIC_RELEASE);
+}
+
+static void
+log_key_create(void)
+{
+  pthread_key_create(&log_key, log_release_ring);
+}
+
+static struct log_ring_t *
+log_ring_get(void)
+{
+  struct log_ring_t *ring;
+  void *mem;
+
+  pthread_once(&log_key_once, log_key_create);
+
+  for (ring = __atomic_load_n(&log_rings, __ATOMIC_ACQUIRE); ring;
+      ring = ring->next)
+    {
+      int free_ring = 0;
+
+      if (__atomic_compare_exchange_n(&ring->in_use, &free_ring, 1, 0,
+          __ATOMIC_ACQUIRE, __ATOMIC_RELAXED))
+        break;
+    }
+
+  if (!ring)
+    {
+      if (posix_memalign(&mem, LOG_CACHE_LINE, sizeof(*ring)))
+        return NULL;
+
+      ring = mem;
+      memset(ring, 0, sizeof(*ring));
+      ring->in_use = 1;
+      ring->next = __atomic_load_n(&log_rings, __ATOMIC_RELAXED);
+      while (!__atomic_compare_exchange_n(&log_rings, &ring->next, ring, 0,
+          __ATOMIC_RELEASE, __ATOMIC_RELAXED))
+        ;
+    }
+
+  pthread_setspecific(log_key, ring);
+  log_self = ring;
+
+  return ring;
+}
+
+// after a sequentially consistent store of the caller, see log_writer()
+static void
+log_writer_wake(void)
+{
+  if (__atomic_load_n(&log_writer_idle, __ATOMIC_SEQ_CST)
+      && __atomic_exchange_n(&log_writer_idle, 0, __ATOMIC_SEQ_CST))
+    syscall(SYS_futex, &log_writer_idle, FUTEX_WAKE_PRIVATE, 1, NULL, NULL, 0);
+}
+
+static size_t log_drain(void);
+
+// the writer is gone or about to, see log_close()
+static void
+log_drain_closed(void)
+{
+  pthread_mutex_lock(&log_close_lock);
+  // a new writer may have been started meanwhile
+  if (!__atomic_load_n(&log_running, __ATOMIC_SEQ_CST))
+    while (log_drain())
+      ;
+  pthread_mutex_unlock(&log_close_lock);
+}
+
+void
+log_write(int level, const char *file, const char *function, int line,
+    const char *fmt, ...)
+{
+  struct log_entry_t *entry, sync_entry;
+  struct log_ring_t *ring = NULL;
+  size_t head = 0;
+  va_list ap;
+
+  if (__atomic_load_n(&log_running, __ATOMIC_ACQUIRE))
+    ring = log_self ? log_self : log_ring_get();
+
+  if (ring)
+    {
+      head = ring->head;
+      if (head - __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE)
+          == LOG_RING_SIZE)
+        {
+          __atomic_store_n(&ring->dropped, ring->dropped + 1,
+              __ATOMIC_RELAXED);
+          return;
+        }
+      entry = &ring->entries[head % LOG_RING_SIZE];
+    }
+  else
+    entry = &sync_entry;
+
+  clock_gettime(CLOCK_REALTIME, &entry->time);
+  entry->file = file;
+  entry->function = function;
+  entry->line = line;
+  entry->level = level;
+
+  va_start(ap, fmt);
+  vsnprintf(entry->text, sizeof(entry->text), fmt, ap);
+  va_end(ap);
+
+  if (ring)
+    {
+      /*
+       * log_close() clears log_running before its final drain. If it is
+       * still set after the message was published that drain sees it,
+       * otherwise the message may have come too late and is written here
+       */
+      __atomic_store_n(&ring->head, head + 1, __ATOMIC_SEQ_CST);
+      if (__atomic_load_n(&log_running, __ATOMIC_SEQ_CST))
+        log_writer_wake();
+      else
+        log_drain_closed();
+    }
+  else
+    log_emit(stderr, entry);
+}
+
+unsigned long
+log_dropped(void)
+{
+  struct log_ring_t *ring;
+  unsigned long dropped = 0;
+
+  for (ring = __atomic_load_n(&log_rings, __ATOMIC_ACQUIRE); ring;
+      ring = ring->next)
+    dropped += __atomic_load_n(&ring->dropped, __ATOMIC_RELAXED);
+
+  return dropped;
+}
+
+static int
+log_entry_before(const struct log_entry_t *a, const struct log_entry_t *b)
+{
+  if (a->time.tv_sec != b->time.tv_sec)
+    return a->time.tv_sec < b->time.tv_sec;
+
+  return a->time.tv_nsec < b->time.tv_nsec;
+}
+
+// write what is queued, oldest first; number of messages written
+static size_t
+log_drain(void)
+{
+  struct log_ring_t *ring, *oldest;
+  struct log_entry_t *entry, *oldest_entry;
+  struct log_entry_t notice;
+  unsigned long dropped;
+  size_t written = 0;
+
+  while (written < LOG_WRITER_BATCH)
+    {
+      oldest = NULL;
+      oldest_entry = NULL;
+
+      for (ring = __atomic_load_n(&log_rings, __ATOMIC_ACQUIRE); ring;
+          ring = ring->next)
+        {
+          if (ring->tail == __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE))
+            continue;
+
+          entry = &ring->entries[ring->tail % LOG_RING_SIZE];
+          if (!oldest || log_entry_before(entry, oldest_entry))
+            {
+              oldest = ring;
+              oldest_entry = entry;
+            }
+        }
+
+      if (!oldest)
+        break;
+
+      log_emit(log_fp, oldest_entry);
+      __atomic_store_n(&oldest->tail, oldest->tail + 1, __ATOMIC_RELEASE);
+      written++;
+    }
+
+  dropped = log_dropped();
+  if (dropped != log_dropped_reported)
+    {
+      memset(&notice, 0, sizeof(notice));
+      clock_gettime(CLOCK_REALTIME, &notice.time);
+      notice.file = __FILE__;
+      notice.function = __FUNCTION__;
+      notice.line = __LINE__;
+      notice.level = LOG_WARNING;
+      snprintf(notice.text, sizeof(notice.text),
+          "%lu messages dropped, log ring full",
+          dropped - log_dropped_reported);
+      log_emit(log_fp, &notice);
+      log_dropped_reported = dropped;
+      written++;
+    }
+
+  if (written && log_fp)
+    fflush(log_fp);
+
+  return written;
+}
+
+static int
+log_pending(void)
+{
+  struct log_ring_t *ring;
+
+  for (ring = __atomic_load_n(&log_rings, __ATOMIC_ACQUIRE); ring;
+      ring = ring->next)
+    {
+      if (ring->tail != __atomic_load_n(&ring->head, __ATOMIC_SEQ_CST))
+        return 1;
+    }
+
+  return 0;
+}
+
+/*
+ * drains the rings and sleeps until a producer wakes it. It announces
+ * that it is idle before it looks at the rings a last time, a producer
+ * publishes its message before it looks at the flag. As all four are
+ * sequentially consistent, either the writer sees the message or the
+ * producer sees the flag.
+ */
+static void *
+log_writer(void *arg)
+{
+  while (__atomic_load_n(&log_running, __ATOMIC_ACQUIRE))
+    {
+      if (log_drain())
+        continue;
+
+      __atomic_store_n(&log_writer_idle, 1, __ATOMIC_SEQ_CST);
+
+      if (!log_pending() && __atomic_load_n(&log_running, __ATOMIC_SEQ_CST))
+        syscall(SYS_futex, &log_writer_idle, FUTEX_WAIT_PRIVATE, 1, NULL,
+            NULL, 0);
+
+      __atomic_store_n(&log_writer_idle, 0, __ATOMIC_RELAXED);
+    }
+
+  return NULL;
+}
+
+int
+log_open(const char *name, const char *target)
+{
+  static int registered;
+
+  if (log_running)
+    return 0;
+
+  if (!target || strcmp(target, "stderr") == 0)
+    {
+      log_target = LOG_TARGET_STDERR;
+      log_fp = stderr;
+    }
+  else if (strcmp(target, "syslog") == 0)
+    {
+      log_target = LOG_TARGET_SYSLOG;
+      log_fp = NULL;
+      openlog(name, LOG_PID, LOG_DAEMON);
+    }
+  else
+    {
+      log_target = LOG_TARGET_FILE;
+      log_fp = fopen(target, "a");
+      if (!log_fp)
+        {
+          log_fp = stderr;
+          log_target = LOG_TARGET_STDERR;
+          logg_err("can't open log file %s", target);
+          return -1;
+        }
+    }
+
+  // no late producer of an earlier log_close() drains next to the writer
+  pthread_mutex_lock(&log_close_lock);
+  __atomic_store_n(&log_running, 1, __ATOMIC_SEQ_CST);
+  if (pthread_create(&log_thread, NULL, log_writer, NULL))
+    {
+      __atomic_store_n(&log_running, 0, __ATOMIC_SEQ_CST);
+      while (log_drain())
+        ;
+      pthread_mutex_unlock(&log_close_lock);
+      logg_err("can't create log thread");
+      return -1;
+    }
+  pthread_mutex_unlock(&log_close_lock);
+
+  // messages still queued at exit are written, not lost
+  if (!registered)
+    {
+      atexit(log_close);
+      registered = 1;
+    }
+
+  logg(LOG_DEBUG, "%s started", name);
+  return 0;
+}
+
+void
+log_close(void)
+{
+  if (!__atomic_load_n(&log_running, __ATOMIC_ACQUIRE))
+    return;
+
+  pthread_mutex_lock(&log_close_lock);
+  if (!__atomic_load_n(&log_running, __ATOMIC_ACQUIRE))
+    {
+      pthread_mutex_unlock(&log_close_lock);
+      return;
+    }
+
+  __atomic_store_n(&log_running, 0, __ATOMIC_SEQ_CST);
+  log_writer_wake();
+  pthread_join(log_thread, NULL);
+  while (log_drain())
+    ;
+
+  if (log_target == LOG_TARGET_SYSLOG)
+    closelog();
+  else if (log_target == LOG_TARGET_FILE)
+    fclose(log_fp);
+  log_target = LOG_TARGET_STDERR;
+  log_fp = stderr;
+  pthread_mutex_unlock(&log_close_lock);
+}
@@ -0,0 +1,79 @@
+/*
+ * log.h
+ *
+ */
+
+#ifndef _LOG_H_
+#define _LOG_H_
+
+#include <stdio.h>
+
+// the syslog(3) priorities, lower is more severe
+#ifndef LOG_ERR
+#define LOG_ERR		3
+#endif
+#ifndef LOG_WARNING
+#define LOG_WARNING	4
+#endif
+#ifndef LOG_INFO
+#define LOG_INFO	6
+#endif
+#ifndef LOG_DEBUG
+#define LOG_DEBUG	7
+#endif
+#define LOG_ERROR	LOG_ERR
+
+// messages above this level are compiled out
+#ifndef LOG_LEVEL_MAX
+#define LOG_LEVEL_MAX	LOG_DEBUG
+#endif
+
+// formatted message size, longer ones are truncated
+#define LOG_LINE_MAX	256
+// messages a thread can have queued before further ones are dropped
+#define LOG_RING_SIZE	256
+
+/**
+ *
+ * \brief leveled, asynchronous logging
+ *
+ * logg() formats into a ring buffer owned by the calling thread and
+ * returns; a writer thread started by log_open() drains the rings to
+ * stderr, syslog or a file, in time order. A producer never blocks or
+ * takes a lock: when its ring is full the message is dropped and
+ * counted. Until log_open() (and after log_close()) messages are written
+ * synchronously to stderr.
+ *
+ * A message above log_level costs a load and a compare, its arguments
+ * are not evaluated; one above LOG_LEVEL_MAX is compiled out.
+ *
+ * log_set_level(LOG_DEBUG);
+ * log_open("lease_parser", "syslog");
+ * logg(LOG_DEBUG, "ip: %s", ip);
+ * log_close();
+ */
+
+extern int log_level;
+
+#define log_enabled(LEVEL)	((LEVEL) <= LOG_LEVEL_MAX && (LEVEL) <= log_level)
+#define logg(LEVEL, FMT, ARGS...)   do { if (log_enabled(LEVEL)) log_write(LEVEL, __FILE__, __FUNCTION__, __LINE__, FMT, ##ARGS); } while (0)
+#define logg_err(FMT, ARGS...)      logg(LOG_ERROR, FMT, ##ARGS)
+
+void log_write(int level, const char *file, const char *function, int line,
+    const char *fmt, ...) __attribute__((format(printf, 5, 6)));
+
+void log_set_level(int level);
+// "error", "warning", "info" or "debug"; -1 if unknown
+int log_level_parse(const char *str);
+
+/*
+ * start the writer thread. target is "stderr" (or NULL), "syslog" or
+ * the path of a file to append to; name is the syslog ident.
+ */
+int log_open(const char *name, const char *target);
+// drain all queued messages and stop the writer thread
+void log_close(void);
+// messages dropped because a ring was full
+unsigned long log_dropped(void);
+
+#endif /* _LOG_H_ */
@@ -1,463 +1,757 @@
 #define _GNU_SOURCE
 
+#include <signal.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
-#include <sys/file.h>
-#include <errno.h>
 #include <time.h>
+#include <unistd.h>
+
+#include "lease.h"
+#include "lease_merge.h"
+#include "lease_metrics.h"
+#include "lease_parser.h"
+#include "lease_query.h"
+#include "lease_server.h"
+#include "lease_snapshot.h"
+#include "lease_table.h"
+#include "lease_trie.h"
+#include "lease_watch.h"
+#include "lease_writer.h"
+#include "log.h"
+#include "toolbox.h"
 
-#include "dllist.h"
+#define LEASE_FILE "/var/lib/dhcp/dhcpd.leases"
+
+static void
+usage(const char *name)
+{
+  printf("usage: %s [-m mmap|stream] [-t threads] [-L lock] [-s] [-c dir]\n"
+      "       [-q filter] [-p fields] [-o format] [-E seconds,...] [-S prefix:len]\n"
+      "       [-P pools] [-M target] [-l level[:target]] [-i seconds]\n"
+      "       [-D old file] [-C] [-Q socket] [-w [-d ms]] [lease file|- ...]\n",
+      name);
+  printf("  -t  parse a mapped file with n threads (0: one per CPU)\n");
+  printf("  -L  lock mode exclusive|shared|none|copy, print lock statistics\n");
+  printf("  -q  print only leases matching a filter, e.g.\n"
+      "      'state=active and ends<now+600 and ip in 10.1.0.0/16'\n");
+  printf("  -p  print these fields tab separated (default %s)\n",
+      LEASE_PROJECTION_DEFAULT);
+  printf("  -o  print the fields as tsv (default), csv, json (lines) or binary\n");
+  printf("  -E  count leases ending within each of these windows, e.g. 300,900,3600\n");
+  printf("  -S  usage of every /len subnet within prefix, e.g. 10.0.0.0/8:24\n");
+  printf("  -P  usage of the pools listed in this file (prefix [name] per line)\n");
+  printf("      columns: subnet total active free expired released abandoned\n"
+      "      backup utilisation%%\n");
+  printf("  -s  start from a binary snapshot next to the lease file\n");
+  printf("  -c  keep the snapshot in this directory instead (implies -s)\n");
+  printf("  -M  parser metrics in Prometheus text format: a file written at\n"
+      "      exit and after every refresh, or served on unix:/path or\n"
+      "      [host:]port\n");
+  printf("  -l  log level error|warning|info (default)|debug, logged to\n"
+      "      stderr (default), syslog or a file\n");
+  printf("  -i  keep running and parse appended leases every n seconds\n");
+  printf("  -D  print the leases added, removed or modified since this file\n");
+  printf("  -C  with -i, print the changes of every refresh instead of the\n"
+      "      leases; both as -o format with a change and a fields column\n");
+  printf("  -Q  answer lookups on this unix socket, refreshed every -i\n"
+      "      seconds (default 5); records carry the -p fields\n");
+  printf("  -w  watch the lease file and print lease events as JSON lines\n");
+  printf("  -d  coalesce file changes for n ms before parsing (default %d)\n",
+      LEASE_WATCH_DEBOUNCE_MS);
+  printf("  several lease files (e.g. of failover peers) are merged, the most\n"
+      "  recent lease of an address wins and differences are logged\n");
+  printf("  default lease file: %s\n", LEASE_FILE);
+}
 
-#define LOG_DEBUG	1
-#define LOG_INFO	2
-#define LOG_ERROR	3
-#define log_open(NAME)		    do { logg(LOG_INFO, "%s started", NAME } while(0);
-#define log_close()		    do { logg(LOG_INFO, "stopp logging" } while(0);
-#define logg(LEVEL, FMT, ARGS...)   do{ printf("%s:%s (%d): "FMT "\n", __FILE__, __FUNCTION__, __LINE__, ##ARGS); } while(0);
-#define logg_err(FMT, ARGS...)      do { printf("%s:%s (%d): " FMT "\n", __FILE__, __FUNCTION__, __LINE__, ##ARGS); } while (0)
+static struct lease_query_t *query;
+static struct lease_projection_t projection;
+static enum lease_writer_format_t output_format = LEASE_WRITER_FORMAT_TSV;
 
-size_t
-toolbox_get_file_size_fp(FILE *fp)
+static void
+dump_leases(const struct lease_table_t *table)
 {
-  long lEndPos;
-  long curPos;
+  const struct lease_element_t *lease_element;
+  char ip[LEASE_ADDR_STR_SIZE], mac[LEASE_HWADDR_STR_SIZE];
+  struct lease_writer_t *writer;
+  const char *str;
+
+  if (projection.count)
+    {
+      // the writer bypasses stdio
+      fflush(stdout);
+      writer = lease_writer_new(STDOUT_FILENO, output_format, &projection);
+      if (!writer)
+        return;
+
+      lease_table_for_each(lease_element, table)
+      {
+        if ((!query || lease_query_match(query, lease_element))
+            && lease_writer_write(writer, lease_element) < 0)
+          break;
+      }
+
+      lease_writer_close(writer);
+      return;
+    }
 
-  curPos = ftell(fp);
-  // Move to the end and get position
-  fseek(fp, 0, SEEK_END);
-  lEndPos = ftell(fp);
+  lease_table_for_each(lease_element, table)
+  {
+    printf("ip: %s\n", lease_addr_to_str(&lease_element->ip, ip, sizeof(ip)));
+    // DHCPv6 leases and blocks without "hardware" have no hardware address
+    str = lease_hwaddr_to_str(&lease_element->hardware, mac, sizeof(mac));
+    printf("mac: %s\n", str ? str : "-");
+    str = lease_binding_state_2_str(lease_element->binding_state);
+    printf("state: %s\n", str ? str : "-");
+    str = lease_element->client_hostname;
+    printf("client host: %s\n\n", str ? str : "-");
+  }
+}
 
-  //move to start position
-  fseek(fp, curPos, SEEK_SET);
+static struct lease_writer_t *change_writer;
 
-  return lEndPos;
+static void
+write_change(enum lease_change_t change, const struct lease_element_t *lease,
+    const struct lease_element_t *previous, uint32_t fields, void *user)
+{
+  if (!query || lease_query_match(query, lease))
+    lease_writer_write_change(change_writer, change, fields, lease);
 }
 
-int
-toolbox_get_file_contents_locked(const char *filename, char **contents,
-    size_t* length, size_t prepend_count)
+static int
+open_change_writer(void)
 {
-  FILE *stream = NULL;
-  size_t objects_read;
-  char *buffer = NULL;
-  size_t buffer_size;
+  // the writer bypasses stdio
+  fflush(stdout);
+  change_writer = lease_writer_new_changes(STDOUT_FILENO, output_format,
+      &projection);
 
-  if (!filename || !contents || prepend_count < 0)
-    return -1;
+  return change_writer ? 0 : -1;
+}
 
-  *contents = NULL;
-  if (length)
-    *length = 0;
+static int
+diff_leases(const char *old_path, const char *file_path,
+    enum lease_parser_read_mode_t mode)
+{
+  struct lease_table_t *old_table, *table = NULL;
+  ssize_t count = -1;
 
-  stream = fopen(filename, "r");
-  if (!stream)
+  old_table = lease_parser_reade_file(old_path, mode);
+  if (!old_table)
     {
-      logg_err("Cannot open %s for read.", filename);
+      logg_err("error parse lease file %s", old_path);
       return -1;
     }
-  if (flock(fileno(stream), LOCK_EX) < 0)
+
+  table = lease_parser_reade_file(file_path, mode);
+  if (!table)
     {
-      logg_err("flock failed (%s)", strerror(errno));
-      goto on_error;
+      logg_err("error parse lease file %s", file_path);
+      goto error_end;
     }
 
-  buffer_size = toolbox_get_file_size_fp(stream);
-  if (buffer_size < 0)
-    goto on_error_locked;
+  if (open_change_writer() < 0)
+    goto error_end;
+
+  count = lease_table_diff(old_table, table, write_change, NULL);
+  if (lease_writer_close(change_writer) < 0)
+    count = -1;
+  change_writer = NULL;
 
-  buffer = (char *) malloc(buffer_size + prepend_count);
-  if (!buffer)
+  if (count >= 0)
+    logg(LOG_INFO, "%zd leases changed, %zu before, %zu after", count,
+        lease_table_size(old_table), lease_table_size(table));
+
+  error_end:
+  lease_table_destroy(table);
+  lease_table_destroy(old_table);
+  return count < 0 ? -1 : 0;
+}
+
+#define EXPIRY_WINDOWS_MAX      8
+
+static unsigned long expiry_windows[EXPIRY_WINDOWS_MAX];
+static int expiry_window_count;
+
+static int
+parse_expiry_windows(const char *list)
+{
+  char *end;
+
+  for (expiry_window_count = 0; *list; list = end + (*end == ','))
     {
-      logg_err("Cannot allocate memory.");
-      goto on_error_locked;
+      if (expiry_window_count == EXPIRY_WINDOWS_MAX)
+        return -1;
+
+      expiry_windows[expiry_window_count++] = strtoul(list, &end, 10);
+      if (end == list || (*end && *end != ','))
+        return -1;
     }
 
-  objects_read = fread(buffer + prepend_count, buffer_size, 1, stream);
-  if (objects_read <= 0)
+  return expiry_window_count ? 0 : -1;
+}
+
+static void
+dump_expiring(struct lease_table_t *table)
+{
+  time_t now = time(NULL);
+  ssize_t count;
+  int i;
+
+  for (i = 0; i < expiry_window_count; i++)
     {
-      logg_err("Failed to read file contents.");
-      goto on_error_locked;
+      count = lease_table_count_range(table, LEASE_TIME_KEY_ENDS, now,
+          now + expiry_windows[i]);
+      if (count < 0)
+        return;
+
+      printf("%zd leases ending within %lu s\n", count, expiry_windows[i]);
     }
+}
 
-  flock(fileno(stream), LOCK_UN);
-  fclose(stream);
+static struct lease_addr_t usage_prefix;
+static unsigned int usage_prefix_len, usage_unit_len;
+static int show_usage;
+static struct lease_pools_t pools;
 
-  *contents = buffer;
-  if (length)
-    *length = buffer_size;
+// prefix/len:unit, the unit defaults to the prefix length
+static int
+parse_usage_prefix(const char *arg)
+{
+  const char *slash = strchr(arg, '/');
+  // IPv6 addresses contain colons, the unit follows the prefix length
+  const char *colon = strchr(slash ? slash : arg, ':');
+  char *end;
 
-  return 0;
+  if (lease_addr_parse_prefix(arg, colon ? colon - arg : strlen(arg),
+      &usage_prefix, &usage_prefix_len) < 0)
+    return -1;
+
+  usage_unit_len = usage_prefix_len;
+  if (colon)
+    {
+      usage_unit_len = strtoul(colon + 1, &end, 10);
+      if (end == colon + 1 || *end)
+        return -1;
+    }
 
-  on_error_locked: flock(fileno(stream), LOCK_UN);
-  on_error: free(buffer);
-  if (stream)
-    fclose(stream);
-  return -1;
+  show_usage = 1;
+  return 0;
 }
 
-enum lease_element_value_type_t
+static void
+print_subnet_usage(const struct lease_addr_t *prefix, unsigned int prefix_len,
+    const struct lease_usage_t *usage, void *user)
 {
-  ELEMENT_VALUE_TYPE_TIME,
-  ELEMENT_VALUE_TYPE_STRING,
-  ELEMENT_VALUE_TYPE_INT,
-};
+  char ip[LEASE_ADDR_STR_SIZE], label[LEASE_ADDR_STR_SIZE + 4];
 
-enum lease_element_type_t
+  snprintf(label, sizeof(label), "%s/%u",
+      lease_addr_to_str(prefix, ip, sizeof(ip)), prefix_len);
+  lease_usage_print(stdout, label, usage);
+}
+
+static void
+dump_usage(const struct lease_table_t *table)
 {
-  LEASE_ELEMENT_TYPE_TIME_STARTS,
-  LEASE_ELEMENT_TYPE_TIME_ENDS,
-  LEASE_ELEMENT_TYPE_TIME_TSTP,
-  LEASE_ELEMENT_TYPE_TIME_CLTT,
-  LEASE_ELEMENT_TYPE_TIME_TSFP,
-  LEASE_ELEMENT_TYPE_TIME_ATSFP,
-  LEASE_ELEMENT_TYPE_BINDING_STATE,
-  LEASE_ELEMENT_TYPE_HARDWARE,
-  LEASE_ELEMENT_TYPE_NEXT_BINDING_STATE,
-  LEASE_ELEMENT_TYPE_REWIND_BINDING_STATE,
-  LEASE_ELEMENT_TYPE_CLIENT_HOSTNAME,
-};
+  struct lease_trie_t trie;
+  size_t i;
 
-struct dhcpd_lease_parser
+  if (show_usage)
+    {
+      lease_trie_init(&trie);
+      if (lease_trie_build(&trie, table) == 0)
+        lease_trie_walk(&trie, &usage_prefix, usage_prefix_len, usage_unit_len,
+            print_subnet_usage, NULL);
+      lease_trie_release(&trie);
+    }
+
+  if (pools.count)
+    {
+      lease_pools_account(&pools, table);
+      for (i = 0; i < pools.count; i++)
+        lease_usage_print(stdout, pools.pools[i].name, &pools.pools[i].usage);
+    }
+}
+
+static int show_lock_stats;
+
+static void
+dump_lock_stats(void)
 {
-  const char *element_name;
-  size_t element_name_size;
-  int value_column;
-  enum lease_element_type_t type;
-  enum lease_element_value_type_t value_type;
-};
+  struct toolbox_lock_stats_t stats;
+
+  if (!show_lock_stats)
+    return;
 
-#define ARRAYSIZE(n) (sizeof(n)/sizeof(n[0]))
+  toolbox_lock_stats(&stats);
+  logg(LOG_INFO, "lock: %s, %llu acquired, wait %llu us (max %llu us), "
+      "%llu retries, %llu bytes copied",
+      toolbox_lock_mode_2_str(toolbox_lock_mode(0)),
+      (unsigned long long) stats.acquired,
+      (unsigned long long) stats.wait_ns / 1000,
+      (unsigned long long) stats.max_wait_ns / 1000,
+      (unsigned long long) stats.retries,
+      (unsigned long long) stats.copied_bytes);
+}
+
+static const char *metrics_path;
+static const char *log_target;
 
-#ifdef DEBUG
-struct lease_element_type_2_str_t
+static int
+parse_log_option(char *arg)
 {
-  enum lease_element_type_t type;
-  const char *str;
-};
+  char *colon = strchr(arg, ':');
+  int level;
 
-struct lease_element_type_2_str_t lease_element_type_2_str_map[] =
+  if (colon)
     {
-        {.type = LEASE_ELEMENT_TYPE_TIME_STARTS,          .str = "starts",               },
-        {.type = LEASE_ELEMENT_TYPE_TIME_ENDS,            .str = "ends",                 },
-        {.type = LEASE_ELEMENT_TYPE_TIME_TSTP,            .str = "tstp",                 },
-        {.type = LEASE_ELEMENT_TYPE_TIME_CLTT,            .str = "cltt",                 },
-        {.type = LEASE_ELEMENT_TYPE_TIME_TSFP,            .str = "tsfp",                 },
-        {.type = LEASE_ELEMENT_TYPE_TIME_ATSFP,           .str = "atsfp",                },
-        {.type = LEASE_ELEMENT_TYPE_BINDING_STATE,        .str = "binding state",        },
-        {.type = LEASE_ELEMENT_TYPE_HARDWARE,             .str = "hardware",             },
-        {.type = LEASE_ELEMENT_TYPE_NEXT_BINDING_STATE,   .str = "next binding state",   },
-        {.type = LEASE_ELEMENT_TYPE_REWIND_BINDING_STATE, .str = "rewind binding state", },
-        {.type = LEASE_ELEMENT_TYPE_CLIENT_HOSTNAME,      .str = "client hostname",      },
-    };
-
-
-static const char *
-lease_element_type_2_str(enum lease_element_type_t type)
+      *colon = 0;
+      log_target = colon + 1;
+    }
+
+  level = log_level_parse(arg);
+  if (level < 0)
+    return -1;
+
+  log_set_level(level);
+  return 0;
+}
+
+static int
+setup_metrics(const char *target)
 {
-  int i;
-  for (i = 0; i < ARRAYSIZE(lease_element_type_2_str_map); i++)
+  lease_metrics_enable(1);
+
+  // anything that is not a socket address is a file
+  if (strncmp(target, "unix:", 5) && (strchr(target, '/')
+      || (!strchr(target, ':') && strspn(target, "0123456789") != strlen(target))))
     {
-      if (type == lease_element_type_2_str_map[i].type)
-        return lease_element_type_2_str_map[i].str;
+      metrics_path = target;
+      return 0;
     }
 
-  return NULL;
+  return lease_metrics_serve(target);
 }
-#endif
-// value_column = max. 9
-struct dhcpd_lease_parser dhcp_lease_parser_map[] =
-  {
-      { .element_name = "  starts",               .element_name_size = sizeof("  starts") -1,               .value_column = 1, .value_type = ELEMENT_VALUE_TYPE_TIME,   .type = LEASE_ELEMENT_TYPE_TIME_STARTS},
-      { .element_name = "  tstp",                 .element_name_size = sizeof("  tstp") -1,                 .value_column = 1, .value_type = ELEMENT_VALUE_TYPE_TIME,   .type = LEASE_ELEMENT_TYPE_TIME_TSTP},
-      { .element_name = "  ends",                 .element_name_size = sizeof("  ends") -1,                 .value_column = 1, .value_type = ELEMENT_VALUE_TYPE_TIME,   .type = LEASE_ELEMENT_TYPE_TIME_ENDS},
-      { .element_name = "  cltt",                 .element_name_size = sizeof("  cltt") -1,                 .value_column = 1, .value_type = ELEMENT_VALUE_TYPE_TIME,   .type = LEASE_ELEMENT_TYPE_TIME_CLTT},
-      { .element_name = "  tsfp",                 .element_name_size = sizeof("  tsfp") -1,                 .value_column = 1, .value_type = ELEMENT_VALUE_TYPE_TIME,   .type = LEASE_ELEMENT_TYPE_TIME_TSFP},
-      { .element_name = "  atsfp",                .element_name_size = sizeof("  atsfp") -1,                .value_column = 1, .value_type = ELEMENT_VALUE_TYPE_TIME,   .type = LEASE_ELEMENT_TYPE_TIME_ATSFP},
-      { .element_name = "  binding state",        .element_name_size = sizeof("  binding state") -1,        .value_column = 2, .value_type = ELEMENT_VALUE_TYPE_STRING, .type = LEASE_ELEMENT_TYPE_BINDING_STATE},
-      { .element_name = "  hardware",             .element_name_size = sizeof("  hardware") -1,             .value_column = 2, .value_type = ELEMENT_VALUE_TYPE_STRING, .type = LEASE_ELEMENT_TYPE_HARDWARE},
-      { .element_name = "  next binding state",   .element_name_size = sizeof("  next binding state") -1,   .value_column = 3, .value_type = ELEMENT_VALUE_TYPE_STRING, .type = LEASE_ELEMENT_TYPE_NEXT_BINDING_STATE},
-      { .element_name = "  rewind binding state", .element_name_size = sizeof("  rewind binding state") -1, .value_column = 3, .value_type = ELEMENT_VALUE_TYPE_STRING, .type = LEASE_ELEMENT_TYPE_REWIND_BINDING_STATE},
-      { .element_name = "  client-hostname",      .element_name_size = sizeof("  client-hostname") -1,      .value_column = 1, .value_type = ELEMENT_VALUE_TYPE_STRING, .type = LEASE_ELEMENT_TYPE_CLIENT_HOSTNAME},
-  };
-
-struct lease_element_t
+
+static void
+dump_metrics(void)
 {
-  char *ip;
-  time_t starts;
-  time_t ends;
-  time_t tstp;
-  time_t cltt;
-  time_t tsfp;
-  time_t atsfp;
-  char *binding_state;
-  char *next_binding_state;
-  char *rewind_binding_state;
-  char *hardware;
-  char *client_hostname;
-  struct dllist link;
-};
+  if (metrics_path && lease_metrics_save(metrics_path) < 0)
+    logg_err("error write metrics %s", metrics_path);
+}
 
-void destroy_lease_element(struct lease_element_t *element)
+// divergences logged one by one, the rest are only counted
+#define MERGE_DIVERGENCES_LOGGED        100
+
+struct merge_report_t
 {
-  if(!element)
-    return;
+  char *const *paths;
+  size_t divergences;
+};
 
-  free(element->ip);
-  element->ip = NULL;
+static void
+report_divergence(const struct lease_element_t *kept, size_t kept_file,
+    const struct lease_element_t *other, size_t other_file, uint32_t fields,
+    void *user)
+{
+  struct merge_report_t *report = user;
+  char ip[LEASE_ADDR_STR_SIZE], names[LEASE_FIELDS_STR_SIZE];
 
-  free(element->binding_state);
-  element->binding_state = NULL;
+  if (report->divergences++ >= MERGE_DIVERGENCES_LOGGED)
+    return;
 
-  free(element->next_binding_state);
-  element->next_binding_state = NULL;
+  logg(LOG_WARNING, "%s differs in %s: %s %s until %lld, %s %s until %lld",
+      lease_addr_to_str(&kept->ip, ip, sizeof(ip)),
+      lease_fields_to_str(fields, names, sizeof(names)),
+      report->paths[kept_file],
+      lease_binding_state_2_str(kept->binding_state), (long long) kept->ends,
+      report->paths[other_file],
+      lease_binding_state_2_str(other->binding_state), (long long) other->ends);
+}
 
-  free(element->rewind_binding_state);
-  element->rewind_binding_state = NULL;
+static struct lease_table_t *
+merge_leases(char *const *paths, size_t count,
+    enum lease_parser_read_mode_t mode)
+{
+  struct merge_report_t report = { paths, 0 };
+  struct lease_table_t *table;
 
-  free(element->hardware);
-  element->hardware = NULL;
+  table = lease_merge_files((const char *const *) paths, count, mode, 0,
+      report_divergence, &report);
+  if (table)
+    logg(LOG_INFO, "%zu files merged, %zu leases, %zu divergences", count,
+        lease_table_size(table), report.divergences);
 
-  free(element->client_hostname);
-  element->client_hostname = NULL;
+  return table;
 }
 
-static void destroy_lease_list(struct dllist *list)
+static int
+follow_leases(const char *file_path, enum lease_parser_read_mode_t mode,
+    unsigned int interval, int changes)
 {
-  struct lease_element_t *data;
-  struct lease_element_t *temp;
+  const struct lease_element_t *lease;
+  struct lease_parser_t *parser;
+  int ret;
 
-  if(!list)
-    return;
+  parser = lease_parser_open(file_path, mode);
+  if (!parser)
+    {
+      logg_err("error parse lease file");
+      return -1;
+    }
 
-  dllist_for_each_safe(data, temp, list, link)
-  {
-    dllist_remove(&data->link);
-    destroy_lease_element(data);
-    free(data);
-    data = NULL;
-  }
+  if (changes)
+    {
+      if (open_change_writer() < 0)
+        {
+          lease_parser_close(parser);
+          return -1;
+        }
+
+      // the stream starts with every lease as added
+      lease_table_for_each(lease, parser->table)
+      {
+        write_change(LEASE_CHANGE_ADDED, lease, NULL, 0, NULL);
+      }
+      lease_writer_flush(change_writer);
+    }
+  else
+    dump_leases(parser->table);
+  dump_expiring(parser->table);
+  dump_usage(parser->table);
+  dump_metrics();
+
+  for (;;)
+    {
+      sleep(interval);
+
+      if (changes)
+        {
+          ret = lease_parser_refresh_diff(parser, write_change, NULL);
+          lease_writer_flush(change_writer);
+        }
+      else
+        ret = lease_parser_refresh(parser);
+
+      switch (ret)
+        {
+      case LEASE_PARSER_REFRESH_APPENDED:
+        logg(LOG_INFO, "%lld bytes appended, %zu leases",
+            (long long) parser->last_parsed, lease_table_size(parser->table));
+        dump_lock_stats();
+        break;
+      case LEASE_PARSER_REFRESH_RELOADED:
+        logg(LOG_INFO, "lease file rewritten, %zu leases",
+            lease_table_size(parser->table));
+        dump_lock_stats();
+        break;
+      case LEASE_PARSER_REFRESH_UNCHANGED:
+        break;
+      default:
+        logg_err("error refresh lease file");
+        break;
+        }
 
-  free(list);
+      dump_metrics();
+      dump_expiring(parser->table);
+      dump_usage(parser->table);
+      // every refresh is printed as it happens, also into a pipe
+      fflush(stdout);
+    }
 
+  lease_writer_close(change_writer);
+  lease_parser_close(parser);
+  return 0;
 }
 
-struct dllist *
-lease_parser_reade_file(char *file_path)
+static struct lease_server_t *server;
+
+static void
+server_stop(int sig)
 {
-  char *lease_file_content = NULL;
-  size_t lease_file_len = 0;
-  char *token, *str1, *saveptr1;
-  char s[3] = "\r\n;";
+  lease_server_stop(server);
+}
 
-  struct lease_element_t *lease_element = NULL;
+static int
+serve_leases(const char *file_path, enum lease_parser_read_mode_t mode,
+    const char *socket_path, unsigned int interval)
+{
+  struct sigaction sa;
+  int ret;
 
-  enum lease_parser_state_t
-  {
-    LEASE_PARSER_STATE_SEARCH_ELEMENT, LEASE_PARSER_STATE_ELEMENT,
-  } parser_state = LEASE_PARSER_STATE_SEARCH_ELEMENT;
+  server = lease_server_new(file_path, mode, socket_path, interval,
+      &projection);
+  if (!server)
+    return -1;
+
+  memset(&sa, 0, sizeof(sa));
+  sa.sa_handler = server_stop;
+  sigaction(SIGINT, &sa, NULL);
+  sigaction(SIGTERM, &sa, NULL);
 
-  char sub_del[1] = " ";
+  logg(LOG_INFO, "serving %zu leases on %s",
+      lease_table_size(server->parser->table), socket_path);
+  ret = lease_server_run(server);
 
-  int j;
+  lease_server_destroy(server);
+  server = NULL;
+  return ret;
+}
 
-  struct dllist *ret_list;
+static int
+snapshot_leases(const char *file_path, enum lease_parser_read_mode_t mode,
+    const char *cache_dir)
+{
+  struct lease_parser_t *parser;
+  char *snap_path;
 
-  if (!file_path)
+  snap_path = lease_snapshot_path(file_path, cache_dir);
+  if (!snap_path)
     {
-      logg_err("parameter error");
-      return NULL;
+      logg_err("Cannot allocate memory.");
+      return -1;
     }
 
-  if (toolbox_get_file_contents_locked(file_path, &lease_file_content,
-      &lease_file_len, 0) < 0)
+  parser = lease_snapshot_open(file_path, mode, snap_path);
+  if (!parser)
     {
-      logg_err("can't read file %s", file_path);
-      return NULL;
+      logg_err("error parse lease file");
+      free(snap_path);
+      return -1;
     }
 
-  ret_list = calloc(1, sizeof(*ret_list));
-
-  if (!ret_list)
-    goto error_end_free_lease_file;
+  // only rewrite the snapshot if text had to be parsed
+  if (parser->last_parsed && lease_snapshot_save(parser, snap_path) < 0)
+    logg_err("error write snapshot %s", snap_path);
 
-  dllist_init(ret_list);
+  dump_leases(parser->table);
+  dump_expiring(parser->table);
+  dump_usage(parser->table);
+  dump_lock_stats();
 
-  for (j = 1, str1 = lease_file_content;; j++, str1 = NULL)
-    {
-      token = strtok_r(str1, s, &saveptr1);
-      if (token == NULL)
-        break;
+  lease_parser_close(parser);
+  dump_metrics();
+  free(snap_path);
+  return 0;
+}
 
-      // skip comments
-      if (token[0] == '#')
-        continue;
+static struct lease_watch_t *watch;
 
-      switch (parser_state)
-        {
-      case LEASE_PARSER_STATE_SEARCH_ELEMENT:
-        {
-          char *sub_str = NULL;
-          char *sub_token, *sub_token_save;
+static void
+watch_print_matching(const struct lease_event_t *event, void *user)
+{
+  if (lease_query_match(query, event->lease))
+    lease_event_print_json(event, user);
+}
 
-          if (strncmp(token, "lease", sizeof("lease") - 1))
-            continue;
+static void
+watch_stop(int sig)
+{
+  lease_watch_stop(watch);
+}
 
-          for (sub_str = token;; sub_str = NULL)
-            {
-              sub_token = strtok_r(sub_str, sub_del, &sub_token_save);
-              if (sub_token == NULL)
-                break;
+static int
+watch_leases(const char *file_path, enum lease_parser_read_mode_t mode,
+    unsigned int debounce_ms)
+{
+  struct sigaction sa;
+  int ret;
 
-              if (strncmp(sub_token, "lease", sizeof("lease") - 1) == 0)
-                continue;
+  watch = lease_watch_new(file_path, mode, debounce_ms);
+  if (!watch)
+    {
+      logg_err("error watch lease file");
+      return -1;
+    }
 
-              lease_element = calloc(1, sizeof(*lease_element));
+  if (lease_watch_add_callback(watch, query ? watch_print_matching
+      : lease_event_print_json, stdout) < 0)
+    {
+      lease_watch_destroy(watch);
+      return -1;
+    }
 
-              if (!lease_element)
-                {
-                  logg_err("error calloc lease element");
-                  goto error_end_free_dllist;
-                }
+  // no SA_RESTART, epoll_wait() has to return to see the stop flag
+  memset(&sa, 0, sizeof(sa));
+  sa.sa_handler = watch_stop;
+  sigaction(SIGINT, &sa, NULL);
+  sigaction(SIGTERM, &sa, NULL);
 
-              lease_element->ip = strdup(sub_token);
-#ifdef DEBUG
-              logg(LOG_DEBUG, "ip: %s", sub_token);
-#endif
-              break;
-            }
+  ret = lease_watch_run(watch);
 
-          parser_state = LEASE_PARSER_STATE_ELEMENT;
-        }
-        break;
+  lease_watch_destroy(watch);
+  watch = NULL;
+  dump_metrics();
+  return ret;
+}
 
-      case LEASE_PARSER_STATE_ELEMENT:
+int
+main(int argn, char *args[])
+{
+  struct lease_table_t *lease_file;
+  enum lease_parser_read_mode_t mode = LEASE_PARSER_READ_MODE_MMAP;
+  const char *file_path = LEASE_FILE, *cache_dir = NULL, *old_path = NULL;
+  const char *socket_path = NULL;
+  unsigned int interval = 0, debounce_ms = 0, threads = 1;
+  int opt, watch_mode = 0, snapshot = 0, changes = 0, lock_mode, format = -1;
+
+  while ((opt = getopt(argn, args, "m:t:L:sc:q:p:o:E:S:P:M:l:i:D:CQ:wd:h"))
+      != -1)
+    {
+      switch (opt)
         {
-          int i = 0, k = 0;
-          char *sub_token_save, *sub_str;
-          char *name;
-
-          if (strncmp(token, "}", 1) == 0)
-            {
-              parser_state = LEASE_PARSER_STATE_SEARCH_ELEMENT;
-              dllist_insert(ret_list, &lease_element->link);
-              lease_element = NULL;
-              continue;
-            }
-
-          for (i = 0; i < ARRAYSIZE(dhcp_lease_parser_map); i++)
-            {
-              if (!strncmp(token, dhcp_lease_parser_map[i].element_name,
-                  dhcp_lease_parser_map[i].element_name_size))
-                break;
-            }
-
-          if (i >= ARRAYSIZE(dhcp_lease_parser_map))
-            {
-#ifdef DEBUG
-              logg_err("unknown: %s", token);
-#endif
-              break;
-            }
-
-          sub_str = token;
-
-          for (k = 0; k <= dhcp_lease_parser_map[i].value_column; k++, sub_str =
-              NULL)
-            {
-              name = strtok_r(sub_str, sub_del, &sub_token_save);
-            }
-          if (dhcp_lease_parser_map[i].value_type == ELEMENT_VALUE_TYPE_TIME)
-            {
-              struct tm tm;
-              time_t epoch_time;
-              strptime(sub_token_save, "%Y/%m/%d %H:%M:%S", &tm);
-              epoch_time = mktime(&tm);
-#ifdef DEBUG
-              logg(LOG_DEBUG, "%s: %ld",
-                  lease_element_type_2_str(dhcp_lease_parser_map[i].type), epoch_time);
-#endif
-              switch (dhcp_lease_parser_map[i].type)
-                {
-              case LEASE_ELEMENT_TYPE_TIME_STARTS:
-                lease_element->starts = epoch_time;
-                break;
-              case LEASE_ELEMENT_TYPE_TIME_ENDS:
-                lease_element->ends = epoch_time;
-                break;
-              case LEASE_ELEMENT_TYPE_TIME_TSTP:
-                lease_element->tstp = epoch_time;
-                break;
-              case LEASE_ELEMENT_TYPE_TIME_CLTT:
-                lease_element->cltt = epoch_time;
-                break;
-              case LEASE_ELEMENT_TYPE_TIME_TSFP:
-                lease_element->tsfp = epoch_time;
-                break;
-              case LEASE_ELEMENT_TYPE_TIME_ATSFP:
-                lease_element->atsfp = epoch_time;
-                break;
-              default:
-                logg_err("unknown time element type");
-                break;
-                }
-            }
-          else
-            {
-
-              switch (dhcp_lease_parser_map[i].type)
-                {
-              case LEASE_ELEMENT_TYPE_BINDING_STATE:
-                lease_element->binding_state = strdup(name);
-                break;
-              case LEASE_ELEMENT_TYPE_HARDWARE:
-                lease_element->hardware = strdup(name);
-                break;
-              case LEASE_ELEMENT_TYPE_NEXT_BINDING_STATE:
-                lease_element->next_binding_state = strdup(name);
-                break;
-              case LEASE_ELEMENT_TYPE_REWIND_BINDING_STATE:
-                lease_element->rewind_binding_state = strdup(name);
-                break;
-              case LEASE_ELEMENT_TYPE_CLIENT_HOSTNAME:
-                lease_element->client_hostname = strdup(name);
-                break;
-              default:
-                logg_err("unknown element type");
-                break;
-                }
-#ifdef DEBUG
-             logg(LOG_DEBUG, "%s: %s", lease_element_type_2_str(dhcp_lease_parser_map[i].type), name);
-#endif
-            }
-        }
+      case 'm':
+        if (strcmp(optarg, "mmap") == 0)
+          mode = LEASE_PARSER_READ_MODE_MMAP;
+        else if (strcmp(optarg, "stream") == 0)
+          mode = LEASE_PARSER_READ_MODE_STREAM;
+        else
+          {
+            usage(args[0]);
+            return -1;
+          }
         break;
-
-      default:
-        logg_err("unknown state");
-        goto error_end_free_dllist;
+      case 't':
+        threads = strtoul(optarg, NULL, 10);
+        break;
+      case 'L':
+        lock_mode = toolbox_lock_mode_parse(optarg);
+        if (lock_mode < 0)
+          {
+            usage(args[0]);
+            return -1;
+          }
+        toolbox_set_lock_mode(lock_mode);
+        show_lock_stats = 1;
+        break;
+      case 's':
+        snapshot = 1;
+        break;
+      case 'c':
+        snapshot = 1;
+        cache_dir = optarg;
+        break;
+      case 'i':
+        interval = strtoul(optarg, NULL, 10);
+        break;
+      case 'D':
+        old_path = optarg;
+        break;
+      case 'C':
+        changes = 1;
+        break;
+      case 'Q':
+        socket_path = optarg;
+        break;
+      case 'w':
+        watch_mode = 1;
+        break;
+      case 'd':
+        debounce_ms = strtoul(optarg, NULL, 10);
+        break;
+      case 'q':
+        lease_query_free(query);
+        query = lease_query_compile(optarg);
+        if (!query)
+          return -1;
+        break;
+      case 'p':
+        if (lease_projection_parse(&projection, optarg) < 0)
+          return -1;
+        break;
+      case 'o':
+        format = lease_writer_format_parse(optarg);
+        if (format < 0)
+          {
+            usage(args[0]);
+            return -1;
+          }
+        output_format = format;
+        break;
+      case 'E':
+        if (parse_expiry_windows(optarg) < 0)
+          {
+            usage(args[0]);
+            return -1;
+          }
+        break;
+      case 'S':
+        if (parse_usage_prefix(optarg) < 0)
+          {
+            usage(args[0]);
+            return -1;
+          }
+        break;
+      case 'P':
+        lease_pools_release(&pools);
+        if (lease_pools_load(&pools, optarg) < 0)
+          return -1;
+        break;
+      case 'M':
+        if (setup_metrics(optarg) < 0)
+          return -1;
         break;
+      case 'l':
+        if (parse_log_option(optarg) < 0)
+          {
+            usage(args[0]);
+            return -1;
+          }
+        break;
+      case 'h':
+        usage(args[0]);
+        return 0;
+      default:
+        usage(args[0]);
+        return -1;
         }
     }
 
-  free(lease_file_content);
-  return ret_list;
+  if (optind < argn)
+    file_path = args[optind];
 
-  error_end_free_dllist:
-  destroy_lease_list(ret_list);
-  error_end_free_lease_file:
-  free(lease_file_content);
-  return NULL;
-}
-#define LEASE_FILE "/var/lib/dhcp/dhcpd.leases"
+  if (argn - optind > 1
+      && (watch_mode || interval || snapshot || old_path || socket_path))
+    {
+      logg_err("-w, -i, -s, -D and -Q take a single lease file");
+      return -1;
+    }
 
-int
-main(int argn, char *args[])
-{
-  struct dllist *lease_file;
-  struct lease_element_t *lease_element;
+  if (changes && !interval)
+    {
+      logg_err("-C needs -i");
+      return -1;
+    }
+
+  if (log_open("lease_parser", log_target) < 0)
+    return -1;
+
+  if ((query || format >= 0 || old_path || changes || socket_path)
+      && !projection.count)
+    lease_projection_parse(&projection, LEASE_PROJECTION_DEFAULT);
+
+  if (watch_mode)
+    return watch_leases(file_path, mode, debounce_ms);
+
+  if (socket_path)
+    return serve_leases(file_path, mode, socket_path, interval);
 
-  lease_file = lease_parser_reade_file(LEASE_FILE);
+  if (old_path)
+    return diff_leases(old_path, file_path, mode);
+
+  if (interval)
+    return follow_leases(file_path, mode, interval, changes);
+
+  if (snapshot && strcmp(file_path, "-"))
+    return snapshot_leases(file_path, mode, cache_dir);
+
+  if (argn - optind > 1)
+    lease_file = merge_leases(args + optind, argn - optind, mode);
+  else if (threads != 1 && mode == LEASE_PARSER_READ_MODE_MMAP)
+    lease_file = lease_parser_reade_file_parallel(file_path, threads);
+  else
+    lease_file = lease_parser_reade_file_filter(file_path, mode,
+        query ? lease_query_match_ip : NULL, query);
 
   if(!lease_file)
     {
@@ -465,15 +759,16 @@ main(int argn, char *args[])
       return -1;
     }
 
-  dllist_for_each(lease_element, lease_file, link)
-  {
-    logg(LOG_DEBUG, "ip: %s", lease_element->ip);
-    logg(LOG_DEBUG, "mac: %s", lease_element->hardware);
-    logg(LOG_DEBUG, "state: %s", lease_element->binding_state);
-    logg(LOG_DEBUG, "client host: %s", lease_element->client_hostname);
-    logg(LOG_DEBUG, "");
-  }
-  destroy_lease_list(lease_file);
+  dump_leases(lease_file);
+  dump_expiring(lease_file);
+  dump_usage(lease_file);
+  dump_lock_stats();
+  lease_table_destroy(lease_file);
+  dump_metrics();
+  lease_metrics_serve_stop();
+  lease_query_free(query);
+  lease_pools_release(&pools);
+  log_close();
 
   return 0;
 }
@@ -0,0 +1,111 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "lease_metrics.h"
+#include "string_pool.h"
+
+#define STRING_POOL_INITIAL_SIZE        1024
+
+static uint32_t
+string_pool_hash(const char *str, size_t len)
+{
+  uint32_t h = 2166136261u;
+  size_t i;
+
+  for (i = 0; i < len; i++)
+    {
+      h ^= (unsigned char) str[i];
+      h *= 16777619u;
+    }
+
+  return h;
+}
+
+static int
+string_pool_resize(struct string_pool_t *pool, size_t size)
+{
+  const char **slots;
+  uint32_t *hashes;
+  size_t i;
+
+  slots = calloc(size, sizeof(*slots));
+  hashes = calloc(size, sizeof(*hashes));
+  if (!slots || !hashes)
+    {
+      free(slots);
+      free(hashes);
+      return -1;
+    }
+  lease_metrics_add(LEASE_METRIC_ALLOCATIONS, 2);
+
+  for (i = 0; i < pool->size; i++)
+    {
+      size_t j;
+
+      if (!pool->slots[i])
+        continue;
+
+      for (j = pool->hashes[i] & (size - 1); slots[j]; j = (j + 1) & (size - 1))
+        ;
+      slots[j] = pool->slots[i];
+      hashes[j] = pool->hashes[i];
+    }
+
+  free(pool->slots);
+  free(pool->hashes);
+  pool->slots = slots;
+  pool->hashes = hashes;
+  pool->size = size;
+
+  return 0;
+}
+
+int
+string_pool_init(struct string_pool_t *pool, struct arena_t *arena)
+{
+  memset(pool, 0, sizeof(*pool));
+  pool->arena = arena;
+
+  return string_pool_resize(pool, STRING_POOL_INITIAL_SIZE);
+}
+
+const char *
+string_pool_intern(struct string_pool_t *pool, const char *str, size_t len)
+{
+  uint32_t h = string_pool_hash(str, len);
+  size_t i;
+  char *dup;
+
+  // keep the load factor below 1/2
+  if ((pool->count + 1) * 2 > pool->size
+      && string_pool_resize(pool, pool->size * 2) < 0)
+    return NULL;
+
+  for (i = h & (pool->size - 1); pool->slots[i]; i = (i + 1) & (pool->size - 1))
+    {
+      if (pool->hashes[i] == h && !strncmp(pool->slots[i], str, len)
+          && pool->slots[i][len] == '\0')
+        return pool->slots[i];
+    }
+
+  dup = arena_strndup(pool->arena, str, len);
+  if (!dup)
+    return NULL;
+
+  pool->slots[i] = dup;
+  pool->hashes[i] = h;
+  pool->count++;
+
+  return dup;
+}
+
+void
+string_pool_release(struct string_pool_t *pool)
+{
+  free(pool->slots);
+  free(pool->hashes);
+  pool->slots = NULL;
+  pool->hashes = NULL;
+  pool->size = 0;
+  pool->count = 0;
+}
@@ -0,0 +1,38 @@
+/*
+ * string_pool.h
+ *
+ */
+
+#ifndef _STRING_POOL_H_
+#define _STRING_POOL_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "arena.h"
+
+/**
+ *
+ * \brief interned strings
+ *
+ * Equal strings are stored once in the arena and returned as the same
+ * pointer, so repeated host names or vendor classes cost one copy and
+ * can be compared by pointer. The pool itself is an open addressing
+ * hash set; the strings live as long as the arena.
+ */
+
+struct string_pool_t
+{
+  struct arena_t *arena;
+  const char **slots;
+  uint32_t *hashes;
+  size_t size;
+  size_t count;
+};
+
+int string_pool_init(struct string_pool_t *pool, struct arena_t *arena);
+const char *string_pool_intern(struct string_pool_t *pool, const char *str,
+    size_t len);
+void string_pool_release(struct string_pool_t *pool);
+
+#endif /* _STRING_POOL_H_ */
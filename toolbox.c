@@ -0,0 +1,285 @@
+#define _GNU_SOURCE
+
+#include <string.h>
+#include <time.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/sendfile.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+
+#include "toolbox.h"
+#include "log.h"
+
+#define ARRAYSIZE(n) (sizeof(n)/sizeof(n[0]))
+
+static const char *toolbox_lock_mode_names[] =
+    {
+        [TOOLBOX_LOCK_EXCLUSIVE] = "exclusive",
+        [TOOLBOX_LOCK_SHARED] = "shared",
+        [TOOLBOX_LOCK_NONE] = "none",
+        [TOOLBOX_LOCK_COPY] = "copy",
+    };
+
+static enum toolbox_lock_mode_t toolbox_lock_mode_current = TOOLBOX_LOCK_EXCLUSIVE;
+static struct toolbox_lock_stats_t toolbox_lock_counters;
+
+int
+toolbox_lock_mode_parse(const char *name)
+{
+  int i;
+
+  for (i = 0; i < ARRAYSIZE(toolbox_lock_mode_names); i++)
+    {
+      if (!strcmp(name, toolbox_lock_mode_names[i]))
+        return i;
+    }
+
+  return -1;
+}
+
+const char *
+toolbox_lock_mode_2_str(enum toolbox_lock_mode_t mode)
+{
+  if (mode >= ARRAYSIZE(toolbox_lock_mode_names))
+    return NULL;
+
+  return toolbox_lock_mode_names[mode];
+}
+
+void
+toolbox_set_lock_mode(enum toolbox_lock_mode_t mode)
+{
+  toolbox_lock_mode_current = mode;
+}
+
+enum toolbox_lock_mode_t
+toolbox_lock_mode(int attempt)
+{
+  if (toolbox_lock_mode_current == TOOLBOX_LOCK_NONE
+      && attempt >= TOOLBOX_LOCK_RETRIES)
+    return TOOLBOX_LOCK_SHARED;
+
+  return toolbox_lock_mode_current;
+}
+
+void
+toolbox_lock_stats(struct toolbox_lock_stats_t *stats)
+{
+  stats->acquired = __atomic_load_n(&toolbox_lock_counters.acquired,
+      __ATOMIC_RELAXED);
+  stats->wait_ns = __atomic_load_n(&toolbox_lock_counters.wait_ns,
+      __ATOMIC_RELAXED);
+  stats->max_wait_ns = __atomic_load_n(&toolbox_lock_counters.max_wait_ns,
+      __ATOMIC_RELAXED);
+  stats->retries = __atomic_load_n(&toolbox_lock_counters.retries,
+      __ATOMIC_RELAXED);
+  stats->copied_bytes = __atomic_load_n(&toolbox_lock_counters.copied_bytes,
+      __ATOMIC_RELAXED);
+}
+
+static uint64_t
+toolbox_now_ns(void)
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+// flock() that accounts the time spent waiting for the lock
+static int
+toolbox_flock(int fd, int operation)
+{
+  uint64_t start, wait, max;
+
+  start = toolbox_now_ns();
+  while (flock(fd, operation) < 0)
+    {
+      if (errno != EINTR)
+        {
+          logg_err("flock failed (%s)", strerror(errno));
+          return -1;
+        }
+    }
+  wait = toolbox_now_ns() - start;
+
+  __atomic_add_fetch(&toolbox_lock_counters.acquired, 1, __ATOMIC_RELAXED);
+  __atomic_add_fetch(&toolbox_lock_counters.wait_ns, wait, __ATOMIC_RELAXED);
+  max = __atomic_load_n(&toolbox_lock_counters.max_wait_ns, __ATOMIC_RELAXED);
+  while (wait > max && !__atomic_compare_exchange_n(
+      &toolbox_lock_counters.max_wait_ns, &max, wait, 0, __ATOMIC_RELAXED,
+      __ATOMIC_RELAXED))
+    ;
+
+  return 0;
+}
+
+int
+toolbox_open_locked(struct toolbox_file_t *file, const char *filename,
+    enum toolbox_lock_mode_t mode)
+{
+  if (!filename || !file)
+    return -1;
+
+  file->mode = mode;
+  file->locked = 0;
+
+  file->fd = open(filename, O_RDONLY | O_CLOEXEC);
+  if (file->fd < 0)
+    {
+      logg_err("Cannot open %s for read.", filename);
+      return -1;
+    }
+
+  if (mode != TOOLBOX_LOCK_NONE)
+    {
+      if (toolbox_flock(file->fd,
+          mode == TOOLBOX_LOCK_EXCLUSIVE ? LOCK_EX : LOCK_SH) < 0)
+        goto on_error;
+      file->locked = 1;
+    }
+
+  if (fstat(file->fd, &file->st) < 0)
+    {
+      logg_err("fstat failed (%s)", strerror(errno));
+      goto on_error;
+    }
+
+  return 0;
+
+  on_error:
+  if (file->locked)
+    flock(file->fd, LOCK_UN);
+  close(file->fd);
+  file->fd = -1;
+  return -1;
+}
+
+/*
+ * the copy keeps the file offsets of the original, the part in front of
+ * from is a hole. sendfile() moves the data between the page caches
+ * without a round trip through user space.
+ */
+int
+toolbox_copy_locked(struct toolbox_file_t *file, off_t from)
+{
+  off_t offset = from;
+  ssize_t n;
+  int copy;
+
+  if (file->mode != TOOLBOX_LOCK_COPY || !file->locked)
+    return 0;
+
+  copy = memfd_create("lease-copy", MFD_CLOEXEC);
+  if (copy < 0)
+    {
+      logg_err("memfd_create failed (%s)", strerror(errno));
+      return -1;
+    }
+
+  if (lseek(copy, from, SEEK_SET) < 0)
+    goto on_error;
+
+  while (offset < file->st.st_size)
+    {
+      n = sendfile(copy, file->fd, &offset, file->st.st_size - offset);
+      if (n < 0 && errno == EINTR)
+        continue;
+      if (n < 0)
+        goto on_error;
+      // the file was truncated behind our back
+      if (n == 0)
+        break;
+    }
+
+  __atomic_add_fetch(&toolbox_lock_counters.copied_bytes, offset - from,
+      __ATOMIC_RELAXED);
+
+  flock(file->fd, LOCK_UN);
+  close(file->fd);
+  file->fd = copy;
+  file->locked = 0;
+  file->st.st_size = offset;
+
+  return 0;
+
+  on_error:
+  logg_err("copy failed (%s)", strerror(errno));
+  close(copy);
+  return -1;
+}
+
+int
+toolbox_close_locked(struct toolbox_file_t *file)
+{
+  struct stat st;
+  int ret = 0;
+
+  if (file->fd < 0)
+    return 0;
+
+  /*
+   * dhcpd only appends to the file or renames a new one into place, both
+   * leave what was read intact. A shorter file or a change without
+   * growth means it was modified in place.
+   */
+  if (file->mode == TOOLBOX_LOCK_NONE)
+    {
+      if (fstat(file->fd, &st) < 0 || st.st_size < file->st.st_size
+          || (st.st_size == file->st.st_size
+              && (st.st_mtim.tv_sec != file->st.st_mtim.tv_sec
+                  || st.st_mtim.tv_nsec != file->st.st_mtim.tv_nsec)))
+        {
+          __atomic_add_fetch(&toolbox_lock_counters.retries, 1,
+              __ATOMIC_RELAXED);
+          ret = -1;
+        }
+    }
+
+  if (file->locked)
+    flock(file->fd, LOCK_UN);
+  close(file->fd);
+  file->fd = -1;
+
+  return ret;
+}
+
+const char *
+toolbox_map_range(int fd, off_t offset, size_t length, void **map_base,
+    size_t *map_len)
+{
+  static const char empty[1];
+  off_t page_offset;
+  void *map;
+
+  *map_base = NULL;
+  *map_len = 0;
+
+  if (!length)
+    return empty;
+
+  page_offset = offset & ~((off_t) sysconf(_SC_PAGESIZE) - 1);
+
+  map = mmap(NULL, length + (offset - page_offset), PROT_READ, MAP_PRIVATE, fd,
+      page_offset);
+  if (map == MAP_FAILED)
+    {
+      logg_err("mmap failed (%s)", strerror(errno));
+      return NULL;
+    }
+
+  *map_base = map;
+  *map_len = length + (offset - page_offset);
+  madvise(map, *map_len, MADV_SEQUENTIAL);
+
+  return (const char *) map + (offset - page_offset);
+}
+
+void
+toolbox_unmap(void *map_base, size_t map_len)
+{
+  if (map_base)
+    munmap(map_base, map_len);
+}
@@ -0,0 +1,83 @@
+/*
+ * toolbox.h
+ *
+ */
+
+#ifndef _TOOLBOX_H_
+#define _TOOLBOX_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+
+/*
+ * how readers of the lease file keep out of each other's way. dhcpd does
+ * not flock the file at all, so the lock only orders our own readers:
+ *
+ * EXCLUSIVE    LOCK_EX for the whole read (the historic behaviour)
+ * SHARED       LOCK_SH for the whole read, readers run concurrently
+ * NONE         no lock; the read is validated by comparing fstat()
+ *              before and after and retried if the file was changed
+ *              other than by appending
+ * COPY         LOCK_SH only while the range to read is copied to a
+ *              memfd in the kernel, the parse runs on the copy
+ */
+enum toolbox_lock_mode_t
+{
+  TOOLBOX_LOCK_EXCLUSIVE,
+  TOOLBOX_LOCK_SHARED,
+  TOOLBOX_LOCK_NONE,
+  TOOLBOX_LOCK_COPY,
+};
+
+// lockless attempts before falling back to a shared lock
+#define TOOLBOX_LOCK_RETRIES            3
+
+struct toolbox_lock_stats_t
+{
+  uint64_t acquired;
+  uint64_t wait_ns;
+  uint64_t max_wait_ns;
+  uint64_t retries;
+  uint64_t copied_bytes;
+};
+
+struct toolbox_file_t
+{
+  int fd;
+  int locked;
+  enum toolbox_lock_mode_t mode;
+  struct stat st;
+};
+
+int toolbox_lock_mode_parse(const char *name);
+const char *toolbox_lock_mode_2_str(enum toolbox_lock_mode_t mode);
+void toolbox_set_lock_mode(enum toolbox_lock_mode_t mode);
+// lock mode for the n-th attempt of a read
+enum toolbox_lock_mode_t toolbox_lock_mode(int attempt);
+void toolbox_lock_stats(struct toolbox_lock_stats_t *stats);
+
+/*
+ * open a file read-only and lock it as mode says; file->st receives the
+ * fstat() of the opened file. Read from file->fd, which is only valid
+ * for [from, file->st.st_size) after toolbox_copy_locked(). Returns 0
+ * or -1.
+ */
+int toolbox_open_locked(struct toolbox_file_t *file, const char *filename,
+    enum toolbox_lock_mode_t mode);
+// COPY: copy [from, st_size) and drop the lock, a no-op for other modes
+int toolbox_copy_locked(struct toolbox_file_t *file, off_t from);
+// -1 if the file changed during a lockless read, the caller retries
+int toolbox_close_locked(struct toolbox_file_t *file);
+
+/*
+ * map [offset, offset + length) of fd read-only. The returned pointer
+ * addresses offset; map_base/map_len describe the page aligned mapping
+ * to pass to toolbox_unmap(). length 0 returns an empty, unmapped range.
+ */
+const char *toolbox_map_range(int fd, off_t offset, size_t length,
+    void **map_base, size_t *map_len);
+void toolbox_unmap(void *map_base, size_t map_len);
+
+#endif /* _TOOLBOX_H_ */